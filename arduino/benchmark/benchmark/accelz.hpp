@@ -0,0 +1 @@
+../../../include/extras/accelz.hpp
\ No newline at end of file
@@ -0,0 +1,409 @@
+/*
+   benchmark.hpp : micro-benchmarks for the control chain, for the Arduino sketch and the host build alike
+
+   Each stage runs SAMPLES times on synthetic inputs that change every call (so that RC's cache of the
+   last sticks never hits), timed one call at a time by the platform's counter: DWT cycles on the
+   Teensy and Ladybug, nanoseconds on the host.  The cost of reading the counter is measured first and
+   taken off every sample.  Results come out as CSV, one line per stage after a '#' comment line
+   saying what was measured, so that runs can be compared by compare.py.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+
+#include "board.hpp"
+#include "config.hpp"
+#include "mixer.hpp"
+#include "msp.hpp"
+#include "profiler.hpp"
+#include "rc.hpp"
+#include "stabilize.hpp"
+#include "accelz.hpp"
+#include "mahony.hpp"
+#include "quaternion.hpp"
+
+namespace hf {
+
+// Stands in for the flight controller: no hardware, so that only the control code is timed.  MSP
+// reads come from a buffer filled before each call, and replies are thrown away.
+class BenchBoard : public Board {
+
+    public:
+
+        const uint8_t * rxBuf;
+        uint8_t         rxLen;
+        uint8_t         rxPos;
+
+        BenchBoard(void)
+        {
+            rxBuf = NULL;
+            rxLen = 0;
+            rxPos = 0;
+
+            // Typical gains, for realistic arithmetic
+            config.pid.levelP         = 0.20f;
+            config.pid.ratePitchrollP = 0.225f;
+            config.pid.ratePitchrollI = 0.12f;
+            config.pid.ratePitchrollD = 0.375f;
+            config.pid.yawP           = 1.0625f;
+            config.pid.yawI           = 0.36f;
+        }
+
+        virtual void     init(void) override { }
+        virtual const    Config& getConfig(void) override { return config; }
+        virtual void     delayMilliseconds(uint32_t msec) override { (void)msec; }
+        virtual void     dump(char * msg) override { (void)msg; }
+        virtual uint64_t getMicros(void) override { return 0; }
+
+        virtual void     imuGetEulerAndGyro(float eulerAnglesRadians[3], int16_t gyroRaw[3]) override
+        {
+            (void)eulerAnglesRadians;
+            (void)gyroRaw;
+        }
+
+        virtual uint16_t rcReadSerial(uint8_t chan) override { (void)chan; return 0; }
+        virtual bool     rcUseSerial(void) override { return false; }
+        virtual uint16_t rcReadPwm(uint8_t chan) override { (void)chan; return 1500; }
+
+        virtual uint8_t  serialAvailableBytes(void) override { return rxLen - rxPos; }
+        virtual uint8_t  serialReadByte(void) override { return rxBuf[rxPos++]; }
+        virtual void     serialWriteByte(uint8_t c) override { (void)c; }
+        virtual void     serialWriteBytes(const uint8_t * buf, uint16_t count) override { (void)buf; (void)count; }
+
+        virtual void     writeMotor(uint8_t index, uint16_t value) override { (void)index; (void)value; }
+        virtual void     writeMotors(const uint16_t * values, uint8_t count) override { (void)values; (void)count; }
+};
+
+class Benchmark {
+
+    public:
+
+        static const uint16_t SAMPLES = 1000;
+
+        // Returns the platform's counter; wraps are fine, so long as one call takes less than a wrap
+        typedef uint32_t (*ticks_t)(void);
+
+        // Prints one line of results, without the newline
+        typedef void (*print_t)(const char * line);
+
+        void init(ticks_t _ticks, print_t _print, const char * _platform, const char * _unit);
+
+        // Runs every stage, printing a comment line, a CSV header, then one line per stage
+        void run(void);
+
+    private:
+
+        ticks_t      ticks;
+        print_t      print;
+        const char * platform;
+        const char * unit;
+
+        BenchBoard   board;
+        RC           rc;
+        Stabilize    stab;
+        VehicleMixer mixer;
+        MSP          msp;
+        Profiler     profiler;
+        AccelZ       accelZ;
+        Mahony<float>   mahonyFloat;
+        Mahony<int32_t> mahonyFixed;
+
+        uint32_t     samples[SAMPLES];
+        uint32_t     overhead;
+        uint32_t     random;
+
+        // Inputs built before each call, outside the timed region
+        int16_t      gyro[3];
+        float        eulerAngles[3];
+        float        vector[3];
+        float        delta[3];
+        int16_t      accelRaw[3];
+        uint32_t     accelTime;
+        float        quaternion[4];
+        uint8_t      message[64];
+
+        uint32_t nextRandom(void);
+        int16_t  randomPwm(void);
+        float    randomFloat(float range);
+        uint8_t  buildMessages(void);
+        uint32_t measureOverhead(void);
+        void     report(const char * stage);
+
+        static void sort(uint32_t * values, uint16_t count);
+};
+
+
+/********************************************* CPP ********************************************************/
+
+void Benchmark::init(ticks_t _ticks, print_t _print, const char * _platform, const char * _unit)
+{
+    ticks    = _ticks;
+    print    = _print;
+    platform = _platform;
+    unit     = _unit;
+
+    const Config & config = board.getConfig();
+
+    rc.init(config.rc, config.pwm, config.loop, &board);
+    stab.init(config.pid, config.imu, config.rate, config.loop, &board);
+    mixer.init(config.pwm, config.thrust, &rc, &stab);
+    profiler.init();
+    msp.init(&mixer, &rc, &profiler, &board, config.loop.mspMaxBytes);
+    accelZ.init(config.imu);
+    accelTime = 0;
+
+    // As on the 8 kHz gyro path, corrected at 1 kHz, with some integral gain so none of it is skipped
+    ImuConfig imuConfig = config.imu;
+    imuConfig.mahonyKi = 0.01f;
+    mahonyFloat.init(imuConfig, 125, 1000);
+    mahonyFixed.init(imuConfig, 125, 1000);
+
+    random = 1;
+}
+
+uint32_t Benchmark::nextRandom(void)
+{
+    // xorshift32: the same inputs on every platform and every run
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    return random;
+}
+
+int16_t Benchmark::randomPwm(void)
+{
+    return (int16_t)(1000 + nextRandom() % 1001);
+}
+
+float Benchmark::randomFloat(float range)
+{
+    return range * ((nextRandom() & 0xFFFF) / 32768.0f - 1);
+}
+
+// One SET_RAW_RC with new sticks, then requests for ATTITUDE and RC, as a ground station would send them
+uint8_t Benchmark::buildMessages(void)
+{
+    uint8_t len = 0;
+
+    const uint8_t commands[3] = {MSP_SET_RAW_RC, MSP_ATTITUDE, MSP_RC};
+
+    for (uint8_t k=0; k<3; ++k) {
+
+        uint8_t size = commands[k] == MSP_SET_RAW_RC ? 16 : 0;
+
+        message[len++] = '$';
+        message[len++] = 'M';
+        message[len++] = '<';
+        message[len++] = size;
+        message[len++] = commands[k];
+
+        uint8_t checksum = size ^ commands[k];
+
+        for (uint8_t i=0; i<size/2; ++i) {
+            int16_t pwm = randomPwm();
+            message[len++] = pwm & 0xFF;
+            message[len++] = pwm >> 8;
+            checksum ^= message[len-2] ^ message[len-1];
+        }
+
+        message[len++] = checksum;
+    }
+
+    return len;
+}
+
+uint32_t Benchmark::measureOverhead(void)
+{
+    for (uint16_t k=0; k<SAMPLES; ++k) {
+        uint32_t start = ticks();
+        samples[k] = ticks() - start;
+    }
+
+    sort(samples, SAMPLES);
+
+    return samples[0];
+}
+
+void Benchmark::sort(uint32_t * values, uint16_t count)
+{
+    // Insertion sort: no library needed, and fast enough for a thousand samples
+    for (uint16_t i=1; i<count; ++i) {
+        uint32_t v = values[i];
+        uint16_t j = i;
+        for (; j>0 && values[j-1] > v; --j) {
+            values[j] = values[j-1];
+        }
+        values[j] = v;
+    }
+}
+
+void Benchmark::report(const char * stage)
+{
+    for (uint16_t k=0; k<SAMPLES; ++k) {
+        samples[k] = samples[k] > overhead ? samples[k] - overhead : 0;
+    }
+
+    sort(samples, SAMPLES);
+
+    char line[100];
+    snprintf(line, sizeof(line), "%s,%s,%u,%lu,%lu,%lu,%lu", stage, unit, SAMPLES,
+            (unsigned long)samples[0], (unsigned long)samples[SAMPLES/2],
+            (unsigned long)samples[SAMPLES*99/100], (unsigned long)samples[SAMPLES-1]);
+    print(line);
+}
+
+void Benchmark::run(void)
+{
+    random = 1;
+
+    overhead = measureOverhead();
+
+    char line[100];
+    snprintf(line, sizeof(line), "# hackflight benchmark: platform=%s unit=%s overhead=%lu",
+            platform, unit, (unsigned long)overhead);
+    print(line);
+    print("stage,unit,samples,min,median,p99,max");
+
+    // Stick expo, with new sticks every call
+    for (uint16_t k=0; k<SAMPLES; ++k) {
+        for (uint8_t c=0; c<4; ++c) {
+            rc.data[c] = randomPwm();
+        }
+        uint32_t start = ticks();
+        rc.computeExpo();
+        samples[k] = ticks() - start;
+    }
+    report("rc_computeExpo");
+
+    // PID, on the commands the last expo produced and a random attitude
+    for (uint16_t k=0; k<SAMPLES; ++k) {
+        for (uint8_t i=0; i<3; ++i) {
+            gyro[i] = (int16_t)randomFloat(2000);
+            eulerAngles[i] = randomFloat(i == AXIS_YAW ? 180 : 30);
+        }
+        uint32_t start = ticks();
+        stab.update(rc.command, gyro, eulerAngles);
+        samples[k] = ticks() - start;
+    }
+    report("stabilize_update");
+
+    // Mixing, armed and with the throttle up so that nothing is short-circuited
+    for (uint16_t k=0; k<SAMPLES; ++k) {
+        rc.data[DEMAND_THROTTLE] = 1500 + (int16_t)(nextRandom() % 400);
+        for (uint8_t i=0; i<3; ++i) {
+            stab.axisPID[i] = (int16_t)randomFloat(200);
+        }
+        uint32_t start = ticks();
+        mixer.update(true, &board);
+        samples[k] = ticks() - start;
+    }
+    report("mixer_update");
+
+    // A burst of ground-station traffic per call
+    for (uint16_t k=0; k<SAMPLES; ++k) {
+        board.rxLen = buildMessages();
+        board.rxPos = 0;
+        board.rxBuf = message;
+        for (uint8_t i=0; i<3; ++i) {
+            eulerAngles[i] = randomFloat(180);
+        }
+        uint32_t start = ticks();
+        msp.update(eulerAngles, false);
+        samples[k] = ticks() - start;
+    }
+    report("msp_update");
+
+    // Vertical accel from the tick's gravity vector, for altitude estimation; one call in forty
+    // (at 1 kHz) also integrates velocity and altitude
+    for (uint16_t k=0; k<SAMPLES; ++k) {
+        for (uint8_t i=0; i<3; ++i) {
+            accelRaw[i] = (int16_t)randomFloat(4096);
+            delta[i] = randomFloat(3.14159f);
+        }
+        Quaternion::gravityFromEuler(delta, vector);
+        accelTime += 1000;
+        uint32_t start = ticks();
+        accelZ.update(accelRaw, vector, accelTime, true);
+        samples[k] = ticks() - start;
+    }
+    report("accelz_update");
+
+    // Euler angles from a random attitude, as for MSP on boards that give a quaternion
+    for (uint16_t k=0; k<SAMPLES; ++k) {
+        float norm = 0;
+        for (uint8_t i=0; i<4; ++i) {
+            quaternion[i] = randomFloat(1);
+            norm += quaternion[i] * quaternion[i];
+        }
+        norm = sqrtf(norm);
+        for (uint8_t i=0; i<4; ++i) {
+            quaternion[i] /= norm;
+        }
+        uint32_t start = ticks();
+        Quaternion::toEuler(quaternion, eulerAngles);
+        samples[k] = ticks() - start;
+    }
+    report("quaternion_toEuler");
+
+    // Attitude estimation for boards without fusion: a gyro sample, then an accelerometer correction
+    // near one G, in float and in Q2.29
+    for (uint16_t k=0; k<SAMPLES; ++k) {
+        for (uint8_t i=0; i<3; ++i) {
+            gyro[i] = (int16_t)randomFloat(2000);
+        }
+        uint32_t start = ticks();
+        mahonyFloat.update(gyro);
+        samples[k] = ticks() - start;
+    }
+    report("mahony_update_float");
+
+    for (uint16_t k=0; k<SAMPLES; ++k) {
+        for (uint8_t i=0; i<3; ++i) {
+            gyro[i] = (int16_t)randomFloat(2000);
+        }
+        uint32_t start = ticks();
+        mahonyFixed.update(gyro);
+        samples[k] = ticks() - start;
+    }
+    report("mahony_update_fixed");
+
+    for (uint16_t k=0; k<SAMPLES; ++k) {
+        for (uint8_t i=0; i<3; ++i) {
+            accelRaw[i] = (int16_t)randomFloat(i == 2 ? 4096 : 400);
+        }
+        accelRaw[2] = 4096 + accelRaw[2] / 16;
+        uint32_t start = ticks();
+        mahonyFloat.correct(accelRaw);
+        samples[k] = ticks() - start;
+    }
+    report("mahony_correct_float");
+
+    for (uint16_t k=0; k<SAMPLES; ++k) {
+        for (uint8_t i=0; i<3; ++i) {
+            accelRaw[i] = (int16_t)randomFloat(i == 2 ? 4096 : 400);
+        }
+        accelRaw[2] = 4096 + accelRaw[2] / 16;
+        uint32_t start = ticks();
+        mahonyFixed.correct(accelRaw);
+        samples[k] = ticks() - start;
+    }
+    report("mahony_correct_fixed");
+}
+
+} // namespace
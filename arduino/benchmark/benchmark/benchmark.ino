@@ -0,0 +1,71 @@
+/*
+   benchmark.ino : control-chain micro-benchmarks, timed by the Cortex-M4 DWT cycle counter
+
+   Runs on the Teensy 3.2 and the Ladybug (STM32L4) alike.  Open the serial monitor: the results
+   are printed as CSV after startup and every ten seconds after that.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+
+#include "benchmark.hpp"
+
+// ARMv7-M debug registers, at the same addresses on every Cortex-M3/M4/M7
+static volatile uint32_t * const DEMCR      = (volatile uint32_t *)0xE000EDFC;
+static volatile uint32_t * const DWT_CTRL   = (volatile uint32_t *)0xE0001000;
+static volatile uint32_t * const DWT_CYCCNT = (volatile uint32_t *)0xE0001004;
+
+static const uint32_t DEMCR_TRCENA       = 1 << 24;
+static const uint32_t DWT_CTRL_CYCCNTENA = 1 << 0;
+
+static uint32_t cycles(void)
+{
+    return *DWT_CYCCNT;
+}
+
+static void printLine(const char * line)
+{
+    Serial.println(line);
+}
+
+static hf::Benchmark benchmark;
+
+static char platform[40];
+
+void setup(void)
+{
+    Serial.begin(115200);
+
+    // Start the cycle counter
+    *DEMCR |= DEMCR_TRCENA;
+    *DWT_CYCCNT = 0;
+    *DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+
+    snprintf(platform, sizeof(platform), "arm-%luMHz", (unsigned long)(F_CPU / 1000000));
+
+    benchmark.init(cycles, printLine, platform, "cycles");
+
+    // Give the serial monitor time to connect
+    delay(2000);
+}
+
+void loop(void)
+{
+    benchmark.run();
+    Serial.println();
+
+    delay(10000);
+}
@@ -0,0 +1 @@
+../../../include/board.hpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../../include/config.hpp
\ No newline at end of file
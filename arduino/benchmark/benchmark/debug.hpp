@@ -0,0 +1 @@
+../../../include/debug.hpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../../include/fastmath.hpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../../include/mixer.hpp
\ No newline at end of file
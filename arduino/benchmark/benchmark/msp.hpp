@@ -0,0 +1 @@
+../../../include/msp.hpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../../include/quaternion.hpp
\ No newline at end of file
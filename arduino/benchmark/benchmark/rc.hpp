@@ -0,0 +1 @@
+../../../include/rc.hpp
\ No newline at end of file
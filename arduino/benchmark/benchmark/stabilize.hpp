@@ -0,0 +1 @@
+../../../include/stabilize.hpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../../include/timedtask.hpp
\ No newline at end of file
@@ -0,0 +1,86 @@
+#!/usr/bin/python3
+
+'''
+compare.py Compares two runs of the control-chain benchmarks (see benchmark/benchmark.hpp)
+
+Usage: compare.py BASELINE NEW [TOLERANCE]
+
+Prints each stage's median and p99 in both runs, and exits with status 1 if any stage's median
+has grown by more than TOLERANCE (default 0.10, i.e. ten percent).  Runs must be in the same unit;
+comparing a board's cycles with the host's nanoseconds means nothing.
+
+Copyright (C) Simon D. Levy 2017
+
+This program is part of Hackflight
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this code.  If not, see <http:#www.gnu.org/licenses/>.
+'''
+
+from sys import argv, exit
+
+def error(errmsg):
+    print(errmsg)
+    exit(1)
+
+def load(filename):
+    '''
+    Returns {stage: row} from the first run in the file, each row a dict keyed by the CSV header
+    '''
+    stages = {}
+    header = None
+    try:
+        lines = open(filename).read().splitlines()
+    except IOError:
+        error('Unable to open ' + filename)
+    for line in lines:
+        if line.startswith('#'):
+            if header:
+                break
+            continue
+        if not line:
+            continue
+        fields = line.split(',')
+        if header is None:
+            header = fields
+            continue
+        row = dict(zip(header, fields))
+        stages[row['stage']] = row
+    return stages
+
+if len(argv) < 3:
+    error('Usage: %s BASELINE NEW [TOLERANCE]' % argv[0])
+
+tolerance = float(argv[3]) if len(argv) > 3 else 0.10
+
+old = load(argv[1])
+new = load(argv[2])
+
+regressed = False
+
+print('%-20s %10s %10s %10s %10s' % ('stage', 'median', 'was', 'p99', 'was'))
+
+for stage in old:
+    if stage not in new:
+        print('%-20s missing' % stage)
+        continue
+    a, b = old[stage], new[stage]
+    if a['unit'] != b['unit']:
+        error('%s: %s against %s' % (stage, b['unit'], a['unit']))
+    flag = ''
+    if int(b['median']) > int(a['median']) * (1 + tolerance):
+        flag = '  SLOWER'
+        regressed = True
+    print('%-20s %10s %10s %10s %10s%s' % (stage, b['median'], a['median'], b['p99'], a['p99'], flag))
+
+exit(1 if regressed else 0)
@@ -0,0 +1,46 @@
+/*
+   host.cpp : control-chain micro-benchmarks on the development machine, timed by std::chrono
+
+   Usage: host [PLATFORM]    (default "host")
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+
+#include <chrono>
+
+#include "benchmark.hpp"
+
+static uint32_t nanoseconds(void)
+{
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void printLine(const char * line)
+{
+    printf("%s\n", line);
+}
+
+int main(int argc, char ** argv)
+{
+    static hf::Benchmark benchmark;
+
+    benchmark.init(nanoseconds, printLine, argc > 1 ? argv[1] : "host", "ns");
+    benchmark.run();
+
+    return 0;
+}
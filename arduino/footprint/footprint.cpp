@@ -0,0 +1,124 @@
+/*
+   footprint.cpp : the firmware as a sketch builds it, on a board that does nothing, for footprint.py
+
+   The Hackflight object keeps every subsystem as a member, so a board's ELF shows its RAM as one symbol.
+   Here each member type also gets an array of its own size, named footprint_ram_SUBSYSTEM__TYPE, and
+   footprint.py adds those up instead; code is measured from the functions the linker kept.  main() runs
+   init() and one update() so that nothing the firmware uses can be thrown away, then returns.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hackflight.hpp"
+
+class FootprintBoard : public hf::Board {
+
+    public:
+
+        virtual void     init(void) override { }
+        virtual const    hf::Config& getConfig() override { return config; }
+        virtual void     delayMilliseconds(uint32_t msec) override { (void)msec; }
+        virtual void     dump(char * msg) override { (void)msg; }
+        virtual uint64_t getMicros() override { return ++micros; }
+
+        virtual void     imuGetEulerAndGyro(float eulerAnglesRadians[3], int16_t gyroRaw[3]) override
+        {
+            memset(eulerAnglesRadians, 0, 3*sizeof(float));
+            memset(gyroRaw, 0, 3*sizeof(int16_t));
+        }
+
+        virtual uint16_t rcReadSerial(uint8_t chan) override { (void)chan; return 1500; }
+        virtual bool     rcUseSerial(void) override { return false; }
+        virtual uint16_t rcReadPwm(uint8_t chan) override { (void)chan; return 1500; }
+
+        virtual uint8_t  serialAvailableBytes(void) override { return 0; }
+        virtual uint8_t  serialReadByte(void) override { return 0; }
+        virtual void     serialWriteByte(uint8_t c) override { (void)c; }
+
+        virtual void     writeMotor(uint8_t index, uint16_t value) override { (void)index; (void)value; }
+
+    private:
+
+        uint64_t micros = 0;
+};
+
+#ifdef CONFIG_PID_FIXED_POINT
+typedef hf::Mahony<int32_t> FootprintEstimator;
+#else
+typedef hf::Mahony<float>   FootprintEstimator;
+#endif
+
+// The Hackflight object's members, by subsystem (see Hackflight's private section)
+#define FOOTPRINT_MEMBERS(X)                        \
+    X(rc,          RC,            hf::RC)           \
+    X(failsafe,    Failsafe,      hf::Failsafe)     \
+    X(navigation,  Navigator,     hf::Navigator)    \
+    X(navigation,  OpticalFlow,   hf::OpticalFlow)  \
+    X(mixer,       VehicleMixer,  hf::VehicleMixer) \
+    X(msp,         MSP,           hf::MSP)          \
+    X(stabilize,   Stabilize,     hf::Stabilize)    \
+    X(scheduler,   Profiler,      hf::Profiler)     \
+    X(blackbox,    Blackbox,      hf::Blackbox)     \
+    X(filters,     GyroFilter,    hf::GyroFilter)   \
+    X(filters,     GyroDecimator, hf::GyroDecimator)\
+    X(leds,        Leds,          hf::Leds)         \
+    X(calibration, Calibration,   hf::Calibration)  \
+    X(scheduler,   LoopRate,      hf::LoopRate)     \
+    X(attitude,    Mahony,        FootprintEstimator) \
+    X(settings,    ConfigStore,   hf::ConfigStore)  \
+    X(scheduler,   Scheduler,     hf::Scheduler)    \
+    FOOTPRINT_DUAL_CORE(X)
+
+// Dual-core builds add the rings between the cores, and the comms core's scheduler
+#ifdef CONFIG_DUAL_CORE
+#define FOOTPRINT_DUAL_CORE(X)                      \
+    X(corelink,    CoreLink,      hf::CoreLink)     \
+    X(scheduler,   CommsScheduler, hf::Scheduler)
+#else
+#define FOOTPRINT_DUAL_CORE(X)
+#endif
+
+#define FOOTPRINT_SIZE(subsystem, name, type) + sizeof(type)
+#define FOOTPRINT_ARRAY(subsystem, name, type) char footprint_ram_##subsystem##__##name[sizeof(type)];
+#define FOOTPRINT_TOUCH(subsystem, name, type) + footprint_ram_##subsystem##__##name[0]
+
+typedef hf::Hackflight<FootprintBoard> FootprintHackflight;
+
+extern "C" {
+
+FOOTPRINT_MEMBERS(FOOTPRINT_ARRAY)
+
+// The rest of the object: flags, task IDs, angles, padding
+char footprint_ram_core__Hackflight[sizeof(FootprintHackflight) - (0 FOOTPRINT_MEMBERS(FOOTPRINT_SIZE))];
+
+char footprint_ram_board__Board[sizeof(FootprintBoard)];
+
+}
+
+int main(int argc, char ** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    FootprintHackflight * h = new FootprintHackflight();
+
+    h->init(new FootprintBoard());
+    h->update();
+#ifdef CONFIG_DUAL_CORE
+    h->updateComms();
+#endif
+
+    return 0 FOOTPRINT_MEMBERS(FOOTPRINT_TOUCH) + footprint_ram_core__Hackflight[0] + footprint_ram_board__Board[0];
+}
@@ -0,0 +1,148 @@
+#!/usr/bin/python3
+
+'''
+footprint.py Reports RAM and flash by subsystem, from the symbols in one or more firmware builds
+
+Usage: footprint.py [--nm NM] ELF [ELF ...]
+
+Each symbol's size (from nm) goes to the subsystem its name belongs to: hf::MSP::update to msp, and so
+on; code from other libraries goes to "library".  Code inlined into a caller counts with the caller.
+Functions, read-only data and initialized data's starting values are flash; initialized and zeroed
+data are RAM.  The footprint_ram_SUBSYSTEM__TYPE arrays in footprint.cpp's builds stand for the members
+of the Hackflight object, and count as RAM only.  In a sketch's own ELF the object is one variable, h,
+counted as core.  With more than one ELF, each gets its own pair of columns, the first being the full
+build to compare against.
+
+Copyright (C) Simon D. Levy 2017
+
+This program is part of Hackflight
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this code.  If not, see <http:#www.gnu.org/licenses/>.
+'''
+
+from sys import argv, exit
+from subprocess import run, PIPE
+import re
+
+# First word of an hf:: name, to subsystem
+SUBSYSTEMS = {
+    'Hackflight'         : 'core',
+    'RC'                 : 'rc',
+    'SerialRx'           : 'rc',
+    'PulseRx'            : 'rc',
+    'Failsafe'           : 'failsafe',
+    'Navigator'          : 'navigation',
+    'OpticalFlow'        : 'navigation',
+    'Mixer'              : 'mixer',
+    'DShot'              : 'mixer',
+    'MSP'                : 'msp',
+    'mspCommandSlot'     : 'msp',
+    'Stabilize'          : 'stabilize',
+    'Scheduler'          : 'scheduler',
+    'Profiler'           : 'scheduler',
+    'TimedTask'          : 'scheduler',
+    'Blackbox'           : 'blackbox',
+    'GyroFilter'         : 'filters',
+    'GyroDecimator'      : 'filters',
+    'Biquad'             : 'filters',
+    'DynamicNotch'       : 'filters',
+    'FilterTables'       : 'filters',
+    'filterFft'          : 'filters',
+    'Leds'               : 'leds',
+    'Calibration'        : 'calibration',
+    'Mahony'             : 'attitude',
+    'MahonyMath'         : 'attitude',
+    'Quaternion'         : 'attitude',
+    'FastMath'           : 'attitude',
+    'InterpolationTable' : 'attitude',
+    'ConfigStore'        : 'settings',
+    'DebugRing'          : 'debug',
+    'debugRing'          : 'debug',
+    'debug'              : 'debug',
+    'debugFlush'         : 'debug',
+    'AccelZ'             : 'extras',
+    'AltitudeEstimator'  : 'extras',
+    'Baro'               : 'extras',
+    'Hover'              : 'extras',
+    'SonarEcho'          : 'extras',
+    'Sonars'             : 'extras',
+}
+
+FLASH_TYPES = 'tTwWrRdD'
+RAM_TYPES   = 'dDbBvVu'
+
+def error(errmsg):
+    print(errmsg)
+    exit(1)
+
+def subsystem(name):
+    '''
+    Returns (subsystem, is footprint.cpp's stand-in for a Hackflight member)
+    '''
+    match = re.match(r'footprint_ram_(\w+?)__', name)
+    if match:
+        return match.group(1), True
+    if name == 'h':
+        return 'core', False
+    match = re.match(r'(?:typeinfo for |typeinfo name for |vtable for )?hf::(\w+)', name)
+    if not match:
+        return 'library', False
+    return SUBSYSTEMS.get(match.group(1), 'board'), False
+
+def load(nm, filename):
+    '''
+    Returns {subsystem: [ram, flash]}
+    '''
+    try:
+        out = run([nm, '--size-sort', '-S', '-C', filename], stdout=PIPE, stderr=PIPE, universal_newlines=True)
+    except OSError:
+        error('Unable to run ' + nm)
+    if out.returncode != 0:
+        error(out.stderr.strip())
+
+    sizes = {}
+    for line in out.stdout.splitlines():
+        fields = line.split(None, 3)
+        if len(fields) < 4:
+            continue
+        size, kind, name = int(fields[1], 16), fields[2], fields[3]
+        which, member = subsystem(name)
+        entry = sizes.setdefault(which, [0, 0])
+        if kind in RAM_TYPES:
+            entry[0] += size
+        if kind in FLASH_TYPES and not member:
+            entry[1] += size
+    return sizes
+
+args = argv[1:]
+nm = 'nm'
+if len(args) > 1 and args[0] == '--nm':
+    nm = args[1]
+    args = args[2:]
+
+if not args:
+    error('Usage: %s [--nm NM] ELF [ELF ...]' % argv[0])
+
+builds = [load(nm, filename) for filename in args]
+
+names = sorted(set(name for build in builds for name in build), key=lambda name: -sum(builds[0].get(name, [0, 0])))
+
+print('%-12s' % 'subsystem' + ''.join(' %10s %10s' % ('RAM', 'flash') for _ in builds))
+print('%-12s' % '' + ''.join(' %21s' % filename[-21:] for filename in args))
+
+for name in names:
+    print('%-12s' % name + ''.join(' %10d %10d' % tuple(build.get(name, [0, 0])) for build in builds))
+
+print('%-12s' % 'total' + ''.join(' %10d %10d' % (sum(v[0] for v in build.values()), sum(v[1] for v in build.values()))
+                                  for build in builds))
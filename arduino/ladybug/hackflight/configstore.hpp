@@ -0,0 +1 @@
+../../../include/configstore.hpp
\ No newline at end of file
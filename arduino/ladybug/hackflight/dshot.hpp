@@ -0,0 +1 @@
+../../../include/dshot.hpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../../include/filters.hpp
\ No newline at end of file
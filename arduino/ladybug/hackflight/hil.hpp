@@ -0,0 +1 @@
+../../../include/hil.hpp
\ No newline at end of file
@@ -27,6 +27,7 @@
 #include <EM7180.h>
 
 #include "hackflight.hpp"
+#include "quaternion.hpp"
 
 EM7180 imu;
 SpektrumDSM2048 rx;
@@ -35,7 +36,17 @@ static uint8_t motorPins[4] = {13, 3, 1, 11};
 
 namespace hf {
 
-class Ladybug : public Board {
+class Ladybug final : public Board {
+
+    // The EM7180 wants a second after power-up, and another between tries if it won't start
+    static const uint32_t IMU_STARTUP_MICRO = 1000000;
+    static const uint32_t IMU_RETRY_MICRO   = 500000;
+
+    uint32_t imuStartTime;
+    bool     imuStarted;
+
+    // Public, so that Hackflight<Ladybug> can call straight through
+    public:
 
     virtual void dump(char * msg) override
     {
@@ -53,19 +64,18 @@ class Ladybug : public Board {
 
         Wire.begin();        
 
-        delay(1000);
-
-        // Start the EM7180
-        uint8_t status = imu.begin(8, 2000, 1000);
-        while (status) {
-            Serial.println(EM7180::errorToString(status));
-        }
+        // The EM7180 is started from imuReady(), once it has had time to power up
+        imuStarted   = false;
+        imuStartTime = micros() + IMU_STARTUP_MICRO;
 
         // Initialize the motors
         for (int k=0; k<4; ++k) {
             analogWriteFrequency(motorPins[k], 10000);  
             analogWrite(motorPins[k], 0);  
         }
+
+        // Start the receiver once, here, rather than each time RC asks about it
+        rx.begin();
     }
 
     virtual const Config& getConfig(void) override
@@ -105,7 +115,6 @@ class Ladybug : public Board {
 
     virtual bool rcUseSerial(void) override
     {
-        rx.begin();
         return true;
     }
 
@@ -136,6 +145,16 @@ class Ladybug : public Board {
         Serial.write(c);
     }
 
+    virtual uint16_t serialAvailableForWrite(void) override
+    {
+        return Serial.availableForWrite();
+    }
+
+    virtual void serialWriteBytes(const uint8_t * buf, uint16_t count) override
+    {
+        Serial.write(buf, count);
+    }
+
     virtual void writeMotor(uint8_t index, uint16_t value) override
     {
         uint8_t aval = map(value, config.pwm.min, config.pwm.max, 0, 255);
@@ -143,6 +162,48 @@ class Ladybug : public Board {
         analogWrite(motorPins[index], aval);
     }
 
+    virtual void writeMotors(const uint16_t * values, uint8_t count) override
+    {
+        // Board has four motor pins
+        if (count > 4) count = 4;
+
+        // Scale first, so the critical section is just the register writes
+        uint8_t avals[4];
+        for (uint8_t i = 0; i < count; i++) {
+            avals[i] = map(values[i], config.pwm.min, config.pwm.max, 0, 255);
+        }
+
+        // Back to back, with nothing run between them; a period can still start partway through,
+        // so this keeps the channels at most one period apart rather than in the same one
+        noInterrupts();
+        for (uint8_t i = 0; i < count; i++) {
+            analogWrite(motorPins[i], avals[i]);
+        }
+        interrupts();
+    }
+
+    virtual bool imuReady(void) override
+    {
+        if (imuStarted) {
+            return true;
+        }
+
+        if ((int32_t)(micros() - imuStartTime) < 0) {
+            return false;
+        }
+
+        // Start the EM7180, trying again later if it won't
+        uint8_t status = imu.begin(8, 2000, 1000);
+        if (status) {
+            Serial.println(EM7180::errorToString(status));
+            imuStartTime = micros() + IMU_RETRY_MICRO;
+            return false;
+        }
+
+        imuStarted = true;
+        return true;
+    }
+
     virtual void imuUpdate(void) override
     {
         uint8_t errorStatus = imu.update();
@@ -154,33 +215,44 @@ class Ladybug : public Board {
         }
     }
         
-    virtual void imuGetEulerAngles(float dT_sec, int16_t accelSmooth[3], int16_t gyroRaw[3], float eulerAnglesRadians[3]) override
+    virtual void imuGetEulerAndGyro(float eulerAnglesRadians[3], int16_t gyroRaw[3]) override
     {
-        // We ignore these values inputs, using quaternions instead
-        (void)dT_sec;
-        (void)accelSmooth;
-        (void)gyroRaw;
-        
-        static float q[4];
-        imu.getQuaternions(q);
+        float q[4];
+        imuGetQuaternionAndGyro(q, gyroRaw);
+        Quaternion::toEuler(q, eulerAnglesRadians);
+    }
+
+    virtual bool imuGetQuaternionAndGyro(float q[4], int16_t gyroRaw[3]) override
+    {
+        // EM7180 gives (x,y,z,w)
+        float qxyzw[4];
+        imu.getQuaternions(qxyzw);
 
-        float yaw   = atan2(2.0f * (q[0] * q[1] + q[3] * q[2]), q[3] * q[3] + q[0] * q[0] - q[1] * q[1] - q[2] * q[2]);   
+        q[0] = qxyzw[3];
+        q[1] = qxyzw[0];
+        q[2] = qxyzw[1];
+        q[3] = qxyzw[2];
 
-        float pitch = -asin(2.0f * (q[0] * q[2] - q[3] * q[1]));
-        float roll  = atan2(2.0f * (q[3] * q[0] + q[1] * q[2]), q[3] * q[3] - q[0] * q[0] - q[1] * q[1] + q[2] * q[2]);
+        imuReadGyro(gyroRaw);
 
-        eulerAnglesRadians[0] =  roll;
-        eulerAnglesRadians[1] = -pitch; // compensate for IMU orientation
-        eulerAnglesRadians[2] =  yaw;
+        return true;
     }
 
-    virtual void imuReadRaw(int16_t accelRaw[3], int16_t gyroRaw[3]) override
+    virtual bool imuReadGyro(int16_t gyroRaw[3]) override
     {
-         imu.getAccelRaw(accelRaw[0], accelRaw[1], accelRaw[2]);
-         imu.getGyroRaw(gyroRaw[0], gyroRaw[1], gyroRaw[2]);
+        imu.getGyroRaw(gyroRaw[0], gyroRaw[1], gyroRaw[2]);
+
+        gyroRaw[1] = -gyroRaw[1];
+        gyroRaw[2] = -gyroRaw[2];
 
-         gyroRaw[1] = -gyroRaw[1];
-         gyroRaw[2] = -gyroRaw[2];
+        return true;
+    }
+
+    virtual bool imuReadAccel(int16_t accelRaw[3]) override
+    {
+        imu.getAccelRaw(accelRaw[0], accelRaw[1], accelRaw[2]);
+
+        return true;
     }
 
 }; // class
@@ -0,0 +1 @@
+../../../include/leds.hpp
\ No newline at end of file
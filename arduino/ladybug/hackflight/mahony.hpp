@@ -0,0 +1 @@
+../../../include/mahony.hpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../../include/mspcommands.hpp
\ No newline at end of file
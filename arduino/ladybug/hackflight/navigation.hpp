@@ -0,0 +1 @@
+../../../include/navigation.hpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../../include/scheduler.hpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../../include/extras/altitude.hpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../../include/extras/baro.hpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../../include/blackbox.hpp
\ No newline at end of file
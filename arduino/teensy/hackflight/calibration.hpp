@@ -0,0 +1 @@
+../../../include/calibration.hpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../../include/failsafe.hpp
\ No newline at end of file
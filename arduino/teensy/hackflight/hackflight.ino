@@ -18,14 +18,30 @@
 
 #include <Arduino.h>
 
+// Uncomment to leave out debug, the blackbox, guided mode and the tuning commands, for the
+// smallest footprint (see config.hpp, and arduino/footprint for what each costs)
+//#define CONFIG_MINIMAL
+
 #include "hackflight.hpp"
 #include "teensy.hpp"
 
-hf::Hackflight h;
+// Uncomment to fly the V-REP simulator from this board (hardware-in-the-loop; see sim/vrep/README.md)
+//#define HIL
+
+#ifdef HIL
+#include "hil.hpp"
+hf::Hackflight<> h;
+#else
+hf::Hackflight<hf::Teensy> h;
+#endif
 
 void setup(void)
 {
+#ifdef HIL
+    h.init(new hf::HilBoard(new hf::Teensy()));
+#else
     h.init(new hf::Teensy());
+#endif
 }
 
 void loop(void)
@@ -0,0 +1 @@
+../../../include/looprate.hpp
\ No newline at end of file
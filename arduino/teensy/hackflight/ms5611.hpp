@@ -0,0 +1 @@
+../../../include/extras/ms5611.hpp
\ No newline at end of file
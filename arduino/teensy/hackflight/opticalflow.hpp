@@ -0,0 +1 @@
+../../../include/opticalflow.hpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../../include/profiler.hpp
\ No newline at end of file
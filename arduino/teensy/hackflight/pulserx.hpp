@@ -0,0 +1 @@
+../../../include/pulserx.hpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../../include/serialrx.hpp
\ No newline at end of file
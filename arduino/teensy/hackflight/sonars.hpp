@@ -0,0 +1 @@
+../../../include/extras/sonars.hpp
\ No newline at end of file
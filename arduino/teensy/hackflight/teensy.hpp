@@ -24,25 +24,211 @@
 
 #include <SpektrumDSM.h>
 #include <EM7180.h>
+#include <DMAChannel.h>
+#include <EEPROM.h>
 
 #include "hackflight.hpp"
 #include "accelz.hpp"
+#include "altitude.hpp"
+#include "baro.hpp"
+#include "ms5611.hpp"
+#include "sonars.hpp"
+#include "quaternion.hpp"
+#include "dshot.hpp"
+#include "serialrx.hpp"
+#include "pulserx.hpp"
 
 namespace hf {
 
-class Teensy : public Board {
+// Set by the EM7180 data-ready interrupt
+static volatile bool teensyImuDataReady;
+
+static void teensyImuInterrupt(void)
+{
+    teensyImuDataReady = true;
+}
+
+// PPM receiver, fed by FTM1's input-capture interrupt (ftm1_isr(), below)
+static PulseRx teensyPulseRx;
+
+// HC-SR04 sonars, if fitted (Teensy::SONARS_FITTED): each echo pin's pin-change interrupt times its
+// pulse.  Back, Bottom, Front, Left, Right, as Sonars orders them.
+static const uint8_t TEENSY_SONAR_ECHO_PINS[CONFIG_SONAR_COUNT] = {11, 12, 14, 15, 16};
+static SonarEcho teensySonarEchoes[CONFIG_SONAR_COUNT];
+
+template <uint8_t K>
+static void teensySonarEdge(void)
+{
+    teensySonarEchoes[K].edge(digitalRead(TEENSY_SONAR_ECHO_PINS[K]), micros());
+}
+
+class Teensy final : public Board {
 
     private:
 
+        // Run the IMU from the EM7180 interrupt pin rather than polling it on a timer
+        static const bool    IMU_USE_INTERRUPT = false;
+        static const uint8_t IMU_INTERRUPT_PIN = 8;
+
+        // The EM7180 wants a moment after power-up, and another between tries if it won't start
+        static const uint32_t IMU_STARTUP_MICRO = 100000;
+        static const uint32_t IMU_RETRY_MICRO   = 500000;
+
+        uint32_t imuStartTime;
+        bool     imuStarted;
+
         uint8_t motorPins[4] = {9, 22, 5, 23};
 
-        float eulerAngles[3];
+        // Set to one of the DShot protocols for brushless ESCs; PWM drives the stock brushed motors
+        static const uint8_t MOTOR_PROTOCOL = MOTOR_PROTOCOL_PWM;
+
+        // FTM0 channels for the motor pins above
+        uint8_t motorChannels[4] = {2, 0, 7, 1};
+
+        // DShot support; the buffers are 32-bit like the CnV registers, so that each DMA transfer moves
+        // one word from source to destination
+        DMAChannel dshotDma[4];
+        uint32_t   dshotBuffers[4][DShot::BUFFER_LENGTH];
+        uint32_t   dshotOneTicks;
+        uint32_t   dshotZeroTicks;
+
+        void dshotInit(void)
+        {
+            uint32_t bitTicks = F_BUS / DShot::bitRate(config.pwm.protocol);
+
+            dshotOneTicks  = DShot::oneTicks(bitTicks);
+            dshotZeroTicks = DShot::zeroTicks(bitTicks);
+
+            // FTM0 counts one DShot bit period, edge-aligned PWM; CnV writes take effect at the next period
+            FTM0_SC   = 0;
+            FTM0_CNT  = 0;
+            FTM0_MOD  = bitTicks - 1;
+            FTM0_MODE = FTM_MODE_WPDIS;
+            FTM0_SC   = FTM_SC_CLKS(1) | FTM_SC_PS(0);
+
+            for (int k=0; k<4; ++k) {
+
+                uint8_t chan = motorChannels[k];
+
+                // Route pin to its FTM0 channel
+                *portConfigRegister(motorPins[k]) = PORT_PCR_MUX(4) | PORT_PCR_DSE | PORT_PCR_SRE;
+
+                // High-true pulses, with a DMA request on each channel match
+                volatile uint32_t * csc = &FTM0_C0SC + 2*chan;
+                volatile uint32_t * cv  = &FTM0_C0V  + 2*chan;
+                *cv  = 0;
+                *csc = FTM_CSC_MSB | FTM_CSC_ELSB | FTM_CSC_CHIE | FTM_CSC_DMA;
+
+                // Each match loads the compare value for the next bit
+                dshotDma[k].destination(*cv);
+                dshotDma[k].sourceBuffer(dshotBuffers[k], sizeof(dshotBuffers[k]));
+                dshotDma[k].triggerAtHardwareEvent(DMAMUX_SOURCE_FTM0_CH0 + chan);
+                dshotDma[k].disableOnCompletion();
+            }
+        }
+
+        void dshotWrite(const uint16_t * values, uint8_t count)
+        {
+            // Build the bit buffers outside the critical section
+            for (uint8_t i = 0; i < count; i++) {
+                uint16_t packet = DShot::packet(DShot::scale(values[i], config.pwm));
+                DShot::fillBitBuffer(packet, dshotBuffers[i], dshotOneTicks, dshotZeroTicks);
+            }
+
+            // Start all channels together
+            noInterrupts();
+            for (uint8_t i = 0; i < count; i++) {
+                dshotDma[i].enable();
+            }
+            interrupts();
+        }
+
+        // SBUS or CRSF receivers go on Serial1's RX pin, where the DSM one would; with neither, SpektrumDSM
+        // decodes DSM2048 for itself
+        static const bool    RX_USE_SERIALRX = false;
+        static const uint8_t RX_PROTOCOL     = SERIALRX_SBUS;
+
+        // SBUS and CRSF send AETR; Hackflight wants roll, pitch, yaw, throttle, aux
+        uint8_t serialRxChanmap[5] = {0, 1, 3, 2, 4};
+
+        // Or a PPM receiver on pin 3 (FTM1 channel 0, clear of the motors' FTM0), its pulses timed by the
+        // timer's input capture; most PPM receivers send AETR too
+        static const bool    RX_USE_PPM = false;
+        static const uint8_t RX_PPM_PIN = 3;
+        static const uint8_t RX_PPM_PRESCALE_LOG2 = 5;
+
+        void ppmInit(void)
+        {
+            teensyPulseRx.init(PULSERX_PPM, F_BUS / (1 << RX_PPM_PRESCALE_LOG2) / 1e6f, 16);
+
+            // FTM1 free-runs over its whole 16 bits; channel 0 captures rising edges with an interrupt
+            FTM1_SC   = 0;
+            FTM1_CNT  = 0;
+            FTM1_MOD  = 0xFFFF;
+            FTM1_MODE = FTM_MODE_WPDIS;
+            FTM1_C0SC = FTM_CSC_ELSA | FTM_CSC_CHIE;
+
+            *portConfigRegister(RX_PPM_PIN) = PORT_PCR_MUX(3);
+
+            FTM1_SC = FTM_SC_CLKS(1) | FTM_SC_PS(RX_PPM_PRESCALE_LOG2);
+            NVIC_ENABLE_IRQ(IRQ_FTM1);
+        }
+
+        SerialRx serialRx;
+
+        // The core's UART interrupt has queued the bytes; they are stamped with when they are drained
+        void serialRxDrain(void)
+        {
+            uint32_t usec = micros();
+            while (Serial1.available()) {
+                serialRx.parse(Serial1.read(), usec);
+            }
+        }
+
+        // Latest attitude, for imuGetEulerAndGyro()
+        float quaternion[4];
 
         EM7180 imu;
         SpektrumDSM2048 rx;
         AccelZ accelZ;
+        AltitudeEstimator altitude;
+
+        // Set if HC-SR04 sonars are wired to the trigger pins here and the echo pins above
+        static const bool SONARS_FITTED = false;
+
+        uint8_t sonarTriggerPins[CONFIG_SONAR_COUNT] = {2, 4, 6, 7, 10};
+
+        void (*sonarEdgeHandlers[CONFIG_SONAR_COUNT])(void) =
+            {teensySonarEdge<0>, teensySonarEdge<1>, teensySonarEdge<2>, teensySonarEdge<3>, teensySonarEdge<4>};
 
-    protected:
+        Sonars sonars;
+
+        // An MS5611 breakout on the I^2C bus, if there is one; baroInit() finds out
+        Baro     baro;
+        uint16_t baroProm[MS5611::PROM_WORDS];
+
+        bool baroCommand(uint8_t command)
+        {
+            Wire.beginTransmission(MS5611::ADDRESS);
+            Wire.write(command);
+            return Wire.endTransmission() == 0;
+        }
+
+        // Big-endian, as the part sends its PROM words and ADC results
+        bool baroRead(uint8_t command, uint8_t count, uint32_t & value)
+        {
+            if (!baroCommand(command) || Wire.requestFrom(MS5611::ADDRESS, count) != count) {
+                return false;
+            }
+            value = 0;
+            for (uint8_t k=0; k<count; ++k) {
+                value = (value << 8) | Wire.read();
+            }
+            return true;
+        }
+
+    // Public, so that Hackflight<Teensy> can call straight through
+    public:
 
         virtual void dump(char * msg) override
         {
@@ -63,23 +249,42 @@ class Teensy : public Board {
             // Start I^2C
             Wire.begin(I2C_MASTER, 0x00, I2C_PINS_18_19, I2C_PULLUP_EXT, I2C_RATE_400);
 
-            // Hang a bit before starting up the EM7180
-            delay(100);
-
-            // Start the EM7180
-            uint8_t status = imu.begin(8, 2000, 1000);
-            while (status) {
-                Serial.println(EM7180::errorToString(status));
-            }
+            // The EM7180 is started from imuReady(), once it has had time to power up
+            imuStarted   = false;
+            imuStartTime = micros() + IMU_STARTUP_MICRO;
 
             // Initialize the motors
-            for (int k=0; k<4; ++k) {
-                analogWriteFrequency(motorPins[k], 10000);  
-                analogWrite(motorPins[k], 0);  
+            config.pwm.protocol = MOTOR_PROTOCOL;
+            if (DShot::isDShot(config.pwm.protocol)) {
+                dshotInit();
+            }
+            else {
+                for (int k=0; k<4; ++k) {
+                    analogWriteFrequency(motorPins[k], 10000);  
+                    analogWrite(motorPins[k], 0);  
+                }
             }
 
-            // Initialize the accelerometer Z for altitude
+            // Initialize the accelerometer Z, and the altitude estimator it feeds
             accelZ.init(config.imu);
+            altitude.init(config.altitude);
+
+            // The baro is on the bus started above
+            baro.init(this);
+            sonars.init(this);
+
+            // Start the receiver once, here, rather than each time RC asks about it
+            if (RX_USE_SERIALRX) {
+                Serial1.begin(RX_PROTOCOL == SERIALRX_SBUS ? 100000 : 420000,
+                        RX_PROTOCOL == SERIALRX_SBUS ? SERIAL_8E2_RXINV : SERIAL_8N1);
+                serialRx.init(RX_PROTOCOL);
+            }
+            else if (RX_USE_PPM) {
+                ppmInit();
+            }
+            else {
+                rx.begin();
+            }
         }
 
         virtual const Config& getConfig(void) override
@@ -97,6 +302,23 @@ class Teensy : public Board {
             // "Software trim"
             config.pid.softwareTrim[AXIS_PITCH] = -50;
 
+            // Aux switch all the way up flies rate (acro) mode
+            config.rate.auxState = 2;
+
+            // Sticks are read every 10 msec, but ramp at the PID rate
+            config.loop.rcInterpolation = true;
+
+            // Gains are tuned at the default 3.5 msec; the loop runs as fast as the IMU chain allows,
+            // timed at startup, down to 1 msec
+            config.loop.imuLoopMinMicro = 1000;
+
+            // Keep attitude control all the way down the throttle
+            config.pwm.airmode = true;
+
+            // Hold, level, then come down if the receiver goes quiet; every receiver here reports only the
+            // frames that have come in (see rcReadSerialFrame()), so a quiet one is noticed
+            config.failsafe.enabled = true;
+
             return config;
         }
 
@@ -119,7 +341,58 @@ class Teensy : public Board {
 
         virtual bool rcUseSerial(void) override
         {
-            rx.begin();
+            return !RX_USE_PPM;
+        }
+
+        virtual uint8_t rcReadSerialFrame(uint16_t channels[CONFIG_RC_CHANS]) override
+        {
+            // Only a frame that has really come in counts, so that a receiver gone quiet ages out and
+            // failsafe can act
+            if (!RX_USE_SERIALRX) {
+                if (!rx.gotNewFrame()) {
+                    return 0;
+                }
+                return Board::rcReadSerialFrame(channels);
+            }
+
+            serialRxDrain();
+
+            uint16_t frame[SerialRx::CHANNELS];
+            if (!serialRx.getFrame(frame)) {
+                return 0;
+            }
+
+            for (uint8_t chan = 0; chan < 5; chan++) {
+                channels[chan] = frame[serialRxChanmap[chan]];
+            }
+
+            return 5;
+        }
+
+        // SpektrumDSM's new-frame flag is cleared by reading it in rcReadSerialFrame(), so DSM stays on the RC
+        // timer
+        virtual bool rcHasFrameSignal(void) override
+        {
+            return RX_USE_SERIALRX || RX_USE_PPM;
+        }
+
+        virtual bool rcFrameReady(void) override
+        {
+            if (RX_USE_PPM) {
+                return teensyPulseRx.frameReady();
+            }
+
+            serialRxDrain();
+            return serialRx.frameReady();
+        }
+
+        virtual bool rcGetLinkStats(rcLinkStats_t & stats) override
+        {
+            if (!RX_USE_SERIALRX) {
+                return false;
+            }
+
+            serialRx.getStats(stats);
             return true;
         }
 
@@ -135,6 +408,21 @@ class Teensy : public Board {
             return 0;
         }
 
+        virtual uint8_t rcReadPwmFrame(uint16_t channels[CONFIG_RC_CHANS]) override
+        {
+            uint16_t frame[PulseRx::CHANNELS];
+            uint8_t count = teensyPulseRx.getFrame(frame);
+            if (count == 0) {
+                return 0;
+            }
+
+            for (uint8_t chan = 0; chan < 5; chan++) {
+                channels[chan] = serialRxChanmap[chan] < count ? frame[serialRxChanmap[chan]] : 0;
+            }
+
+            return 5;
+        }
+
         virtual uint8_t serialAvailableBytes(void) override
         {
             return Serial.available();
@@ -150,13 +438,109 @@ class Teensy : public Board {
             Serial.write(c);
         }
 
+        virtual uint16_t serialAvailableForWrite(void) override
+        {
+            return Serial.availableForWrite();
+        }
+
+        virtual void serialWriteBytes(const uint8_t * buf, uint16_t count) override
+        {
+            Serial.write(buf, count);
+        }
+
+        // Settings go in the Teensy's emulated EEPROM, from address zero
+        virtual bool configRead(uint8_t * buf, uint16_t count) override
+        {
+            if (count > EEPROM.length()) {
+                return false;
+            }
+
+            for (uint16_t k = 0; k < count; k++) {
+                buf[k] = EEPROM.read(k);
+            }
+
+            return true;
+        }
+
+        virtual bool configWrite(const uint8_t * buf, uint16_t count) override
+        {
+            if (count > EEPROM.length()) {
+                return false;
+            }
+
+            // Only the bytes that have changed are written, which spares the flash
+            for (uint16_t k = 0; k < count; k++) {
+                EEPROM.update(k, buf[k]);
+            }
+
+            return true;
+        }
+
         virtual void writeMotor(uint8_t index, uint16_t value) override
         {
+            // DShot channels are only ever written together
+            if (DShot::isDShot(config.pwm.protocol)) {
+                return;
+            }
+
             uint8_t aval = map(value, config.pwm.min, config.pwm.max, 0, 255);
 
             analogWrite(motorPins[index], aval);
         }
 
+        virtual void writeMotors(const uint16_t * values, uint8_t count) override
+        {
+            // Board has four motor pins
+            if (count > 4) count = 4;
+
+            if (DShot::isDShot(config.pwm.protocol)) {
+                dshotWrite(values, count);
+                return;
+            }
+
+            // Scale first, so the critical section is just the register writes
+            uint8_t avals[4];
+            for (uint8_t i = 0; i < count; i++) {
+                avals[i] = map(values[i], config.pwm.min, config.pwm.max, 0, 255);
+            }
+
+            // Back to back, with nothing run between them; a period can still start partway through,
+            // so this keeps the channels at most one period apart rather than in the same one
+            noInterrupts();
+            for (uint8_t i = 0; i < count; i++) {
+                analogWrite(motorPins[i], avals[i]);
+            }
+            interrupts();
+        }
+
+        virtual bool imuReady(void) override
+        {
+            if (imuStarted) {
+                return true;
+            }
+
+            if ((int32_t)(micros() - imuStartTime) < 0) {
+                return false;
+            }
+
+            // Start the EM7180, trying again later if it won't
+            uint8_t status = imu.begin(8, 2000, 1000);
+            if (status) {
+                Serial.println(EM7180::errorToString(status));
+                imuStartTime = micros() + IMU_RETRY_MICRO;
+                return false;
+            }
+
+            // EM7180 raises its interrupt line when a new sample is ready
+            if (IMU_USE_INTERRUPT) {
+                pinMode(IMU_INTERRUPT_PIN, INPUT);
+                attachInterrupt(IMU_INTERRUPT_PIN, teensyImuInterrupt, RISING);
+            }
+
+            imuStarted = true;
+            return true;
+        }
+
         virtual void imuUpdate(void) override
         {
             uint8_t errorStatus = imu.update();
@@ -168,32 +552,161 @@ class Teensy : public Board {
             }
         }
 
-        virtual void imuGetEulerAndGyro(float _eulerAngles[3], int16_t gyroRaw[3]) override
+        virtual bool imuHasDataReadyInterrupt(void) override
         {
-            static float q[4];
-            imu.getQuaternions(q);
+            return IMU_USE_INTERRUPT;
+        }
 
-            float yaw   = atan2(2.0f * (q[0] * q[1] + q[3] * q[2]), q[3] * q[3] + q[0] * q[0] - q[1] * q[1] - q[2] * q[2]);   
-            float pitch = -asin(2.0f * (q[0] * q[2] - q[3] * q[1]));
-            float roll  = atan2(2.0f * (q[3] * q[0] + q[1] * q[2]), q[3] * q[3] - q[0] * q[0] - q[1] * q[1] + q[2] * q[2]);
+        virtual bool imuDataReady(void) override
+        {
+            noInterrupts();
+            bool ready = teensyImuDataReady;
+            teensyImuDataReady = false;
+            interrupts();
 
-            _eulerAngles[0] =  roll;
-            _eulerAngles[1] = -pitch; // compensate for IMU orientation
-            _eulerAngles[2] =  yaw;
+            return ready;
+        }
+
+        virtual void idle(void) override
+        {
+            // Checking with interrupts off closes the race with the ISR; WFI still wakes on a pending interrupt
+            noInterrupts();
+            if (!teensyImuDataReady) {
+                asm volatile("wfi");
+            }
+            interrupts();
+        }
+
+        virtual void imuGetEulerAndGyro(float eulerAngles[3], int16_t gyroRaw[3]) override
+        {
+            imuGetQuaternionAndGyro(quaternion, gyroRaw);
+            Quaternion::toEuler(quaternion, eulerAngles);
+        }
+
+        virtual bool imuGetQuaternionAndGyro(float q[4], int16_t gyroRaw[3]) override
+        {
+            // EM7180 gives (x,y,z,w)
+            float qxyzw[4];
+            imu.getQuaternions(qxyzw);
 
+            quaternion[0] = qxyzw[3];
+            quaternion[1] = qxyzw[0];
+            quaternion[2] = qxyzw[1];
+            quaternion[3] = qxyzw[2];
+
+            memcpy(q, quaternion, sizeof(quaternion));
+
+            imuReadGyro(gyroRaw);
+
+            return true;
+        }
+
+        virtual bool imuReadGyro(int16_t gyroRaw[3]) override
+        {
             imu.getGyroRaw(gyroRaw[0], gyroRaw[1], gyroRaw[2]);
             gyroRaw[1] = -gyroRaw[1];
             gyroRaw[2] = -gyroRaw[2];
 
-            // Store Euler angles for extrasUpdateAccelZ()
-            memcpy(eulerAngles, _eulerAngles, 3*sizeof(float));
+            return true;
+        }
+
+        virtual bool imuReadAccel(int16_t accelRaw[3]) override
+        {
+            imu.getAccelRaw(accelRaw[0], accelRaw[1], accelRaw[2]);
+
+            return true;
+        }
+
+        virtual bool baroInit(void) override
+        {
+            if (!baroCommand(MS5611::CMD_RESET)) {
+                return false;
+            }
+            delayMicroseconds(MS5611::RESET_MICRO);
+
+            for (uint8_t k=0; k<MS5611::PROM_WORDS; ++k) {
+                uint32_t word;
+                if (!baroRead(MS5611::CMD_PROM_READ + 2*k, 2, word)) {
+                    return false;
+                }
+                baroProm[k] = (uint16_t)word;
+            }
+
+            return MS5611::promValid(baroProm);
+        }
+
+        virtual uint32_t baroStartConversion(bool temperature) override
+        {
+            baroCommand(temperature ? MS5611::CMD_CONVERT_D2 : MS5611::CMD_CONVERT_D1);
+            return MS5611::CONVERSION_MICRO;
+        }
+
+        virtual uint32_t baroReadConversion(void) override
+        {
+            uint32_t raw = 0;
+            baroRead(MS5611::CMD_ADC_READ, 3, raw);
+            return raw;
+        }
+
+        virtual int32_t baroCompensate(uint32_t rawTemperature, uint32_t rawPressure) override
+        {
+            return MS5611::compensate(baroProm, rawTemperature, rawPressure);
+        }
+
+        virtual bool sonarInit(uint8_t index) override
+        {
+            if (!SONARS_FITTED) {
+                return false;
+            }
+
+            pinMode(sonarTriggerPins[index], OUTPUT);
+            digitalWrite(sonarTriggerPins[index], LOW);
+            pinMode(TEENSY_SONAR_ECHO_PINS[index], INPUT);
+            attachInterrupt(TEENSY_SONAR_ECHO_PINS[index], sonarEdgeHandlers[index], CHANGE);
+
+            return true;
         }
 
-        virtual void extrasUpdateAccelZ(bool armed) override
+        virtual void sonarTrigger(uint8_t mask) override
+        {
+            // The HC-SR04 wants a 10 usec pulse; the group shares one
+            for (uint8_t k=0; k<CONFIG_SONAR_COUNT; ++k) {
+                if (mask & (1<<k)) {
+                    teensySonarEchoes[k].start();
+                    digitalWrite(sonarTriggerPins[k], HIGH);
+                }
+            }
+
+            delayMicroseconds(10);
+
+            for (uint8_t k=0; k<CONFIG_SONAR_COUNT; ++k) {
+                if (mask & (1<<k)) {
+                    digitalWrite(sonarTriggerPins[k], LOW);
+                }
+            }
+        }
+
+        virtual bool sonarGetEcho(uint8_t index, uint32_t & echoMicro) override
+        {
+            return teensySonarEchoes[index].get(echoMicro);
+        }
+
+        virtual void extrasUpdateAccelZ(const float gravity[3], bool armed) override
         { 
             int16_t accelRaw[3];
             imu.getAccelRaw(accelRaw[0], accelRaw[1], accelRaw[2]);
-            accelZ.update(accelRaw, eulerAngles, micros(), armed);
+            uint32_t usec = micros();
+            accelZ.update(accelRaw, gravity, usec, armed);
+            altitude.predict(accelZ.getAcceleration(), usec, armed);
+        }
+
+        virtual void extrasRegisterMspHandlers(MSP * msp) override
+        {
+            altitude.registerMspHandlers(msp);
+
+            if (sonars.available()) {
+                sonars.registerMspHandlers(msp);
+            }
         }
 
         virtual void extrasHandleAuxSwitch(uint8_t auxState) override
@@ -201,16 +714,34 @@ class Teensy : public Board {
             Serial.println(auxState);
         }
 
+        // Baro, then sonars
         virtual uint8_t extrasGetTaskCount(void) override
         { 
-            return 1; 
+            return 2; 
         }
 
-        virtual void extrasPerformTask(uint8_t taskIndex) 
+        virtual void extrasPerformTask(uint8_t taskIndex) override
         { 
-            Serial.println(taskIndex);
+            if (taskIndex == 0) {
+                if (baro.update()) {
+                    altitude.correctBaro(baro.getAltitude());
+                }
+            }
+            else if (sonars.update()) {
+                altitude.correctSonar(sonars.getAltitude(), sonars.getAltitudeTime());
+            }
         }
  
 }; // class
 
 } // namespace
+
+// Reading the capture clears nothing; the flag is cleared by writing it back as zero
+void ftm1_isr(void)
+{
+    if (FTM1_C0SC & FTM_CSC_CHF) {
+        uint32_t capture = FTM1_C0V;
+        FTM1_C0SC &= ~FTM_CSC_CHF;
+        hf::teensyPulseRx.ppmEdge(capture);
+    }
+}
@@ -25,8 +25,13 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+
 #include "serial.hpp"
 
 // Adapted from http://stackoverflow.com/questions/6947413/how-to-open-read-and-write-from-serial-port-in-c
@@ -71,7 +76,7 @@ static int set_interface_attribs (int fd, int speed, int parity)
     return 0;
 }
 
-static void set_blocking (int fd, bool should_block)
+static void set_read_timing (int fd, int vmin, int vtime)
 {
     struct termios tty;
     memset (&tty, 0, sizeof tty);
@@ -81,18 +86,27 @@ static void set_blocking (int fd, bool should_block)
         return;
     }
 
-    tty.c_cc[VMIN]  = should_block ? 1 : 0;
-    tty.c_cc[VTIME] = 5;            // 0.5 seconds read timeout
+    tty.c_cc[VMIN]  = vmin;
+    tty.c_cc[VTIME] = vtime;
 
     if (tcsetattr (fd, TCSANOW, &tty) != 0)
         fprintf(stderr, "error %d setting term attributes", errno);
 }
 
+static void set_blocking (int fd, bool should_block)
+{
+    set_read_timing(fd, should_block ? 1 : 0, 5);   // 0.5 seconds read timeout
+}
+
 SerialConnection::SerialConnection(const char * portname, int baudrate, bool blocking, int parity)
 {
     strcpy(this->portname, portname);
     this->blocking = blocking;
     this->parity = parity;
+    this->fd = -1;
+    this->rxHead = 0;
+    this->rxLen = 0;
+    this->pollReads = false;
 
     switch (baudrate) {
         case 110:
@@ -148,22 +162,145 @@ bool SerialConnection::openConnection(void)
     set_interface_attribs (this->fd, this->baudrate, this->parity);
 
     set_blocking (this->fd, this->blocking);
+    this->pollReads = false;
+
+    this->rxHead = 0;
+    this->rxLen = 0;
 
     return true;
 }
 
+bool SerialConnection::setLowLatency(bool enable)
+{
+#ifdef __linux__
+    struct serial_struct serial;
+
+    if (ioctl(this->fd, TIOCGSERIAL, &serial) < 0)
+        return false;
+
+    if (enable)
+        serial.flags |= ASYNC_LOW_LATENCY;
+    else
+        serial.flags &= ~ASYNC_LOW_LATENCY;
+
+    return ioctl(this->fd, TIOCSSERIAL, &serial) == 0;
+#else
+    (void)enable;
+    return false;
+#endif
+}
+
 int SerialConnection::bytesAvailable(void)
 {
     int avail = 0;
     ioctl(this->fd, FIONREAD, &avail);
-    return avail;
+    return this->rxLen + avail;
 }
 
 int SerialConnection::readBytes(char * buf, int size)
 {
+    // Anything readSome() already took from the port comes first
+    if (this->rxLen > 0)
+        return drainRing(buf, size);
+
+    // Back to the blocking setup, if readSome() had the port
+    if (this->pollReads) {
+        set_blocking (this->fd, this->blocking);
+        this->pollReads = false;
+    }
+
     return read(this->fd, buf, size);
 }
 
+int SerialConnection::fillRing(void)
+{
+    // Into the free space after the data, in at most two pieces (a second only if the first filled up
+    // to the end of the ring).  readSome() has set VMIN and VTIME to zero, so neither read waits: each
+    // takes what the driver holds.  The second is made only when the FIONREAD count says there is more.
+    int total = 0;
+
+    for (int piece=0; piece<2 && this->rxLen < RX_RING; ++piece) {
+
+        int tail = (this->rxHead + this->rxLen) % RX_RING;
+        int room = tail >= this->rxHead ? RX_RING - tail : this->rxHead - tail;
+
+        if (piece > 0) {
+            int avail = 0;
+            ioctl(this->fd, FIONREAD, &avail);
+            if (avail <= 0)
+                break;
+        }
+
+        ssize_t n = read(this->fd, this->rxRing + tail, room);
+
+        if (n == 0)
+            return total ? total : -1;
+
+        if (n < 0)
+            return total ? total : ((errno == EAGAIN || errno == EINTR) ? 0 : -1);
+
+        this->rxLen += n;
+        total += n;
+
+        if (n < room)
+            break;
+    }
+
+    return total;
+}
+
+int SerialConnection::drainRing(char * buf, int cap)
+{
+    int n = 0;
+
+    while (n < cap && this->rxLen > 0) {
+        int chunk = RX_RING - this->rxHead;
+        if (chunk > this->rxLen)
+            chunk = this->rxLen;
+        if (chunk > cap - n)
+            chunk = cap - n;
+        memcpy(buf + n, this->rxRing + this->rxHead, chunk);
+        this->rxHead = (this->rxHead + chunk) % RX_RING;
+        this->rxLen -= chunk;
+        n += chunk;
+    }
+
+    return n;
+}
+
+int SerialConnection::readSome(char * buf, int cap, int timeoutUsec)
+{
+    // poll() does the waiting, so reads from the port return at once with whatever is there
+    if (!this->pollReads) {
+        set_read_timing (this->fd, 0, 0);
+        this->pollReads = true;
+    }
+
+    if (this->rxLen == 0) {
+
+        struct pollfd pfd;
+        pfd.fd = this->fd;
+        pfd.events = POLLIN;
+
+        // poll() counts in milliseconds; round up, so that a short timeout still waits
+        int ready = poll(&pfd, 1, (timeoutUsec + 999) / 1000);
+
+        if (ready < 0)
+            return errno == EINTR ? 0 : -1;
+
+        if (ready == 0)
+            return 0;
+
+        if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))
+            return -1;
+
+        if (fillRing() < 0)
+            return -1;
+    }
+
+    return drainRing(buf, cap);
+}
+
 int SerialConnection::writeBytes(char * buf, int size)
 {
     return write(this->fd, buf, size);
@@ -172,4 +309,5 @@ int SerialConnection::writeBytes(char * buf, int size)
 void SerialConnection::closeConnection(void)
 {
     close(this->fd);
+    this->fd = -1;
 }
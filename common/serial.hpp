@@ -25,20 +25,44 @@ class SerialConnection {
 
         bool openConnection(void);
 
+        // Asks the driver (FTDI, ACM and other USB serial adapters, on Linux) to hand over each byte as it
+        // arrives, rather than batching them on a timer; returns false if it can't
+        bool setLowLatency(bool enable=true);
+
         int bytesAvailable(void);
 
         int readBytes(char * buf, int size);
 
+        // Waits up to timeoutUsec (zero just checks) for input, then returns what has arrived, up to cap bytes;
+        // zero on timeout, negative if the port has closed or failed.  Reads from the port go through a
+        // ring buffer, so that a burst costs one system call however small the caller's reads are.  The
+        // first call sets VMIN and VTIME to zero, so that the waiting is all poll()'s; a later readBytes()
+        // puts back the setup chosen by the constructor.
+        int readSome(char * buf, int cap, int timeoutUsec);
+
         int writeBytes(char * buf, int size);
 
         void closeConnection(void);
 
+        int getFd(void) { return this->fd; }
+
     private:
 
+        static const int RX_RING = 4096;
+
         int fd;
         char portname[100];
         int baudrate;
         bool blocking;
         int parity;
 
+        char rxRing[RX_RING];
+        int  rxHead;
+        int  rxLen;
+
+        // Whether readSome() has set VMIN and VTIME to zero; readBytes() restores the blocking setup
+        bool pollReads;
+
+        int  fillRing(void);
+        int  drainRing(char * buf, int cap);
 };
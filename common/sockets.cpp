@@ -29,6 +29,41 @@
 #include <sys/select.h>
 #include <unistd.h>
 #include <string.h>
+#include <fcntl.h>
+
+static void set_nonblocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+// Reads or writes whatever is ready, without waiting; negative for an error or a closed peer
+static int recv_some(int fd, char * buf, int count)
+{
+    ssize_t n = recv(fd, buf, count, MSG_DONTWAIT);
+
+    if (n == 0)
+        return -1;
+
+    if (n < 0)
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+
+    return (int)n;
+}
+
+static int writev_some(int fd, const struct iovec * iov, int iovcnt)
+{
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = (struct iovec *)iov;
+    msg.msg_iovlen = iovcnt;
+
+    ssize_t n = sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    if (n < 0)
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+
+    return (int)n;
+}
 
 // http://web.eecs.utk.edu/~plank/plank/classes/cs360/360/notes/Sockets/sockettome.c
 static int serve_socket(const char *hostname, int port)
@@ -108,8 +143,8 @@ static int read_from_socket(int clientfd, char * buf, int n)
                 close(clientfd);
             }
 
-            else {
-                return n; // Success!
+            else if (result > 0) {
+                return result; // Success!
             }
         }
     }
@@ -121,6 +156,9 @@ SocketServer::SocketServer(const char * _hostname, int _port)
 {
     strcpy(this->hostname, _hostname);
     this->port = _port;
+    this->sockfd = -1;
+    this->clientfd = -1;
+    this->clientCount = 0;
 }
 
 
@@ -149,8 +187,79 @@ void SocketServer::halt(void)
 {
     printf("Halting %s:%d\n", this->hostname, this->port);
 
-    close(this->sockfd);
-    close(this->clientfd);
+    if (this->sockfd >= 0)
+        close(this->sockfd);
+    if (this->clientfd >= 0)
+        close(this->clientfd);
+
+    while (this->clientCount > 0)
+        dropClient(this->clientCount-1);
+}
+
+void SocketServer::listenForClients(void)
+{
+    this->sockfd = serve_socket(this->hostname, this->port);
+
+    if (listen(this->sockfd, MAX_CLIENTS) == -1) {
+        perror("listen()");
+        exit(1);
+    }
+
+    set_nonblocking(this->sockfd);
+
+    printf("Listening for %s:%d\n", this->hostname, this->port);
+}
+
+bool SocketServer::acceptPending(void)
+{
+    int fd = accept(this->sockfd, (struct sockaddr *)NULL, NULL);
+
+    if (fd < 0)
+        return false;
+
+    // Full: turn the client away
+    if (this->clientCount == MAX_CLIENTS) {
+        close(fd);
+        return false;
+    }
+
+    set_nonblocking(fd);
+    this->clients[this->clientCount++] = fd;
+
+    printf("Accepted client %d on %s:%d\n", this->clientCount, this->hostname, this->port);
+
+    return true;
+}
+
+void SocketServer::dropClient(int index)
+{
+    close(this->clients[index]);
+    this->clients[index] = this->clients[--this->clientCount];
+}
+
+int SocketServer::recvFrom(int index, char * buf, int count)
+{
+    int n = recv_some(this->clients[index], buf, count);
+
+    if (n < 0) {
+        dropClient(index);
+        return 0;
+    }
+
+    return n;
+}
+
+void SocketServer::broadcast(const struct iovec * iov, int iovcnt)
+{
+    int total = 0;
+    for (int k=0; k<iovcnt; ++k)
+        total += (int)iov[k].iov_len;
+
+    // Backwards, so that dropping a client doesn't skip the next one
+    for (int k=this->clientCount-1; k>=0; --k) {
+        if (writev_some(this->clients[k], iov, iovcnt) != total)
+            dropClient(k);
+    }
 }
 
 SocketClient::SocketClient(const char * _hostname, int _port)
@@ -199,9 +308,126 @@ void SocketClient::send(char * buf, int count)
     write(this->sockfd, buf, count);
 }
 
+int SocketClient::sendSome(char * buf, int count)
+{
+    struct iovec iov = {buf, (size_t)count};
+    return sendSome(&iov, 1);
+}
+
+int SocketClient::sendSome(const struct iovec * iov, int iovcnt)
+{
+    int sent = writev_some(this->sockfd, iov, iovcnt);
+    return sent < 0 ? 0 : sent;
+}
+
+int SocketClient::recvSome(char * buf, int count)
+{
+    int n = recv_some(this->sockfd, buf, count);
+    return n < 0 ? 0 : n;
+}
+
 void SocketClient::halt(void)
 {
     close(this->sockfd);
 }
 
+SocketReactor::SocketReactor(void)
+{
+    this->count = 0;
+    this->running = false;
+}
+
+int SocketReactor::find(int fd)
+{
+    for (int k=0; k<this->count; ++k) {
+        if (this->fds[k].fd == fd && !this->entries[k].removed)
+            return k;
+    }
+
+    return -1;
+}
+
+bool SocketReactor::add(int fd, short events, handler_t handler, void * context)
+{
+    if (this->count == MAX_SOCKETS)
+        return false;
+
+    set_nonblocking(fd);
+
+    this->fds[this->count].fd = fd;
+    this->fds[this->count].events = events;
+    this->fds[this->count].revents = 0;
+    this->entries[this->count].handler = handler;
+    this->entries[this->count].context = context;
+    this->entries[this->count].removed = false;
+    this->count++;
+
+    return true;
+}
+
+void SocketReactor::setEvents(int fd, short events)
+{
+    int k = find(fd);
+
+    if (k >= 0)
+        this->fds[k].events = events;
+}
+
+void SocketReactor::remove(int fd)
+{
+    int k = find(fd);
+
+    if (k < 0)
+        return;
+
+    // A handler may remove a socket while we're dispatching, so just mark it until we're done
+    this->entries[k].removed = true;
+    this->fds[k].fd = -1;
+
+    if (!this->running)
+        compact();
+}
+
+void SocketReactor::compact(void)
+{
+    int n = 0;
+
+    for (int k=0; k<this->count; ++k) {
+        if (!this->entries[k].removed) {
+            this->fds[n] = this->fds[k];
+            this->entries[n] = this->entries[k];
+            n++;
+        }
+    }
+
+    this->count = n;
+}
 
+int SocketReactor::run(int timeoutMsec)
+{
+    int ready;
+
+    do {
+        ready = poll(this->fds, this->count, timeoutMsec);
+    } while (ready < 0 && errno == EINTR);
+
+    if (ready <= 0)
+        return 0;
+
+    // Handlers added during dispatch wait for the next run
+    int n = this->count;
+
+    this->running = true;
+
+    for (int k=0; k<n; ++k) {
+        short revents = this->fds[k].revents;
+        if (revents && !this->entries[k].removed)
+            this->entries[k].handler(this->entries[k].context, this->fds[k].fd, revents);
+    }
+
+    this->running = false;
+
+    compact();
+
+    return ready;
+}
@@ -17,8 +17,17 @@
    along with 3DSLAM.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#pragma once
+
+#include <poll.h>
+#include <sys/uio.h>
+
 class SocketServer {
 
+    public:
+
+        static const int MAX_CLIENTS = 8;
+
     private:
 
         char hostname[100];
@@ -26,6 +35,12 @@ class SocketServer {
         int sockfd;
         int clientfd;
 
+        // Multiple-client mode
+        int clients[MAX_CLIENTS];
+        int clientCount;
+
+        void dropClient(int index);
+
     public:
 
         SocketServer(const char * hostname = "localhost", int port = 20000);
@@ -37,6 +52,21 @@ class SocketServer {
         void send(char * buf, int count);
 
         void halt(void); 
+
+        // Multiple-client mode: starts listening without waiting for a client.  When the listening socket
+        // (getListenFd) is readable, acceptPending() takes the new client, non-blocking.
+        void listenForClients(void);
+        bool acceptPending(void);
+        int  getListenFd(void) { return this->sockfd; }
+        int  getClientCount(void) { return this->clientCount; }
+        int  getClientFd(int index) { return this->clients[index]; }
+
+        // Reads what a client has sent, without waiting; drops the client if it has gone away
+        int recvFrom(int index, char * buf, int count);
+
+        // Sends the message to every client in one gathered write each; a client that has gone away, or is so
+        // far behind that it can't take the whole message, is dropped
+        void broadcast(const struct iovec * iov, int iovcnt);
 };
 
 class SocketClient {
@@ -59,5 +89,53 @@ class SocketClient {
 
         void send(char * buf, int count);
 
+        // Sends what the socket will take without waiting; returns the number of bytes sent
+        int sendSome(char * buf, int count);
+
+        // The same, gathered from several buffers
+        int sendSome(const struct iovec * iov, int iovcnt);
+
+        // Reads what has arrived, without waiting; returns the number of bytes read
+        int recvSome(char * buf, int count);
+
+        int getFd(void) { return this->sockfd; }
+
         void halt(void); 
 };
+
+// Waits on many sockets at once, and calls each one's handler when it is ready
+class SocketReactor {
+
+    public:
+
+        static const int MAX_SOCKETS = 32;
+
+        typedef void (*handler_t)(void * context, int fd, short revents);
+
+        SocketReactor(void);
+
+        // Events are POLLIN and/or POLLOUT; errors and hangups are always reported
+        bool add(int fd, short events, handler_t handler, void * context);
+        void setEvents(int fd, short events);
+        void remove(int fd);
+
+        // Waits up to timeoutMsec (zero just checks, negative waits forever) for any socket, then runs the
+        // handlers of those that are ready; returns how many were
+        int run(int timeoutMsec);
+
+    private:
+
+        typedef struct entry_t {
+            handler_t handler;
+            void    * context;
+            bool      removed;
+        } entry_t;
+
+        struct pollfd fds[MAX_SOCKETS];
+        entry_t       entries[MAX_SOCKETS];
+        int           count;
+        bool          running;
+
+        int  find(int fd);
+        void compact(void);
+};
@@ -0,0 +1,223 @@
+/*
+   extras.cpp : Test code for the altitude extras, run against the headless simulator's board
+
+   Feeds AltitudeEstimator made-up readings and checks that it settles where it should, then builds
+   Hover on top of it; runs Baro against a board that answers as the MS5611 in its datasheet's example,
+   and Sonars against one whose echo interrupts the test fires itself.  Exits nonzero, saying which
+   check failed.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <stdio.h>
+
+#include "hackflight.hpp"
+#include "simboard.hpp"
+#include "altitude.hpp"
+#include "hover.hpp"
+#include "baro.hpp"
+#include "ms5611.hpp"
+#include "sonars.hpp"
+
+static int failures;
+
+static void check(bool ok, const char * what, float value)
+{
+    printf("%s: %-48s %.2f\n", ok ? "ok  " : "FAIL", what, value);
+    if (!ok)
+        failures++;
+}
+
+// Baro 100 m above sea level on the ground (cm)
+static const int32_t GROUND = 10000;
+
+// Runs the estimator for the given time at the simulator's step, with a baro reading every 20 msec
+static void run(hf::SimBoard & board, hf::AltitudeEstimator & altitude, float seconds, float accelZ,
+        int32_t baro, bool armed)
+{
+    for (uint32_t k=0; k<(uint32_t)(seconds*1e6f)/hf::SimBoard::STEP_MICRO; ++k) {
+        board.advance(hf::SimBoard::STEP_MICRO);
+        uint32_t usec = (uint32_t)board.getMicros();
+        altitude.predict(accelZ, usec, armed);
+        if (k % 80 == 0)
+            altitude.correctBaro(baro);
+    }
+}
+
+// The datasheet's example coefficients (C1 through C6), whose CRC is zero, and raw readings
+static const uint16_t PROM[hf::MS5611::PROM_WORDS] = {0, 40127, 36924, 23317, 23282, 33464, 28312, 0};
+static const uint32_t D1 = 9085466;
+static const uint32_t D2 = 8569150;
+
+// An MS5611 whose results are ready CONVERSION_MICRO after each command
+class BaroBoard : public hf::SimBoard {
+
+    public:
+
+        int  reads = 0;
+        bool temperature = false;
+
+        virtual bool     baroInit(void) override { return hf::MS5611::promValid(PROM); }
+
+        virtual uint32_t baroStartConversion(bool _temperature) override
+        {
+            temperature = _temperature;
+            return hf::MS5611::CONVERSION_MICRO;
+        }
+
+        virtual uint32_t baroReadConversion(void) override
+        {
+            reads++;
+            return temperature ? D2 : D1;
+        }
+
+        virtual int32_t  baroCompensate(uint32_t rawTemperature, uint32_t rawPressure) override
+        {
+            return hf::MS5611::compensate(PROM, rawTemperature, rawPressure);
+        }
+};
+
+static void testBaro(void)
+{
+    // Application note AN520's example, whose CRC is 0xB
+    uint16_t an520[hf::MS5611::PROM_WORDS] = {0x3132, 0x3334, 0x3536, 0x3738, 0x3940, 0x4142, 0x4344, 0x450B};
+    check(hf::MS5611::promValid(an520), "MS5611 PROM CRC", an520[7] & 0x0F);
+    an520[3] ^= 1;
+    check(!hf::MS5611::promValid(an520), "MS5611 PROM CRC, one bit off", an520[7] & 0x0F);
+    uint16_t absent[hf::MS5611::PROM_WORDS] = {0};
+    check(!hf::MS5611::promValid(absent), "MS5611 PROM, all zeros", 0);
+
+    int32_t pressure = hf::MS5611::compensate(PROM, D2, D1);
+    check(pressure == 100009, "MS5611 pressure, datasheet example (Pa)", (float)pressure);
+
+    BaroBoard board;
+    hf::Baro baro;
+    baro.init(&board);
+    check(baro.available(), "Baro available", 0);
+
+    // Polled every 500 usec: nothing is read before its conversion is done, and a pressure comes
+    // after one temperature and one pressure conversion
+    int pressures = 0;
+    for (uint32_t k=0; k<200; ++k) {
+        board.advance(500);
+        if (baro.update()) {
+            pressures++;
+        }
+    }
+    uint32_t conversions = 200 * 500 / hf::MS5611::CONVERSION_MICRO;
+    check(board.reads <= (int)conversions, "Baro reads in 100 msec, at most", (float)board.reads);
+    check(pressures >= 5, "Baro pressures in 100 msec, at least", (float)pressures);
+    check(abs(baro.getAltitude() - 11014) <= 8, "Baro altitude at 1000.09 mbar (cm)", (float)baro.getAltitude());
+}
+
+// Sonars timed by SonarEcho, as a board's interrupts would time them; the test plays the interrupts
+class SonarBoard : public hf::SimBoard {
+
+    public:
+
+        hf::SonarEcho echoes[hf::CONFIG_SONAR_COUNT];
+        int  triggers = 0;
+        uint8_t lastMask = 0;
+
+        virtual bool sonarInit(uint8_t index) override { (void)index; return true; }
+
+        virtual void sonarTrigger(uint8_t mask) override
+        {
+            triggers++;
+            lastMask = mask;
+            for (uint8_t k=0; k<hf::CONFIG_SONAR_COUNT; ++k) {
+                if (mask & (1<<k)) {
+                    echoes[k].start();
+                }
+            }
+        }
+
+        virtual bool sonarGetEcho(uint8_t index, uint32_t & echoMicro) override
+        {
+            return echoes[index].get(echoMicro);
+        }
+};
+
+static void testSonars(void)
+{
+    SonarBoard board;
+    hf::Sonars sonars;
+    sonars.init(&board);
+    check(sonars.available(), "Sonars available", 0);
+
+    // The first update pings the group
+    sonars.update();
+    check(board.triggers == 1 && board.lastMask == hf::CONFIG_SONAR_GROUPS[0], "Sonars ping the first group",
+            board.lastMask);
+
+    // The bottom sonar hears a wall 100 cm away; the others hear nothing
+    uint32_t ping = (uint32_t)board.getMicros();
+    board.echoes[1].edge(true,  ping + 500);
+    board.echoes[1].edge(false, ping + 500 + 100*58);
+
+    // Nothing is published until the rest have had their time
+    bool published = false;
+    uint32_t publishedAfter = 0;
+    while (!published && (uint32_t)board.getMicros() - ping < 2*hf::CONFIG_SONAR_TIMEOUT_MICRO) {
+        board.advance(1000);
+        published = sonars.update();
+        publishedAfter = (uint32_t)board.getMicros() - ping;
+    }
+    check(published && publishedAfter >= hf::CONFIG_SONAR_TIMEOUT_MICRO, "Sonars publish after the timeout (usec)",
+            (float)publishedAfter);
+    check(sonars.getAltitude() == 100, "Sonars altitude (cm)", sonars.getAltitude());
+    check(sonars.getAltitudeTime() == ping, "Sonars altitude time is the ping's", 0);
+    check(sonars.getSnapshot().distances[0] == 0, "Sonars with no echo read zero", sonars.getSnapshot().distances[0]);
+    check(board.triggers == 2, "Sonars ping the next group at once", (float)board.triggers);
+}
+
+int main(int argc, char ** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    hf::SimBoard board;
+
+    hf::AltitudeConfig config;
+
+    hf::AltitudeEstimator altitude;
+    altitude.init(config);
+
+    // On the ground, the baro's reading is zero
+    run(board, altitude, 5, 0, GROUND, false);
+    check(altitude.getAltitude() == 0, "disarmed altitude (cm)", altitude.getAltitude());
+
+    // Climb to 1.5 m by the baro: ten time constants later, the estimate is there and still
+    run(board, altitude, 20, 0, GROUND + 150, true);
+    check(fabsf(altitude.getAltitude() - 150) < 5, "altitude after a baro step to 150 (cm)", altitude.getAltitude());
+    check(fabsf(altitude.getVelocity()) < 5, "velocity after a baro step (cm/sec)", altitude.getVelocity());
+
+    // A biased accel is learned, rather than integrated into a climb
+    run(board, altitude, 30, 20, GROUND + 150, true);
+    check(fabsf(altitude.getAltitude() - 150) < 5, "altitude with 20 cm/sec/sec of accel bias (cm)",
+            altitude.getAltitude());
+
+    // Hover holds from the same estimate
+    hf::RC rc;
+    hf::Hover hover;
+    hover.init(&board, config, &altitude, &rc);
+    hover.updateAltitudePid();
+    check(fabsf(hover.estAlt - altitude.getAltitude()) < 1, "Hover's altitude (cm)", (float)hover.estAlt);
+
+    testBaro();
+    testSonars();
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,99 @@
+/*
+   fastmath.cpp : Test code for the FastMath approximations, against libm
+
+   Sweeps each function over its range and exits nonzero, saying which one, if the worst error is past the
+   bound documented in fastmath.hpp (and, for the baro altitude table, in baro.hpp).
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <stdio.h>
+
+#include "config.hpp"
+#include "fastmath.hpp"
+
+static const int STEPS = 200000;
+
+static int failures;
+
+static void check(const char * what, double worst, double bound)
+{
+    bool ok = worst <= bound;
+    printf("%s: %-34s worst %.3g, bound %.3g\n", ok ? "ok  " : "FAIL", what, worst, bound);
+    if (!ok)
+        failures++;
+}
+
+static double worse(double worst, double error)
+{
+    error = fabs(error);
+    return error > worst ? error : worst;
+}
+
+// As Baro::pressureToAltitude(), in cm from Pa
+static float altitude(float pressure)
+{
+    return (1.0f - powf(pressure / 101325.0f, 0.190295f)) * 4433000.0f;
+}
+
+int main(int argc, char ** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    double worstSin = 0, worstCos = 0;
+    for (int k=0; k<=STEPS; ++k) {
+        float x = -2*M_PI + 4*M_PI * k / STEPS;
+        worstSin = worse(worstSin, hf::FastMath::sin(x) - sin((double)x));
+        worstCos = worse(worstCos, hf::FastMath::cos(x) - cos((double)x));
+    }
+    check("sin, |x| <= 2pi", worstSin, 4e-6);
+    check("cos, |x| <= 2pi", worstCos, 4e-6);
+
+    // Around the circle, and at a few radii
+    double worstAtan2 = 0;
+    const float radii[] = {1e-3f, 1, 1e3f};
+    for (float r : radii) {
+        for (int k=0; k<=STEPS; ++k) {
+            double a = -M_PI + 2*M_PI * k / STEPS;
+            float y = r * sin(a), x = r * cos(a);
+            worstAtan2 = worse(worstAtan2, hf::FastMath::atan2(y, x) - atan2((double)y, (double)x));
+        }
+    }
+    check("atan2", worstAtan2, 1.2e-5);
+
+    double worstAsin = 0;
+    for (int k=0; k<=STEPS; ++k) {
+        float x = -1 + 2.0f * k / STEPS;
+        worstAsin = worse(worstAsin, hf::FastMath::asin(x) - asin((double)x));
+    }
+    check("asin", worstAsin, 1.3e-5);
+
+    // The baro's table, built as Baro::init() builds it
+    static hf::InterpolationTable<hf::CONFIG_BARO_TABLE_SIZE> table;
+    table.init(altitude, hf::CONFIG_BARO_TABLE_MIN_PA, hf::CONFIG_BARO_TABLE_MAX_PA);
+    double worstAltitude = 0, worstLowAltitude = 0;
+    for (int k=0; k<=STEPS; ++k) {
+        float p = hf::CONFIG_BARO_TABLE_MIN_PA + (hf::CONFIG_BARO_TABLE_MAX_PA - hf::CONFIG_BARO_TABLE_MIN_PA) * k / STEPS;
+        double error = table.get(p) - (1 - pow(p / 101325.0, 0.190295)) * 4433000.0;
+        worstAltitude = worse(worstAltitude, error);
+        if (p >= 90000)
+            worstLowAltitude = worse(worstLowAltitude, error);
+    }
+    check("baro altitude (cm)", worstAltitude, 8);
+    check("baro altitude above 900 hPa (cm)", worstLowAltitude, 2);
+
+    return failures ? 1 : 0;
+}
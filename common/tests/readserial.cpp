@@ -32,15 +32,22 @@ int main(int argc, char ** argv)
 
     SerialConnection s(argv[1], atoi(argv[2]));
 
-    s.openConnection();
+    if (!s.openConnection())
+        exit(1);
+
+    s.setLowLatency();
 
     while (true) {
 
-        while (s.bytesAvailable()) {
-            char c;
-            s.readBytes(&c, 1);
-            printf("%c\n", c);
-        }
+        // Sleeps until bytes arrive
+        char buf[256];
+        int count = s.readSome(buf, sizeof(buf), 1000000);
+
+        if (count < 0)
+            break;
+
+        for (int k=0; k<count; ++k)
+            printf("%c\n", buf[k]);
     }
 
     s.closeConnection();
@@ -0,0 +1,105 @@
+/*
+   scheduler.cpp : Test code for the Scheduler class, run against the headless simulator's board
+
+   Exits nonzero, saying which check failed, if the scheduler doesn't behave.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "scheduler.hpp"
+#include "simboard.hpp"
+
+static int runs[2];
+
+static void task0(void * context) { (void)context; runs[0]++; }
+static void task1(void * context) { (void)context; runs[1]++; }
+
+static int failures;
+
+static void check(bool ok, const char * what)
+{
+    printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok)
+        failures++;
+}
+
+// Runs the scheduler once per simulator step until the task has run, or the steps run out
+static int stepsUntilRun(hf::SimBoard & board, hf::Scheduler & scheduler, int task, int steps)
+{
+    for (int k=1; k<=steps; ++k) {
+        board.advance(hf::SimBoard::STEP_MICRO);
+        scheduler.run(&board);
+        if (runs[task])
+            return k;
+    }
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    hf::Profiler profiler;
+    profiler.init();
+
+    // A disabled realtime task (the IMU's during startup) is overdue, but holds nothing up
+    {
+        hf::SimBoard board;
+        hf::Scheduler scheduler;
+        scheduler.init(&board, &profiler);
+        uint8_t rt = scheduler.add(task0, NULL, 1000, hf::SCHEDULER_PRIORITY_REALTIME);
+        scheduler.add(task1, NULL, 1000, hf::SCHEDULER_PRIORITY_HIGH);
+        scheduler.setEnabled(rt, false);
+        runs[0] = runs[1] = 0;
+        board.advance(2000);
+
+        check(stepsUntilRun(board, scheduler, 1, 100) == 1, "disabled realtime task defers nothing");
+        check(runs[0] == 0, "disabled realtime task doesn't run");
+    }
+
+    // An enabled, overdue one goes first
+    {
+        hf::SimBoard board;
+        hf::Scheduler scheduler;
+        scheduler.init(&board, &profiler);
+        scheduler.add(task0, NULL, 1000, hf::SCHEDULER_PRIORITY_REALTIME);
+        scheduler.add(task1, NULL, 1000, hf::SCHEDULER_PRIORITY_HIGH);
+        runs[0] = runs[1] = 0;
+        board.advance(2000);
+
+        check(stepsUntilRun(board, scheduler, 0, 1) == 1 && runs[1] == 0, "overdue realtime task runs first");
+    }
+
+    // Past CONFIG_SCHEDULER_TASKS, add() refuses, and the other methods ignore what it returned
+    {
+        hf::SimBoard board;
+        hf::Scheduler scheduler;
+        scheduler.init(&board, &profiler);
+        bool added = true;
+        for (uint8_t k=0; k<hf::CONFIG_SCHEDULER_TASKS; ++k)
+            added = added && scheduler.add(task0, NULL, 1000, hf::SCHEDULER_PRIORITY_LOW) == k;
+        uint8_t extra = scheduler.add(task1, NULL, 1000, hf::SCHEDULER_PRIORITY_LOW);
+        scheduler.setEnabled(extra, false);
+        scheduler.setPeriod(extra, 500);
+
+        check(added, "every slot can be filled");
+        check(extra == hf::SCHEDULER_NO_TASK, "a task past the last slot is refused");
+    }
+
+    return failures ? 1 : 0;
+}
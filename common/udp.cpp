@@ -0,0 +1,199 @@
+/*
+   udp.cpp: Implementation of UdpLink
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "udp.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+UdpLink::UdpLink(int _port)
+{
+    this->port = _port;
+    this->sockfd = -1;
+    this->peerCount = 0;
+    this->recvCount = 0;
+    this->multicast = false;
+}
+
+bool UdpLink::openLink(void)
+{
+    if ((this->sockfd = socket(AF_INET, SOCK_DGRAM, 0)) == -1) {
+        perror("socket()");
+        return false;
+    }
+
+    // Several ground stations on one host can watch the same group
+    int option = 1;
+    setsockopt(this->sockfd, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
+
+    struct sockaddr_in sn;
+    memset(&sn, 0, sizeof(sn));
+    sn.sin_family = AF_INET;
+    sn.sin_port = htons((short)this->port);
+    sn.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if (bind(this->sockfd, (struct sockaddr *)&sn, sizeof(sn)) == -1) {
+        perror("bind()");
+        closeLink();
+        return false;
+    }
+
+    fcntl(this->sockfd, F_SETFL, fcntl(this->sockfd, F_GETFL, 0) | O_NONBLOCK);
+
+    return true;
+}
+
+bool UdpLink::lookup(const char * hostname, int _port, struct sockaddr_in & addr)
+{
+    struct hostent * he = gethostbyname(hostname);
+
+    if (!he) {
+        printf("can't get host id for %s\n", hostname);
+        return false;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((short)_port);
+    memcpy(&addr.sin_addr, he->h_addr_list[0], sizeof(addr.sin_addr));
+
+    return true;
+}
+
+bool UdpLink::connectTo(const char * hostname, int _port)
+{
+    struct sockaddr_in addr;
+
+    if (!lookup(hostname, _port, addr)) {
+        return false;
+    }
+
+    addPeer(addr);
+
+    return true;
+}
+
+bool UdpLink::multicastTo(const char * groupname, int _port, int ttl)
+{
+    if (!lookup(groupname, _port, this->group)) {
+        return false;
+    }
+
+    unsigned char t = (unsigned char)ttl;
+    if (setsockopt(this->sockfd, IPPROTO_IP, IP_MULTICAST_TTL, &t, sizeof(t)) == -1) {
+        perror("setsockopt(IP_MULTICAST_TTL)");
+        return false;
+    }
+
+    this->multicast = true;
+
+    return true;
+}
+
+bool UdpLink::joinGroup(const char * groupname)
+{
+    struct ip_mreq mreq;
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+
+    if (inet_pton(AF_INET, groupname, &mreq.imr_multiaddr) != 1) {
+        printf("%s is not a multicast group\n", groupname);
+        return false;
+    }
+
+    if (setsockopt(this->sockfd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == -1) {
+        perror("setsockopt(IP_ADD_MEMBERSHIP)");
+        return false;
+    }
+
+    return true;
+}
+
+void UdpLink::addPeer(const struct sockaddr_in & addr)
+{
+    int k = 0;
+
+    for (; k<this->peerCount; ++k) {
+        if (this->peers[k].sin_addr.s_addr == addr.sin_addr.s_addr && this->peers[k].sin_port == addr.sin_port) {
+            break;
+        }
+    }
+
+    // New, and full: replace the quietest
+    if (k == MAX_PEERS) {
+        k = 0;
+        for (int j=1; j<MAX_PEERS; ++j) {
+            if (this->heard[j] < this->heard[k]) {
+                k = j;
+            }
+        }
+    }
+
+    if (k == this->peerCount) {
+        this->peerCount++;
+        printf("UDP peer %d is %s:%d\n", this->peerCount, inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+    }
+
+    this->peers[k] = addr;
+    this->heard[k] = ++this->recvCount;
+}
+
+int UdpLink::recvSome(char * buf, int count)
+{
+    struct sockaddr_in from;
+    socklen_t fromlen = sizeof(from);
+
+    ssize_t n = recvfrom(this->sockfd, buf, count, MSG_DONTWAIT, (struct sockaddr *)&from, &fromlen);
+
+    // A datagram too big for the buffer is cut short; MSP will find the frame it ends in doesn't check out
+    if (n <= 0) {
+        return 0;
+    }
+
+    addPeer(from);
+
+    return (int)n;
+}
+
+void UdpLink::send(const char * buf, int count)
+{
+    // A full socket buffer drops the datagram, as the network might have
+    for (int k=0; k<this->peerCount; ++k) {
+        sendto(this->sockfd, buf, count, MSG_DONTWAIT, (struct sockaddr *)&this->peers[k], sizeof(this->peers[k]));
+    }
+
+    if (this->multicast) {
+        sendto(this->sockfd, buf, count, MSG_DONTWAIT, (struct sockaddr *)&this->group, sizeof(this->group));
+    }
+}
+
+void UdpLink::closeLink(void)
+{
+    if (this->sockfd >= 0) {
+        close(this->sockfd);
+    }
+
+    this->sockfd = -1;
+    this->peerCount = 0;
+    this->multicast = false;
+}
@@ -0,0 +1,74 @@
+/*
+   udp.hpp: class declaration for UdpLink, MSP over UDP for ground stations and the simulator
+
+   Each datagram carries one burst of whole MSP frames (see datagramport.hpp on the firmware side), so a
+   lost or late one costs only its own frames, and never holds up the ones after it as a TCP stream would.
+   Either end can serve: whoever sends it a datagram becomes one of its peers, and gets everything it
+   sends from then on.  Telemetry can also go to a multicast group, for any number of ground stations.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <netinet/in.h>
+
+class UdpLink {
+
+    public:
+
+        static const int MAX_PEERS = 8;
+
+        // Port to listen on; zero for any free one, as a client would
+        UdpLink(int port = 0);
+
+        bool openLink(void);
+
+        // Adds a peer by name, as a ground station does its board
+        bool connectTo(const char * hostname, int port);
+
+        // Also sends to this group (e.g. "239.255.72.70") and port; ttl 1 keeps it on the local network
+        bool multicastTo(const char * group, int port, int ttl = 1);
+
+        // Takes what's sent to this group on our port, as a ground station that only watches
+        bool joinGroup(const char * group);
+
+        // The next datagram, without waiting; zero if there is none.  A new sender becomes a peer, in place
+        // of the one heard from least recently if there's no room.
+        int recvSome(char * buf, int count);
+
+        // One datagram to every peer and the multicast group
+        void send(const char * buf, int count);
+
+        int getFd(void) { return this->sockfd; }
+        int getPeerCount(void) { return this->peerCount; }
+
+        void closeLink(void);
+
+    private:
+
+        int port;
+        int sockfd;
+
+        struct sockaddr_in peers[MAX_PEERS];
+        unsigned           heard[MAX_PEERS];
+        int                peerCount;
+        unsigned           recvCount;
+
+        struct sockaddr_in group;
+        bool               multicast;
+
+        bool lookup(const char * hostname, int port, struct sockaddr_in & addr);
+        void addPeer(const struct sockaddr_in & addr);
+};
@@ -42,11 +42,11 @@ void loop(void)
     short y = rx.readRawRC(0); // yaw
     short a = rx.readRawRC(5); // aux
 
-    MSP_Message msg = MSP_Parser::serialize_RC(r, p, t, y, a, 0, 0, 0);
+    byte buf[32];
 
-    for (byte b=msg.start(); msg.hasNext(); b=msg.getNext()) {
-        Serial.write(b);
-    }
+    size_t len = MSP_Parser::serialize_RC_into(buf, sizeof(buf), r, p, t, y, a, 0, 0, 0);
+
+    Serial.write(buf, len);
 }
 
 
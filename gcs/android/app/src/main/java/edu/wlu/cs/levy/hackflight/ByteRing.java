@@ -0,0 +1,65 @@
+/*
+   ByteRing.java : lock-free byte queue from one producer thread to one consumer thread
+
+   Copyright (C) 2017 Simon D. Levy
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+package edu.wlu.cs.levy.hackflight;
+
+// The indices run free and are masked only to index the buffer, so that full and empty differ without
+// a spare slot; each is written by one thread only, and being volatile, publishes the bytes before it.
+class ByteRing {
+
+    private final byte [] buffer;
+    private final int mask;
+
+    private volatile int head;      // written by the producer
+    private volatile int tail;      // written by the consumer
+
+    ByteRing(int capacityLog2) {
+
+        buffer = new byte[1 << capacityLog2];
+        mask = buffer.length - 1;
+    }
+
+    // Producer: queues as much of data as fits; the parser resynchronizes on the next frame after a loss
+    void write(byte [] data) {
+
+        int h = head;
+        int count = Math.min(data.length, buffer.length - (h - tail));
+
+        int first = Math.min(count, buffer.length - (h & mask));
+        System.arraycopy(data, 0, buffer, h & mask, first);
+        System.arraycopy(data, first, buffer, 0, count - first);
+
+        head = h + count;
+    }
+
+    // Consumer: takes up to out.length bytes; returns how many
+    int read(byte [] out) {
+
+        int t = tail;
+        int count = Math.min(out.length, head - t);
+
+        int first = Math.min(count, buffer.length - (t & mask));
+        System.arraycopy(buffer, t & mask, out, 0, first);
+        System.arraycopy(buffer, 0, out, first, count - first);
+
+        tail = t + count;
+
+        return count;
+    }
+}
@@ -31,22 +31,21 @@ import android.widget.Toast;
 import android.content.BroadcastReceiver;
 import android.content.ComponentName;
 import android.os.IBinder;
-import android.os.Handler;
-import android.os.Message;
+import android.view.Choreographer;
 
 import java.util.Set;
 
-import edu.wlu.cs.msppg.ATTITUDE_Handler;
-import edu.wlu.cs.msppg.Parser;
-
-public class MainActivity extends AppCompatActivity {
+public class MainActivity extends AppCompatActivity implements Choreographer.FrameCallback {
 
     private static UsbService usbService;
 
-    private MyHandler mHandler;
+    private TelemetryWorker mWorker;
 
     private TextView mAttitudeText;
 
+    // Update count of the attitude on display
+    private int mAttitudeShown = -1;
+
     @Override
     protected void onCreate(Bundle savedInstanceState) {
 
@@ -55,9 +54,10 @@ public class MainActivity extends AppCompatActivity {
 
         mAttitudeText = (TextView)findViewById(R.id.attitude_Text);
 
-        startService(UsbService.class, usbConnection, null);        //starts the usb service
+        mWorker = new TelemetryWorker();
+        mWorker.start();
 
-        mHandler = new MyHandler(this);
+        startService(UsbService.class, usbConnection, null);        //starts the usb service
     }
 
     @Override
@@ -65,6 +65,38 @@ public class MainActivity extends AppCompatActivity {
         super.onResume();
         setFilters();  // Start listening notifications from UsbService
         startService(UsbService.class, usbConnection, null); // Start UsbService(if it was not started before) and Bind it
+        Choreographer.getInstance().postFrameCallback(this);
+    }
+
+    @Override
+    public void onPause() {
+        super.onPause();
+        Choreographer.getInstance().removeFrameCallback(this);
+    }
+
+    @Override
+    protected void onDestroy() {
+        super.onDestroy();
+        if (usbService != null) {
+            usbService.setWorker(null);
+        }
+        mWorker.quit();
+    }
+
+    // Once per display refresh, however fast the attitude comes in, and only when it has changed
+    @Override
+    public void doFrame(long frameTimeNanos) {
+
+        long attitude = mWorker.getAttitude();
+
+        int count = TelemetryWorker.updateCount(attitude);
+
+        if (count != mAttitudeShown) {
+            setAttitudeText(TelemetryWorker.roll(attitude), TelemetryWorker.pitch(attitude), TelemetryWorker.yaw(attitude));
+            mAttitudeShown = count;
+        }
+
+        Choreographer.getInstance().postFrameCallback(this);
     }
 
     public void setAttitudeText(int roll, int pitch, int yaw) {
@@ -132,76 +164,18 @@ public class MainActivity extends AppCompatActivity {
         public void onServiceConnected(ComponentName arg0, IBinder arg1)
         {
             usbService = ((UsbService.UsbBinder) arg1).getService();
-            usbService.setHandler(mHandler);
+            usbService.setWorker(mWorker);
+            mWorker.setUsbService(usbService);
 
             // When the connection is made, send the flight controller a request for ATTITUDE messages
-            sendAttitudeRequest();
+            mWorker.requestAttitude();
         }
 
         @Override
         public void onServiceDisconnected(ComponentName arg0)
         {
+            mWorker.setUsbService(null);
             usbService = null;
         }
     };
-
-
-    public static class MyHandler extends Handler  implements ATTITUDE_Handler {
-
-        private MainActivity mMainActivity;
-
-        private Parser parser;
-
-        public static Short[] orientation;
-        private static byte[] attitude_request;
-
-
-        public MyHandler(MainActivity activity) {
-            mMainActivity = activity;
-            parser    = new Parser();
-            parser.set_ATTITUDE_Handler(this);
-
-            orientation = new Short[] {0,0,0};
-            attitude_request = parser.serialize_ATTITUDE_Request();
-        }
-
-        //Sends the request so long as a usb is plugged in
-        public static void sendRequest(byte[] request){
-            if (usbService != null){
-                usbService.write(request);
-            }
-        }
-
-
-        public void handle_ATTITUDE(short roll, short pitch, short yaw) {
-
-            //rollText.setText(String.format("Roll: %d", roll))
-
-            mMainActivity.setAttitudeText(roll, pitch, yaw);
-
-            sendAttitudeRequest();  //sends a request to continue the call and response.
-        }
-
-
-        @Override
-        public void handleMessage(Message msg) {
-
-            switch(msg.what)
-            {
-                case UsbService.MESSAGE_FROM_SERIAL_PORT:
-
-                    byte [] data = (byte []) msg.obj;
-                    for (byte b : data) {
-                        parser.parse(b);
-                    }
-                    break;
-            }
-        }
-    }
-
-    //Sends an attitude request if the current tab allows for it.
-    public static void sendAttitudeRequest(){
-
-        MyHandler.sendRequest(MyHandler.attitude_request);
-    }
-}
\ No newline at end of file
+}
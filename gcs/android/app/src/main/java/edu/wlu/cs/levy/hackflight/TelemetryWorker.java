@@ -0,0 +1,140 @@
+/*
+   TelemetryWorker.java : MSP parsing off the UI thread for Android version of Hackflight GCS
+
+   Copyright (C) 2017 Simon D. Levy
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+package edu.wlu.cs.levy.hackflight;
+
+import java.util.concurrent.atomic.AtomicLong;
+import java.util.concurrent.locks.LockSupport;
+
+import edu.wlu.cs.msppg.ATTITUDE_Handler;
+import edu.wlu.cs.msppg.Parser;
+
+// The USB read thread queues what it gets and goes straight back for more; this thread takes the bytes
+// in blocks and parses them, and keeps only the latest attitude, which the UI picks up once a frame.
+class TelemetryWorker extends Thread implements ATTITUDE_Handler {
+
+    // Over a second of a 115200-baud link, so a stalled worker loses nothing short of a real hang
+    private static final int RING_SIZE_LOG2 = 14;
+
+    private static final int CHUNK_SIZE = 512;
+
+    private final ByteRing ring = new ByteRing(RING_SIZE_LOG2);
+    private final byte [] chunk = new byte[CHUNK_SIZE];
+
+    private final Parser parser = new Parser();
+    private final byte [] attitudeRequest;
+
+    private volatile UsbService usbService;
+    private volatile boolean running = true;
+
+    // Roll, pitch and yaw in the low 48 bits and a count of updates in the top 16, so that the UI gets
+    // all three from one read, and can tell whether they are new, without a lock
+    private final AtomicLong attitude = new AtomicLong();
+
+    TelemetryWorker() {
+
+        super("TelemetryWorker");
+
+        parser.set_ATTITUDE_Handler(this);
+
+        attitudeRequest = parser.serialize_ATTITUDE_Request();
+    }
+
+    void setUsbService(UsbService service) {
+
+        usbService = service;
+    }
+
+    // Called on the USB read thread
+    void onReceivedData(byte [] data) {
+
+        ring.write(data);
+
+        LockSupport.unpark(this);
+    }
+
+    @Override
+    public void run() {
+
+        while (running) {
+
+            int count = ring.read(chunk);
+
+            if (count > 0) {
+                parser.parse(chunk, 0, count);
+            }
+
+            // An unpark() since the read leaves a permit, so no bytes wait for the next ones
+            else {
+                LockSupport.park(this);
+            }
+        }
+    }
+
+    void quit() {
+
+        running = false;
+
+        LockSupport.unpark(this);
+    }
+
+    void requestAttitude() {
+
+        UsbService service = usbService;
+
+        if (service != null) {
+            service.write(attitudeRequest);
+        }
+    }
+
+    long getAttitude() {
+
+        return attitude.get();
+    }
+
+    static int updateCount(long packed) {
+
+        return (int)(packed >>> 48);
+    }
+
+    static short roll(long packed) {
+
+        return (short)packed;
+    }
+
+    static short pitch(long packed) {
+
+        return (short)(packed >>> 16);
+    }
+
+    static short yaw(long packed) {
+
+        return (short)(packed >>> 32);
+    }
+
+    public void handle_ATTITUDE(short roll, short pitch, short yaw) {
+
+        long count = (updateCount(attitude.get()) + 1) & 0xFFFF;
+
+        attitude.set(count << 48 | ((long)yaw & 0xFFFF) << 32 | ((long)pitch & 0xFFFF) << 16 | ((long)roll & 0xFFFF));
+
+        // Keep the call and response going
+        requestAttitude();
+    }
+}
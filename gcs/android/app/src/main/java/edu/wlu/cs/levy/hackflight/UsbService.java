@@ -25,7 +25,6 @@ import android.hardware.usb.UsbDevice;
 import android.hardware.usb.UsbDeviceConnection;
 import android.hardware.usb.UsbManager;
 import android.os.Binder;
-import android.os.Handler;
 import android.os.IBinder;
 import android.util.Log;
 
@@ -44,14 +43,13 @@ public class UsbService extends Service
     public static final String ACTION_USB_DEVICE_NOT_WORKING = "com.felhr.connectivityservices.ACTION_USB_DEVICE_NOT_WORKING";
 
     private static final int BAUD_RATE = 115200; // XXX we tried to set this with a method but failed :^(
-    public static final int MESSAGE_FROM_SERIAL_PORT = 0;
 
     public static boolean SERVICE_CONNECTED = false;
 
     private IBinder binder = new UsbBinder();
 
     private Context context;
-    private Handler mHandler;
+    private volatile TelemetryWorker worker;
     private UsbManager usbManager;
     private UsbDevice device;
     private UsbDeviceConnection connection;
@@ -106,9 +104,9 @@ public class UsbService extends Service
         }
     }
 
-    public void setHandler(Handler mHandler)
+    public void setWorker(TelemetryWorker worker)
     {
-        this.mHandler = mHandler;
+        this.worker = worker;
     }
 
 
@@ -171,17 +169,18 @@ public class UsbService extends Service
     }
 
     /*
-     *  Data received from serial port will be received here. Just populate onReceivedData with your code
-     *  In this particular example. byte stream is converted to String and send to UI thread to
-     *  be treated there.
+     *  Data received from serial port will be received here, on the USB read thread.  It goes straight
+     *  to the telemetry worker's queue, rather than through a Handler to the UI thread, so that parsing
+     *  never waits on the UI and vice versa.
      */
     private UsbSerialInterface.UsbReadCallback mCallback = new UsbSerialInterface.UsbReadCallback()
     {
         @Override
         public void onReceivedData(byte[] buffer)
         {
-            if(mHandler != null) {
-                mHandler.obtainMessage(MESSAGE_FROM_SERIAL_PORT, buffer).sendToTarget();
+            TelemetryWorker w = worker;
+            if(w != null) {
+                w.onReceivedData(buffer);
             }
         }
     };
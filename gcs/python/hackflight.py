@@ -31,6 +31,15 @@ CONNECTION_DELAY_MSEC = 1000
 
 USB_UPDATE_MSEC = 200
 
+# Telemetry pushed by the firmware (MSP SET_STREAM), Hz; the state vector carries the attitude, and at
+# 36 bytes a frame fits a 115200-baud link three times over at the MSP task's 100 Hz
+STATE_STREAM_HZ = 100
+RC_STREAM_HZ    = 20
+
+# These should agree with messages.json
+STATE_ID = 114
+RC_ID    = 105
+
 # These should agree with the values in firmware Config.PwmConfg
 PWM_MIN = 1000
 PWM_MAX = 2000
@@ -126,12 +135,9 @@ class GCS:
         # Create a message parser 
         self.parser = MSP_Parser()
 
-        # Set up parser's request strings
-        self.attitude_request = serialize_ATTITUDE_Request()
-        self.rc_request = serialize_RC_Request()
-
         # No messages yet
         self.roll_pitch_yaw = 0,0,0
+        self.state = None
         self.rxchannels = 0,0,0,0,0
 
         # A hack to support display in IMU dialog
@@ -201,27 +207,23 @@ class GCS:
         #self.messages.stop()
         #self.maps.stop()
 
-        self.parser.set_ATTITUDE_Handler(self._handle_attitude)
-        self._send_attitude_request()
+        self.parser.set_STATE_Handler(self._handle_state)
+        self._stream(STATE_STREAM_HZ, 0)
         self.imu.start()
 
     def _start(self):
 
-        self.parser.set_ATTITUDE_Handler(self._handle_attitude)
-        self._send_attitude_request()
+        self.parser.set_STATE_Handler(self._handle_state)
+        self._stream(STATE_STREAM_HZ, 0)
         self.imu.start()
 
         self.parser.set_RC_Handler(self._handle_rc)
 
-    # Sends Attitude request to FC
-    def _send_attitude_request(self):
+    # Asks FC to push state and RC messages at the given rates; zero stops a message
+    def _stream(self, state_hz, rc_hz):
 
-        self.comms.send_request(self.attitude_request)
-
-    # Sends RC request to FC
-    def _send_rc_request(self):
-
-        self.comms.send_request(self.rc_request)
+        self.comms.send_message(serialize_SET_STREAM, (STATE_ID, state_hz))
+        self.comms.send_message(serialize_SET_STREAM, (RC_ID, rc_hz))
 
     # Callback for Motors button
     def _motors_button_callback(self):
@@ -232,6 +234,7 @@ class GCS:
         self.receiver.stop()
         #self.messages.stop()
         #self.maps.stop()
+        self._stream(0, 0)
         self.motors.start()
 
     def _clear(self):
@@ -248,7 +251,7 @@ class GCS:
         #self.messages.stop()
         #self.maps.stop()
 
-        self._send_rc_request()
+        self._stream(0, RC_STREAM_HZ)
         self.receiver.start()
 
     # Callback for Messages button
@@ -399,7 +402,8 @@ class GCS:
 
         values = [PWM_MIN]*4
         values[index-1] += int(percent/100. * (PWM_MAX-PWM_MIN))
-        self.comms.send_message(serialize_SET_MOTOR, values)
+        # Unsequenced (zero): each gets its own reply
+        self.comms.send_message(serialize_SET_MOTOR, values + [0])
 
     def _show_splash(self):
 
@@ -439,20 +443,22 @@ class GCS:
 
         self.roll_pitch_yaw = x, -y, z  
 
-        #self.messages.setCurrentMessage('Roll/Pitch/Yaw: %+3.3f %+3.3f %+3.3f' % self.roll_pitch_yaw)
+    def _handle_state(self, time, roll, pitch, yaw, gyroX, gyroY, gyroZ, pidRoll, pidPitch, pidYaw, 
+            m1, m2, m3, m4, loopExec, loopLate):
 
-        # As soon as we handle the callback from one request, send another request, if IMU dialog is running
-        if self.imu.running:
-            self._send_attitude_request()
+        # Angles come in tenths of a degree
+        self._handle_attitude(roll / 10., pitch / 10., yaw / 10.)
+
+        # The whole sample, for anything that wants to plot or log it
+        self.state = (time, (gyroX, gyroY, gyroZ), (pidRoll, pidPitch, pidYaw), 
+                tuple(1000 + 4*m for m in (m1, m2, m3, m4)), loopExec, loopLate)
+
+        #self.messages.setCurrentMessage('Roll/Pitch/Yaw: %+3.3f %+3.3f %+3.3f' % self.roll_pitch_yaw)
 
     def _handle_rc(self, c1, c2, c3, c4, c5, c6, c7, c8):
 
         self.rxchannels = c1, c2, c3, c4, c5
 
-        # As soon as we handle the callback from one request, send another request, if receiver dialog is running
-        if self.receiver.running:
-            self._send_rc_request()
-
         #self.messages.setCurrentMessage('Receiver: %04d %04d %04d %04d %04d' % (c1, c2, c3, c4, c5))
 
     def _handle_arm_status(self, armed):
@@ -487,20 +493,21 @@ class Comms:
 
     def send_message(self, serializer, contents):
 
-        for c in serializer(*contents):
-
-            self.port.write(c)
+        self.port.write(serializer(*contents))
 
     def send_request(self, request):
 
         self.port.write(request)
 
+    # Reader thread: takes whatever has come in, in one go, and parses it (in C++ if msppg's native module
+    # was built).  The handlers replace the GCS's latest-state tuples whole, and the dialogs draw from
+    # those at their own frame rates, so the Tk loop never parses and the port never backs up behind it.
     def run(self):
 
         while self.running:
             try:
-                byte = self.port.read(1)
-                self.gcs.parser.parse(byte)
+                data = self.port.read(max(1, self.port.in_waiting))
+                self.gcs.parser.parse_bytes(data)
             except:
                 None
 
@@ -24,7 +24,9 @@ LEVEL_MAX_ANGLE_DIFF = .25
 
 VEHICLE_SCALE = 0.10
 
-UPDATE_MSEC = 10
+# Redraws at most this often, whatever the telemetry rate
+FRAME_RATE_HZ = 30
+UPDATE_MSEC = 1000 // FRAME_RATE_HZ
 
 YAW_ACTIVE = 1
 PITCH_ACTIVE = 2
@@ -68,6 +70,8 @@ class IMU(Dialog):
 
     def start(self):
 
+        self.roll_pitch_yaw = None
+
         self.schedule_display_task(UPDATE_MSEC)
 
         self.running = True
@@ -93,9 +97,14 @@ class IMU(Dialog):
 
         if self.running:
 
-            self.roll_pitch_yaw = self.driver.getRollPitchYaw()
+            roll_pitch_yaw = self.driver.getRollPitchYaw()
+
+            # The reader thread replaces the tuple with each new attitude, so the same one needs no redraw
+            if roll_pitch_yaw is not self.roll_pitch_yaw:
+
+                self.roll_pitch_yaw = roll_pitch_yaw
 
-            self._update()
+                self._update()
 
             self.schedule_display_task(UPDATE_MSEC)
 
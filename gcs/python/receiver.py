@@ -19,7 +19,8 @@ You should have received a copy of the GNU Lesser General Public License
 along with this code.  If not, see <http:#www.gnu.org/licenses/>.
 '''
 
-UPDATE_MSEC = 1
+# The sticks come in at RC_STREAM_HZ, so there is nothing to gain from redrawing faster than the display
+UPDATE_MSEC = 33
 
 
 from tkcompat import *
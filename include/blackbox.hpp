@@ -0,0 +1,279 @@
+/*
+   blackbox.hpp : on-board flight logger
+
+   Records the inputs and outputs of stabilization and mixing at loop rate.  Each record is
+   a frame of integer fields: an intra ('I') frame holds absolute values, and the predicted
+   ('P') frames that follow hold differences from the previous record.  Every value is
+   zigzag-encoded and written as a variable-length integer, so slowly changing fields take a
+   byte.  Records go into one of two buffers; a full buffer is handed to the board by flush(),
+   which Hackflight calls outside the IMU task.  parser/blackbox_decode.py turns a log into CSV.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "board.hpp"
+#include "config.hpp"
+#include "mixer.hpp"
+
+namespace hf {
+
+#ifdef CONFIG_NO_BLACKBOX
+
+// Left out of the build (config.hpp): nothing is logged, and no buffers are kept
+class Blackbox {
+
+    public:
+
+        static const bool BUILT = false;
+
+        void init(const BlackboxConfig & config, Board * _board) { (void)config; (void)_board; }
+
+        void log(uint32_t time, int16_t gyroRaw[3], float eulerAngles[3], int16_t rcCommand[4],
+                int16_t axisPID[3], const uint16_t motors[VehicleMixer::MOTORS])
+        {
+            (void)time; (void)gyroRaw; (void)eulerAngles; (void)rcCommand; (void)axisPID; (void)motors;
+        }
+
+        void stop(void) { }
+        void flush(void) { }
+
+        uint16_t getDropped(void) { return 0; }
+        bool     isAvailable(void) { return false; }
+};
+
+#else
+
+class Blackbox {
+
+    public:
+
+        static const bool BUILT = true;
+
+        static const uint8_t VERSION = 1;
+
+        // time, gyro[3], euler[3] (tenths of a degree), rc command[4], PID[3], motors
+        static const uint8_t FIELDS = 14 + VehicleMixer::MOTORS;
+
+        void init(const BlackboxConfig & config, Board * _board);
+
+        // Called from the IMU task; costs a few hundred cycles and never waits on storage
+        void log(uint32_t time, int16_t gyroRaw[3], float eulerAngles[3], int16_t rcCommand[4],
+                int16_t axisPID[3], const uint16_t motors[VehicleMixer::MOTORS]);
+
+        // Ends a session (e.g. on disarm); the next record starts a new one with its own header
+        void stop(void);
+
+        // Called outside the IMU task
+        void flush(void);
+
+        uint16_t getDropped(void) { return dropped; }
+
+        // False when the board has nowhere to put a log, so that callers can skip preparing records
+        bool     isAvailable(void) { return avail; }
+
+    private:
+
+        // Marker plus at most five bytes per field
+        static const uint16_t RECORD_MAX = 1 + 5*FIELDS;
+
+        static const uint8_t HEADER_SIZE = 7;
+
+        Board  * board;
+        bool     avail;
+
+        uint8_t  rateDivisor;
+        uint8_t  intraInterval;
+        uint8_t  cycle;
+        uint8_t  sinceIntra;
+        bool     running;
+        bool     needIntra;
+
+        int32_t  previous[FIELDS];
+
+        uint8_t  buffers[2][CONFIG_BLACKBOX_BUFFER_SIZE];
+        uint16_t lengths[2];
+        uint8_t  active;
+        bool     pending;
+
+        uint16_t dropped;
+
+        bool     reserve(uint16_t count);
+        void     writeHeader(void);
+        void     writeByte(uint8_t b);
+        void     writeVarint(int32_t value);
+        void     swap(void);
+};
+
+/********************************************* CPP ********************************************************/
+
+void Blackbox::init(const BlackboxConfig & config, Board * _board)
+{
+    board = _board;
+
+    rateDivisor   = config.rateDivisor ? config.rateDivisor : 1;
+    intraInterval = config.intraInterval ? config.intraInterval : 1;
+
+    cycle      = 0;
+    sinceIntra = 0;
+    running    = false;
+    needIntra  = true;
+
+    memset(previous, 0, sizeof(previous));
+    memset(lengths, 0, sizeof(lengths));
+    active  = 0;
+    pending = false;
+    dropped = 0;
+
+    avail = board->blackboxInit();
+}
+
+void Blackbox::log(uint32_t time, int16_t gyroRaw[3], float eulerAngles[3], int16_t rcCommand[4],
+        int16_t axisPID[3], const uint16_t motors[VehicleMixer::MOTORS])
+{
+    if (!avail)
+        return;
+
+    if (++cycle < rateDivisor)
+        return;
+    cycle = 0;
+
+    // A new session starts with a header, which must share a buffer with its first record
+    uint16_t needed = running ? RECORD_MAX : HEADER_SIZE + RECORD_MAX;
+
+    if (!reserve(needed)) {
+
+        // Lost a record, so the decoder's previous values are stale until the next intra frame
+        if (dropped < 0xFFFF)
+            dropped++;
+        needIntra = true;
+        return;
+    }
+
+    if (!running) {
+        writeHeader();
+        running = true;
+        needIntra = true;
+    }
+
+    int32_t fields[FIELDS];
+    uint8_t n = 0;
+
+    fields[n++] = (int32_t)time;
+    for (uint8_t k=0; k<3; ++k)
+        fields[n++] = gyroRaw[k];
+    for (uint8_t k=0; k<3; ++k)
+        fields[n++] = (int32_t)(10 * eulerAngles[k]);
+    for (uint8_t k=0; k<4; ++k)
+        fields[n++] = rcCommand[k];
+    for (uint8_t k=0; k<3; ++k)
+        fields[n++] = axisPID[k];
+    for (uint8_t k=0; k<VehicleMixer::MOTORS; ++k)
+        fields[n++] = motors[k];
+
+    bool intra = needIntra || sinceIntra >= intraInterval;
+
+    writeByte(intra ? 'I' : 'P');
+
+    for (uint8_t k=0; k<FIELDS; ++k) {
+        writeVarint(intra ? fields[k] : (int32_t)((uint32_t)fields[k] - (uint32_t)previous[k]));
+        previous[k] = fields[k];
+    }
+
+    sinceIntra = intra ? 1 : sinceIntra + 1;
+    needIntra = false;
+}
+
+void Blackbox::stop(void)
+{
+    if (!running)
+        return;
+
+    running = false;
+
+    // Hand over the partial buffer if the flusher is free; otherwise it goes out with the next one
+    if (!pending && lengths[active])
+        swap();
+}
+
+void Blackbox::flush(void)
+{
+    if (!pending)
+        return;
+
+    uint8_t full = active ^ 1;
+
+    board->blackboxWrite(buffers[full], lengths[full]);
+
+    lengths[full] = 0;
+    pending = false;
+}
+
+bool Blackbox::reserve(uint16_t count)
+{
+    if (lengths[active] + count <= CONFIG_BLACKBOX_BUFFER_SIZE)
+        return true;
+
+    // Active buffer is full; swap only if the other one has been written out
+    if (pending)
+        return false;
+
+    swap();
+
+    return true;
+}
+
+void Blackbox::swap(void)
+{
+    pending = true;
+    active ^= 1;
+}
+
+void Blackbox::writeHeader(void)
+{
+    writeByte('H');
+    writeByte('F');
+    writeByte('B');
+    writeByte('B');
+    writeByte(VERSION);
+    writeByte(FIELDS);
+    writeByte(VehicleMixer::MOTORS);
+}
+
+void Blackbox::writeByte(uint8_t b)
+{
+    buffers[active][lengths[active]++] = b;
+}
+
+void Blackbox::writeVarint(int32_t value)
+{
+    // Zigzag maps small magnitudes of either sign to small unsigned values
+    uint32_t u = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+
+    while (u >= 0x80) {
+        writeByte((uint8_t)(u | 0x80));
+        u >>= 7;
+    }
+
+    writeByte((uint8_t)u);
+}
+
+#endif // CONFIG_NO_BLACKBOX
+
+} // namespace
@@ -22,6 +22,17 @@
 
 namespace hf {
 
+// How a serial receiver's link is doing, for boards that can tell
+typedef struct rcLinkStats_t {
+    uint32_t frames;        // good channel frames
+    uint16_t errors;        // bad CRCs and framing
+    uint16_t lost;          // frames the receiver says it missed from the transmitter
+    uint32_t frameMicro;    // between the latest two channel frames
+    uint8_t  quality;       // percent of frames getting through
+    int8_t   rssi;          // dBm, for receivers that report it; zero otherwise
+    bool     failsafe;      // the receiver has lost the transmitter
+} rcLinkStats_t;
+
 class Board {
 
     private:
@@ -44,26 +55,161 @@ class Board {
 
     //------------------------------------------- IMU -----------------------------------------------------------
         virtual void     imuUpdate(void) { }
+
+        // Boards whose IMU needs time after power-up, or can fail to start, begin it in init() without
+        // waiting and bring it up from here, returning true once it is running; Hackflight calls this
+        // during startup, while RC and MSP are already being serviced, and reads the IMU only after
+        virtual bool     imuReady(void) { return true; }
+
+        // Boards with a data-ready interrupt return true here; Hackflight then calls imuUpdate() and runs
+        // PID only when imuDataReady() reports a fresh sample (and clears it), and calls idle() in between
+        virtual bool     imuHasDataReadyInterrupt(void) { return false; }
+        virtual bool     imuDataReady(void) { return false; }
+        virtual void     idle(void) { }
         virtual void     imuGetEulerAndGyro(float eulerAnglesRadians[3], int16_t gyroRaw[3]) = 0;
 
+        // Boards whose IMU fuses attitude itself can hand over its quaternion (w,x,y,z; see quaternion.hpp)
+        // instead, and return true; Hackflight then works out Euler angles only when something asks for them
+        virtual bool     imuGetQuaternionAndGyro(float q[4], int16_t gyroRaw[3]) { (void)q; (void)gyroRaw; return false; }
+
+        // Gyro alone, for oversampling between PID cycles; boards that can't return false
+        virtual bool     imuReadGyro(int16_t gyroRaw[3]) { (void)gyroRaw; return false; }
+
+        // Raw accelerometer, Z reading one G when level, for calibration (see calibration.hpp); boards that
+        // can't return false
+        virtual bool     imuReadAccel(int16_t accelRaw[3]) { (void)accelRaw; return false; }
+
+        // Boards with a bare gyro and accelerometer (MPU6050 and the like) return false, and read both
+        // above; Hackflight then works out the attitude itself (see mahony.hpp), and never calls
+        // imuGetEulerAndGyro() or imuGetQuaternionAndGyro()
+        virtual bool     imuHasFusion(void) { return true; }
+
+    //------------------------------------------- Baro ----------------------------------------------------------
+        // Baros that convert on command (MS5611, BMP280): baroStartConversion() starts a temperature or pressure
+        // conversion and returns at once with how long it will take (usec); baroReadConversion() fetches the raw
+        // result once that time is up; baroCompensate() turns the latest raw pair into pressure (Pa).  Boards
+        // without a baro return false from baroInit().
+        virtual bool     baroInit(void) { return false; }
+        virtual uint32_t baroStartConversion(bool temperature) { (void)temperature; return 0; }
+        virtual uint32_t baroReadConversion(void) { return 0; }
+        virtual int32_t  baroCompensate(uint32_t rawTemperature, uint32_t rawPressure) { (void)rawTemperature; return (int32_t)rawPressure; }
+
+    //------------------------------------------ Sonars ---------------------------------------------------------
+        // sonarTrigger() pings every sonar in the mask (bit k for sonar k) at once and returns; the board
+        // times each echo with a pin-change or input-capture interrupt (see SonarEcho in sonars.hpp), and
+        // sonarGetEcho() gives its round trip (usec) once it is back
+        virtual bool     sonarInit(uint8_t index) { (void)index; return false; }
+        virtual void     sonarTrigger(uint8_t mask) { (void)mask; }
+        virtual bool     sonarGetEcho(uint8_t index, uint32_t & echoMicro) { (void)index; (void)echoMicro; return false; }
+
+    //--------------------------------------- Optical flow ------------------------------------------------------
+        // Motion sensors that look down, like the PMW3901.  flowRead() gives the counts accumulated since the
+        // last read, X positive for the ground passing backward beneath (flying forward) and Y for it passing
+        // leftward (flying right), and the sensor's surface quality (0-255); false if it didn't answer.  The
+        // counts include the vehicle's turning: pitching nose-up reads as forward, and rolling right as left.
+        // flowGetRange() gives the distance along the sensor's view to the surface (m), from a sonar or other
+        // range finder looking the same way (see Sonars); false with none in range.
+        virtual bool     flowInit(void) { return false; }
+        virtual bool     flowRead(int16_t counts[2], uint8_t & quality) { (void)counts; (void)quality; return false; }
+        virtual bool     flowGetRange(float & meters) { (void)meters; return false; }
+
     //-------------------------------------------- RC -----------------------------------------------------
         virtual uint16_t rcReadSerial(uint8_t chan) = 0;
         virtual bool     rcUseSerial(void) = 0;
+
+        // Serial receivers: every channel of the latest frame at once, as PWM usec in DEMAND_ order; returns
+        // how many it filled, or zero if no frame has come in since the last call.  The default reads
+        // rcReadSerial() channel by channel, for receiver libraries that decode on their own; since it reports a
+        // frame every time, a receiver that goes quiet is never noticed, so boards that keep it cannot support
+        // failsafe (see failsafe.hpp) and should leave FailsafeConfig::enabled off.
+        virtual uint8_t  rcReadSerialFrame(uint16_t channels[CONFIG_RC_CHANS])
+        {
+            for (uint8_t chan = 0; chan < 5; chan++) {
+                channels[chan] = rcReadSerial(chan);
+            }
+            return 5;
+        }
+
+        // Boards that can tell when a receiver frame has come in return true here; Hackflight then runs RC
+        // only when rcFrameReady() reports one, rather than every LoopConfig::rcLoopMilli
+        virtual bool     rcHasFrameSignal(void) { return false; }
+        virtual bool     rcFrameReady(void) { return false; }
+
+        // Boards with a receiver that reports on its link (see SerialRx) fill stats and return true
+        virtual bool     rcGetLinkStats(rcLinkStats_t & stats) { (void)stats; return false; }
+
         virtual uint16_t rcReadPwm(uint8_t chan) = 0;
 
+        // PWM and PPM receivers: every channel at once, as pulse widths (usec), zero for a channel with no
+        // good pulse; returns how many it filled, or zero if nothing has come in since the last call.  The
+        // default reads rcReadPwm() channel by channel; boards that capture the pulses themselves (see
+        // PulseRx) hand over the whole frame.
+        virtual uint8_t  rcReadPwmFrame(uint16_t channels[CONFIG_RC_CHANS])
+        {
+            for (uint8_t chan = 0; chan < 8; chan++) {
+                channels[chan] = rcReadPwm(chan);
+            }
+            return 8;
+        }
+
     //------------------------------------------ Serial ---------------------------------------------------------
         virtual uint8_t  serialAvailableBytes(void) = 0;
         virtual uint8_t  serialReadByte(void) = 0;
         virtual void     serialWriteByte(uint8_t c) = 0;
 
+        // Bytes the port can accept without blocking; the default suits ports that never block
+        virtual uint16_t serialAvailableForWrite(void) { return 0xFFFF; }
+
+        virtual void     serialWriteBytes(const uint8_t * buf, uint16_t count)
+        {
+            for (uint16_t i = 0; i < count; i++) {
+                serialWriteByte(buf[i]);
+            }
+        }
+
+        // Called after each burst of MSP replies and telemetry; boards that send in packets (see
+        // DatagramPort) send the burst as one
+        virtual void     serialFlush(void) { }
+
     //------------------------------------------ Motors ---------------------------------------------------------
         virtual void     writeMotor(uint8_t index, uint16_t value) = 0;
 
+        // Called once per IMU cycle with all motor values; boards that can update every channel
+        // in one burst (timer registers, DMA) should override this
+        virtual void     writeMotors(const uint16_t * values, uint8_t count) 
+        { 
+            for (uint8_t i = 0; i < count; i++) {
+                writeMotor(i, values[i]);
+            }
+        }
+
+    //------------------------------------------ Battery --------------------------------------------------------
+        // Pack voltage (mV), read by a low-rate task for the mixer's sag compensation; zero if unknown
+        virtual uint16_t batteryGetMillivolts(void) { return 0; }
+
+    //----------------------------------------- Blackbox --------------------------------------------------------
+        // Boards with log storage (SPI flash, SD) return true from init; writes come from outside the IMU task
+        virtual bool     blackboxInit(void) { return false; }
+        virtual void     blackboxWrite(const uint8_t * buf, uint16_t count) { (void)buf; (void)count; }
+
+    //-------------------------------------- Config storage -----------------------------------------------------
+        // Boards with EEPROM or a spare flash page keep tuned settings there (see configstore.hpp): reads and
+        // writes are of the whole blob, at the start of the storage, and return false if it won't fit
+        virtual bool     configRead(uint8_t * buf, uint16_t count) { (void)buf; (void)count; return false; }
+        virtual bool     configWrite(const uint8_t * buf, uint16_t count) { (void)buf; (void)count; return false; }
+
+    //---------------------------------------- Navigation -------------------------------------------------------
+        // Boards that know where they are (GPS, motion capture, a simulator) give position (m) and velocity
+        // (m/s) north, east and up, from an origin of their own, for guided mode (see navigation.hpp)
+        virtual bool     navGetPosition(float position[3], float velocity[3]) { (void)position; (void)velocity; return false; }
+
     //------------------------------------------ Extras ---------------------------------------------------------
         virtual void    extrasHandleAuxSwitch(uint8_t auxState) { (void)auxState; }
         virtual uint8_t extrasGetTaskCount(void)  { return 0; }
         virtual void    extrasPerformTask(uint8_t taskIndex) { (void)taskIndex; }
-        virtual void    extrasUpdateAccelZ(bool armed) { (void)armed; }
+        // Once per IMU cycle, with gravity's direction in the vehicle's frame (see Quaternion::gravity())
+        virtual void    extrasUpdateAccelZ(const float gravity[3], bool armed) { (void)gravity; (void)armed; }
+        virtual void    extrasRegisterMspHandlers(class MSP * msp) { (void)msp; }
 
 }; // class Board
 
@@ -0,0 +1,229 @@
+/*
+   calibration.hpp : gyro and accelerometer offsets, found at rest during startup
+
+   The startup task calls update() with one sample a step, so RC and MSP go on being serviced and nothing
+   waits in a loop.  Each axis keeps a running mean and variance by Welford's method, which has no sums
+   growing with the sample count and keeps its precision for a small spread about a large mean, as the
+   accelerometer's Z axis has.  A sample far from the mean so far, or a full window spread too wide, means
+   the vehicle was moved, and the window starts over.  A still window gives the gyro offsets and, if none
+   are stored or the config asks for them every boot, the accelerometer's: its mean, less one G on Z, so
+   the board has to be level.  If the vehicle won't keep still before the timeout, the stored offsets
+   stand.  ConfigStore keeps the offsets with the tuned settings.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "config.hpp"
+
+namespace hf {
+
+// Raw counts, subtracted from the board's readings
+struct ImuOffsets {
+    int16_t gyro[3];
+    int16_t accel[3];
+    bool    accelValid;
+};
+
+class Calibration {
+
+    public:
+
+        // Stored offsets, or zeros, until a still window replaces them
+        void init(const CalibrationConfig & _config, uint16_t _accel1G, const ImuOffsets & stored);
+
+        void start(uint32_t currentTime);
+
+        // One sample, and NULL for boards without a raw accelerometer; true once finished, whether
+        // calibrated or timed out
+        bool update(const int16_t gyroRaw[3], const int16_t * accelRaw, uint32_t currentTime);
+
+        bool finished(void) { return done; }
+
+        // Every IMU cycle
+        void apply(int16_t gyroRaw[3]);
+
+        // For the attitude estimator, on boards without fusion; nothing until there are offsets
+        void applyAccel(int16_t accelRaw[3]);
+
+        const ImuOffsets & getOffsets(void) { return offsets; }
+
+        // Windows thrown away for motion since start()
+        uint16_t getRestarts(void) { return restarts; }
+
+    private:
+
+        // Samples in before a single one can count as motion, so that the mean means something
+        static const uint16_t DEVIATION_MIN_SAMPLES = 16;
+
+        typedef struct stats_t {
+            uint16_t count;
+            float    mean;
+            float    m2;        // sum of squared differences from the mean
+        } stats_t;
+
+        CalibrationConfig config;
+        uint16_t   accel1G;
+
+        ImuOffsets offsets;
+        bool       done;
+        bool       takeAccel;
+        uint16_t   restarts;
+        uint32_t   startTime;
+
+        stats_t    gyroStats[3];
+        stats_t    accelStats[3];
+
+        void restart(void);
+
+        // Adds the samples; false if any is further than maxDeviation from its mean
+        static bool push(stats_t stats[3], const int16_t samples[3], float maxDeviation);
+        static bool still(const stats_t stats[3], float maxStdev);
+};
+
+/********************************************* CPP ********************************************************/
+
+void Calibration::init(const CalibrationConfig & _config, uint16_t _accel1G, const ImuOffsets & stored)
+{
+    memcpy(&config, &_config, sizeof(CalibrationConfig));
+    accel1G = _accel1G;
+
+    memcpy(&offsets, &stored, sizeof(ImuOffsets));
+    takeAccel = config.accelEveryBoot || !offsets.accelValid;
+
+    done      = false;
+    restarts  = 0;
+    startTime = 0;
+}
+
+void Calibration::start(uint32_t currentTime)
+{
+    startTime = currentTime;
+    restarts  = 0;
+    done      = false;
+
+    restart();
+}
+
+void Calibration::restart(void)
+{
+    memset(gyroStats,  0, sizeof(gyroStats));
+    memset(accelStats, 0, sizeof(accelStats));
+}
+
+bool Calibration::update(const int16_t gyroRaw[3], const int16_t * accelRaw, uint32_t currentTime)
+{
+    if (done) {
+        return true;
+    }
+
+    if (currentTime - startTime > config.timeoutMilli * 1000) {
+        done = true;
+        return true;
+    }
+
+    bool moved = !push(gyroStats, gyroRaw, config.gyroMaxDeviation);
+    if (accelRaw) {
+        moved |= !push(accelStats, accelRaw, config.accelMaxDeviation);
+    }
+
+    if (!moved && gyroStats[0].count < config.samples) {
+        return false;
+    }
+
+    moved |= !still(gyroStats, config.gyroMaxStdev) || (accelRaw && !still(accelStats, config.accelMaxStdev));
+
+    if (moved) {
+        restarts++;
+        restart();
+        return false;
+    }
+
+    for (uint8_t axis = 0; axis < 3; axis++) {
+        offsets.gyro[axis] = (int16_t)lrintf(gyroStats[axis].mean);
+    }
+
+    if (accelRaw && takeAccel) {
+        for (uint8_t axis = 0; axis < 3; axis++) {
+            offsets.accel[axis] = (int16_t)lrintf(accelStats[axis].mean);
+        }
+        offsets.accel[2] -= accel1G;
+        offsets.accelValid = true;
+    }
+
+    done = true;
+    return true;
+}
+
+void Calibration::apply(int16_t gyroRaw[3])
+{
+    for (uint8_t axis = 0; axis < 3; axis++) {
+        int32_t value = (int32_t)gyroRaw[axis] - offsets.gyro[axis];
+        gyroRaw[axis] = value > INT16_MAX ? INT16_MAX : (value < INT16_MIN ? INT16_MIN : value);
+    }
+}
+
+void Calibration::applyAccel(int16_t accelRaw[3])
+{
+    if (!offsets.accelValid) {
+        return;
+    }
+
+    for (uint8_t axis = 0; axis < 3; axis++) {
+        int32_t value = (int32_t)accelRaw[axis] - offsets.accel[axis];
+        accelRaw[axis] = value > INT16_MAX ? INT16_MAX : (value < INT16_MIN ? INT16_MIN : value);
+    }
+}
+
+bool Calibration::push(stats_t stats[3], const int16_t samples[3], float maxDeviation)
+{
+    bool ok = true;
+
+    for (uint8_t axis = 0; axis < 3; axis++) {
+
+        stats_t & s = stats[axis];
+        float x = samples[axis];
+        float delta = x - s.mean;
+
+        if (s.count >= DEVIATION_MIN_SAMPLES && fabsf(delta) > maxDeviation) {
+            ok = false;
+        }
+
+        s.count++;
+        s.mean += delta / s.count;
+        s.m2   += delta * (x - s.mean);
+    }
+
+    return ok;
+}
+
+bool Calibration::still(const stats_t stats[3], float maxStdev)
+{
+    // Comparing m2 saves the square root: variance is m2 / (count - 1)
+    for (uint8_t axis = 0; axis < 3; axis++) {
+        if (stats[axis].m2 > maxStdev * maxStdev * (stats[axis].count - 1)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+} // namespace hf
@@ -20,6 +20,35 @@
 
 #include <cstdint>
 
+//=========================================================================
+// Build profile: subsystems that can be left out, for the smallest boards
+//=========================================================================
+
+// Define CONFIG_MINIMAL ahead of hackflight.hpp to leave out everything below, or any one CONFIG_NO_* to
+// leave out just that.  A subsystem left out keeps its class, with methods that do nothing, so the rest
+// builds unchanged; arduino/footprint reports what each one costs.
+//
+//   CONFIG_NO_DEBUG       debug() and its ring, and the formatting that goes with them
+//   CONFIG_NO_BLACKBOX    the flight logger and its buffers
+//   CONFIG_NO_NAVIGATION  guided mode and the optical-flow estimate
+//   CONFIG_NO_MSP_TUNING  the MSP commands for tuning and plotting (stored settings, LOOP_TIMING,
+//                         SET_STREAM, STATE), and the larger serial buffers they need
+
+#ifdef CONFIG_MINIMAL
+#ifndef CONFIG_NO_DEBUG
+#define CONFIG_NO_DEBUG
+#endif
+#ifndef CONFIG_NO_BLACKBOX
+#define CONFIG_NO_BLACKBOX
+#endif
+#ifndef CONFIG_NO_NAVIGATION
+#define CONFIG_NO_NAVIGATION
+#endif
+#ifndef CONFIG_NO_MSP_TUNING
+#define CONFIG_NO_MSP_TUNING
+#endif
+#endif
+
 namespace hf {
 
 //=========================================================================
@@ -42,6 +71,10 @@ struct PidConfig {
 
     // Trim for a particular vehicle: roll, pitch, yaw
     int16_t softwareTrim[3] = {0, 0, 0};
+
+    // Feed-forward: output added per unit of setpoint change over an RC period (the setpoint's share of
+    // the P term, so 1 doubles the P response to stick movement); zero disables
+    float feedForward = 0;
 };
 
 //=========================================================================
@@ -51,8 +84,32 @@ struct PidConfig {
 struct LoopConfig {
 
     uint32_t angleCheckMilli = 500;
+
+    // One step of the LED patterns (see leds.hpp), so a tilt blink is eight of these
+    uint32_t ledLoopMilli    = 125;
     uint32_t rcLoopMilli     = 10;
     uint32_t imuLoopMicro    = 3500;
+
+    // Loop-rate selection (looprate.hpp): when imuLoopMinMicro is set, the IMU period becomes the shortest, but
+    // no shorter than it, in which the IMU chain, timed at startup over imuLoopBenchmarkCycles cycles, takes at
+    // most imuLoopLoad of each period; imuLoopMicro is then the period the gains were tuned at
+    uint32_t imuLoopMinMicro        = 0;
+    float    imuLoopLoad            = 0.5f;
+    uint16_t imuLoopBenchmarkCycles = 64;
+
+    // Gyro oversampling between PID (IMU loop) cycles; zero disables
+    uint32_t gyroLoopMicro   = 0;
+    uint32_t mspLoopMilli    = 10;
+
+    // Battery voltage, for the mixer's sag compensation
+    uint32_t batteryLoopMilli = 100;
+
+    // Ramp stick commands to each new RC reading over the IMU cycles until the next one, rather than
+    // stepping once per RC period
+    bool     rcInterpolation = false;
+
+    // Bytes parsed per MSP pass; 128 every 10 msec keeps up with a 115200-baud link
+    uint8_t  mspMaxBytes     = 128;
 };
 
 //=========================================================================
@@ -69,17 +126,107 @@ struct ImuConfig {
     int32_t  accelZDeadband         = 40;
     float    accelZLpfCutoff        = 5.0f;
     uint32_t accelZCalcMicro        = 25000;
+
+    // Gyro counts per degree per second, the MultiWii scale that Stabilize is written for
+    float    gyroLsbPerDps          = 4.1f;
+
+    // Attitude estimator (mahony.hpp), for boards without fusion: gains on the accelerometer's error
+    // (rad/s per unit), and how far from one G its reading may be and still count
+    float    mahonyKp               = 0.25f;
+    float    mahonyKi               = 0.0f;
+    float    mahonyAccelWindow      = 0.15f;
+};
+
+//=========================================================================
+// Rate (acro) mode config
+//=========================================================================
+
+struct RateConfig {
+
+    // Setpoint curve, as Betaflight has it: 200 * rcRate deg/sec at full stick, with expo in [0,1]
+    // softening the center and superRate in [0,1) steepening the ends
+    float    rcRate         = 1.0f;
+    float    superRate      = 0.7f;
+    float    expo           = 0.0f;
+
+    // Throttle-PID attenuation: from tpaBreakpoint up, roll and pitch P and D fall off linearly, to
+    // (1 - tpaRate) times themselves at full throttle
+    uint16_t tpaBreakpoint  = 1500;
+    float    tpaRate        = 0.5f;
+
+    // Aux switch position (see RC::getAuxState()) that selects rate mode; the default, none, keeps
+    // the vehicle self-leveling
+    uint8_t  auxState       = 0xFF;
 };
 
 
+//=========================================================================
+// Altitude estimation config
+//=========================================================================
+
+struct AltitudeConfig {
+
+    // Time constants (sec) over which the accel's integration is pulled toward each reference
+    float    baroTimeConstant       = 2.0f;
+    float    sonarTimeConstant      = 0.5f;
+
+    // Sonar readings count from above zero up to this (cm), and for this long (usec); the baro
+    // takes over after that
+    uint16_t sonarMaxCm             = 400;
+    uint32_t sonarTimeoutMicro      = 200000;
+
+    // Hover's altitude hold, in MultiWii's integer units: throttle per cm of error is holdP/128, and
+    // holdI and holdD keep the meaning they had when the hold ran once per holdStepMilli
+    int16_t  holdP                  = 64;
+    int16_t  holdI                  = 25;
+    int16_t  holdD                  = 24;
+    uint16_t holdStepMilli          = 25;
+};
+
 //=========================================================================
 // PWM config
 //=========================================================================
 
+enum {
+    MOTOR_PROTOCOL_PWM = 0,
+    MOTOR_PROTOCOL_DSHOT150,
+    MOTOR_PROTOCOL_DSHOT300,
+    MOTOR_PROTOCOL_DSHOT600
+};
+
 struct PwmConfig {
 
     uint16_t min = 1000;
     uint16_t max = 2000;
+
+    // Armed, the motors never go below min + idle
+    uint16_t idle = 0;
+
+    // Airmode: once the throttle has been up since arming, the mix is shifted (or, if it can't fit, squeezed)
+    // into [min + idle, max] from either side, rather than cut at zero throttle, so the PID keeps its authority
+    bool     airmode = false;
+
+    // Most a motor may change in one IMU cycle while armed; zero disables
+    uint16_t slewLimit = 0;
+
+    // Boards that support DShot remap [min,max] to DShot throttle values; see dshot.hpp
+    uint8_t  protocol = MOTOR_PROTOCOL_PWM;
+};
+
+//=========================================================================
+// thrust compensation config
+//=========================================================================
+
+struct ThrustConfig {
+
+    // Thrust goes as (1 - linearization) * command + linearization * command^2 (as fractions of full), which the
+    // mixer undoes, so that a change of command gives the same change of thrust at any throttle; zero disables
+    float    linearization = 0;
+
+    // Pack voltage (mV) the PIDs were tuned at; as the pack sags below it, commands are scaled up to match, by at
+    // most maxBoost.  Zero disables.
+    uint16_t referenceMillivolts = 0;
+    float    maxBoost = 1.3f;
 };
 
 //=========================================================================
@@ -94,6 +241,27 @@ struct RcConfig {
     int16_t rate8       = 90;
     int8_t  thrMid8     = 50;
     int32_t thrExpo8    = 0;
+
+    // PWM inputs are averaged over 2^averageLog2 samples (at most 2^CONFIG_RC_AVERAGE_MAX_LOG2); zero disables
+    uint8_t averageLog2 = 2;
+};
+
+//=========================================================================
+// failsafe config
+//=========================================================================
+
+struct FailsafeConfig {
+
+    bool     enabled         = false;
+
+    // The link is lost once a stick channel has gone this long without a good reading; the last commands
+    // are held for holdMicro, then the vehicle levels itself at the held throttle for levelMicro, then
+    // descends at descentThrottle (stick PWM) for descentMicro and disarms.  No descent disarms after leveling.
+    uint32_t lossMicro       = 100000;
+    uint32_t holdMicro       = 1000000;
+    uint32_t levelMicro      = 500000;
+    uint32_t descentMicro    = 10000000;
+    uint16_t descentThrottle = 1300;
 };
 
 //=========================================================================
@@ -107,6 +275,113 @@ struct InitConfig {
     uint32_t ledFlashCount = 20;
 };
 
+//=========================================================================
+// guided-mode navigation config
+//=========================================================================
+
+struct NavConfig {
+
+    // Aux switch position that flies the mission, on boards that know where they are
+    // (Board::navGetPosition(), or an optical-flow sensor); Hover called this one guided mode
+    uint8_t  auxState        = 2;
+    uint32_t loopMilli       = 20;
+
+    // A waypoint is reached within this distance (m); the position controller aims this far ahead
+    // along the segment, at its speed (sec)
+    float    acceptRadius    = 0.5f;
+    float    lookaheadSec    = 1.0f;
+
+    // For waypoints that leave the speed zero, and for holding (m/s)
+    float    defaultSpeed    = 2.0f;
+
+    // Horizontal: m/s per m of position error, m/s/s per m/s of velocity error, and the tilt allowed
+    float    positionP       = 1.0f;
+    float    velocityP       = 2.0f;
+    float    velocityI       = 0.5f;
+    float    maxTiltDegrees  = 20;
+
+    // Vertical: m/s per m, the climb limit (m/s), and throttle command per m/s of climb-rate error
+    float    climbP          = 1.0f;
+    float    maxClimb        = 1.0f;
+    float    throttleP       = 100;
+    float    throttleI       = 50;
+    float    throttleIMax    = 200;
+};
+
+//=========================================================================
+// optical flow config
+//=========================================================================
+
+struct FlowConfig {
+
+    // Estimator step, one sensor read each; the PMW3901 has a new motion report about every 8 msec
+    uint32_t loopMilli       = 10;
+
+    // Sensor scale (radians of view per count), which depends on the lens
+    float    radiansPerCount = 0.00125f;
+
+    // Reads below this surface quality, or with the range to the surface outside these limits (m), are
+    // not used
+    uint8_t  minQuality      = 30;
+    float    minRange        = 0.08f;
+    float    maxRange        = 3.5f;
+
+    // Share of each new velocity measurement taken per step
+    float    velocityGain    = 0.5f;
+
+    // Steps in a row without a usable read before the estimate stops counting as a position
+    uint8_t  maxStaleSteps   = 25;
+};
+
+//=========================================================================
+// gyro and accelerometer calibration config
+//=========================================================================
+
+struct CalibrationConfig {
+
+    // Still samples averaged for the offsets, one per startup step
+    uint16_t samples          = 500;
+    uint32_t sampleMicro      = 2000;
+
+    // Motion that restarts the window: a sample this far from the mean so far, or a full window with a
+    // standard deviation above this, on any axis (raw counts)
+    float    gyroMaxDeviation  = 40;
+    float    gyroMaxStdev      = 8;
+    float    accelMaxDeviation = 400;
+    float    accelMaxStdev     = 80;
+
+    // A vehicle that won't keep still this long flies on the stored offsets
+    uint32_t timeoutMilli     = 10000;
+
+    // Accelerometer offsets need the board level, so by default they are found only when none are stored
+    bool     accelEveryBoot   = false;
+};
+
+//=========================================================================
+// gyro filter config
+//=========================================================================
+
+struct FilterConfig {
+
+    // Biquad low-pass on raw gyro; zero disables
+    float   gyroLowpassHz  = 0;
+
+    // Dynamic notch, tracking the strongest gyro noise peak above notchMinHz
+    bool    notchEnabled   = false;
+    float   notchMinHz     = 80;
+    float   notchQ         = 3;
+};
+
+//=========================================================================
+// blackbox config
+//=========================================================================
+
+struct BlackboxConfig {
+
+    uint8_t rateDivisor    = 1;     // log every Nth IMU cycle
+    uint8_t intraInterval  = 32;    // records between absolute (intra) frames
+};
+
 //=========================================================================
 // all config
 //=========================================================================
@@ -114,10 +389,19 @@ struct InitConfig {
 struct Config {
     LoopConfig loop;
     ImuConfig imu;
+    AltitudeConfig altitude;
     RcConfig rc;
     PidConfig pid;
+    RateConfig rate;
     PwmConfig pwm;
+    ThrustConfig thrust;
+    FailsafeConfig failsafe;
     InitConfig init;
+    CalibrationConfig calibration;
+    NavConfig nav;
+    FlowConfig flow;
+    FilterConfig filter;
+    BlackboxConfig blackbox;
 };
 
 //=========================================================================
@@ -143,6 +427,95 @@ static const uint8_t CONFIG_RC_CHANS                = 8;
 static const uint8_t CONFIG_PITCH_LOOKUP_LENGTH     = 7;
 static const uint8_t CONFIG_THROTTLE_LOOKUP_LENGTH  = 12;
 
+// RC expo tables hold every 2^CONFIG_RC_EXPO_SHIFT usec of stick travel; lookups interpolate with shifts.
+// Throttle covers the worst case of MINCHECK at 1000.
+static const uint8_t  CONFIG_RC_AVERAGE_MAX_LOG2      = 4;
+
+static const uint8_t  CONFIG_RC_EXPO_SHIFT            = 2;
+static const uint16_t CONFIG_RC_PITCH_TABLE_LENGTH    = (500 >> CONFIG_RC_EXPO_SHIFT) + 2;
+static const uint16_t CONFIG_RC_THROTTLE_TABLE_LENGTH = (1000 >> CONFIG_RC_EXPO_SHIFT) + 2;
+
+// Sticks held this long in one place give a command (arm, disarm); a hair under the twenty 10-msec readings
+// it used to be counted in, so that polled receivers still act on the same reading
+static const uint32_t CONFIG_RC_COMBO_MICRO           = 195000;
+
+// PWM pulses outside this range mean the receiver has stopped sending them
+static const uint16_t CONFIG_RC_PULSE_MIN             = 885;
+static const uint16_t CONFIG_RC_PULSE_MAX             = 2115;
+
+// Thrust linearization table: the motor range, sampled every 2^k usec for the smallest k that fits
+static const uint16_t CONFIG_THRUST_TABLE_LENGTH      = (1000 >> 3) + 2;
+
+// Loop profiler: bucket 0 is [0,32) usec, bucket k is [32*2^(k-1), 32*2^k), last bucket is open-ended
+static const uint8_t CONFIG_PROFILER_BUCKETS        = 8;
+static const uint8_t CONFIG_PROFILER_BUCKET0_LOG2   = 5;
+
+static const uint8_t CONFIG_MSP_STREAMS             = 4;
+
+// A sequenced command further than this behind the last one accepted comes from a host that has started
+// counting again, rather than from a late or repeated frame
+static const uint16_t CONFIG_MSP_SEQ_WINDOW         = 64;
+
+// MSP over UDP (datagramport.hpp): the largest datagram a board sends or takes, well inside one Ethernet
+// or Wi-Fi frame
+static const uint16_t CONFIG_DATAGRAM_SIZE          = 512;
+
+static const uint16_t CONFIG_BLACKBOX_BUFFER_SIZE   = 512;
+
+static const uint8_t CONFIG_DEBUG_RECORDS           = 32;
+static const uint8_t CONFIG_DEBUG_FLUSH_MAX         = 4;     // messages formatted per extras pass
+static const uint8_t CONFIG_DEBUG_LINE_LENGTH       = 128;
+
+// Scheduler: task slots, and how many times in a row a task may be deferred for the IMU deadline
+// before it runs anyway
+static const uint8_t CONFIG_SCHEDULER_TASKS         = 10;
+static const uint8_t CONFIG_SCHEDULER_MAX_DEFERRALS = 20;
+
+// Dual-core builds (corelink.hpp): IMU-cycle snapshots the comms core can fall behind by before they are
+// dropped, and commands waiting for the control core
+static const uint8_t CONFIG_CORE_STATE_RING         = 32;
+static const uint8_t CONFIG_CORE_COMMAND_RING       = 8;
+
+// Hardware-in-the-loop: simulated IMU samples arrive over MSP, so HilBoard parses it this often
+static const uint8_t CONFIG_HIL_MSP_LOOP_MILLI      = 1;
+
+// Gyro samples kept between PID cycles
+static const uint8_t CONFIG_GYRO_OVERSAMPLE_MAX     = 8;
+
+// Dynamic notch: FFT length (power of two), how far a peak must stand above the mean power, and
+// how quickly the notch follows it
+static const uint8_t CONFIG_FILTER_NOTCH_WINDOW     = 32;
+static const float   CONFIG_FILTER_NOTCH_PEAK_RATIO = 4.0f;
+static const float   CONFIG_FILTER_NOTCH_SMOOTHING  = 0.3f;
+
+// Fast approximations (fastmath.hpp) rather than libm, per use: gravity from Euler angles for
+// altitude, and Euler angles from a quaternion
+static const bool    CONFIG_FASTMATH_ACCELZ         = true;
+static const bool    CONFIG_FASTMATH_EULER          = true;
+
+// Baro pressure-to-altitude table: entries, and the range covered (Pa), about 9 km down to below sea level
+static const uint16_t CONFIG_BARO_TABLE_SIZE        = 256;
+static const float    CONFIG_BARO_TABLE_MIN_PA      = 30000;
+static const float    CONFIG_BARO_TABLE_MAX_PA      = 110000;
+
+// Sonars: how many, and the sets fired together, as masks of non-interfering sensors (the stock
+// five all face different ways, so they go at once); an echo not back in CONFIG_SONAR_TIMEOUT_MICRO
+// (about five meters) counts as none
+static const uint8_t  CONFIG_SONAR_COUNT            = 5;
+static const uint8_t  CONFIG_SONAR_GROUP_COUNT      = 1;
+static const uint8_t  CONFIG_SONAR_GROUPS[CONFIG_SONAR_GROUP_COUNT] = {0x1F};
+static const uint32_t CONFIG_SONAR_TIMEOUT_MICRO    = 30000;
+
+// Mission capacity for guided mode (navigation.hpp)
+static const uint8_t  CONFIG_NAV_WAYPOINTS          = 16;
+
+// Baro conversions: temperature drifts slowly, so it is read once per this many pressures
+static const uint8_t  CONFIG_BARO_PRESSURES_PER_TEMPERATURE = 4;
+
+// Stored settings (configstore.hpp): bump the version whenever PidConfig, RcConfig or ImuOffsets changes
+// layout, so that a blob from older firmware is ignored rather than misread
+static const uint16_t CONFIG_STORE_VERSION          = 3;
+
 //=========================================================================
 // STM32 reboot support
 //=========================================================================
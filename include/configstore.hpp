@@ -0,0 +1,361 @@
+/*
+   configstore.hpp : PID and RC settings, and IMU offsets, kept across reboots, and tuned over MSP without one
+
+   At boot, load() reads the settings blob from the board's storage (see Board::configRead()) straight
+   into place and, if its version, size and CRC check out, puts it over the board's defaults; otherwise
+   the defaults stand.  Over MSP, PID_CONFIG and RC_CONFIG report the settings in use, SET_PID_CONFIG
+   and SET_RC_CONFIG change them at once, and EEPROM_WRITE saves them, with the offsets from the latest
+   calibration, for the next boot.  Handlers run in the MSP task, which the scheduler never starts in
+   the middle of the IMU task, so a new setting always takes effect between loop iterations; new PID
+   gains wait in Stabilize's spare set until the top of the next IMU cycle.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#include "board.hpp"
+#include "calibration.hpp"
+#include "config.hpp"
+#include "msp.hpp"
+#include "rc.hpp"
+#include "stabilize.hpp"
+
+#ifdef CONFIG_DUAL_CORE
+#include "corelink.hpp"
+#endif
+
+namespace hf {
+
+class ConfigStore {
+
+    public:
+
+        void init(Board * _board, RC * _rc, Stabilize * _stab, Calibration * _calibration, const bool * _armed);
+
+        // Replaces the defaults with the stored settings, if there are good ones; call before RC::init(),
+        // Stabilize::init() and Calibration::init()
+        bool load(PidConfig & pidConfig, RcConfig & rcConfig, ImuOffsets & offsets);
+
+        // Stores the settings RC and Stabilize are using, and Calibration's offsets; false if the board has
+        // nowhere to put them
+        bool save(void);
+
+        void registerMspHandlers(MSP * msp);
+
+#ifdef CONFIG_DUAL_CORE
+        // RC and Stabilize belong to the control core, so new settings go to it over the link; call once
+        // they are initialized, and from then on only from the comms core
+        void attach(CoreLink * _link);
+#endif
+
+    private:
+
+        // Payload sizes of the SET_ messages
+        static const uint8_t PID_CONFIG_SIZE = 6*4 + 3*2 + 4;
+        static const uint8_t RC_CONFIG_SIZE  = 4*2 + 3;
+
+        struct blob_t {
+            uint16_t  version;
+            uint16_t  size;
+            PidConfig pid;
+            RcConfig  rc;
+            ImuOffsets imu;
+            uint16_t  crc;      // CRC-16/CCITT of everything before it
+        };
+
+        Board     * board;
+        RC        * rc;
+        Stabilize * stab;
+        Calibration * calibration;
+        const bool * armed;
+
+#ifdef CONFIG_DUAL_CORE
+        // What was last sent to the control core, which is what it will be flying with
+        CoreLink  * link;
+        PidConfig   pidConfig;
+        RcConfig    rcConfig;
+#endif
+
+        const PidConfig & getPidConfig(void);
+        const RcConfig  & getRcConfig(void);
+
+        // False if the settings could not be passed on
+        bool setPidConfig(const PidConfig & _pidConfig);
+        bool setRcConfig(const RcConfig & _rcConfig);
+
+        static uint16_t crc16(const uint8_t * buf, uint16_t count);
+
+        static bool valid(const PidConfig & pidConfig);
+        static bool valid(const RcConfig & rcConfig);
+
+        static void handlePidConfig(MSP & msp, void * context);
+        static void handleSetPidConfig(MSP & msp, void * context);
+        static void handleRcConfig(MSP & msp, void * context);
+        static void handleSetRcConfig(MSP & msp, void * context);
+        static void handleEepromWrite(MSP & msp, void * context);
+};
+
+/********************************************* CPP ********************************************************/
+
+void ConfigStore::init(Board * _board, RC * _rc, Stabilize * _stab, Calibration * _calibration, const bool * _armed)
+{
+    board = _board;
+    rc    = _rc;
+    stab  = _stab;
+    calibration = _calibration;
+    armed = _armed;
+}
+
+#ifdef CONFIG_DUAL_CORE
+void ConfigStore::attach(CoreLink * _link)
+{
+    link = _link;
+    memcpy(&pidConfig, &stab->getPidConfig(), sizeof(PidConfig));
+    memcpy(&rcConfig,  &rc->getConfig(),      sizeof(RcConfig));
+}
+#endif
+
+const PidConfig & ConfigStore::getPidConfig(void)
+{
+#ifdef CONFIG_DUAL_CORE
+    return pidConfig;
+#else
+    return stab->getPidConfig();
+#endif
+}
+
+const RcConfig & ConfigStore::getRcConfig(void)
+{
+#ifdef CONFIG_DUAL_CORE
+    return rcConfig;
+#else
+    return rc->getConfig();
+#endif
+}
+
+bool ConfigStore::setPidConfig(const PidConfig & _pidConfig)
+{
+#ifdef CONFIG_DUAL_CORE
+    CoreCommand command;
+    command.set(CORE_COMMAND_PID_CONFIG, _pidConfig);
+    if (!link->commands.push(command)) {
+        return false;
+    }
+    memcpy(&pidConfig, &_pidConfig, sizeof(PidConfig));
+#else
+    stab->setPidConfig(_pidConfig);
+#endif
+    return true;
+}
+
+bool ConfigStore::setRcConfig(const RcConfig & _rcConfig)
+{
+#ifdef CONFIG_DUAL_CORE
+    CoreCommand command;
+    command.set(CORE_COMMAND_RC_CONFIG, _rcConfig);
+    if (!link->commands.push(command)) {
+        return false;
+    }
+    memcpy(&rcConfig, &_rcConfig, sizeof(RcConfig));
+#else
+    rc->setConfig(_rcConfig);
+#endif
+    return true;
+}
+
+bool ConfigStore::load(PidConfig & pidConfig, RcConfig & rcConfig, ImuOffsets & offsets)
+{
+    blob_t blob;
+
+    if (!board->configRead((uint8_t *)&blob, sizeof(blob_t))) {
+        return false;
+    }
+
+    // Erased storage, another firmware's layout, or a write cut short
+    if (blob.version != CONFIG_STORE_VERSION || blob.size != sizeof(blob_t) ||
+            blob.crc != crc16((const uint8_t *)&blob, offsetof(blob_t, crc))) {
+        return false;
+    }
+
+    if (!valid(blob.pid) || !valid(blob.rc)) {
+        return false;
+    }
+
+    memcpy(&pidConfig, &blob.pid, sizeof(PidConfig));
+    memcpy(&rcConfig,  &blob.rc,  sizeof(RcConfig));
+    memcpy(&offsets,   &blob.imu, sizeof(ImuOffsets));
+
+    return true;
+}
+
+bool ConfigStore::save(void)
+{
+    blob_t blob;
+
+    // Padding goes into the CRC, so it has to be the same every time
+    memset((void *)&blob, 0, sizeof(blob_t));
+
+    blob.version = CONFIG_STORE_VERSION;
+    blob.size    = sizeof(blob_t);
+    memcpy(&blob.pid, &getPidConfig(), sizeof(PidConfig));
+    memcpy(&blob.rc,  &getRcConfig(),  sizeof(RcConfig));
+    memcpy(&blob.imu, &calibration->getOffsets(), sizeof(ImuOffsets));
+    blob.crc     = crc16((const uint8_t *)&blob, offsetof(blob_t, crc));
+
+    return board->configWrite((const uint8_t *)&blob, sizeof(blob_t));
+}
+
+uint16_t ConfigStore::crc16(const uint8_t * buf, uint16_t count)
+{
+    uint16_t crc = 0xFFFF;
+
+    for (uint16_t i = 0; i < count; i++) {
+        crc ^= (uint16_t)buf[i] << 8;
+        for (uint8_t k = 0; k < 8; k++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+bool ConfigStore::valid(const PidConfig & pidConfig)
+{
+    // Comparisons are false for NaN, so this rejects those too
+    return pidConfig.levelP >= 0 && pidConfig.ratePitchrollP > 0 && pidConfig.ratePitchrollI >= 0 &&
+        pidConfig.ratePitchrollD >= 0 && pidConfig.yawP > 0 && pidConfig.yawI >= 0 && pidConfig.feedForward >= 0;
+}
+
+bool ConfigStore::valid(const RcConfig & rcConfig)
+{
+    // The throttle curve divides by 100 - thrMid8, and the expo tables are int16_t
+    return rcConfig.mincheck >= 1000 && rcConfig.mincheck < rcConfig.maxcheck && rcConfig.maxcheck <= 2000 &&
+        rcConfig.expo8 >= 0 && rcConfig.expo8 <= 100 && rcConfig.rate8 >= 0 && rcConfig.rate8 <= 250 &&
+        rcConfig.thrMid8 >= 0 && rcConfig.thrMid8 < 100 && rcConfig.thrExpo8 >= 0 && rcConfig.thrExpo8 <= 100 &&
+        rcConfig.averageLog2 <= CONFIG_RC_AVERAGE_MAX_LOG2;
+}
+
+void ConfigStore::registerMspHandlers(MSP * msp)
+{
+    msp->registerHandler(MSP_PID_CONFIG,     handlePidConfig,    this);
+    msp->registerHandler(MSP_SET_PID_CONFIG, handleSetPidConfig, this);
+    msp->registerHandler(MSP_RC_CONFIG,      handleRcConfig,     this);
+    msp->registerHandler(MSP_SET_RC_CONFIG,  handleSetRcConfig,  this);
+    msp->registerHandler(MSP_EEPROM_WRITE,   handleEepromWrite,  this);
+}
+
+void ConfigStore::handlePidConfig(MSP & msp, void * context)
+{
+    const PidConfig & pidConfig = ((ConfigStore *)context)->getPidConfig();
+
+    msp.headSerialReply(PID_CONFIG_SIZE);
+    msp.serializeFloat(pidConfig.levelP);
+    msp.serializeFloat(pidConfig.ratePitchrollP);
+    msp.serializeFloat(pidConfig.ratePitchrollI);
+    msp.serializeFloat(pidConfig.ratePitchrollD);
+    msp.serializeFloat(pidConfig.yawP);
+    msp.serializeFloat(pidConfig.yawI);
+    for (uint8_t axis = 0; axis < 3; axis++)
+        msp.serialize16(pidConfig.softwareTrim[axis]);
+    msp.serializeFloat(pidConfig.feedForward);
+}
+
+void ConfigStore::handleSetPidConfig(MSP & msp, void * context)
+{
+    ConfigStore * store = (ConfigStore *)context;
+
+    if (msp.payloadSize() != PID_CONFIG_SIZE) {
+        msp.headSerialError(0);
+        return;
+    }
+
+    PidConfig pidConfig = store->getPidConfig();
+
+    pidConfig.levelP         = msp.readFloat();
+    pidConfig.ratePitchrollP = msp.readFloat();
+    pidConfig.ratePitchrollI = msp.readFloat();
+    pidConfig.ratePitchrollD = msp.readFloat();
+    pidConfig.yawP           = msp.readFloat();
+    pidConfig.yawI           = msp.readFloat();
+    for (uint8_t axis = 0; axis < 3; axis++)
+        pidConfig.softwareTrim[axis] = (int16_t)msp.read16();
+    pidConfig.feedForward    = msp.readFloat();
+
+    if (!valid(pidConfig) || !store->setPidConfig(pidConfig)) {
+        msp.headSerialError(0);
+        return;
+    }
+
+    msp.headSerialReply(0);
+}
+
+void ConfigStore::handleRcConfig(MSP & msp, void * context)
+{
+    const RcConfig & rcConfig = ((ConfigStore *)context)->getRcConfig();
+
+    msp.headSerialReply(RC_CONFIG_SIZE);
+    msp.serialize16(rcConfig.mincheck);
+    msp.serialize16(rcConfig.maxcheck);
+    msp.serialize16(rcConfig.expo8);
+    msp.serialize16(rcConfig.rate8);
+    msp.serialize8(rcConfig.thrMid8);
+    msp.serialize8(rcConfig.thrExpo8);
+    msp.serialize8(rcConfig.averageLog2);
+}
+
+void ConfigStore::handleSetRcConfig(MSP & msp, void * context)
+{
+    ConfigStore * store = (ConfigStore *)context;
+
+    if (msp.payloadSize() != RC_CONFIG_SIZE) {
+        msp.headSerialError(0);
+        return;
+    }
+
+    RcConfig rcConfig = store->getRcConfig();
+
+    rcConfig.mincheck    = msp.read16();
+    rcConfig.maxcheck    = msp.read16();
+    rcConfig.expo8       = (int16_t)msp.read16();
+    rcConfig.rate8       = (int16_t)msp.read16();
+    rcConfig.thrMid8     = (int8_t)msp.read8();
+    rcConfig.thrExpo8    = msp.read8();
+    rcConfig.averageLog2 = msp.read8();
+
+    if (!valid(rcConfig) || !store->setRcConfig(rcConfig)) {
+        msp.headSerialError(0);
+        return;
+    }
+
+    msp.headSerialReply(0);
+}
+
+void ConfigStore::handleEepromWrite(MSP & msp, void * context)
+{
+    ConfigStore * store = (ConfigStore *)context;
+
+    // EEPROM writes take milliseconds, which the loop can't spare in flight
+    if (*store->armed || !store->save()) {
+        msp.headSerialError(0);
+        return;
+    }
+
+    msp.headSerialReply(0);
+}
+
+} // namespace hf
@@ -0,0 +1,204 @@
+/*
+   corelink.hpp : what passes between the cores, on boards that give the control loop a core of its own
+
+   Built with CONFIG_DUAL_CORE, Hackflight::update() runs only what flies the vehicle: the IMU, PID and
+   mixer, RC, failsafe, the LEDs, the battery and startup.  Hackflight::updateComms(), called from the
+   other core's loop, runs MSP, the blackbox, and the extras (debug output, guided mode, optical flow, and
+   the board's own baro and sonar), so no amount of ground-station traffic or logging can push back an IMU
+   cycle.  Neither core touches the objects the other runs.  Every IMU cycle, the control core pushes a
+   snapshot of its state into one ring, and the comms core logs, reports and navigates from those;
+   whatever the comms core would have written into the control loop (sticks and motors from MSP, new
+   settings, guided mode's demands) goes back as commands through a second ring, applied by a
+   control-core task between IMU cycles.  A full ring drops what doesn't fit.
+
+   Each ring has one producer and one consumer, each of which writes only its own index, so neither ever
+   waits on the other: the producer's release store of its index publishes the entry, and the consumer's
+   acquire load sees it whole.  The board must keep its own accessors safe across cores: the control
+   core uses the IMU, receiver, motors and LEDs; the comms core the serial port, blackbox storage, the flow
+   sensor and the extras' sensors.  Two objects are shared besides the rings.  The loop-timing profiler:
+   each core records only its own tasks, and MSP reads the control core's figures as they stand.  And
+   the debug() ring (debug.hpp), filled on the control core and flushed on the comms core, whose
+   indices are atomics like the rings'.
+
+   A sketch starts the second core after Hackflight::init() and loops updateComms() there, e.g. on the
+   RP2040's Arduino core:
+
+     void loop(void)  { h.update(); }
+     void loop1(void) { h.updateComms(); }
+
+   updateComms() does nothing until init() has finished.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#include "config.hpp"
+#include "mixer.hpp"
+
+namespace hf {
+
+template <typename T, uint8_t SIZE>
+class SpscRing {
+
+    public:
+
+        void init(void)
+        {
+            head.store(0, std::memory_order_relaxed);
+            tail.store(0, std::memory_order_relaxed);
+        }
+
+        // Producer only; false if the ring is full
+        bool push(const T & item)
+        {
+            uint8_t h = head.load(std::memory_order_relaxed);
+            uint8_t next = (h + 1) % SIZE;
+
+            if (next == tail.load(std::memory_order_acquire)) {
+                return false;
+            }
+
+            items[h] = item;
+            head.store(next, std::memory_order_release);
+
+            return true;
+        }
+
+        // Consumer only; false if the ring is empty
+        bool pop(T & item)
+        {
+            uint8_t t = tail.load(std::memory_order_relaxed);
+
+            if (t == head.load(std::memory_order_acquire)) {
+                return false;
+            }
+
+            item = items[t];
+            tail.store((t + 1) % SIZE, std::memory_order_release);
+
+            return true;
+        }
+
+    private:
+
+        T items[SIZE];
+
+        std::atomic<uint8_t> head;
+        std::atomic<uint8_t> tail;
+};
+
+// One IMU cycle, as the control core saw it
+typedef struct coreState_t {
+    uint32_t time;
+    float    quaternion[4];         // when haveQuaternion
+    float    eulerAngles[3];        // degrees, otherwise
+    float    gravity[3];
+    int16_t  gyro[3];               // filtered, as the PID saw it
+    int16_t  command[4];
+    int16_t  axisPID[3];
+    int16_t  channels[CONFIG_RC_CHANS];  // raw PWM, for MSP_RC
+    uint16_t motors[VehicleMixer::MOTORS];
+    uint8_t  auxState;
+    bool     armed;
+    bool     attitude;              // false while armed in rate mode, when none was worked out
+    bool     haveQuaternion;
+} coreState_t;
+
+enum {
+    CORE_COMMAND_RC,                // coreChannels_t, from SET_RAW_RC
+    CORE_COMMAND_MOTORS,            // coreMotors_t, from SET_MOTOR
+    CORE_COMMAND_NAV,               // coreNav_t
+    CORE_COMMAND_PID_CONFIG,        // PidConfig
+    CORE_COMMAND_RC_CONFIG          // RcConfig
+};
+
+typedef struct coreChannels_t {
+    int16_t  values[CONFIG_RC_CHANS];
+} coreChannels_t;
+
+typedef struct coreMotors_t {
+    uint16_t values[4];
+    uint8_t  count;
+} coreMotors_t;
+
+typedef struct coreNav_t {
+    int16_t  command[4];            // roll, pitch and throttle, as Navigator::apply() leaves them
+    bool     active;
+} coreNav_t;
+
+// Room for the largest of the above
+constexpr size_t coreLarger(size_t a, size_t b) { return a > b ? a : b; }
+
+static const size_t CORE_COMMAND_BYTES = coreLarger(coreLarger(sizeof(PidConfig), sizeof(RcConfig)),
+        coreLarger(sizeof(coreChannels_t), coreLarger(sizeof(coreMotors_t), sizeof(coreNav_t))));
+
+class CoreCommand {
+
+    public:
+
+        uint8_t kind;
+
+        template <typename T>
+        void set(uint8_t _kind, const T & value)
+        {
+            static_assert(sizeof(T) <= sizeof(data), "command too big for CoreCommand");
+            kind = _kind;
+            memcpy(data, &value, sizeof(T));
+        }
+
+        template <typename T>
+        void get(T & value) const
+        {
+            memcpy(&value, data, sizeof(T));
+        }
+
+    private:
+
+        uint8_t data[CORE_COMMAND_BYTES];
+};
+
+class CoreLink {
+
+    public:
+
+        SpscRing<coreState_t, CONFIG_CORE_STATE_RING>   state;      // control core to comms core
+        SpscRing<CoreCommand, CONFIG_CORE_COMMAND_RING> commands;   // comms core to control core
+
+        void init(void);
+
+        // Set by the control core once init() is done; until then the comms core leaves everything alone
+        void setReady(void) { ready.store(true, std::memory_order_release); }
+        bool isReady(void) { return ready.load(std::memory_order_acquire); }
+
+    private:
+
+        std::atomic<bool> ready;
+};
+
+/********************************************* CPP ********************************************************/
+
+void CoreLink::init(void)
+{
+    state.init();
+    commands.init();
+    ready.store(false, std::memory_order_relaxed);
+}
+
+} // namespace hf
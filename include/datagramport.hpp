@@ -0,0 +1,150 @@
+/*
+   datagramport.hpp : MSP over a packet link (UDP on Wi-Fi boards and the simulator), for a board's serial methods
+
+   A board with a datagram socket keeps one of these and hands its serial methods to it.  When MSP finds
+   nothing left to read, the board takes the next datagram from its socket into receiveBuffer() and calls
+   received(); MSP then parses it as it would bytes off a UART.  Everything MSP writes between two
+   serialFlush() calls (one burst of replies and due telemetry) is gathered, and serialFlush() sends it as
+   a single datagram.  A lost datagram is never sent again: the next burst carries newer telemetry anyway.
+
+   An ESP32 board, for example, would do:
+
+       uint8_t serialAvailableBytes(void)
+       {
+           if (!port.available() && udp.parsePacket())
+               port.received(udp.read(port.receiveBuffer(), CONFIG_DATAGRAM_SIZE));
+           return port.available();
+       }
+
+       void serialFlush(void)
+       {
+           if (port.pending()) {
+               udp.beginPacket(gcsAddress, gcsPort);
+               udp.write(port.sendBuffer(), port.pending());
+               udp.endPacket();
+               port.sent();
+           }
+       }
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "config.hpp"
+
+namespace hf {
+
+class DatagramPort {
+
+    public:
+
+        void init(void);
+
+    //------------------------------------------ Receive --------------------------------------------------------
+        // Where the board puts the next datagram, up to CONFIG_DATAGRAM_SIZE bytes; only while available() is zero
+        uint8_t * receiveBuffer(void) { return rxBuf; }
+        void      received(int16_t count);
+
+        // For serialAvailableBytes() and serialReadByte()
+        uint8_t   available(void);
+        uint8_t   read(void);
+
+    //-------------------------------------------- Send ---------------------------------------------------------
+        // For serialAvailableForWrite(), serialWriteByte() and serialWriteBytes(); MSP keeps what won't fit for
+        // the next datagram
+        uint16_t  availableForWrite(void) { return CONFIG_DATAGRAM_SIZE - txLen; }
+        void      write(uint8_t c);
+        void      write(const uint8_t * buf, uint16_t count);
+
+        // The datagram to send from serialFlush(), if pending() is nonzero, then sent()
+        const uint8_t * sendBuffer(void) { return txBuf; }
+        uint16_t  pending(void) { return txLen; }
+        void      sent(void) { txLen = 0; }
+
+    private:
+
+        uint8_t  rxBuf[CONFIG_DATAGRAM_SIZE];
+        uint16_t rxLen;
+        uint16_t rxIndex;
+
+        uint8_t  txBuf[CONFIG_DATAGRAM_SIZE];
+        uint16_t txLen;
+};
+
+/********************************************* CPP ********************************************************/
+
+void DatagramPort::init(void)
+{
+    rxLen   = 0;
+    rxIndex = 0;
+    txLen   = 0;
+}
+
+void DatagramPort::received(int16_t count)
+{
+    // Nothing, or a socket error
+    if (count <= 0) {
+        return;
+    }
+
+    rxLen   = count > (int16_t)CONFIG_DATAGRAM_SIZE ? CONFIG_DATAGRAM_SIZE : count;
+    rxIndex = 0;
+}
+
+uint8_t DatagramPort::available(void)
+{
+    uint16_t left = rxLen - rxIndex;
+
+    return left > 0xFF ? 0xFF : (uint8_t)left;
+}
+
+uint8_t DatagramPort::read(void)
+{
+    if (rxIndex == rxLen) {
+        return 0;
+    }
+
+    uint8_t c = rxBuf[rxIndex++];
+
+    if (rxIndex == rxLen) {
+        rxLen   = 0;
+        rxIndex = 0;
+    }
+
+    return c;
+}
+
+void DatagramPort::write(uint8_t c)
+{
+    if (txLen < CONFIG_DATAGRAM_SIZE) {
+        txBuf[txLen++] = c;
+    }
+}
+
+void DatagramPort::write(const uint8_t * buf, uint16_t count)
+{
+    if (count > CONFIG_DATAGRAM_SIZE - txLen) {
+        count = CONFIG_DATAGRAM_SIZE - txLen;
+    }
+
+    memcpy(&txBuf[txLen], buf, count);
+    txLen += count;
+}
+
+} // namespace hf
@@ -1,5 +1,15 @@
 /*
-   debug.hpp : Simple serial debugging
+   debug.hpp : Deferred serial debugging
+
+   debug() only copies a format string pointer and up to four integer arguments into a
+   single-producer / single-consumer ring; no formatting happens at the call site, so it is
+   cheap enough for the IMU loop.  debugFlush(), run from a low-priority task, formats queued
+   messages and sends them to Board::dump().  The format string must be a literal (its address
+   identifies it), and only integer conversions (%d, %u, %x, %c) are supported.
+
+   The ring's indices are atomics, like those of the rings in corelink.hpp, so that with
+   CONFIG_DUAL_CORE the control core can queue messages that the comms core flushes.  There is still
+   only one producer: call debug() from one core, the control core on dual-core boards.
 
    This file is part of Hackflight.
 
@@ -18,19 +28,145 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdio>
+
 #include "board.hpp"
 #include "common.hpp"
+#include "config.hpp"
 
 namespace hf {
 
-void debug(Board * board, const char * fmt, ...)
+#ifdef CONFIG_NO_DEBUG
+
+// Left out of the build (config.hpp): messages go nowhere, and there is no ring to keep them in
+inline void debug(const char * fmt, int32_t a=0, int32_t b=0, int32_t c=0, int32_t d=0)
+{
+    (void)fmt; (void)a; (void)b; (void)c; (void)d;
+}
+
+inline void debugFlush(Board * board, uint8_t maxMessages)
+{
+    (void)board;
+    (void)maxMessages;
+}
+
+#else
+
+class DebugRing {
+
+    public:
+
+        static const uint8_t ARGS = 4;
+
+        bool push(const char * fmt, int32_t a, int32_t b, int32_t c, int32_t d);
+        bool pop(const char * & fmt, int32_t args[ARGS]);
+
+        uint16_t takeDropped(void);
+
+    private:
+
+        typedef struct record_t {
+            const char * fmt;
+            int32_t      args[ARGS];
+        } record_t;
+
+        record_t records[CONFIG_DEBUG_RECORDS];
+
+        // Producer writes only head, consumer only tail
+        std::atomic<uint8_t> head;
+        std::atomic<uint8_t> tail;
+
+        // Approximate: a drop counted while the consumer is reading it may be lost
+        std::atomic<uint16_t> dropped;
+};
+
+void debug(const char * fmt, int32_t a=0, int32_t b=0, int32_t c=0, int32_t d=0);
+
+void debugFlush(Board * board, uint8_t maxMessages);
+
+/********************************************* CPP ********************************************************/
+
+// Zero-initialized as a static, so usable before Hackflight::init
+DebugRing debugRing;
+
+void debug(const char * fmt, int32_t a, int32_t b, int32_t c, int32_t d)
+{
+    debugRing.push(fmt, a, b, c, d);
+}
+
+void debugFlush(Board * board, uint8_t maxMessages)
+{
+    char buf[CONFIG_DEBUG_LINE_LENGTH];
+
+    uint16_t dropped = debugRing.takeDropped();
+    if (dropped) {
+        snprintf(buf, sizeof(buf), "[%u debug messages dropped]\n", (unsigned)dropped);
+        board->dump(buf);
+    }
+
+    const char * fmt;
+    int32_t args[DebugRing::ARGS];
+
+    for (uint8_t k=0; k<maxMessages && debugRing.pop(fmt, args); ++k) {
+        snprintf(buf, sizeof(buf), fmt, args[0], args[1], args[2], args[3]);
+        board->dump(buf);
+    }
+}
+
+bool DebugRing::push(const char * fmt, int32_t a, int32_t b, int32_t c, int32_t d)
+{
+    uint8_t h = head.load(std::memory_order_relaxed);
+    uint8_t next = (h + 1) % CONFIG_DEBUG_RECORDS;
+
+    // Acquire, so that the consumer is done with the record before it is overwritten
+    if (next == tail.load(std::memory_order_acquire)) {
+        uint16_t n = dropped.load(std::memory_order_relaxed);
+        if (n < 0xFFFF)
+            dropped.store(n + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    record_t & r = records[h];
+    r.fmt = fmt;
+    r.args[0] = a;
+    r.args[1] = b;
+    r.args[2] = c;
+    r.args[3] = d;
+
+    // Record must be complete before the consumer can see the new head
+    head.store(next, std::memory_order_release);
+
+    return true;
+}
+
+bool DebugRing::pop(const char * & fmt, int32_t args[ARGS])
 {
-    va_list ap;       
-    va_start(ap, fmt);     
-    char buf[1000];
-    VSPRINTF(buf, fmt, ap);
-    board->dump(buf);
-    va_end(ap);  
+    uint8_t t = tail.load(std::memory_order_relaxed);
+
+    if (t == head.load(std::memory_order_acquire))
+        return false;
+
+    const record_t & r = records[t];
+    fmt = r.fmt;
+    for (uint8_t k=0; k<ARGS; ++k)
+        args[k] = r.args[k];
+
+    // Record must be read before the producer can reuse it
+    tail.store((t + 1) % CONFIG_DEBUG_RECORDS, std::memory_order_release);
+
+    return true;
 }
 
+uint16_t DebugRing::takeDropped(void)
+{
+    // Only the rare drop costs a write, so the flusher doesn't dirty the counter every pass
+    uint16_t n = dropped.load(std::memory_order_relaxed);
+    if (n)
+        dropped.store(0, std::memory_order_relaxed);
+    return n;
 }
+
+#endif // CONFIG_NO_DEBUG
+
+} // namespace
@@ -0,0 +1,110 @@
+/*
+   dshot.hpp : board-independent support for the DShot digital ESC protocol
+
+   A DShot frame is sixteen bits, sent MSB first: an eleven-bit throttle value, a telemetry-request
+   bit, and a four-bit checksum.  Each bit takes a fixed period; a one is a long high pulse and a zero
+   a short one.  Boards precompute the frame as a buffer of timer compare values and send it by DMA.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "config.hpp"
+
+namespace hf {
+
+class DShot {
+
+    public:
+
+        static const uint16_t THROTTLE_MIN   = 48;      // values 1-47 are reserved for ESC commands
+        static const uint16_t THROTTLE_MAX   = 2047;
+        static const uint8_t  FRAME_BITS     = 16;
+
+        // Bit buffers hold one compare value per bit, plus a trailing zero to hold the line low
+        static const uint8_t  BUFFER_LENGTH  = FRAME_BITS + 1;
+
+        static bool     isDShot(uint8_t protocol);
+        static uint32_t bitRate(uint8_t protocol);
+
+        static uint16_t scale(uint16_t value, const PwmConfig & pwmConfig);
+        static uint16_t packet(uint16_t throttle, bool telemetry=false);
+
+        template <typename T>
+        static void fillBitBuffer(uint16_t packet, T buffer[BUFFER_LENGTH], T oneTicks, T zeroTicks);
+
+        // High time of a one bit is 3/4 of the bit period, of a zero bit 3/8
+        static uint32_t oneTicks(uint32_t bitTicks)  { return (3 * bitTicks) / 4; }
+        static uint32_t zeroTicks(uint32_t bitTicks) { return (3 * bitTicks) / 8; }
+};
+
+/********************************************* CPP ********************************************************/
+
+bool DShot::isDShot(uint8_t protocol)
+{
+    return bitRate(protocol) != 0;
+}
+
+uint32_t DShot::bitRate(uint8_t protocol)
+{
+    switch (protocol) {
+        case MOTOR_PROTOCOL_DSHOT150:
+            return 150000;
+        case MOTOR_PROTOCOL_DSHOT300:
+            return 300000;
+        case MOTOR_PROTOCOL_DSHOT600:
+            return 600000;
+        default:
+            return 0;
+    }
+}
+
+uint16_t DShot::scale(uint16_t value, const PwmConfig & pwmConfig)
+{
+    // Minimum PWM (throttle down, disarmed) means motor stop, which DShot sends as zero
+    if (value <= pwmConfig.min)
+        return 0;
+
+    if (value >= pwmConfig.max)
+        return THROTTLE_MAX;
+
+    return THROTTLE_MIN + (uint32_t)(value - pwmConfig.min) * (THROTTLE_MAX - THROTTLE_MIN) /
+        (pwmConfig.max - pwmConfig.min);
+}
+
+uint16_t DShot::packet(uint16_t throttle, bool telemetry)
+{
+    uint16_t value = (throttle << 1) | (telemetry ? 1 : 0);
+
+    uint16_t checksum = (value ^ (value >> 4) ^ (value >> 8)) & 0x0F;
+
+    return (value << 4) | checksum;
+}
+
+template <typename T>
+void DShot::fillBitBuffer(uint16_t packet, T buffer[BUFFER_LENGTH], T oneTicks, T zeroTicks)
+{
+    for (uint8_t k=0; k<FRAME_BITS; ++k) {
+        buffer[k] = (packet & 0x8000) ? oneTicks : zeroTicks;
+        packet <<= 1;
+    }
+
+    buffer[FRAME_BITS] = 0;
+}
+
+} // namespace
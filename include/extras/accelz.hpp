@@ -3,6 +3,13 @@
 
    Adapted from https://github.com/multiwii/baseflight/blob/master/src/imu.c
 
+   Each IMU cycle, update() takes the vertical component of the accelerometer as a dot product with
+   the gravity vector the firmware has already found for the tick (see Quaternion::gravity()), so no
+   rotation is recomputed per sample.  The smoothed, deadbanded values are summed as integers, and
+   every ImuConfig::accelZCalcMicro the sum is integrated into vertical velocity and altitude.
+   getAcceleration() gives each sample's value, for AltitudeEstimator.  While disarmed the estimator learns the at-rest offset and holds both at zero, so
+   altitude is relative to where the vehicle was armed.
+
    This file is part of Hackflight.
 
    Hackflight is free software: you can redistribute it and/or modify
@@ -30,146 +37,145 @@ class AccelZ {
     private:
 
         ImuConfig imuConfig;
+        TimedTask computeTask;
 
-        int32_t   accelZSum;
         float     accelVelScale;
+        float     fcAcc;
+
+        // Per-sample state: 64 times the vertical accel at rest, and the low-passed vertical accel
         int32_t   accelZOffset;
         float     accelZSmooth;
-        int16_t   accelSmooth[3];
+        int32_t   accelZ;
+        uint32_t  previousTimeUsec;
+        bool      started;
+
+        // Accumulated since the last compute()
+        int32_t   accelZSum;
         uint32_t  accelTimeSum;
-        int32_t   accelSumCount;
-        float     fcAcc;
+        uint16_t  accelSumCount;
+
+        // Outputs
+        float     altitude;
+        float     velocity;
 
         static int32_t deadbandFilter(int32_t value, int32_t deadband);
-        static void    rotateV(float v[3], float *delta);
+
+        void  compute(bool armed);
 
     public:
 
-        void  init(ImuConfig& _imuConfig);
-        void  update(int16_t accelRaw[3], float eulerAngles[3], uint32_t currentTimeUsec, bool armed);
-        float compute(void);
+        void  init(const ImuConfig& _imuConfig);
+
+        // Once per IMU cycle, with the raw accelerometer (accel1G per g) and the unit vector along
+        // gravity in the vehicle's frame; returns true when altitude and velocity have been updated
+        bool  update(const int16_t accelRaw[3], const float gravity[3], uint32_t currentTimeUsec, bool armed);
+
+        // Centimeters above where the vehicle was armed, and centimeters per second upward
+        float getAltitude(void) { return altitude; }
+        float getVelocity(void) { return velocity; }
+
+        // The latest sample's vertical acceleration, less gravity, in cm/sec/sec upward
+        float getAcceleration(void) { return accelZ * accelVelScale * 1e6f; }
 };
 
 /********************************************* CPP ********************************************************/
 
-void AccelZ::init(ImuConfig& _imuConfig)
+void AccelZ::init(const ImuConfig& _imuConfig)
 {
     memcpy(&imuConfig, &_imuConfig, sizeof(ImuConfig));
 
+    // Accel units times microseconds to cm/sec
     accelVelScale = 9.80665f / imuConfig.accel1G / 10000.0f;
 
-    for (int k=0; k<3; ++k) {
-        accelSmooth[k] = 0;
-    }
+    // Calculate RC time constant used in the accelZ lpf    
+    fcAcc = (float)(0.5f / (M_PI * imuConfig.accelZLpfCutoff)); 
+
+    computeTask.init(imuConfig.accelZCalcMicro);
+
     accelZOffset = 0;
-    accelTimeSum = 0;
-    accelSumCount = 0;
     accelZSmooth = 0;
+    accelZ = 0;
+    previousTimeUsec = 0;
+    started = false;
+
     accelZSum = 0;
+    accelTimeSum = 0;
+    accelSumCount = 0;
 
-    // Calculate RC time constant used in the accelZ lpf    
-    fcAcc = (float)(0.5f / (M_PI * imuConfig.accelZLpfCutoff)); 
+    altitude = 0;
+    velocity = 0;
 }
 
-void AccelZ::update(int16_t accelRaw[3], float eulerAngles[3], uint32_t currentTimeUsec, bool armed)
+bool AccelZ::update(const int16_t accelRaw[3], const float gravity[3], uint32_t currentTimeUsec, bool armed)
 {
-    // Track delta time
-    static uint32_t previousTimeUsec;
+    // Vertical (earth-frame) component of the accel
+    float accelZEarth = gravity[0] * accelRaw[0] + gravity[1] * accelRaw[1] + gravity[2] * accelRaw[2];
+
+    // Track delta time; the first sample only starts the clock
     uint32_t dT_usec = currentTimeUsec - previousTimeUsec;
     previousTimeUsec = currentTimeUsec;
 
-    // Rotate accel values into the earth frame
-
-    float rpy[3];
-    rpy[0] = -(float)eulerAngles[0];
-    rpy[1] = -(float)eulerAngles[1];
-    rpy[2] = -(float)eulerAngles[2];
-
-    float       accelNed[3];
-    accelNed[0] = accelSmooth[0];
-    accelNed[1] = accelSmooth[1];
-    accelNed[2] = accelSmooth[2];
-    rotateV(accelNed, rpy);
+    if (!started) {
+        started = true;
+        accelZOffset = 64 * (int32_t)accelZEarth;
+        computeTask.update(currentTimeUsec);
+        return false;
+    }
 
     // Compute vertical acceleration offset at rest
     if (!armed) {
         accelZOffset -= accelZOffset / 64;
-        accelZOffset += (int32_t)accelNed[2];
+        accelZOffset += (int32_t)accelZEarth;
     }
 
     // Compute smoothed vertical acceleration
-    accelNed[2] -= accelZOffset / 64;  // compensate for gravitation on z-axis
+    accelZEarth -= accelZOffset / 64;  // compensate for gravitation on z-axis
     float dT_sec = dT_usec * 1e-6f;
-    accelZSmooth = accelZSmooth + (dT_sec / (fcAcc + dT_sec)) * (accelNed[2] - accelZSmooth); // low pass filter
+    accelZSmooth = accelZSmooth + (dT_sec / (fcAcc + dT_sec)) * (accelZEarth - accelZSmooth); // low pass filter
 
     // Apply Deadband to reduce integration drift and vibration influence and
     // sum up Values for later integration to get velocity and distance
-    accelZSum += deadbandFilter((int32_t)lrintf(accelZSmooth),  imuConfig.accelZDeadband);
+    accelZ = deadbandFilter((int32_t)lrintf(accelZSmooth),  imuConfig.accelZDeadband);
+    accelZSum += accelZ;
 
     // Accumulate time and count for integrating accelerometer values
     accelTimeSum += dT_usec;
-    accelZSum += deadbandFilter((int32_t)lrintf(accelZSmooth),  imuConfig.accelZDeadband);
-}
+    accelSumCount++;
+
+    if (!computeTask.checkAndUpdate(currentTimeUsec)) {
+        return false;
+    }
 
+    compute(armed);
+
+    return true;
+}
 
-float AccelZ::compute(void)
+void AccelZ::compute(bool armed)
 {
-    // altitude in cm
-    static float accelAlt;
+    if (accelSumCount > 0) {
 
-    float accZ_tmp = (float)accelZSum / (float)accelSumCount;
-    float vel_acc = accZ_tmp * accelVelScale * (float)accelTimeSum;
+        float accZ_tmp = (float)accelZSum / (float)accelSumCount;
+        float vel_acc = accZ_tmp * accelVelScale * (float)accelTimeSum;
 
-    // Integrate velocity to get distance (x= a/2 * t^2)
-    float dt = accelTimeSum * 1e-6f; // delta acc reading time in seconds
-    accelAlt += (vel_acc * 0.5f) * dt;
+        // Integrate velocity to get distance (x= a/2 * t^2 + v * t)
+        float dt = accelTimeSum * 1e-6f; // delta acc reading time in seconds
+        altitude += (vel_acc * 0.5f + velocity) * dt;
+        velocity += vel_acc;
+    }
+
+    // On the ground, nothing is moving
+    if (!armed) {
+        altitude = 0;
+        velocity = 0;
+    }
 
     // Reset accumulated values
     accelZSum = 0;
     accelTimeSum = 0;
     accelSumCount = 0;
-
-    return accelAlt;
 }
 
-
-void AccelZ::rotateV(float v[3], float *delta)
-{
-    float * v_tmp = v;
-
-    // This does a  "proper" matrix rotation using gyro deltas without small-angle approximation
-    float mat[3][3];
-    float cosx, sinx, cosy, siny, cosz, sinz;
-    float coszcosx, sinzcosx, coszsinx, sinzsinx;
-
-    cosx = cosf(delta[0]);
-    sinx = sinf(delta[0]);
-    cosy = cosf(delta[1]);
-    siny = sinf(delta[1]);
-    cosz = cosf(delta[2]);
-    sinz = sinf(delta[2]);
-
-    coszcosx = cosz * cosx;
-    sinzcosx = sinz * cosx;
-    coszsinx = sinx * cosz;
-    sinzsinx = sinx * sinz;
-
-    mat[0][0] = cosz * cosy;
-    mat[0][1] = -cosy * sinz;
-    mat[0][2] = siny;
-    mat[1][0] = sinzcosx + (coszsinx * siny);
-    mat[1][1] = coszcosx - (sinzsinx * siny);
-    mat[1][2] = -sinx * cosy;
-    mat[2][0] = (sinzsinx) - (coszcosx * siny);
-    mat[2][1] = (coszsinx) + (sinzcosx * siny);
-    mat[2][2] = cosy * cosx;
-
-    v[0] = v_tmp[0] * mat[0][0] + v_tmp[1] * mat[1][0] + v_tmp[2] * mat[2][0];
-    v[1] = v_tmp[0] * mat[0][1] + v_tmp[1] * mat[1][1] + v_tmp[2] * mat[2][1];
-    v[2] = v_tmp[0] * mat[0][2] + v_tmp[1] * mat[1][2] + v_tmp[2] * mat[2][2];
-}
-
-
 int32_t AccelZ::deadbandFilter(int32_t value, int32_t deadband)
 {
     if (abs(value) < deadband) {
@@ -183,4 +189,3 @@ int32_t AccelZ::deadbandFilter(int32_t value, int32_t deadband)
 }
 
 } // namespace hf
-
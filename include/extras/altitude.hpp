@@ -0,0 +1,218 @@
+/*
+   altitude.hpp : Altitude and vertical velocity from the accelerometer, baro and sonar together
+
+   A third-order complementary filter, after ArduPilot's AP_InertialNav: each IMU cycle, predict()
+   integrates AccelZ's vertical acceleration into velocity and altitude, and the error against
+   the most recent reference (sonar while it has a reading, else baro) pulls all three, the accel
+   bias included, back toward it.  The references come in at their own rates through
+   correctBaro() and correctSonar(); every call costs a handful of multiplies, whatever the mix.
+
+   Altitude is relative to where the vehicle was armed: while disarmed, each reference's reading
+   is taken as the ground.  While the sonar is in charge, the baro's offset from the estimate is
+   tracked, so that handing back to the baro causes no step.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "config.hpp"
+#include "msp.hpp"
+
+namespace hf {
+
+class AltitudeEstimator {
+
+    private:
+
+        // How quickly the baro's offset follows the ground, or the estimate while the sonar is in charge
+        static constexpr float BARO_OFFSET_RATE = 0.05f;
+
+        AltitudeConfig config;
+
+        // Position, velocity and accel-bias gains for each reference
+        float    baroGains[3];
+        float    sonarGains[3];
+
+        // Estimate: cm, cm/sec, cm/sec/sec
+        float    altitude;
+        float    velocity;
+        float    accelCorrection;
+
+        // Latest reference's error, and the gains it is applied with
+        float    error;
+        float  * gains;
+
+        float    baroOffset;
+        bool     baroStarted;
+
+        float    sonarOffset;
+        uint32_t sonarTimeUsec;
+        bool     sonarValid;
+
+        uint32_t previousTimeUsec;
+        bool     armed;
+
+        static void computeGains(float timeConstant, float gains[3]);
+
+        static void handleMsp(MSP & msp, void * context);
+
+        void reset(void);
+
+    public:
+
+        void  init(const AltitudeConfig & _config);
+
+        // Once per IMU cycle, with the vertical acceleration less gravity (cm/sec/sec upward, as
+        // from AccelZ::getAcceleration())
+        void  predict(float accelZ, uint32_t currentTimeUsec, bool _armed);
+
+        // Baro altitude above sea level (cm), whenever the baro has one
+        void  correctBaro(int32_t baroAltitude);
+
+        // Sonar distance to the ground (cm), whenever the sonar has one; zero means no echo
+        void  correctSonar(uint16_t distance, uint32_t currentTimeUsec);
+
+        // Centimeters above where the vehicle was armed, and centimeters per second upward
+        float getAltitude(void) { return altitude; }
+        float getVelocity(void) { return velocity; }
+
+        // Replaces Baro's MSP_ALTITUDE reply, which had no vario
+        void  registerMspHandlers(MSP * msp);
+};
+
+/********************************************* CPP ********************************************************/
+
+void AltitudeEstimator::init(const AltitudeConfig & _config)
+{
+    memcpy(&config, &_config, sizeof(AltitudeConfig));
+
+    computeGains(config.baroTimeConstant,  baroGains);
+    computeGains(config.sonarTimeConstant, sonarGains);
+
+    gains = baroGains;
+
+    baroOffset  = 0;
+    baroStarted = false;
+
+    sonarOffset   = 0;
+    sonarTimeUsec = 0;
+    sonarValid    = false;
+
+    previousTimeUsec = 0;
+    armed = false;
+
+    reset();
+}
+
+void AltitudeEstimator::computeGains(float timeConstant, float gains[3])
+{
+    // Critically damped: all three poles at -1/timeConstant
+    gains[0] = 3 / timeConstant;
+    gains[1] = 3 / (timeConstant * timeConstant);
+    gains[2] = 1 / (timeConstant * timeConstant * timeConstant);
+}
+
+void AltitudeEstimator::reset(void)
+{
+    altitude        = 0;
+    velocity        = 0;
+    accelCorrection = 0;
+    error           = 0;
+}
+
+void AltitudeEstimator::predict(float accelZ, uint32_t currentTimeUsec, bool _armed)
+{
+    float dt = (currentTimeUsec - previousTimeUsec) * 1e-6f;
+    previousTimeUsec = currentTimeUsec;
+
+    // On the ground, nothing is moving; the first armed cycle has no time step to integrate over
+    if (!_armed || !armed) {
+        armed = _armed;
+        reset();
+        return;
+    }
+
+    // Without a fresh echo, the baro takes over
+    if (sonarValid && (int32_t)(currentTimeUsec - sonarTimeUsec) > (int32_t)config.sonarTimeoutMicro) {
+        sonarValid = false;
+        gains = baroGains;
+        error = 0;
+    }
+
+    // Pull the estimate toward the reference
+    accelCorrection += error * gains[2] * dt;
+    velocity        += error * gains[1] * dt;
+    float altitudeCorrection = error * gains[0] * dt;
+
+    // Integrate the corrected accel
+    float velocityIncrease = (accelZ + accelCorrection) * dt;
+    altitude += (velocity + velocityIncrease * 0.5f) * dt + altitudeCorrection;
+    velocity += velocityIncrease;
+}
+
+void AltitudeEstimator::correctBaro(int32_t baroAltitude)
+{
+    if (!baroStarted) {
+        baroOffset  = baroAltitude;
+        baroStarted = true;
+    }
+
+    float relative = baroAltitude - baroOffset;
+
+    // Disarmed, the baro's reading is the ground
+    if (!armed || sonarValid) {
+        baroOffset += BARO_OFFSET_RATE * (relative - altitude);
+        return;
+    }
+
+    error = relative - altitude;
+}
+
+void AltitudeEstimator::correctSonar(uint16_t distance, uint32_t currentTimeUsec)
+{
+    if (distance == 0 || distance > config.sonarMaxCm) {
+        return;
+    }
+
+    sonarValid    = true;
+    sonarTimeUsec = currentTimeUsec;
+    gains         = sonarGains;
+
+    // Disarmed, the sonar's reading is the ground
+    if (!armed) {
+        sonarOffset = distance;
+        error = 0;
+        return;
+    }
+
+    error = distance - sonarOffset - altitude;
+}
+
+void AltitudeEstimator::registerMspHandlers(MSP * msp)
+{
+    msp->registerHandler(MSP_ALTITUDE, AltitudeEstimator::handleMsp, this);
+}
+
+void AltitudeEstimator::handleMsp(MSP & msp, void * context)
+{
+    AltitudeEstimator * estimator = (AltitudeEstimator *)context;
+
+    msp.headSerialReply(6);
+    msp.serialize32((int32_t)estimator->altitude);
+    msp.serialize16((int16_t)estimator->velocity);
+}
+
+} // namespace hf
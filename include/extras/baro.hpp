@@ -1,5 +1,13 @@
 /*
-   baro.hpp : Baro class header
+   baro.hpp : Baro class
+
+   Adapted from 
+
+     https://github.com/multiwii/baseflight/blob/master/src/imu.c
+     https://github.com/multiwii/baseflight/blob/master/src/sensors.c
+
+   Each extras slot, update() collects a conversion the board's baro has finished and starts the
+   next, never waiting on the part (see Board::baroStartConversion()).
 
    This file is part of Hackflight.
 
@@ -17,25 +25,133 @@
 
 #pragma once
 
+#include <cmath>
+
+#include "board.hpp"
+#include "config.hpp"
+#include "fastmath.hpp"
+
+namespace hf {
+
 class Baro {
 
     private:
 
+        Board * board;
+
         bool avail;
 
-        static const int TABLE_SIZE = 21;
+        // The conversion under way, when it will be done, and pressures since the last temperature
+        bool     convertingTemperature;
+        bool     converting;
+        uint32_t readyTimeUsec;
+        uint8_t  pressureCount;
 
-        uint32_t pressureSum;
-        int32_t  historyTable[TABLE_SIZE];
-        int      historyIdx;
+        // Raw results, and the latest pressure (Pa); smoothing is left to AltitudeEstimator
+        uint32_t rawTemperature;
+        uint32_t rawPressure;
+        int32_t  pressure;
+
+        void startConversion(bool temperature, uint32_t currentTimeUsec);
+
+        // Altitude (cm) against pressure (Pa), so that getAltitude() needs no powf()
+        InterpolationTable<CONFIG_BARO_TABLE_SIZE> altitudeTable;
+
+        static float pressureToAltitude(float pressure);
 
     public:
 
-        void init(void);
+        void init(Board * _board);
 
         bool available(void);
 
-        void update(void);
+        // Once per extras slot: collects a finished conversion and starts the next, never waiting on
+        // the part; true when there is a new pressure
+        bool update(void);
 
         int32_t getAltitude(void);
 };
+
+/********************************************* CPP ********************************************************/
+
+void Baro::init(Board * _board)
+{
+    this->board = _board;
+
+    this->converting = false;
+    this->convertingTemperature = false;
+    this->readyTimeUsec = 0;
+    this->pressureCount = 0;
+    this->rawTemperature = 0;
+    this->rawPressure = 0;
+    this->pressure = 0;
+
+    this->avail = this->board->baroInit();
+
+    this->altitudeTable.init(Baro::pressureToAltitude, CONFIG_BARO_TABLE_MIN_PA, CONFIG_BARO_TABLE_MAX_PA);
+}
+
+bool Baro::available(void)
+{
+    return this->avail;
+}
+
+void Baro::startConversion(bool temperature, uint32_t currentTimeUsec)
+{
+    this->convertingTemperature = temperature;
+    this->readyTimeUsec = currentTimeUsec + this->board->baroStartConversion(temperature);
+    this->converting = true;
+}
+
+bool Baro::update(void)
+{
+    if (!this->avail) {
+        return false;
+    }
+
+    uint32_t currentTimeUsec = (uint32_t)this->board->getMicros();
+
+    // Temperature first, since pressure can't be compensated without it
+    if (!this->converting) {
+        startConversion(true, currentTimeUsec);
+        return false;
+    }
+
+    // Still converting: come back next slot
+    if ((int32_t)(currentTimeUsec - this->readyTimeUsec) < 0) {
+        return false;
+    }
+
+    bool gotPressure = false;
+
+    if (this->convertingTemperature) {
+        this->rawTemperature = this->board->baroReadConversion();
+        this->pressureCount = 0;
+    }
+    else {
+        this->rawPressure = this->board->baroReadConversion();
+        this->pressure = this->board->baroCompensate(this->rawTemperature, this->rawPressure);
+        this->pressureCount++;
+        gotPressure = true;
+    }
+
+    // Start the next one right away, so the part converts while the other tasks run
+    startConversion(this->pressureCount >= CONFIG_BARO_PRESSURES_PER_TEMPERATURE, currentTimeUsec);
+
+    return gotPressure;
+}
+
+float Baro::pressureToAltitude(float pressure)
+{
+    // Calculate altitude above sea level in cm via baro pressure in Pascals (millibars)
+    // See: https://github.com/diydrones/ardupilot/blob/master/libraries/AP_Baro/AP_Baro.cpp#L140
+    return (1.0f - powf(pressure / 101325.0f, 0.190295f)) * 4433000.0f;
+}
+
+int32_t Baro::getAltitude(void)
+{
+    // From the table: within 2 cm of the formula above 900 hPa, and 8 cm over its whole range
+    return (int32_t)this->altitudeTable.get((float)this->pressure);
+}
+
+} // namespace hf
@@ -1,5 +1,9 @@
 /*
-   hover.hpp : Class declaration for hover-in-place functionality
+   hover.hpp : Hover-in-place functionality
+
+   Once per IMU cycle, after AltitudeEstimator::predict(), updateAltitudePid() turns the error between
+   the held altitude and the estimate into a throttle correction, which perform() applies while the aux
+   switch is up.
 
    This file is part of Hackflight.
 
@@ -17,21 +21,26 @@
 
 #pragma once
 
-#ifdef __arm__
-extern "C" {
-#else
-#include <stdio.h>
-#endif
+#include <cstdlib>
 
-#include "hackflight.hpp"
+#include "board.hpp"
+#include "config.hpp"
+#include "rc.hpp"
+#include "altitude.hpp"
+
+namespace hf {
 
 class Hover {
 
     private:
 
-        class IMU    * imu;
-        class Sonars * sonars;
-        class RC     * rc;
+        static const int16_t THROTTLE_NEUTRAL_ZONE = 40;
+
+        Board             * board;
+        AltitudeEstimator * altitude;
+        RC                * rc;
+
+        AltitudeConfig config;
 
         typedef enum {
             MODE_NORMAL,
@@ -44,12 +53,10 @@ class Hover {
         bool     altHoldChanged;
         int16_t  altHoldCorrection;
         int32_t  altHoldValue;
-        uint16_t lastSonarAlt;
         int16_t  altHoldPID;
         int16_t  errorAltitudeI;
         int16_t  initialThrottleHold;
         uint32_t previousT;
-        bool     wasArmed;
 
     public:
 
@@ -58,16 +65,123 @@ class Hover {
         int32_t  vario;
 
         // for heading
-        int16_t headHold; 
-  
-        // called by MW
-        void init(class IMU * _imu, class Sonars * _sonars, class RC * _rc);
+        int16_t headHold;
+
+        void init(Board * _board, const AltitudeConfig & _config, AltitudeEstimator * _altitude, RC * _rc);
         void checkSwitch(void);
         void updateAltitudePid(void);
         void perform(void);
 };
 
-
-#ifdef __arm__
-} // extern "C"
+/********************************************* CPP ********************************************************/
+
+void Hover::init(Board * _board, const AltitudeConfig & _config, AltitudeEstimator * _altitude, RC * _rc)
+{
+    this->board    = _board;
+    this->altitude = _altitude;
+    this->rc       = _rc;
+
+    memcpy(&this->config, &_config, sizeof(AltitudeConfig));
+
+    this->flightMode = MODE_NORMAL;
+    this->altHoldChanged = false;
+    this->altHoldCorrection = 0;
+    this->altHoldValue = 0;
+    this->altHoldPID = 0;
+    this->errorAltitudeI = 0;
+    this->estAlt = 0;
+    this->headHold = 0;
+    this->initialThrottleHold = 0;
+    this->previousT = 0;
+    this->vario = 0;
+}
+
+void Hover::checkSwitch(void)
+{
+    // If aux switch not in off state
+    if (this->rc->getAuxState() > 0) {
+
+        // If we've just changed state,
+        if (!this->flightMode) {
+
+            // grab altitude and throttle values for hold
+            this->altHoldValue = this->estAlt;
+            this->initialThrottleHold = this->rc->command[DEMAND_THROTTLE];
+
+            // reset PID values
+            this->altHoldPID = 0;
+            this->errorAltitudeI = 0;
+        }
+
+        this->flightMode = this->rc->getAuxState() > 1 ? MODE_GUIDED : MODE_ALTHOLD;
+
+    }
+    else
+        this->flightMode = MODE_NORMAL;
+}
+
+void Hover::updateAltitudePid(void)
+{
+    uint32_t currentT = (uint32_t)this->board->getMicros();
+    uint32_t dTime = currentT - this->previousT;
+    this->previousT = currentT;
+
+    // Fused baro/sonar/accel estimate, fresh every IMU cycle
+    this->estAlt = (int32_t)this->altitude->getAltitude();
+    this->vario  = (int32_t)this->altitude->getVelocity();
+
+    // PID: P
+    int16_t errorAltitudeP = this->altHoldValue - this->estAlt;
+    //errorAltitudeP = constrain(errorAltitudeP, -300, 300);
+    //errorAltitudeP = deadbandFilter(errorAltitudeP, 10); //remove small P param to reduce noise near zero position
+    this->altHoldPID = this->config.holdP * errorAltitudeP>>7;
+    //this->altHoldPID = constrain(this->altHoldPID, -150, +150);
+
+    // PID: I, scaled by the time step so that the gain means what it did at one step per holdStepMilli
+    this->errorAltitudeI += (int32_t)this->config.holdI * errorAltitudeP * (int32_t)dTime / (this->config.holdStepMilli*1000) >>6;
+    //this->errorAltitudeI = constrain(this->errorAltitudeI,-30000,30000);
+    this->altHoldPID += errorAltitudeI>>9;    //I in range +/-60
+
+    // PID: D, on the climb per holdStepMilli as before
+    //this->vario = deadbandFilter(this->vario, 5);
+    int16_t errorAltitudeD = this->config.holdD * this->vario * this->config.holdStepMilli / 1000;
+    //errorAltitudeD = constrain(errorAltitudeD, -150, 150);
+    this->altHoldPID -= errorAltitudeD;
+}
+
+void Hover::perform(void)
+{
+    // For now, support navigation tasks in simulation only
+#ifndef _SIM
+    return;
 #endif
+
+    if (this->flightMode) { // alt-hold or guided
+
+        // If pilot moved throttle stick signficantly since initiating alt-hold
+        if (abs(this->rc->command[DEMAND_THROTTLE]-this->initialThrottleHold) > THROTTLE_NEUTRAL_ZONE) {
+
+            // Slowly increase/decrease AltHold proportional to stick movement ( +100 throttle gives ~ +50 cm in 1
+            // second with cycle time about 3-4ms)
+            this->altHoldCorrection += this->rc->command[DEMAND_THROTTLE] - this->initialThrottleHold;
+            if(abs(this->altHoldCorrection) > 512) {
+                this->altHoldValue += this->altHoldCorrection/512;
+                this->altHoldCorrection %= 512;
+            }
+
+            this->altHoldChanged = true;
+        }
+
+        // Otherwise, see whether alt-hold just changed
+        else if (this->altHoldChanged) {
+            this->altHoldValue = this->estAlt;
+            this->altHoldChanged = false;
+
+        }
+
+        // Adjust the throttle command via PID to maintain altitude
+        this->rc->command[DEMAND_THROTTLE] = this->initialThrottleHold + this->altHoldPID;
+    }
+}
+
+} // namespace hf
@@ -0,0 +1,102 @@
+/*
+   ms5611.hpp : Commands and compensation for the MS5611 baro, whatever bus it is on
+
+   A board sends the commands and reads the results over its own I^2C or SPI; compensate() turns the
+   raw temperature and pressure into pascals, second-order below 20 C, as in the MS5611-01BA03
+   datasheet.  promValid() checks the factory coefficients against their CRC (application note
+   AN520), which also tells a missing part from a present one.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace hf {
+
+class MS5611 {
+
+    public:
+
+        // I^2C address with CSB low
+        static const uint8_t  ADDRESS          = 0x77;
+
+        static const uint8_t  CMD_RESET        = 0x1E;
+        static const uint8_t  CMD_ADC_READ     = 0x00;
+        static const uint8_t  CMD_PROM_READ    = 0xA0;     // plus twice the word's index
+        static const uint8_t  CMD_CONVERT_D1   = 0x48;     // pressure, OSR 4096
+        static const uint8_t  CMD_CONVERT_D2   = 0x58;     // temperature, OSR 4096
+
+        // After a reset, and for an OSR 4096 conversion (the datasheet's maximum)
+        static const uint32_t RESET_MICRO      = 2800;
+        static const uint32_t CONVERSION_MICRO = 9040;
+
+        static const uint8_t  PROM_WORDS       = 8;
+
+        static bool    promValid(const uint16_t prom[PROM_WORDS]);
+
+        // Pressure in Pa from the raw temperature (D2) and pressure (D1)
+        static int32_t compensate(const uint16_t prom[PROM_WORDS], uint32_t rawTemperature, uint32_t rawPressure);
+};
+
+/********************************************* CPP ********************************************************/
+
+bool MS5611::promValid(const uint16_t prom[PROM_WORDS])
+{
+    // An absent part reads as all zeros or all ones, and zeros would pass the CRC
+    for (uint8_t k=1; k<7; ++k) {
+        if (prom[k] == 0 || prom[k] == 0xFFFF) {
+            return false;
+        }
+    }
+
+    // CRC-4 over all sixteen bytes, with the CRC's own nibble taken as zero
+    uint16_t rem = 0;
+    for (uint8_t k=0; k<2*PROM_WORDS; ++k) {
+        uint16_t word = (k>>1) == 7 ? (prom[7] & 0xFF00) : prom[k>>1];
+        rem ^= (k & 1) ? (word & 0x00FF) : (word >> 8);
+        for (uint8_t bit=0; bit<8; ++bit) {
+            rem = (rem & 0x8000) ? (rem << 1) ^ 0x3000 : (rem << 1);
+        }
+    }
+
+    return ((rem >> 12) & 0x0F) == (prom[7] & 0x0F);
+}
+
+int32_t MS5611::compensate(const uint16_t prom[PROM_WORDS], uint32_t rawTemperature, uint32_t rawPressure)
+{
+    // Words 1 through 6 are the datasheet's C1 through C6
+    int64_t dT   = (int64_t)rawTemperature - ((int64_t)prom[5] << 8);
+    int64_t temp = 2000 + ((dT * prom[6]) >> 23);
+    int64_t off  = ((int64_t)prom[2] << 16) + ((prom[4] * dT) >> 7);
+    int64_t sens = ((int64_t)prom[1] << 15) + ((prom[3] * dT) >> 8);
+
+    // Second order, below 20 C
+    if (temp < 2000) {
+        int64_t cold = (temp - 2000) * (temp - 2000);
+        off  -= (5 * cold) >> 1;
+        sens -= (5 * cold) >> 2;
+        if (temp < -1500) {
+            int64_t colder = (temp + 1500) * (temp + 1500);
+            off  -= 7 * colder;
+            sens -= (11 * colder) >> 1;
+        }
+    }
+
+    // Hundredths of a millibar, which are pascals
+    return (int32_t)((((rawPressure * sens) >> 21) - off) >> 15);
+}
+
+} // namespace hf
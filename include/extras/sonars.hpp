@@ -1,5 +1,10 @@
 /*
-   sonars.hpp : Sonars class header
+   sonars.hpp : Sonars class
+
+   Each extras slot, update() collects the echoes the board's interrupts have timed for the group
+   of sonars in flight (see CONFIG_SONAR_GROUPS), never waiting on a pulse.  Once every echo in the
+   group is back or timed out, the distances go into the back one of two snapshots, which then
+   becomes the front, so a reader always sees a whole set; and the next group is pinged.
 
    This file is part of Hackflight.
 
@@ -17,24 +22,218 @@
 
 #pragma once
 
+#include <cstring>
+
+#include "board.hpp"
+#include "config.hpp"
+#include "msp.hpp"
+
+namespace hf {
+
+// Times one sonar's echo pulse from its pin's edges: the board calls start() from sonarTrigger(),
+// edge() from the pin-change or input-capture interrupt with the timer's reading, and get() from
+// sonarGetEcho()
+class SonarEcho {
+
+    private:
+
+        volatile uint32_t riseUsec;
+        volatile uint32_t echoUsec;
+        volatile bool     done;
+
+    public:
+
+        void start(void) { done = false; }
+
+        void edge(bool high, uint32_t usec)
+        {
+            if (high) {
+                riseUsec = usec;
+            }
+            else if (!done) {
+                echoUsec = usec - riseUsec;
+                done = true;
+            }
+        }
+
+        bool get(uint32_t & echoMicro)
+        {
+            if (!done) {
+                return false;
+            }
+            echoMicro = echoUsec;
+            return true;
+        }
+};
+
 class Sonars {
 
+    public:
+
+        // Distances (cm; zero for no echo) indexed Back, Bottom, Front, Left, Right, and when each
+        // sonar was pinged (usec)
+        typedef struct snapshot_t {
+            uint16_t distances[CONFIG_SONAR_COUNT];
+            uint32_t times[CONFIG_SONAR_COUNT];
+        } snapshot_t;
+
     private:
 
-        uint8_t  count;
+        // Sound's round trip per centimeter
+        static const uint8_t USEC_PER_CM = 58;
+
+        Board * board;
+
         bool     avail;
-        uint8_t  index;
-        bool     ready;
 
-    public:
+        snapshot_t snapshots[2];
+        volatile uint8_t front;
 
-        uint16_t getAltitude(void);
+        // Group in flight, when it was pinged, and the echoes still to come
+        uint8_t  group;
+        bool     pinging;
+        uint32_t pingTimeUsec;
+        uint8_t  pending;
 
-        uint16_t distances[5];
+        void ping(uint32_t currentTimeUsec);
+        void publish(void);
 
-        void init(void);
+        static void handleMsp(MSP & msp, void * context);
+
+    public:
+
+        void init(Board * _board);
 
         bool available(void);
 
-        void update(void);
+        // Once per extras slot; true when a new snapshot has been published
+        bool update(void);
+
+        // Latest complete set of readings
+        const snapshot_t & getSnapshot(void) { return snapshots[front]; }
+
+        uint16_t getAltitude(void);
+        uint32_t getAltitudeTime(void);
+
+        void registerMspHandlers(MSP * msp);
 };
+
+/********************************************* CPP ********************************************************/
+
+void Sonars::init(Board * _board)
+{
+    this->board = _board;
+
+    this->avail = true;
+    for (uint8_t k=0; k<CONFIG_SONAR_COUNT; ++k) {
+        this->avail = this->avail && this->board->sonarInit(k);
+    }
+
+    memset(this->snapshots, 0, sizeof(this->snapshots));
+    this->front = 0;
+
+    this->group = 0;
+    this->pinging = false;
+    this->pingTimeUsec = 0;
+    this->pending = 0;
+}
+
+bool Sonars::available(void)
+{
+    return this->avail;
+}
+
+uint16_t Sonars::getAltitude(void)
+{
+    return getSnapshot().distances[1]; // Back, Bottom, Front, Left, Right
+}
+
+uint32_t Sonars::getAltitudeTime(void)
+{
+    return getSnapshot().times[1];
+}
+
+bool Sonars::update(void)
+{
+    if (!this->avail) {
+        return false;
+    }
+
+    uint32_t currentTimeUsec = (uint32_t)this->board->getMicros();
+
+    if (!this->pinging) {
+        ping(currentTimeUsec);
+        return false;
+    }
+
+    // Collect whatever echoes the interrupts have timed so far
+    snapshot_t & back = this->snapshots[this->front ^ 1];
+    for (uint8_t k=0; k<CONFIG_SONAR_COUNT; ++k) {
+        uint32_t echoMicro;
+        if ((this->pending & (1<<k)) && this->board->sonarGetEcho(k, echoMicro)) {
+            back.distances[k] = echoMicro / USEC_PER_CM;
+            back.times[k] = this->pingTimeUsec;
+            this->pending &= ~(1<<k);
+        }
+    }
+
+    // The rest count as no echo once they've had time to come back from the farthest wall
+    if (this->pending && (currentTimeUsec - this->pingTimeUsec) < CONFIG_SONAR_TIMEOUT_MICRO) {
+        return false;
+    }
+
+    for (uint8_t k=0; k<CONFIG_SONAR_COUNT; ++k) {
+        if (this->pending & (1<<k)) {
+            back.distances[k] = 0;
+            back.times[k] = this->pingTimeUsec;
+        }
+    }
+
+    publish();
+
+    // The next group goes out right away
+    this->group = (this->group + 1) % CONFIG_SONAR_GROUP_COUNT;
+    ping(currentTimeUsec);
+
+    return true;
+}
+
+void Sonars::ping(uint32_t currentTimeUsec)
+{
+    // The whole group at once
+    this->pending = CONFIG_SONAR_GROUPS[this->group];
+    this->pingTimeUsec = currentTimeUsec;
+    this->pinging = true;
+    this->board->sonarTrigger(this->pending);
+}
+
+void Sonars::publish(void)
+{
+    uint8_t next = this->front ^ 1;
+
+    this->front = next;
+
+    // The new back buffer starts from the new front, so sonars outside the next group keep their readings
+    memcpy(&this->snapshots[next ^ 1], &this->snapshots[next], sizeof(snapshot_t));
+}
+
+void Sonars::registerMspHandlers(MSP * msp)
+{
+    msp->registerHandler(MSP_SONARS, Sonars::handleMsp, this);
+}
+
+void Sonars::handleMsp(MSP & msp, void * context)
+{
+    Sonars * sonars = (Sonars *)context;
+
+    const snapshot_t & snapshot = sonars->getSnapshot();
+
+    // Horizontal sonars only: back, front, left, right
+    msp.headSerialReply(8);
+    msp.serialize16(snapshot.distances[0]);
+    msp.serialize16(snapshot.distances[2]);
+    msp.serialize16(snapshot.distances[3]);
+    msp.serialize16(snapshot.distances[4]);
+}
+
+} // namespace hf
@@ -0,0 +1,143 @@
+/*
+   failsafe.hpp : what the vehicle does when the receiver goes quiet
+
+   RC stamps each channel when it has a good reading, and keeps the oldest of the sticks' stamps, so each
+   IMU cycle update() needs only one subtraction to know how long the link has been out.  Armed with the
+   link out, the vehicle holds the last commands for a moment, in case the link comes straight back;
+   then levels itself, sticks centered, at the throttle it had; then descends at a fixed throttle and
+   disarms.  A good reading at any stage gives the pilot back control.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstring>
+
+#include "config.hpp"
+#include "rc.hpp"
+
+namespace hf {
+
+enum {
+    FAILSAFE_IDLE = 0,
+    FAILSAFE_HOLD,
+    FAILSAFE_LEVEL,
+    FAILSAFE_DESCEND
+};
+
+class Failsafe {
+
+    public:
+
+        void init(const FailsafeConfig & _config);
+
+        // Once per IMU cycle, before RC::computeExpo(), so that the commands come from the failsafe sticks
+        // when there are some; returns false when the vehicle should disarm
+        bool update(RC * rc, uint32_t currentTime, bool armed);
+
+        // Arming waits for the link, whatever the stage
+        bool linkLost(void) { return lost; }
+
+        // Leveling and descending fly angle mode, whatever the aux switch says
+        bool leveling(void) { return state >= FAILSAFE_LEVEL; }
+
+        uint8_t getState(void) { return state; }
+
+    private:
+
+        FailsafeConfig config;
+
+        uint8_t  state;
+        uint32_t stateTime;
+        bool     lost;
+
+        void enter(uint8_t _state, uint32_t currentTime);
+};
+
+/********************************************* CPP ********************************************************/
+
+void Failsafe::init(const FailsafeConfig & _config)
+{
+    memcpy(&config, &_config, sizeof(FailsafeConfig));
+
+    state     = FAILSAFE_IDLE;
+    stateTime = 0;
+    lost      = false;
+}
+
+void Failsafe::enter(uint8_t _state, uint32_t currentTime)
+{
+    state     = _state;
+    stateTime = currentTime;
+}
+
+bool Failsafe::update(RC * rc, uint32_t currentTime, bool armed)
+{
+    if (!config.enabled) {
+        return true;
+    }
+
+    lost = currentTime - rc->getLinkTime() > config.lossMicro;
+
+    if (!lost || !armed) {
+        state = FAILSAFE_IDLE;
+        return true;
+    }
+
+    uint32_t elapsed = currentTime - stateTime;
+
+    switch (state) {
+
+        case FAILSAFE_IDLE:
+            enter(FAILSAFE_HOLD, currentTime);
+            break;
+
+        case FAILSAFE_HOLD:
+            if (elapsed > config.holdMicro) {
+                enter(FAILSAFE_LEVEL, currentTime);
+            }
+            break;
+
+        case FAILSAFE_LEVEL:
+            if (elapsed > config.levelMicro) {
+                if (config.descentMicro == 0) {
+                    state = FAILSAFE_IDLE;
+                    return false;
+                }
+                enter(FAILSAFE_DESCEND, currentTime);
+            }
+            break;
+
+        case FAILSAFE_DESCEND:
+            if (elapsed > config.descentMicro) {
+                state = FAILSAFE_IDLE;
+                return false;
+            }
+            break;
+    }
+
+    // The sticks stay where the receiver left them until then
+    if (state == FAILSAFE_LEVEL) {
+        rc->centerSticks(rc->data[DEMAND_THROTTLE]);
+    }
+    else if (state == FAILSAFE_DESCEND) {
+        rc->centerSticks(config.descentThrottle);
+    }
+
+    return true;
+}
+
+} // namespace hf
@@ -0,0 +1,195 @@
+/*
+   fastmath.hpp : fast approximations to the libm functions on the attitude and altitude paths
+
+   Each function takes a template argument saying whether to approximate (the default) or call
+   libm, so that every call site picks for itself at compile time (see CONFIG_FASTMATH_* in
+   config.hpp) and pays nothing for the choice.  The approximations are single-precision
+   polynomials, with no tables and no branches beyond range reduction:
+
+     sin, cos   degree-9 minimax on [-pi/2,+pi/2]; within 4e-6 for |x| <= 2pi, and to the
+                float's own precision beyond
+     atan2      degree-9 (Abramowitz & Stegun 4.4.49) on [0,1]; within 1.2e-5 radian
+     asin       from atan2; within 1.3e-5 radian
+
+   InterpolationTable samples a costlier function once, at init(), and then looks it up with one
+   multiply and a linear interpolation; Baro uses it for the pressure-to-altitude power law.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+
+namespace hf {
+
+class FastMath {
+
+    public:
+
+        template <bool fast=true> static float sin(float x);
+        template <bool fast=true> static float cos(float x);
+        template <bool fast=true> static float atan2(float y, float x);
+        template <bool fast=true> static float asin(float x);
+
+    private:
+
+        static constexpr float PI     = 3.14159265f;
+        static constexpr float HALFPI = 1.57079633f;
+        static constexpr float TWOPI  = 6.28318531f;
+
+        static float sinPoly(float x);
+        static float atanPoly(float x);
+};
+
+// Tabulates f over [lo,hi] in SIZE-1 equal steps; get() clamps to the ends
+template <uint16_t SIZE>
+class InterpolationTable {
+
+    public:
+
+        void  init(float (*f)(float), float lo, float hi);
+        float get(float x);
+
+    private:
+
+        float table[SIZE];
+        float lo;
+        float hi;
+        float scale;
+};
+
+/********************************************* CPP ********************************************************/
+
+float FastMath::sinPoly(float x)
+{
+    // Valid on [-pi/2,+pi/2]
+    float x2 = x * x;
+    return x * (0.99999999997f + x2 * (-0.16666666609f + x2 * (0.0083333307206f +
+                    x2 * (-0.00019840832823f + x2 * 2.7523971075e-6f))));
+}
+
+float FastMath::atanPoly(float x)
+{
+    // Valid on [0,1]
+    float x2 = x * x;
+    return x * (0.9998660f + x2 * (-0.3302995f + x2 * (0.1801410f + x2 * (-0.0851330f + x2 * 0.0208351f))));
+}
+
+template <bool fast>
+float FastMath::sin(float x)
+{
+    if (!fast) {
+        return sinf(x);
+    }
+
+    // Reduce to [-pi,+pi] (angles mostly are already), then fold onto [-pi/2,+pi/2], where sin is
+    // symmetric about the ends
+    if (x > PI || x < -PI) {
+        int32_t turns = (int32_t)(x * (1 / TWOPI) + (x > 0 ? 0.5f : -0.5f));
+        x -= turns * TWOPI;
+    }
+
+    if (x > HALFPI) {
+        x = PI - x;
+    }
+    else if (x < -HALFPI) {
+        x = -PI - x;
+    }
+
+    return sinPoly(x);
+}
+
+template <bool fast>
+float FastMath::cos(float x)
+{
+    return fast ? sin<true>(x + HALFPI) : cosf(x);
+}
+
+template <bool fast>
+float FastMath::atan2(float y, float x)
+{
+    if (!fast) {
+        return atan2f(y, x);
+    }
+
+    float ax = fabsf(x);
+    float ay = fabsf(y);
+
+    if (ax == 0 && ay == 0) {
+        return 0;
+    }
+
+    // First octant, then out to the right one
+    float a = ay > ax ? HALFPI - atanPoly(ax / ay) : atanPoly(ay / ax);
+
+    if (x < 0) {
+        a = PI - a;
+    }
+
+    return y < 0 ? -a : a;
+}
+
+template <bool fast>
+float FastMath::asin(float x)
+{
+    if (!fast) {
+        return asinf(x);
+    }
+
+    // A quaternion's sin(pitch) can stray just past one
+    x = x > 1 ? 1 : (x < -1 ? -1 : x);
+
+    return atan2<true>(x, sqrtf((1 - x) * (1 + x)));
+}
+
+template <uint16_t SIZE>
+void InterpolationTable<SIZE>::init(float (*f)(float), float _lo, float _hi)
+{
+    lo    = _lo;
+    hi    = _hi;
+    scale = (SIZE - 1) / (hi - lo);
+
+    for (uint16_t k=0; k<SIZE; ++k) {
+        table[k] = f(lo + k / scale);
+    }
+}
+
+template <uint16_t SIZE>
+float InterpolationTable<SIZE>::get(float x)
+{
+    if (x <= lo) {
+        return table[0];
+    }
+
+    if (x >= hi) {
+        return table[SIZE-1];
+    }
+
+    float    position = (x - lo) * scale;
+    uint16_t index    = (uint16_t)position;
+
+    // Only x == hi would index past the end, and that was handled above
+    if (index >= SIZE-1) {
+        index = SIZE-2;
+    }
+
+    float fraction = position - index;
+
+    return table[index] + fraction * (table[index+1] - table[index]);
+}
+
+} // namespace hf
@@ -0,0 +1,387 @@
+/*
+   filters.hpp : gyro filtering between the board and Stabilize
+
+   Biquad coefficients follow Robert Bristow-Johnson's "Audio EQ Cookbook".  The dynamic notch
+   keeps a short window of gyro samples per axis, finds the strongest peak above a minimum
+   frequency with a small FFT, and moves a notch filter onto it.  All state is fixed-size.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "common.hpp"
+#include "config.hpp"
+
+namespace hf {
+
+class Biquad {
+
+    public:
+
+        void initLowpass(float cutoffHz, float sampleHz, float q);
+        void initNotch(float centerHz, float sampleHz, float q);
+
+        // Changes coefficients without disturbing the filter state
+        void setNotch(float centerHz, float sampleHz, float q);
+
+        float apply(float x);
+
+    private:
+
+        float b0, b1, b2, a1, a2;
+        float s1, s2;
+
+        void setCoefficients(float _b0, float _b1, float _b2, float a0, float _a1, float _a2);
+};
+
+class DynamicNotch {
+
+    public:
+
+        static const uint8_t WINDOW = CONFIG_FILTER_NOTCH_WINDOW;
+
+        void  init(const FilterConfig & config, float sampleHz);
+        float apply(float x);
+
+        // Runs one FFT on the current window; costs a few thousand cycles, so Hackflight spreads
+        // the calls over axes and cycles
+        void  analyze(void);
+
+        float getCenterHz(void) { return centerHz; }
+
+    private:
+
+        Biquad  notch;
+
+        float   sampleHz;
+        float   minHz;
+        float   q;
+        float   centerHz;
+
+        float   history[WINDOW];
+        uint8_t index;
+};
+
+class GyroDecimator {
+
+    public:
+
+        void init(void);
+
+        // Called at the gyro rate
+        void push(const int16_t sample[3]);
+
+        // Called at the PID rate: averages the samples since the last call; false if there were none
+        bool decimate(int16_t gyro[3]);
+
+    private:
+
+        int16_t samples[CONFIG_GYRO_OVERSAMPLE_MAX][3];
+        uint8_t index;
+        uint8_t count;
+};
+
+class GyroFilter {
+
+    public:
+
+        void init(const FilterConfig & config, float sampleHz);
+
+        // Filters raw gyro values in place
+        void apply(int16_t gyro[3]);
+
+    private:
+
+        bool         lowpassEnabled;
+        bool         notchEnabled;
+
+        Biquad       lowpass[3];
+        DynamicNotch notch[3];
+
+        uint8_t      analyzeAxis;
+        uint8_t      analyzeCountdown;
+};
+
+/********************************************* CPP ********************************************************/
+
+// Window and FFT tables are shared by all axes and all instances, and never change once built
+struct FilterTables {
+
+    float hann[CONFIG_FILTER_NOTCH_WINDOW];
+    float cos[CONFIG_FILTER_NOTCH_WINDOW/2];
+    float sin[CONFIG_FILTER_NOTCH_WINDOW/2];
+
+    FilterTables(void)
+    {
+        const uint8_t n = CONFIG_FILTER_NOTCH_WINDOW;
+
+        for (uint8_t k=0; k<n; ++k)
+            hann[k] = 0.5f - 0.5f * cosf(2 * M_PIf * k / n);
+
+        for (uint8_t k=0; k<n/2; ++k) {
+            cos[k] = cosf(2 * M_PIf * k / n);
+            sin[k] = -sinf(2 * M_PIf * k / n);
+        }
+    }
+};
+
+// Built on first use, which C++11 makes safe when several instances start at once
+static const FilterTables & filterTables(void)
+{
+    static const FilterTables tables;
+    return tables;
+}
+
+// In-place iterative radix-2 FFT
+static void filterFft(float re[], float im[])
+{
+    const uint8_t n = CONFIG_FILTER_NOTCH_WINDOW;
+
+    const FilterTables & tables = filterTables();
+
+    for (uint8_t i=1, j=0; i<n; ++i) {
+        uint8_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            float t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+
+    for (uint8_t len=2; len<=n; len <<= 1) {
+        uint8_t step = n / len;
+        for (uint8_t i=0; i<n; i+=len) {
+            for (uint8_t k=0; k<len/2; ++k) {
+                float wr = tables.cos[k*step];
+                float wi = tables.sin[k*step];
+                uint8_t a = i + k;
+                uint8_t b = a + len/2;
+                float xr = re[b]*wr - im[b]*wi;
+                float xi = re[b]*wi + im[b]*wr;
+                re[b] = re[a] - xr;
+                im[b] = im[a] - xi;
+                re[a] += xr;
+                im[a] += xi;
+            }
+        }
+    }
+}
+
+void Biquad::setCoefficients(float _b0, float _b1, float _b2, float a0, float _a1, float _a2)
+{
+    b0 = _b0 / a0;
+    b1 = _b1 / a0;
+    b2 = _b2 / a0;
+    a1 = _a1 / a0;
+    a2 = _a2 / a0;
+}
+
+void Biquad::initLowpass(float cutoffHz, float sampleHz, float q)
+{
+    float w0 = 2 * M_PIf * cutoffHz / sampleHz;
+    float c = cosf(w0);
+    float alpha = sinf(w0) / (2 * q);
+
+    setCoefficients((1-c)/2, 1-c, (1-c)/2, 1+alpha, -2*c, 1-alpha);
+
+    s1 = s2 = 0;
+}
+
+void Biquad::initNotch(float centerHz, float sampleHz, float q)
+{
+    setNotch(centerHz, sampleHz, q);
+
+    s1 = s2 = 0;
+}
+
+void Biquad::setNotch(float centerHz, float sampleHz, float q)
+{
+    float w0 = 2 * M_PIf * centerHz / sampleHz;
+    float c = cosf(w0);
+    float alpha = sinf(w0) / (2 * q);
+
+    setCoefficients(1, -2*c, 1, 1+alpha, -2*c, 1-alpha);
+}
+
+float Biquad::apply(float x)
+{
+    // Direct form II transposed
+    float y = b0 * x + s1;
+    s1 = b1 * x - a1 * y + s2;
+    s2 = b2 * x - a2 * y;
+    return y;
+}
+
+void DynamicNotch::init(const FilterConfig & config, float _sampleHz)
+{
+    sampleHz = _sampleHz;
+    minHz    = config.notchMinHz;
+    q        = config.notchQ;
+
+    // Start halfway between the minimum and Nyquist until the first peak is found
+    centerHz = (minHz + sampleHz/2) / 2;
+
+    notch.initNotch(centerHz, sampleHz, q);
+
+    memset(history, 0, sizeof(history));
+    index = 0;
+}
+
+float DynamicNotch::apply(float x)
+{
+    history[index] = x;
+    index = (index + 1) % WINDOW;
+
+    return notch.apply(x);
+}
+
+void DynamicNotch::analyze(void)
+{
+    float re[WINDOW];
+    float im[WINDOW];
+
+    const FilterTables & tables = filterTables();
+
+    // Oldest sample first, windowed
+    for (uint8_t k=0; k<WINDOW; ++k) {
+        re[k] = history[(index + k) % WINDOW] * tables.hann[k];
+        im[k] = 0;
+    }
+
+    filterFft(re, im);
+
+    float binHz = sampleHz / WINDOW;
+
+    uint8_t first = (uint8_t)(minHz / binHz) + 1;
+    if (first < 1)
+        first = 1;
+
+    float power[WINDOW/2];
+    float total = 0;
+    uint8_t peak = 0;
+
+    for (uint8_t k=first; k<WINDOW/2; ++k) {
+        power[k] = re[k]*re[k] + im[k]*im[k];
+        total += power[k];
+        if (!peak || power[k] > power[peak])
+            peak = k;
+    }
+
+    // Keep the old notch unless there is a clear peak
+    if (!peak || power[peak] * (WINDOW/2 - first) < CONFIG_FILTER_NOTCH_PEAK_RATIO * total)
+        return;
+
+    // Parabolic interpolation between neighbouring bins
+    float offset = 0;
+    if (peak > first && peak < WINDOW/2-1) {
+        float l = power[peak-1], c = power[peak], r = power[peak+1];
+        float d = l - 2*c + r;
+        if (d < 0)
+            offset = 0.5f * (l - r) / d;
+    }
+
+    float peakHz = (peak + offset) * binHz;
+
+    peakHz = constrain(peakHz, minHz, sampleHz/2 * 0.95f);
+
+    // Smooth so that the notch doesn't jump between bins
+    centerHz += CONFIG_FILTER_NOTCH_SMOOTHING * (peakHz - centerHz);
+
+    notch.setNotch(centerHz, sampleHz, q);
+}
+
+void GyroDecimator::init(void)
+{
+    index = 0;
+    count = 0;
+}
+
+void GyroDecimator::push(const int16_t sample[3])
+{
+    for (uint8_t k=0; k<3; ++k)
+        samples[index][k] = sample[k];
+
+    index = (index + 1) % CONFIG_GYRO_OVERSAMPLE_MAX;
+
+    // If the PID task falls behind, the oldest samples are overwritten
+    if (count < CONFIG_GYRO_OVERSAMPLE_MAX)
+        count++;
+}
+
+bool GyroDecimator::decimate(int16_t gyro[3])
+{
+    if (!count)
+        return false;
+
+    for (uint8_t k=0; k<3; ++k) {
+        int32_t sum = 0;
+        for (uint8_t j=0; j<count; ++j)
+            sum += samples[(index + CONFIG_GYRO_OVERSAMPLE_MAX - 1 - j) % CONFIG_GYRO_OVERSAMPLE_MAX][k];
+        gyro[k] = (int16_t)(sum / count);
+    }
+
+    count = 0;
+
+    return true;
+}
+
+void GyroFilter::init(const FilterConfig & config, float sampleHz)
+{
+    // Filters at or above Nyquist would do nothing useful
+    lowpassEnabled = config.gyroLowpassHz > 0 && config.gyroLowpassHz < sampleHz/2;
+    notchEnabled   = config.notchEnabled && config.notchMinHz < sampleHz/2;
+
+    // Build the tables here rather than in the first analyze(), which runs in the IMU task
+    filterTables();
+
+    for (uint8_t k=0; k<3; ++k) {
+        lowpass[k].initLowpass(config.gyroLowpassHz, sampleHz, 0.7071f);
+        notch[k].init(config, sampleHz);
+    }
+
+    analyzeAxis = 0;
+    analyzeCountdown = 0;
+}
+
+void GyroFilter::apply(int16_t gyro[3])
+{
+    for (uint8_t k=0; k<3; ++k) {
+
+        float x = gyro[k];
+
+        if (notchEnabled)
+            x = notch[k].apply(x);
+
+        if (lowpassEnabled)
+            x = lowpass[k].apply(x);
+
+        gyro[k] = (int16_t)(constrain(lrintf(x), INT16_MIN, INT16_MAX));
+    }
+
+    // One axis is analyzed at a time, each once per half window
+    if (notchEnabled && ++analyzeCountdown >= DynamicNotch::WINDOW / 6) {
+        analyzeCountdown = 0;
+        notch[analyzeAxis].analyze();
+        analyzeAxis = (analyzeAxis + 1) % 3;
+    }
+}
+
+} // namespace
@@ -18,19 +18,39 @@
 
 #pragma once
 
+#include <cmath>
 #include <cstdlib>
 #include <cstdarg>
 #include <cstdio>
+#include <cstring>
 
 #include "config.hpp"
+#include "blackbox.hpp"
 #include "board.hpp"
+#include "calibration.hpp"
 #include "mixer.hpp"
 #include "msp.hpp"
+#include "navigation.hpp"
+#include "opticalflow.hpp"
 #include "common.hpp"
+#include "configstore.hpp"
+#include "debug.hpp"
+#include "failsafe.hpp"
+#include "filters.hpp"
+#include "leds.hpp"
+#include "looprate.hpp"
+#include "mahony.hpp"
+#include "profiler.hpp"
+#include "quaternion.hpp"
 #include "rc.hpp"
+#include "scheduler.hpp"
 #include "stabilize.hpp"
 #include "timedtask.hpp"
 
+#ifdef CONFIG_DUAL_CORE
+#include "corelink.hpp"
+#endif
+
 // For logical combinations of stick positions (low, center, high)
 #define ROL_LO (1 << (2 * DEMAND_ROLL))
 #define ROL_CE (3 << (2 * DEMAND_ROLL))
@@ -47,55 +67,210 @@
 
 namespace hf {
 
+// BoardType is the board's own class where the sketch knows it, so that the calls made every
+// loop (clock, IMU, motors, serial) go straight to it and can be inlined; Board itself, the
+// default, keeps virtual dispatch for boards chosen at run time, such as the simulators'
+template <class BoardType = Board>
 class Hackflight {
 
     public:
 
-        void init(Board * _board);
+        void init(BoardType * _board);
         void update(void);
 
+#ifdef CONFIG_DUAL_CORE
+        // The comms core's loop (corelink.hpp); update() is then the control core's
+        void updateComms(void);
+#endif
+
     private:
 
-        void blinkLedForTilt(void);
-        void flashLeds(const InitConfig& config);
+        void updateStartup(void);
+        void startFlight(void);
+        void applyLoopRate(void);
         void updateRc(void);
         void updateImu(void);
         void updateExtras(void);
-        void updateReadyState(float eulerAngles[3]);
+        void updateGyro(void);
+        void updateReadyState(float eulerAngles[3], uint32_t currentTime);
+        void updateEulerAngles(void);
+        void updateEstimator(int16_t gyroRaw[3]);
+        void updateNavigation(void);
+        void updateFlow(void);
+
+#ifdef CONFIG_DUAL_CORE
+        void sendState(int16_t gyroRaw[3], bool attitude, bool haveQuaternion);
+        void receiveState(const coreState_t & state);
+        void sendNav(void);
+        void applyCommands(void);
+#endif
+
+        // The attitude in degrees, as MSP, guided mode and flow see it
+        float * getEulerAngles(void);
+
+        static void toDegrees(float eulerAngles[3]);
+
+        // Scheduler entry points
+        static void imuTaskFunction(void * hackflight);
+        static void gyroTaskFunction(void * hackflight);
+        static void rcTaskFunction(void * hackflight);
+        static void mspTaskFunction(void * hackflight);
+        static void extrasTaskFunction(void * hackflight);
+        static void blackboxTaskFunction(void * hackflight);
+        static void ledTaskFunction(void * hackflight);
+        static void batteryTaskFunction(void * hackflight);
+        static void flowTaskFunction(void * hackflight);
+        static void startupTaskFunction(void * hackflight);
+
+        static void handleState(MSP & msp, void * context);
+
+#ifdef CONFIG_DUAL_CORE
+        static void commandTaskFunction(void * hackflight);
+
+        static void handleSetRawRc(MSP & msp, void * context);
+        static void handleSetMotor(MSP & msp, void * context);
+        static void handleRc(MSP & msp, void * context);
+#endif
 
     private:
 
-        bool       armed;
-        uint8_t    auxState;
+        bool         armed;
+        uint8_t      auxState;
 
-        RC         rc;
-        Mixer      mixer;
-        MSP        msp;
-        Stabilize  stab;
-        Board    * board;
+        // Rate (acro) mode, chosen by the aux switch; while armed in it, no attitude is worked out
+        bool         rateMode;
+        uint8_t      rateAuxState;
+
+        RC           rc;
+        Failsafe     failsafe;
+        Navigator    navigator;
+        OpticalFlow  opticalFlow;
+        VehicleMixer mixer;
+        MSP          msp;
+        Stabilize    stab;
+        Profiler     profiler;
+        Blackbox     blackbox;
+        GyroFilter   gyroFilter;
+        GyroDecimator gyroDecimator;
+        Leds         leds;
+        Calibration  calibration;
+        LoopRate     loopRate;
+
+        // Attitude for boards without fusion, in fixed point along with the PID where there is no FPU
+#ifdef CONFIG_PID_FIXED_POINT
+        Mahony<int32_t> estimator;
+#else
+        Mahony<float>   estimator;
+#endif
+        ConfigStore  configStore;
+        BoardType  * board;
+
+        Scheduler scheduler;
+
+        // The most tasks init() gives the control loop's scheduler, with every option on; keep it up to date
+        // when adding one
+#ifdef CONFIG_DUAL_CORE
+        static const uint8_t SCHEDULER_TASKS = 7;
+#else
+        static const uint8_t SCHEDULER_TASKS = 10;
+#endif
+        static_assert(SCHEDULER_TASKS <= CONFIG_SCHEDULER_TASKS, "more tasks than CONFIG_SCHEDULER_TASKS");
+
+        uint8_t   imuTaskId;
+        uint8_t   rcTaskId;
+        uint8_t   gyroTaskId;
+        uint8_t   extrasTaskId;
+        uint8_t   ledTaskId;
+        uint8_t   startupTaskId;
+
+        // Startup runs from update(): the LED flash, then the IMU's warm-up, then gyro and accelerometer
+        // calibration, then timing the IMU chain for the loop rate if the board asks, then flight
+        enum {
+            STARTUP_FLASHING,
+            STARTUP_WARMING,
+            STARTUP_CALIBRATING,
+            STARTUP_TIMING,
+            STARTUP_READY
+        };
+
+        uint8_t   startupState;
+        uint16_t  startupSteps;
+        uint16_t  startupFlashSteps;
+        uint32_t  startupWarmMicro;
+        uint32_t  startupWarmStart;
+        uint32_t  calibrationSampleMicro;
 
-        TimedTask imuTask;
-        TimedTask rcTask;
         TimedTask angleCheckTask;
 
+        // Guided mode, by aux switch position; its controllers run from the extras task at their own rate
+        uint8_t   navAuxState;
+        TimedTask navTask;
+
+        // Boards with a flow sensor have a velocity estimate of their own, stepped by its task
+        bool      flowEnabled;
+
+        bool     gyroOversampling;
+        bool     imuFusion;
+        bool     imuInterruptDriven;
+        bool     rcEventDriven;
+        uint8_t  extrasIndex;
+
+        // Latest attitude in degrees, kept for MSP, which no longer runs with the IMU
+        float    eulerAngles[3];
+
+        // Latest filtered gyro, for MSP_STATE
+        int16_t  gyro[3];
+
+        // From boards that give a quaternion: roll and pitch from level (degrees) for the IMU task,
+        // and the quaternion, from which eulerAngles are worked out when next wanted
+        float    quaternion[4];
+        float    tiltAngles[3];
+        bool     eulerStale;
+
+        // Unit vector along gravity in the vehicle's frame, found once per IMU cycle for altitude
+        float    gravity[3];
+
         bool     safeToArm;
         uint16_t maxArmingAngle;
+
+#ifdef CONFIG_DUAL_CORE
+        CoreLink    link;
+
+        // MSP, logging and the extras run from the comms core's own scheduler; what they see of the
+        // vehicle is the latest snapshot, with its Euler angles worked out when next wanted, as above
+        Scheduler   commsScheduler;
+        coreState_t latest;
+        float       latestEuler[3];
+        bool        latestEulerStale;
+
+        // Guided mode's demands, as the control core last heard them, and whether the comms core last
+        // sent it active ones
+        coreNav_t   nav;
+        bool        navSent;
+#endif
 };
 
 /********************************************* CPP ********************************************************/
 
-void Hackflight::init(Board * _board)
+template <class BoardType>
+void Hackflight<BoardType>::init(BoardType * _board)
 {  
     board = _board;
 
+#ifdef CONFIG_DUAL_CORE
+    link.init();
+#endif
+
     // Do hardware initialization for board
     board->init();
 
     // Get board configuration
     const Config& config = board->getConfig();
 
-    // Flash the LEDs to indicate startup
-    flashLeds(config.init);
+    // Flash the LEDs to indicate startup: the LEDs take turns, a step per startup task
+    leds.init(board);
+    leds.setPattern(0, LED_PATTERN_FLASH);
+    leds.setPattern(1, LED_PATTERN_FLASH_ALT);
 
     // Get particulars for board
     LoopConfig loopConfig = config.loop;
@@ -104,57 +279,233 @@ void Hackflight::init(Board * _board)
     // Store some for later
     maxArmingAngle = imuConfig.maxArmingAngle;
 
-    // Sleep  a bit to allow IMU to catch up
-    board->delayMilliseconds(config.init.delayMilli);
+    // Initialize loop-timing instrumentation
+    profiler.init();
+    profiler.setPeriod(PROFILER_TASK_IMU, loopConfig.imuLoopMicro);
+    profiler.setPeriod(PROFILER_TASK_RC, loopConfig.rcLoopMilli * 1000);
+    profiler.setPeriod(PROFILER_TASK_MSP, loopConfig.mspLoopMilli * 1000);
+
+    // Initialize timing tasks: the IMU (stabilization and mixing) is the one deadline that others must not 
+    // push back; logging and extras fill whatever time is left
+    scheduler.init(board, &profiler);
+
+    // On two cores, MSP, logging and the extras have a scheduler of their own, on the other one
+#ifdef CONFIG_DUAL_CORE
+    commsScheduler.init(board, &profiler);
+    Scheduler & comms = commsScheduler;
+#else
+    Scheduler & comms = scheduler;
+#endif
+
+    imuTaskId = scheduler.add(imuTaskFunction, this, loopConfig.imuLoopMicro, SCHEDULER_PRIORITY_REALTIME, 
+            PROFILER_TASK_IMU);
+
+    // With a data-ready interrupt, the IMU task runs once per fresh sample instead of on a timer
+    imuInterruptDriven = board->imuHasDataReadyInterrupt();
+    if (imuInterruptDriven) {
+        scheduler.setEventDriven(imuTaskId);
+    }
+
+    // Oversampling only makes sense with a gyro faster than the PID loop
+    gyroOversampling = loopConfig.gyroLoopMicro > 0 && loopConfig.gyroLoopMicro < loopConfig.imuLoopMicro;
+    gyroDecimator.init();
+
+    // Boards without fusion have their attitude estimated on every gyro sample
+    imuFusion = board->imuHasFusion();
+    estimator.init(imuConfig, gyroOversampling ? loopConfig.gyroLoopMicro : loopConfig.imuLoopMicro,
+            loopConfig.imuLoopMicro);
+    if (gyroOversampling) {
+        gyroTaskId = scheduler.add(gyroTaskFunction, this, loopConfig.gyroLoopMicro, SCHEDULER_PRIORITY_HIGH);
+        scheduler.setEnabled(gyroTaskId, false);
+    }
+
+    rcTaskId = scheduler.add(rcTaskFunction, this, loopConfig.rcLoopMilli * 1000, SCHEDULER_PRIORITY_HIGH, 
+            PROFILER_TASK_RC);
+
+    // Likewise RC, once per receiver frame, for boards that know when one is in; the time it would have
+    // spent polling goes to the extras
+    rcEventDriven = board->rcHasFrameSignal();
+    if (rcEventDriven) {
+        scheduler.setEventDriven(rcTaskId);
+    }
+    comms.add(mspTaskFunction, this, loopConfig.mspLoopMilli * 1000, SCHEDULER_PRIORITY_LOW, PROFILER_TASK_MSP);
+    extrasTaskId = comms.add(extrasTaskFunction, this, 0, SCHEDULER_PRIORITY_BACKGROUND, PROFILER_TASK_EXTRAS);
+    if (Blackbox::BUILT) {
+        comms.add(blackboxTaskFunction, this, 0, SCHEDULER_PRIORITY_BACKGROUND);
+    }
+
+    // What MSP and guided mode ask of the control loop reaches it at MSP's rate
+#ifdef CONFIG_DUAL_CORE
+    scheduler.add(commandTaskFunction, this, loopConfig.mspLoopMilli * 1000, SCHEDULER_PRIORITY_MEDIUM);
+#endif
+    ledTaskId = scheduler.add(ledTaskFunction, this, loopConfig.ledLoopMilli * 1000, SCHEDULER_PRIORITY_LOW);
+
+    // The pack sags over seconds, so its voltage is read at a low rate, and only if the mixer will use it
+    if (config.thrust.referenceMillivolts) {
+        scheduler.add(batteryTaskFunction, this, loopConfig.batteryLoopMilli * 1000, SCHEDULER_PRIORITY_LOW);
+    }
+
+    // The flow estimator takes a fixed step per sensor read, so it has a task of its own rather than the extras
+    flowEnabled = OpticalFlow::BUILT && board->flowInit();
+    if (flowEnabled) {
+        comms.add(flowTaskFunction, this, config.flow.loopMilli * 1000, SCHEDULER_PRIORITY_MEDIUM);
+    }
+
+    // Until startup is done, only RC, MSP, logging and the startup task itself run; the comms core's
+    // extras can't get in its way, so they start right away
+    startupTaskId = scheduler.add(startupTaskFunction, this, 
+            config.init.ledFlashMilli * 1000 / config.init.ledFlashCount, SCHEDULER_PRIORITY_LOW);
+    scheduler.setEnabled(imuTaskId, false);
+#ifndef CONFIG_DUAL_CORE
+    scheduler.setEnabled(extrasTaskId, false);
+#endif
+    scheduler.setEnabled(ledTaskId, false);
+
+    startupState      = STARTUP_FLASHING;
+    startupSteps      = 0;
+    startupFlashSteps = 2 * config.init.ledFlashCount;
+
+    // Then wait a bit to allow IMU to catch up
+    startupWarmMicro  = config.init.delayMilli * 1000;
+    startupWarmStart  = 0;
+
+    // Then calibrate, with the startup task sped up to a sample a step
+    calibrationSampleMicro = config.calibration.sampleMicro;
+
+    // Then, unless the period is fixed, time the IMU chain a cycle a step
+    loopRate.init(loopConfig);
 
-    // Initialize timing tasks
-    imuTask.init(loopConfig.imuLoopMicro);
-    rcTask.init(loopConfig.rcLoopMilli * 1000);
     angleCheckTask.init(loopConfig.angleCheckMilli * 1000);
+    extrasIndex = 0;
+
+    // Tuned settings and IMU offsets, if the board has stored any, replace its defaults
+    PidConfig pidConfig = config.pid;
+    RcConfig  rcConfig  = config.rc;
+    ImuOffsets offsets;
+    memset(&offsets, 0, sizeof(ImuOffsets));
+#ifdef CONFIG_DUAL_CORE
+    configStore.init(board, &rc, &stab, &calibration, &latest.armed);
+#else
+    configStore.init(board, &rc, &stab, &calibration, &armed);
+#endif
+    configStore.load(pidConfig, rcConfig, offsets);
+    calibration.init(config.calibration, imuConfig.accel1G, offsets);
 
     // Initialize the RC receiver
-    rc.init(config.rc, config.pwm, board);
+    rc.init(rcConfig, config.pwm, loopConfig, board);
+    failsafe.init(config.failsafe);
+    navigator.init(config.nav);
+    navAuxState = config.nav.auxState;
+    navTask.init(config.nav.loopMilli * 1000);
+    opticalFlow.init(config.flow, imuConfig.gyroLsbPerDps);
+
+    // Gyro is filtered once per IMU cycle
+    gyroFilter.init(config.filter, 1e6f / loopConfig.imuLoopMicro);
 
     // Initialize our stabilization, mixing, and MSP (serial comms)
-    stab.init(config.pid, config.imu, board);
-    mixer.init(config.pwm, &rc, &stab); 
-    msp.init(&mixer, &rc, board);
+    stab.init(pidConfig, config.imu, config.rate, loopConfig, board);
+    rateAuxState = config.rate.auxState;
+    rateMode = false;
+    mixer.init(config.pwm, config.thrust, &rc, &stab); 
+    msp.init(&mixer, &rc, &profiler, board, loopConfig.mspMaxBytes);
+#ifndef CONFIG_NO_MSP_TUNING
+    msp.registerHandler(MSP_STATE, handleState, this);
+    configStore.registerMspHandlers(&msp);
+    loopRate.registerMspHandlers(&msp);
+#endif
+    navigator.registerMspHandlers(&msp);
+    board->extrasRegisterMspHandlers(&msp);
+
+    // MSP's own handlers would reach into RC and the mixer, which are the control core's
+#ifdef CONFIG_DUAL_CORE
+    msp.registerHandler(MSP_SET_RAW_RC, handleSetRawRc, this);
+    msp.registerHandler(MSP_SET_MOTOR,  handleSetMotor, this);
+    msp.registerHandler(MSP_RC,         handleRc,       this);
+    configStore.attach(&link);
+#endif
+
+    // Initialize flight logging, if the board has somewhere to put it
+    blackbox.init(config.blackbox, board);
 
     // Ready to rock!
     armed = false;
     safeToArm = false;
+    memset(eulerAngles, 0, sizeof(eulerAngles));
+    memset(gyro, 0, sizeof(gyro));
+    memset(tiltAngles, 0, sizeof(tiltAngles));
+    memset(gravity, 0, sizeof(gravity));
+    eulerStale = false;
+
+#ifdef CONFIG_DUAL_CORE
+    memset(&latest, 0, sizeof(latest));
+    memcpy(latest.channels, rc.data, sizeof(latest.channels));
+    memset(latestEuler, 0, sizeof(latestEuler));
+    latestEulerStale = false;
+    memset(&nav, 0, sizeof(nav));
+    navSent = false;
+
+    // Everything above is done before the comms core looks at any of it
+    link.setReady();
+#endif
 
 } // init
 
-void Hackflight::update(void)
+template <class BoardType>
+void Hackflight<BoardType>::update(void)
 {
-    // Grab current time for various loops
-    uint32_t currentTime = board->getMicros();
+    if (rcEventDriven && board->rcFrameReady()) {
+        scheduler.trigger(board, rcTaskId);
+    }
 
-    // Outer (slow) loop: update RC
-    if (rcTask.checkAndUpdate(currentTime)) {
-        updateRc();
+    // The IMU isn't read until startup has brought it up; from calibration on, it is kept up to date
+    if (startupState < STARTUP_CALIBRATING) {
+        scheduler.run(board);
+        return;
     }
 
-    // Not time to update RC; perform extra tasks
+    // Polling for EM7180 SENtral Sensor Fusion IMU; with a data-ready interrupt, it is read only
+    // when there is a fresh sample
+    if (imuInterruptDriven) {
+        if (board->imuDataReady()) {
+            board->imuUpdate();
+            scheduler.trigger(board, imuTaskId);
+        }
+    }
     else {
-        updateExtras();
-   }
-
-    // Polling for EM7180 SENtral Sensor Fusion IMU
-    board->imuUpdate();
+        board->imuUpdate();
+    }
 
-    // Inner (fast) loop: update IMU
-    if (imuTask.checkAndUpdate(currentTime)) {
-        updateImu();
+    // Run the most urgent task; if that was only background work, nothing else is urgent until the next
+    // sample arrives
+    if (!scheduler.run(board) && imuInterruptDriven) {
+        board->idle();
     }
 
 } // update
 
-void Hackflight::updateRc(void)
+#ifdef CONFIG_DUAL_CORE
+template <class BoardType>
+void Hackflight<BoardType>::updateComms(void)
+{
+    if (!link.isReady()) {
+        return;
+    }
+
+    // Every snapshot is logged, and goes to what integrates them; the tasks want only the latest
+    coreState_t state;
+    while (link.state.pop(state)) {
+        receiveState(state);
+    }
+
+    commsScheduler.run(board);
+}
+#endif
+
+template <class BoardType>
+void Hackflight<BoardType>::updateRc(void)
 {
     // Update RC channels
-    rc.update();
+    rc.update(board);
 
     // When landed, reset integral component of PID
     if (rc.throttleIsDown()) {
@@ -179,11 +530,14 @@ void Hackflight::updateRc(void)
 
             // Arm via throttle-low / yaw-right
             if (rc.sticks == THR_LO + YAW_HI + PIT_CE + ROL_CE) {
-                if (safeToArm) {
+                if (safeToArm && !failsafe.linkLost()) {
                     auxState = rc.getAuxState();
                     if (!auxState) // aux switch must be in zero position
                         if (!armed) {
                             armed = true;
+#ifndef CONFIG_DUAL_CORE
+                            opticalFlow.reset();
+#endif
                         }
                 }
             }
@@ -192,60 +546,301 @@ void Hackflight::updateRc(void)
 
     } // rc.changed()
 
+    // Switching modes starts the integrals afresh, since each mode winds them up its own way
+    bool rate = rc.getAuxState() == rateAuxState;
+    if (rate != rateMode) {
+        stab.resetIntegral();
+        rateMode = rate;
+    }
+
+    // Guided mode and the extras belong to the comms core, which hears of the switch from the snapshots
+#ifndef CONFIG_DUAL_CORE
+    navigator.setEngaged(armed && rc.getAuxState() == navAuxState);
+
     // Detect aux switch changes for hover, altitude-hold, etc.
     if (rc.getAuxState() != auxState) {
         board->extrasHandleAuxSwitch(rc.getAuxState());
-        auxState = rc.getAuxState();
     }
+#endif
+    auxState = rc.getAuxState();
 }
 
-void Hackflight::updateImu(void)
+template <class BoardType>
+void Hackflight<BoardType>::updateImu(void)
 {
-    // Compute exponential RC commands
+    // Gains tuned over MSP since the last cycle take effect here, all at once
+    stab.swapGains();
+
+    uint32_t currentTime = (uint32_t)board->getMicros();
+
+    // With the receiver out, failsafe's sticks are the ones the commands come from
+    if (!failsafe.update(&rc, currentTime, armed)) {
+        armed = false;
+    }
+    bool rate = rateMode && !failsafe.leveling();
+
+    // Compute exponential RC commands; guided mode puts its own over them, unless failsafe has the sticks
     rc.computeExpo();
+#ifdef CONFIG_DUAL_CORE
+    if (nav.active && armed && rc.getAuxState() == navAuxState && !failsafe.leveling()) {
+        rc.command[DEMAND_ROLL]     = nav.command[DEMAND_ROLL];
+        rc.command[DEMAND_PITCH]    = nav.command[DEMAND_PITCH];
+        rc.command[DEMAND_THROTTLE] = nav.command[DEMAND_THROTTLE];
+    }
+#else
+    if (navigator.active() && !failsafe.leveling()) {
+        navigator.apply(rc.command);
+    }
+#endif
 
-    // Get Eulaer angles and raw gyro values from board
-    float eulerAngles[3];
+    // Get attitude and raw gyro values from board: a quaternion if it has one, else Euler angles.  Armed
+    // in rate mode, nothing needs the attitude, so boards that can read the gyro alone do just that.
     int16_t gyroRaw[3];
-    board->imuGetEulerAndGyro(eulerAngles, gyroRaw);
+    float * levelAngles = eulerAngles;
 
-    // Convert angles from radians to degrees
-    for (int k=0; k<3; ++k) {
-        eulerAngles[k]  = eulerAngles[k]  * 180.0f / M_PI;
+    bool attitude;
+    bool haveQuaternion;
+
+    if (imuFusion) {
+        attitude = !(rate && armed) || !board->imuReadGyro(gyroRaw);
+        haveQuaternion = attitude && board->imuGetQuaternionAndGyro(quaternion, gyroRaw);
+    }
+    else {
+        // The estimator is kept up to date every cycle, rate mode or not, so that leveling can take over
+        updateEstimator(gyroRaw);
+        attitude = !(rate && armed);
+        haveQuaternion = attitude;
+        if (attitude) {
+            estimator.getQuaternion(quaternion);
+        }
     }
 
-    // Convert heading from [-180,+180] to [0,360]
-    if (eulerAngles[AXIS_YAW] < 0) {
-        eulerAngles[AXIS_YAW] += 360;
+    if (!attitude) {
+        // Angles for MSP and the log hold still until leveling is back
     }
+    else if (haveQuaternion) {
 
-    // Update status using Euler angles
-    updateReadyState(eulerAngles);
+        // Leveling needs only the tilt, which takes no trig
+        float tilt[2];
+        Quaternion::gravity(quaternion, gravity);
+        Quaternion::tiltFromGravity(gravity, tilt);
+        tiltAngles[0] = tilt[0] * 180.0f / M_PI;
+        tiltAngles[1] = tilt[1] * 180.0f / M_PI;
 
-    // Compute accelerometer-based altitude if indicated
-    board->extrasUpdateAccelZ(armed);
+        levelAngles = tiltAngles;
+        eulerStale  = true;
+    }
+    else {
+        board->imuGetEulerAndGyro(eulerAngles, gyroRaw);
+        Quaternion::gravityFromEuler(eulerAngles, gravity);
+        toDegrees(eulerAngles);
+    }
+
+    // With oversampling, the gyro value is the average of samples since the last cycle
+    if (gyroOversampling) {
+        gyroDecimator.decimate(gyroRaw);
+    }
+
+    // Take out the offsets, then low-pass and notch-filter the gyro before the PID controller sees it
+    calibration.apply(gyroRaw);
+    gyroFilter.apply(gyroRaw);
+    memcpy(gyro, gyroRaw, sizeof(gyro));
+
+    // The flow task takes the turning out of what its sensor saw, with the gyro averaged over its step
+#ifndef CONFIG_DUAL_CORE
+    if (flowEnabled) {
+        opticalFlow.addGyro(gyroRaw);
+    }
+#endif
+
+    if (attitude) {
+
+        // Update status using roll and pitch
+        updateReadyState(levelAngles, currentTime);
 
-    // Stabilization, mixing, and MSP are synced to IMU update.  Stabilizer also uses raw gyro values.
-    stab.update(rc.command, gyroRaw, eulerAngles);
+        // Compute accelerometer-based altitude if indicated, from the attitude found above
+#ifndef CONFIG_DUAL_CORE
+        board->extrasUpdateAccelZ(gravity, armed);
+#endif
+    }
+
+    // Stabilization and mixing are synced to IMU update.  Stabilizer also uses raw gyro values.
+    if (rate) {
+        stab.updateRate(rc.deflection, rc.command[DEMAND_THROTTLE], gyroRaw);
+    }
+    else {
+        stab.update(rc.command, gyroRaw, levelAngles);
+    }
     mixer.update(armed, board);
-    msp.update(eulerAngles, armed);
+
+    // The comms core logs, and does the rest of the above that isn't flying, from a snapshot of the cycle
+#ifdef CONFIG_DUAL_CORE
+    sendState(gyroRaw, attitude, haveQuaternion);
+#else
+
+    // Log a record per cycle while armed
+    if (armed) {
+        if (blackbox.isAvailable()) {
+            updateEulerAngles();
+        }
+        blackbox.log((uint32_t)board->getMicros(), gyroRaw, eulerAngles, rc.command, stab.axisPID, mixer.outputs);
+    }
+    else {
+        blackbox.stop();
+    }
+#endif
 } 
 
-void Hackflight::updateReadyState(float eulerAngles[3])
+#ifdef CONFIG_DUAL_CORE
+template <class BoardType>
+void Hackflight<BoardType>::sendState(int16_t gyroRaw[3], bool attitude, bool haveQuaternion)
+{
+    coreState_t state;
+
+    state.time = (uint32_t)board->getMicros();
+    memcpy(state.quaternion,  quaternion,    sizeof(state.quaternion));
+    memcpy(state.eulerAngles, eulerAngles,   sizeof(state.eulerAngles));
+    memcpy(state.gravity,     gravity,       sizeof(state.gravity));
+    memcpy(state.gyro,        gyroRaw,       sizeof(state.gyro));
+    memcpy(state.command,     rc.command,    sizeof(state.command));
+    memcpy(state.axisPID,     stab.axisPID,  sizeof(state.axisPID));
+    memcpy(state.channels,    rc.data,       sizeof(state.channels));
+    memcpy(state.motors,      mixer.outputs, sizeof(state.motors));
+    state.auxState       = rc.getAuxState();
+    state.armed          = armed;
+    state.attitude       = attitude;
+    state.haveQuaternion = haveQuaternion;
+
+    // A comms core too far behind misses this one
+    link.state.push(state);
+}
+
+template <class BoardType>
+void Hackflight<BoardType>::receiveState(const coreState_t & state)
+{
+    // Arming starts the flow estimate afresh
+    if (state.armed && !latest.armed) {
+        opticalFlow.reset();
+    }
+
+    if (state.auxState != latest.auxState) {
+        board->extrasHandleAuxSwitch(state.auxState);
+    }
+
+    navigator.setEngaged(state.armed && state.auxState == navAuxState);
+
+    memcpy(&latest, &state, sizeof(coreState_t));
+
+    if (flowEnabled) {
+        opticalFlow.addGyro(latest.gyro);
+    }
+
+    // Without an attitude, the angles hold still, as they do on the control core
+    if (latest.haveQuaternion) {
+        latestEulerStale = true;
+    }
+    else if (latest.attitude) {
+        memcpy(latestEuler, latest.eulerAngles, sizeof(latestEuler));
+        latestEulerStale = false;
+    }
+
+    if (latest.attitude) {
+        board->extrasUpdateAccelZ(latest.gravity, latest.armed);
+    }
+
+    if (latest.armed) {
+        float * angles = blackbox.isAvailable() ? getEulerAngles() : latestEuler;
+        blackbox.log(latest.time, latest.gyro, angles, latest.command, latest.axisPID, latest.motors);
+    }
+    else {
+        blackbox.stop();
+    }
+}
+
+template <class BoardType>
+void Hackflight<BoardType>::sendNav(void)
+{
+    // Nothing to say while guided mode is off and the control core knows it
+    bool active = navigator.active();
+    if (!active && !navSent) {
+        return;
+    }
+
+    coreNav_t demands;
+    memcpy(demands.command, latest.command, sizeof(demands.command));
+    navigator.apply(demands.command);
+    demands.active = active;
+
+    CoreCommand command;
+    command.set(CORE_COMMAND_NAV, demands);
+    if (link.commands.push(command)) {
+        navSent = active;
+    }
+}
+
+template <class BoardType>
+void Hackflight<BoardType>::applyCommands(void)
+{
+    CoreCommand command;
+
+    while (link.commands.pop(command)) {
+
+        switch (command.kind) {
+
+            case CORE_COMMAND_RC:
+                {
+                    coreChannels_t channels;
+                    command.get(channels);
+                    memcpy(rc.data, channels.values, sizeof(rc.data));
+                }
+                break;
+
+            case CORE_COMMAND_MOTORS:
+                {
+                    coreMotors_t motors;
+                    command.get(motors);
+                    for (uint8_t i = 0; i < VehicleMixer::MOTORS && i < motors.count; i++)
+                        mixer.motorsDisarmed[i] = motors.values[i];
+                }
+                break;
+
+            case CORE_COMMAND_NAV:
+                command.get(nav);
+                break;
+
+            // Gains take effect at the next IMU cycle's swapGains(), as they would have on one core
+            case CORE_COMMAND_PID_CONFIG:
+                {
+                    PidConfig pidConfig;
+                    command.get(pidConfig);
+                    stab.setPidConfig(pidConfig);
+                }
+                break;
+
+            case CORE_COMMAND_RC_CONFIG:
+                {
+                    RcConfig rcConfig;
+                    command.get(rcConfig);
+                    rc.setConfig(rcConfig);
+                }
+                break;
+        }
+    }
+}
+#endif
+
+template <class BoardType>
+void Hackflight<BoardType>::updateReadyState(float eulerAngles[3], uint32_t currentTime)
 {
-    if (safeToArm)
-        board->ledSet(0, false);
-    if (armed)
-        board->ledSet(1, true);
-    else
-        board->ledSet(1, false);
+    // Blink LED 0 while too steep to arm, and light LED 1 while armed; the LED task does the blinking,
+    // and the board hears only of changes
+    leds.setPattern(0, safeToArm ? LED_PATTERN_OFF : LED_PATTERN_BLINK);
+    leds.setPattern(1, armed ? (failsafe.getState() ? LED_PATTERN_FLASH : LED_PATTERN_ON) : LED_PATTERN_OFF);
 
-    // If angle too steep, flash LED
-    uint32_t currentTime = board->getMicros();
+    // Once too steep, stay unsafe for at least an angle-check period
     if (angleCheckTask.check(currentTime)) {
         if (!(abs(eulerAngles[0]) < maxArmingAngle && abs(eulerAngles[1]) < maxArmingAngle)) {
             safeToArm = false; 
-            blinkLedForTilt();
             angleCheckTask.update(currentTime);
         } else {
             safeToArm = true;
@@ -253,44 +848,394 @@ void Hackflight::updateReadyState(float eulerAngles[3])
     }
 }
 
-void Hackflight::updateExtras(void)
+template <class BoardType>
+void Hackflight<BoardType>::updateEulerAngles(void)
 {
-    static int taskOrder;
-    board->extrasPerformTask(taskOrder);
-    taskOrder++;
-    if (taskOrder >= board->extrasGetTaskCount()) // using >= supports zero or more tasks
-        taskOrder = 0;
+    if (!eulerStale) {
+        return;
+    }
+
+    Quaternion::toEuler(quaternion, eulerAngles);
+    toDegrees(eulerAngles);
+
+    eulerStale = false;
 }
 
-void Hackflight::blinkLedForTilt(void)
+template <class BoardType>
+float * Hackflight<BoardType>::getEulerAngles(void)
 {
-    static bool on;
+#ifdef CONFIG_DUAL_CORE
+    if (latestEulerStale) {
+        Quaternion::toEuler(latest.quaternion, latestEuler);
+        toDegrees(latestEuler);
+        latestEulerStale = false;
+    }
+    return latestEuler;
+#else
+    updateEulerAngles();
+    return eulerAngles;
+#endif
+}
 
-    if (on) {
-        board->ledSet(0, false);
-        on = false;
+template <class BoardType>
+void Hackflight<BoardType>::toDegrees(float eulerAngles[3])
+{
+    // Convert angles from radians to degrees
+    for (int k=0; k<3; ++k) {
+        eulerAngles[k]  = eulerAngles[k]  * 180.0f / M_PI;
     }
-    else {
-        board->ledSet(0, true);
-        on = true;
+
+    // Convert heading from [-180,+180] to [0,360]
+    if (eulerAngles[AXIS_YAW] < 0) {
+        eulerAngles[AXIS_YAW] += 360;
+    }
+}
+
+template <class BoardType>
+void Hackflight<BoardType>::updateExtras(void)
+{
+    // Debug messages queued in the fast loop are formatted here, where time is cheap
+    debugFlush(board, CONFIG_DEBUG_FLUSH_MAX);
+
+    if (Navigator::BUILT && navTask.checkAndUpdate((uint32_t)board->getMicros())) {
+        updateNavigation();
+#ifdef CONFIG_DUAL_CORE
+        sendNav();
+#endif
+    }
+
+    board->extrasPerformTask(extrasIndex);
+    extrasIndex++;
+    if (extrasIndex >= board->extrasGetTaskCount()) // using >= supports zero or more tasks
+        extrasIndex = 0;
+}
+
+template <class BoardType>
+void Hackflight<BoardType>::updateNavigation(void)
+{
+#ifdef CONFIG_DUAL_CORE
+    bool    engaged  = latest.armed && latest.auxState == navAuxState;
+    int16_t throttle = latest.command[DEMAND_THROTTLE];
+#else
+    bool    engaged  = armed && rc.getAuxState() == navAuxState;
+    int16_t throttle = rc.command[DEMAND_THROTTLE];
+#endif
+
+    if (!engaged) {
+        return;
+    }
+
+    // Without a position, from the board or else from flow, guided mode gives the sticks back
+    float position[3];
+    float velocity[3];
+    if (!board->navGetPosition(position, velocity) && !(flowEnabled && opticalFlow.getEstimate(position, velocity))) {
+        navigator.setEngaged(false);
+        return;
+    }
+
+    navigator.update(position, velocity, getEulerAngles()[AXIS_YAW], throttle, (uint32_t)board->getMicros());
+}
+
+template <class BoardType>
+void Hackflight<BoardType>::updateFlow(void)
+{
+    int16_t counts[2];
+    uint8_t quality = 0;
+    bool    read = board->flowRead(counts, quality);
+
+    float range = 0;
+    bool  haveRange = board->flowGetRange(range);
+
+    opticalFlow.update(read ? counts : NULL, quality, haveRange, range, getEulerAngles());
+}
+
+template <class BoardType>
+void Hackflight<BoardType>::updateGyro(void)
+{
+    // Gyro samples between PID cycles are averaged when the PID runs
+    int16_t sample[3];
+    if (board->imuReadGyro(sample)) {
+        gyroDecimator.push(sample);
+
+        if (!imuFusion) {
+            calibration.apply(sample);
+            estimator.update(sample);
+        }
+    }
+}
+
+template <class BoardType>
+void Hackflight<BoardType>::updateEstimator(int16_t gyroRaw[3])
+{
+    board->imuReadGyro(gyroRaw);
+
+    // With oversampling, the gyro task has already integrated every sample
+    if (!gyroOversampling) {
+        int16_t rates[3];
+        memcpy(rates, gyroRaw, sizeof(rates));
+        calibration.apply(rates);
+        estimator.update(rates);
+    }
+
+    int16_t accelRaw[3];
+    if (board->imuReadAccel(accelRaw)) {
+        calibration.applyAccel(accelRaw);
+        estimator.correct(accelRaw);
+    }
+}
+
+template <class BoardType>
+void Hackflight<BoardType>::imuTaskFunction(void * hackflight)
+{
+    ((Hackflight *)hackflight)->updateImu();
+}
+
+template <class BoardType>
+void Hackflight<BoardType>::gyroTaskFunction(void * hackflight)
+{
+    ((Hackflight *)hackflight)->updateGyro();
+}
+
+template <class BoardType>
+void Hackflight<BoardType>::rcTaskFunction(void * hackflight)
+{
+    ((Hackflight *)hackflight)->updateRc();
+}
+
+template <class BoardType>
+void Hackflight<BoardType>::mspTaskFunction(void * hackflight)
+{
+    Hackflight * h = (Hackflight *)hackflight;
+#ifdef CONFIG_DUAL_CORE
+    h->msp.update(h->board, h->getEulerAngles(), h->latest.armed);
+#else
+    h->msp.update(h->board, h->getEulerAngles(), h->armed);
+#endif
+}
+
+// Everything a plot wants from one sample in a single frame, small enough to stream at the MSP task's rate
+template <class BoardType>
+void Hackflight<BoardType>::handleState(MSP & msp, void * context)
+{
+    Hackflight * h = (Hackflight *)context;
+
+    const Profiler::taskStats_t & imu = h->profiler.getStats(PROFILER_TASK_IMU);
+
+#ifdef CONFIG_DUAL_CORE
+    const int16_t  * gyro    = h->latest.gyro;
+    const int16_t  * axisPID = h->latest.axisPID;
+    const uint16_t * motors  = h->latest.motors;
+#else
+    const int16_t  * gyro    = h->gyro;
+    const int16_t  * axisPID = h->stab.axisPID;
+    const uint16_t * motors  = h->mixer.outputs;
+#endif
+    const float    * eulerAngles = h->getEulerAngles();
+
+    msp.headSerialReply(4 + 9*2 + 4 + 2*2);
+    msp.serialize32((uint32_t)h->board->getMicros());
+    for (uint8_t axis = 0; axis < 3; axis++)
+        msp.serialize16((int16_t)lrintf(eulerAngles[axis] * 10));
+    for (uint8_t axis = 0; axis < 3; axis++)
+        msp.serialize16(gyro[axis]);
+    for (uint8_t axis = 0; axis < 3; axis++)
+        msp.serialize16(axisPID[axis]);
+    for (uint8_t i = 0; i < 4; i++) {
+        int32_t pulse = i < VehicleMixer::MOTORS ? motors[i] : 1000;
+        int32_t scaled = (pulse - 1000) / 4;
+        scaled = constrain(scaled, 0, 255);
+        msp.serialize8(scaled);
+    }
+    msp.serializeSaturated16(imu.execLast);
+    msp.serializeSaturated16(imu.lateLast);
+}
+
+#ifdef CONFIG_DUAL_CORE
+template <class BoardType>
+void Hackflight<BoardType>::handleSetRawRc(MSP & msp, void * context)
+{
+    coreChannels_t channels;
+    for (uint8_t i = 0; i < CONFIG_RC_CHANS; i++)
+        channels.values[i] = msp.read16();
+    if (!msp.sequence(2*CONFIG_RC_CHANS))
+        return;
+
+    // A full ring loses the frame, like a dropped packet; the next one follows
+    CoreCommand command;
+    command.set(CORE_COMMAND_RC, channels);
+    ((Hackflight *)context)->link.commands.push(command);
+}
+
+template <class BoardType>
+void Hackflight<BoardType>::handleSetMotor(MSP & msp, void * context)
+{
+    coreMotors_t motors;
+    for (motors.count = 0; motors.count < 4 && 2*motors.count+1 < msp.payloadSize(); motors.count++)
+        motors.values[motors.count] = msp.read16();
+    if (!msp.sequence(8))
+        return;
+
+    CoreCommand command;
+    command.set(CORE_COMMAND_MOTORS, motors);
+    ((Hackflight *)context)->link.commands.push(command);
+}
+
+template <class BoardType>
+void Hackflight<BoardType>::handleRc(MSP & msp, void * context)
+{
+    Hackflight * h = (Hackflight *)context;
+    msp.headSerialReply(2*CONFIG_RC_CHANS);
+    for (uint8_t i = 0; i < CONFIG_RC_CHANS; i++)
+        msp.serialize16(h->latest.channels[i]);
+}
+
+template <class BoardType>
+void Hackflight<BoardType>::commandTaskFunction(void * hackflight)
+{
+    ((Hackflight *)hackflight)->applyCommands();
+}
+#endif
+
+template <class BoardType>
+void Hackflight<BoardType>::extrasTaskFunction(void * hackflight)
+{
+    ((Hackflight *)hackflight)->updateExtras();
+}
+
+template <class BoardType>
+void Hackflight<BoardType>::blackboxTaskFunction(void * hackflight)
+{
+    ((Hackflight *)hackflight)->blackbox.flush();
+}
+
+template <class BoardType>
+void Hackflight<BoardType>::ledTaskFunction(void * hackflight)
+{
+    ((Hackflight *)hackflight)->leds.step();
+}
+
+template <class BoardType>
+void Hackflight<BoardType>::batteryTaskFunction(void * hackflight)
+{
+    Hackflight * h = (Hackflight *)hackflight;
+    h->mixer.updateBattery(h->board->batteryGetMillivolts());
+}
+
+template <class BoardType>
+void Hackflight<BoardType>::flowTaskFunction(void * hackflight)
+{
+    ((Hackflight *)hackflight)->updateFlow();
+}
+
+template <class BoardType>
+void Hackflight<BoardType>::startupTaskFunction(void * hackflight)
+{
+    ((Hackflight *)hackflight)->updateStartup();
+}
+
+template <class BoardType>
+void Hackflight<BoardType>::updateStartup(void)
+{
+    uint32_t currentTime = (uint32_t)board->getMicros();
+
+    switch (startupState) {
+
+        case STARTUP_FLASHING:
+            leds.step();
+            if (++startupSteps < startupFlashSteps) {
+                break;
+            }
+            leds.setPattern(0, LED_PATTERN_OFF);
+            leds.setPattern(1, LED_PATTERN_OFF);
+            startupWarmStart = currentTime;
+            startupState = STARTUP_WARMING;
+            break;
+
+        case STARTUP_WARMING:
+            if (currentTime - startupWarmStart < startupWarmMicro || !board->imuReady()) {
+                break;
+            }
+            calibration.start(currentTime);
+            scheduler.setPeriod(startupTaskId, calibrationSampleMicro);
+            startupState = STARTUP_CALIBRATING;
+            break;
+
+        case STARTUP_CALIBRATING:
+            {
+                // Boards that can't read the gyro alone keep their stored offsets
+                int16_t gyroRaw[3];
+                int16_t accelRaw[3];
+                if (board->imuReadGyro(gyroRaw) && !calibration.update(gyroRaw, 
+                            board->imuReadAccel(accelRaw) ? accelRaw : NULL, currentTime)) {
+                    break;
+                }
+            }
+
+            // An IMU run from its interrupt goes at the sensor's rate, so there is nothing to choose
+            if (loopRate.enabled() && !imuInterruptDriven) {
+                loopRate.start();
+                startupState = STARTUP_TIMING;
+                break;
+            }
+
+            startFlight();
+            break;
+
+        case STARTUP_TIMING:
+            {
+                // Disarmed, the cycle is the one flight will run, sensor reads and all
+                uint32_t start = (uint32_t)board->getMicros();
+                board->imuUpdate();
+                updateImu();
+                if (!loopRate.update((uint32_t)board->getMicros() - start)) {
+                    break;
+                }
+            }
+
+            applyLoopRate();
+            startFlight();
+            break;
     }
 }
 
-void Hackflight::flashLeds(const InitConfig& config)
+template <class BoardType>
+void Hackflight<BoardType>::startFlight(void)
 {
-    uint32_t pauseMilli = config.ledFlashMilli / config.ledFlashCount;
-    board->ledSet(0, false);
-    board->ledSet(1, false);
-    for (uint8_t i = 0; i < config.ledFlashCount; i++) {
-        board->ledSet(0, true);
-        board->ledSet(1, false);
-        board->delayMilliseconds(pauseMilli);
-        board->ledSet(0, false);
-        board->ledSet(1, true);
-        board->delayMilliseconds(pauseMilli);
+    // Hand over to flight
+    scheduler.setEnabled(startupTaskId, false);
+    scheduler.setEnabled(imuTaskId, true);
+    if (gyroOversampling) {
+        scheduler.setEnabled(gyroTaskId, true);
     }
-    board->ledSet(0, false);
-    board->ledSet(1, false);
+#ifndef CONFIG_DUAL_CORE
+    scheduler.setEnabled(extrasTaskId, true);
+#endif
+    scheduler.setEnabled(ledTaskId, true);
+    startupState = STARTUP_READY;
+}
+
+template <class BoardType>
+void Hackflight<BoardType>::applyLoopRate(void)
+{
+    const Config& config = board->getConfig();
+
+    LoopConfig loopConfig = config.loop;
+    loopConfig.imuLoopMicro = loopRate.getPeriod();
+
+    scheduler.setPeriod(imuTaskId, loopConfig.imuLoopMicro);
+    profiler.setPeriod(PROFILER_TASK_IMU, loopConfig.imuLoopMicro);
+
+    // Oversampling needs gyro samples to come faster than the PID runs
+    gyroOversampling = gyroOversampling && loopConfig.gyroLoopMicro < loopConfig.imuLoopMicro;
+
+    // Everything that steps once per IMU cycle is set up again for the new step; the cycles just timed
+    // leave nothing that matters behind
+    estimator.init(config.imu, gyroOversampling ? loopConfig.gyroLoopMicro : loopConfig.imuLoopMicro,
+            loopConfig.imuLoopMicro);
+    gyroFilter.init(config.filter, 1e6f / loopConfig.imuLoopMicro);
+    rc.setLoopConfig(loopConfig);
+    stab.setLoopConfig(loopConfig);
+    stab.resetIntegral();
 }
 
 } // namespace
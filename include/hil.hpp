@@ -0,0 +1,392 @@
+/*
+   hil.hpp : hardware-in-the-loop support
+
+   HilBoard wraps a real board, so that its firmware flies the simulator instead of its own sensors.
+   The simulator sends each IMU sample as MSP_HIL_STATE; the IMU task runs once per sample, as it
+   would with a data-ready interrupt, and the motor values the mixer computes from it go back
+   as MSP_HIL_MOTORS, along with how long the board took.  Everything else (RC, serial, the
+   motors themselves, extras) is the real board's, so the timing is what it would be in flight.
+   REMOVE THE PROPS: the real motors run too.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "board.hpp"
+#include "config.hpp"
+#include "msp.hpp"
+
+namespace hf {
+
+class HilBoard : public Board {
+
+    public:
+
+        // Euler angles in MSP_HIL_STATE are in units of 1/ANGLE_SCALE radian
+        static constexpr float ANGLE_SCALE = 10000;
+
+        static const uint8_t MOTORS = 4;
+
+        HilBoard(Board * _real);
+
+    //------------------------------------ Core functionality ----------------------------------------------------
+        virtual void     init(void) override;
+        virtual const    Config& getConfig(void) override;
+        virtual void     delayMilliseconds(uint32_t msec) override;
+        virtual void     dump(char * msg) override;
+        virtual uint64_t getMicros(void) override;
+        virtual void     ledSet(uint8_t id, bool is_on, float max_brightness = 255) override;
+
+    //------------------------------------------- IMU -----------------------------------------------------------
+        virtual void     imuUpdate(void) override;
+        virtual bool     imuHasDataReadyInterrupt(void) override;
+        virtual bool     imuDataReady(void) override;
+        virtual void     imuGetEulerAndGyro(float eulerAnglesRadians[3], int16_t gyroRaw[3]) override;
+
+    //-------------------------------------------- RC -----------------------------------------------------
+        virtual uint16_t rcReadSerial(uint8_t chan) override;
+        virtual uint8_t  rcReadSerialFrame(uint16_t channels[CONFIG_RC_CHANS]) override;
+        virtual bool     rcHasFrameSignal(void) override;
+        virtual bool     rcFrameReady(void) override;
+        virtual bool     rcGetLinkStats(rcLinkStats_t & stats) override;
+        virtual bool     rcUseSerial(void) override;
+        virtual uint16_t rcReadPwm(uint8_t chan) override;
+        virtual uint8_t  rcReadPwmFrame(uint16_t channels[CONFIG_RC_CHANS]) override;
+
+    //------------------------------------------ Serial ---------------------------------------------------------
+        virtual uint8_t  serialAvailableBytes(void) override;
+        virtual uint8_t  serialReadByte(void) override;
+        virtual void     serialWriteByte(uint8_t c) override;
+        virtual uint16_t serialAvailableForWrite(void) override;
+        virtual void     serialWriteBytes(const uint8_t * buf, uint16_t count) override;
+        virtual void     serialFlush(void) override;
+
+    //------------------------------------------ Motors ---------------------------------------------------------
+        virtual void     writeMotor(uint8_t index, uint16_t value) override;
+        virtual void     writeMotors(const uint16_t * values, uint8_t count) override;
+
+    //------------------------------------------ Battery --------------------------------------------------------
+        virtual uint16_t batteryGetMillivolts(void) override;
+
+    //----------------------------------------- Blackbox --------------------------------------------------------
+        virtual bool     blackboxInit(void) override;
+        virtual void     blackboxWrite(const uint8_t * buf, uint16_t count) override;
+
+    //------------------------------------------ Extras ---------------------------------------------------------
+        virtual void     extrasHandleAuxSwitch(uint8_t auxState) override;
+        virtual uint8_t  extrasGetTaskCount(void) override;
+        virtual void     extrasPerformTask(uint8_t taskIndex) override;
+        virtual void     extrasUpdateAccelZ(const float gravity[3], bool armed) override;
+        virtual void     extrasRegisterMspHandlers(MSP * _msp) override;
+
+    private:
+
+        Board  * real;
+        MSP    * msp;
+
+        // Latest sample from the simulator, and when it arrived
+        int16_t  seq;
+        float    eulerAngles[3];
+        int16_t  gyro[3];
+        uint32_t arrivalMicros;
+        bool     fresh;
+        bool     started;
+
+        // Samples that never reached the IMU task: lost on the way, or overwritten before it ran
+        uint16_t missed;
+
+        uint16_t motors[MOTORS];
+        uint16_t latency;
+
+        static void handleHilState(MSP & msp, void * context);
+        static void handleHilMotors(MSP & msp, void * context);
+};
+
+/********************************************* CPP ********************************************************/
+
+HilBoard::HilBoard(Board * _real)
+{
+    real = _real;
+    msp  = NULL;
+
+    seq     = 0;
+    arrivalMicros = 0;
+    fresh   = false;
+    started = false;
+    missed  = 0;
+    latency = 0;
+
+    for (uint8_t k=0; k<3; ++k) {
+        eulerAngles[k] = 0;
+        gyro[k] = 0;
+    }
+
+    for (uint8_t k=0; k<MOTORS; ++k) {
+        motors[k] = 0;
+    }
+}
+
+void HilBoard::init(void)
+{
+    real->init();
+}
+
+const Config& HilBoard::getConfig(void)
+{
+    config = real->getConfig();
+
+    // A sample waits in the serial buffer until MSP parses it, so parse often
+    config.loop.mspLoopMilli = CONFIG_HIL_MSP_LOOP_MILLI;
+
+    return config;
+}
+
+void HilBoard::delayMilliseconds(uint32_t msec)
+{
+    real->delayMilliseconds(msec);
+}
+
+void HilBoard::dump(char * msg)
+{
+    real->dump(msg);
+}
+
+uint64_t HilBoard::getMicros(void)
+{
+    return real->getMicros();
+}
+
+void HilBoard::ledSet(uint8_t id, bool is_on, float max_brightness)
+{
+    real->ledSet(id, is_on, max_brightness);
+}
+
+void HilBoard::imuUpdate(void)
+{
+    // The real IMU's reading is ignored, but it still costs what it would in flight
+    real->imuUpdate();
+}
+
+bool HilBoard::imuHasDataReadyInterrupt(void)
+{
+    return true;
+}
+
+bool HilBoard::imuDataReady(void)
+{
+    bool ready = fresh;
+    fresh = false;
+    return ready;
+}
+
+void HilBoard::imuGetEulerAndGyro(float eulerAnglesRadians[3], int16_t gyroRaw[3])
+{
+    for (uint8_t k=0; k<3; ++k) {
+        eulerAnglesRadians[k] = eulerAngles[k];
+        gyroRaw[k] = gyro[k];
+    }
+}
+
+uint16_t HilBoard::rcReadSerial(uint8_t chan)
+{
+    return real->rcReadSerial(chan);
+}
+
+uint8_t HilBoard::rcReadSerialFrame(uint16_t channels[CONFIG_RC_CHANS])
+{
+    return real->rcReadSerialFrame(channels);
+}
+
+bool HilBoard::rcHasFrameSignal(void)
+{
+    return real->rcHasFrameSignal();
+}
+
+bool HilBoard::rcFrameReady(void)
+{
+    return real->rcFrameReady();
+}
+
+bool HilBoard::rcGetLinkStats(rcLinkStats_t & stats)
+{
+    return real->rcGetLinkStats(stats);
+}
+
+bool HilBoard::rcUseSerial(void)
+{
+    return real->rcUseSerial();
+}
+
+uint16_t HilBoard::rcReadPwm(uint8_t chan)
+{
+    return real->rcReadPwm(chan);
+}
+
+uint8_t HilBoard::rcReadPwmFrame(uint16_t channels[CONFIG_RC_CHANS])
+{
+    return real->rcReadPwmFrame(channels);
+}
+
+uint8_t HilBoard::serialAvailableBytes(void)
+{
+    return real->serialAvailableBytes();
+}
+
+uint8_t HilBoard::serialReadByte(void)
+{
+    return real->serialReadByte();
+}
+
+void HilBoard::serialWriteByte(uint8_t c)
+{
+    real->serialWriteByte(c);
+}
+
+uint16_t HilBoard::serialAvailableForWrite(void)
+{
+    return real->serialAvailableForWrite();
+}
+
+void HilBoard::serialWriteBytes(const uint8_t * buf, uint16_t count)
+{
+    real->serialWriteBytes(buf, count);
+}
+
+void HilBoard::serialFlush(void)
+{
+    real->serialFlush();
+}
+
+void HilBoard::writeMotor(uint8_t index, uint16_t value)
+{
+    real->writeMotor(index, value);
+}
+
+void HilBoard::writeMotors(const uint16_t * values, uint8_t count)
+{
+    real->writeMotors(values, count);
+
+    for (uint8_t k=0; k<count && k<MOTORS; ++k) {
+        motors[k] = values[k];
+    }
+
+    uint32_t usec = (uint32_t)real->getMicros() - arrivalMicros;
+    latency = usec > 0xFFFF ? 0xFFFF : (uint16_t)usec;
+
+    // Straight back to the simulator, rather than waiting for the MSP task
+    if (msp) {
+        msp->push(MSP_HIL_MOTORS);
+    }
+}
+
+uint16_t HilBoard::batteryGetMillivolts(void)
+{
+    return real->batteryGetMillivolts();
+}
+
+bool HilBoard::blackboxInit(void)
+{
+    return real->blackboxInit();
+}
+
+void HilBoard::blackboxWrite(const uint8_t * buf, uint16_t count)
+{
+    real->blackboxWrite(buf, count);
+}
+
+void HilBoard::extrasHandleAuxSwitch(uint8_t auxState)
+{
+    real->extrasHandleAuxSwitch(auxState);
+}
+
+uint8_t HilBoard::extrasGetTaskCount(void)
+{
+    return real->extrasGetTaskCount();
+}
+
+void HilBoard::extrasPerformTask(uint8_t taskIndex)
+{
+    real->extrasPerformTask(taskIndex);
+}
+
+void HilBoard::extrasUpdateAccelZ(const float gravity[3], bool armed)
+{
+    real->extrasUpdateAccelZ(gravity, armed);
+}
+
+void HilBoard::extrasRegisterMspHandlers(MSP * _msp)
+{
+    msp = _msp;
+
+    msp->registerHandler(MSP_HIL_STATE,  handleHilState, this);
+    msp->registerHandler(MSP_HIL_MOTORS, handleHilMotors, this);
+
+    real->extrasRegisterMspHandlers(msp);
+}
+
+void HilBoard::handleHilState(MSP & msp, void * context)
+{
+    HilBoard * board = (HilBoard *)context;
+
+    if (msp.payloadSize() < 14) {
+        msp.headSerialError(0);
+        return;
+    }
+
+    int16_t seq = (int16_t)msp.read16();
+
+    // Count the samples skipped since the last one, and the last one if the IMU task never took it
+    if (board->started) {
+        uint16_t gap = (uint16_t)(seq - board->seq - 1);
+        if (gap < 0x8000) {
+            board->missed += gap;
+        }
+        if (board->fresh) {
+            board->missed++;
+        }
+    }
+
+    board->seq = seq;
+
+    for (uint8_t k=0; k<3; ++k) {
+        board->eulerAngles[k] = (int16_t)msp.read16() / ANGLE_SCALE;
+    }
+
+    for (uint8_t k=0; k<3; ++k) {
+        board->gyro[k] = (int16_t)msp.read16();
+    }
+
+    board->arrivalMicros = (uint32_t)board->real->getMicros();
+    board->fresh   = true;
+    board->started = true;
+
+    msp.headSerialReply(0);
+}
+
+void HilBoard::handleHilMotors(MSP & msp, void * context)
+{
+    HilBoard * board = (HilBoard *)context;
+
+    msp.headSerialReply(2 * (3 + MOTORS));
+    msp.serialize16(board->seq);
+    for (uint8_t k=0; k<MOTORS; ++k) {
+        msp.serialize16(board->motors[k]);
+    }
+    msp.serialize16(board->latency);
+    msp.serialize16(board->missed);
+}
+
+} // namespace
@@ -0,0 +1,116 @@
+/*
+   leds.hpp : edge-triggered LED state and blink patterns
+
+   The firmware says what each LED should be doing with setPattern(), as often as it likes; the
+   board hears about it only when an LED actually changes, either at once (a new pattern) or
+   from step(), which a low-rate task runs to move patterns on.  Patterns are eight steps long,
+   one bit per step, so a blink costs a shift and a compare.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "board.hpp"
+
+namespace hf {
+
+enum {
+    LED_PATTERN_OFF = 0,
+    LED_PATTERN_ON,
+    LED_PATTERN_BLINK,      // half the cycle on, half off
+    LED_PATTERN_FLASH,      // on every other step
+    LED_PATTERN_FLASH_ALT,  // the steps FLASH is off
+    LED_PATTERN_COUNT
+};
+
+class Leds {
+
+    public:
+
+        static const uint8_t COUNT = 2;
+
+        void init(Board * _board);
+
+        // Cheap enough for the IMU task: the board is called only if the LED changes
+        void setPattern(uint8_t id, uint8_t pattern);
+
+        // Moves every pattern on one step
+        void step(void);
+
+    private:
+
+        static const uint8_t PATTERN_STEPS = 8;
+
+        static constexpr uint8_t patterns[LED_PATTERN_COUNT] = {0x00, 0xFF, 0x0F, 0x55, 0xAA};
+
+        Board * board;
+
+        uint8_t pattern[COUNT];
+        bool    on[COUNT];
+        uint8_t phase;
+
+        void apply(uint8_t id);
+};
+
+/********************************************* CPP ********************************************************/
+
+constexpr uint8_t Leds::patterns[LED_PATTERN_COUNT];
+
+void Leds::init(Board * _board)
+{
+    board = _board;
+    phase = 0;
+
+    // Start from a known state
+    for (uint8_t id=0; id<COUNT; ++id) {
+        pattern[id] = LED_PATTERN_OFF;
+        on[id] = false;
+        board->ledSet(id, false);
+    }
+}
+
+void Leds::setPattern(uint8_t id, uint8_t _pattern)
+{
+    if (pattern[id] == _pattern) {
+        return;
+    }
+
+    pattern[id] = _pattern;
+    apply(id);
+}
+
+void Leds::step(void)
+{
+    phase = (phase + 1) % PATTERN_STEPS;
+
+    for (uint8_t id=0; id<COUNT; ++id) {
+        apply(id);
+    }
+}
+
+void Leds::apply(uint8_t id)
+{
+    bool state = (patterns[pattern[id]] >> phase) & 1;
+
+    if (state != on[id]) {
+        on[id] = state;
+        board->ledSet(id, state);
+    }
+}
+
+} // namespace hf
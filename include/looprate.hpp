@@ -0,0 +1,123 @@
+/*
+   looprate.hpp : the IMU loop's period, picked at startup from how long the IMU chain takes
+
+   With LoopConfig::imuLoopMinMicro set, the startup task times the whole IMU chain, the board's own
+   sensor reads included, for imuLoopBenchmarkCycles cycles once calibration is done.  The period is then
+   the shortest in which the slowest of those cycles takes no more than imuLoopLoad of it, but no shorter
+   than imuLoopMinMicro; the rest of each period is left to RC, MSP and the extras.  LoopConfig::imuLoopMicro
+   is then the period the gains were tuned at, and Hackflight rescales the PID, gyro filter and estimator
+   to the new one.  An IMU run from its data-ready interrupt goes at the sensor's rate, so nothing is timed.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include "config.hpp"
+#include "msp.hpp"
+
+namespace hf {
+
+class LoopRate {
+
+    public:
+
+        void init(const LoopConfig & loopConfig);
+
+        // False for a fixed period
+        bool enabled(void) { return minMicro > 0; }
+
+        void start(void);
+
+        // One IMU cycle's time, sensor reads included; true once enough have been timed, with the period chosen
+        bool update(uint32_t execMicro);
+
+        // The period chosen, or the tuned one until then
+        uint32_t getPeriod(void) { return period; }
+        uint32_t getTunedPeriod(void) { return tunedMicro; }
+
+        void registerMspHandlers(MSP * msp);
+
+    private:
+
+        uint32_t tunedMicro;
+        uint32_t minMicro;
+        float    load;
+        uint16_t cycles;
+
+        uint32_t period;
+        uint32_t worst;
+        uint16_t count;
+
+        static void handleLoopRate(MSP & msp, void * context);
+};
+
+/********************************************* CPP ********************************************************/
+
+void LoopRate::init(const LoopConfig & loopConfig)
+{
+    tunedMicro = loopConfig.imuLoopMicro;
+    minMicro   = loopConfig.imuLoopMinMicro;
+    load       = loopConfig.imuLoopLoad;
+    cycles     = loopConfig.imuLoopBenchmarkCycles;
+
+    period = tunedMicro;
+    worst  = 0;
+    count  = 0;
+}
+
+void LoopRate::start(void)
+{
+    worst = 0;
+    count = 0;
+}
+
+bool LoopRate::update(uint32_t execMicro)
+{
+    if (execMicro > worst) {
+        worst = execMicro;
+    }
+
+    if (++count < cycles) {
+        return false;
+    }
+
+    // Rounded up, so that the chain never takes more than its share
+    uint32_t fits = (uint32_t)ceilf(worst / load);
+
+    period = fits > minMicro ? fits : minMicro;
+
+    return true;
+}
+
+void LoopRate::registerMspHandlers(MSP * msp)
+{
+    msp->registerHandler(MSP_LOOP_RATE, handleLoopRate, this);
+}
+
+void LoopRate::handleLoopRate(MSP & msp, void * context)
+{
+    LoopRate * rate = (LoopRate *)context;
+
+    msp.headSerialReply(4 + 4 + 2);
+    msp.serialize32(rate->period);
+    msp.serialize32(rate->tunedMicro);
+    msp.serializeSaturated16(rate->worst);
+}
+
+} // namespace hf
@@ -0,0 +1,255 @@
+/*
+   mahony.hpp : attitude from a bare gyro and accelerometer, for boards without sensor fusion
+
+   Mahony's complementary filter on a quaternion (w,x,y,z, as quaternion.hpp has it).  The work is split
+   by rate.  update() runs on every gyro sample, up to the 8 kHz oversampling path: it integrates the
+   rates plus the last correction, and renormalizes with one Newton step instead of a square root, whose
+   error goes as the square of the step's drift from unit length.  correct() runs at the IMU rate: it crosses the
+   accelerometer's direction with the gravity the quaternion predicts, and turns that error into the
+   correction, proportional plus integral (for gyro bias).  If the accelerometer reads far from one G,
+   the vehicle is accelerating, and only the bias estimate is applied until it reads true again.
+
+   T is float, or int32_t for Q2.29 fixed point on FPU-less targets; the algorithm is written once, and
+   MahonyMath<T> supplies the arithmetic.  The gyro and accelerometer must share axes, with the gyro in
+   the firmware's raw counts and the accelerometer reading +1G on Z when level.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include "config.hpp"
+
+namespace hf {
+
+template <typename T> struct MahonyMath;
+
+template <>
+struct MahonyMath<float> {
+
+    // Gyro counts times a per-count scale
+    typedef float scale_t;
+
+    static float   fromFloat(float v) { return v; }
+    static float   toFloat(float v) { return v; }
+    static float   mul(float a, float b) { return a * b; }
+    static scale_t toScale(float k) { return k; }
+    static float   scale(int16_t counts, scale_t k) { return counts * k; }
+
+    // Unit vector from raw counts, given their squared length
+    static void unit(const int16_t v[3], uint32_t norm2, float u[3])
+    {
+        float inverse = 1 / sqrtf((float)norm2);
+        for (uint8_t k = 0; k < 3; k++) {
+            u[k] = v[k] * inverse;
+        }
+    }
+};
+
+template <>
+struct MahonyMath<int32_t> {
+
+    static const uint8_t FRACTION_BITS = 29;
+
+    // The per-count gyro scale is tiny (under 1e-6 at 8 kHz), so it keeps this many more bits
+    typedef int32_t scale_t;
+    static const uint8_t SCALE_EXTRA_BITS = 16;
+
+    static int32_t fromFloat(float v) { return (int32_t)lrintf(v * (1 << FRACTION_BITS)); }
+    static float   toFloat(int32_t v) { return v / (float)(1 << FRACTION_BITS); }
+
+    // 32x32->64 multiply is a single instruction (SMULL) on Cortex-M3 and up
+    static int32_t mul(int32_t a, int32_t b) { return (int32_t)(((int64_t)a * b) >> FRACTION_BITS); }
+
+    static scale_t toScale(float k) { return (int32_t)lrintf(k * (1 << FRACTION_BITS) * (1 << SCALE_EXTRA_BITS)); }
+    static int32_t scale(int16_t counts, scale_t k) { return (int32_t)(((int64_t)counts * k) >> SCALE_EXTRA_BITS); }
+
+    static void unit(const int16_t v[3], uint32_t norm2, int32_t u[3])
+    {
+        uint32_t norm = isqrt(norm2);
+        for (uint8_t k = 0; k < 3; k++) {
+            u[k] = (int32_t)(((int64_t)v[k] << FRACTION_BITS) / norm);
+        }
+    }
+
+    // Bit at a time, so no FPU and no division
+    static uint32_t isqrt(uint32_t x)
+    {
+        uint32_t root = 0;
+        uint32_t bit  = 1UL << 30;
+
+        while (bit > x) {
+            bit >>= 2;
+        }
+
+        while (bit) {
+            if (x >= root + bit) {
+                x -= root + bit;
+                root = (root >> 1) + bit;
+            }
+            else {
+                root >>= 1;
+            }
+            bit >>= 2;
+        }
+
+        return root;
+    }
+};
+
+template <typename T>
+class Mahony {
+
+    public:
+
+        // Periods of update() and correct() calls (usec); starts level
+        void init(const ImuConfig & imuConfig, uint32_t gyroMicro, uint32_t accelMicro);
+
+        // Every gyro sample, offsets already taken out
+        void update(const int16_t gyroRaw[3]);
+
+        // Every accelerometer sample, offsets already taken out
+        void correct(const int16_t accelRaw[3]);
+
+        void getQuaternion(float q[4]);
+
+    private:
+
+        typedef MahonyMath<T> M;
+
+        T q[4];
+
+        // Correction, as half-angle per update(), and the integral term behind it (rad/s)
+        T correction[3];
+        T integral[3];
+
+        typename M::scale_t gyroScale;
+
+        T halfDt;
+        T kpHalfDt;
+        T kiDt;
+        T three;
+        T half;
+
+        // Accelerometer's squared length allowed, in raw counts
+        uint32_t accelMin2;
+        uint32_t accelMax2;
+};
+
+/********************************************* CPP ********************************************************/
+
+template <typename T>
+void Mahony<T>::init(const ImuConfig & imuConfig, uint32_t gyroMicro, uint32_t accelMicro)
+{
+    float gyroDt  = gyroMicro  * 1e-6f;
+    float accelDt = accelMicro * 1e-6f;
+
+    // Counts to half the angle turned in one gyro period (radians), as the quaternion update wants it
+    gyroScale = M::toScale(0.5f * gyroDt * (float)M_PI / 180 / imuConfig.gyroLsbPerDps);
+
+    halfDt   = M::fromFloat(0.5f * gyroDt);
+    kpHalfDt = M::fromFloat(imuConfig.mahonyKp * 0.5f * gyroDt);
+    kiDt     = M::fromFloat(imuConfig.mahonyKi * accelDt);
+    three    = M::fromFloat(3);
+    half     = M::fromFloat(0.5f);
+
+    float lo = imuConfig.accel1G * (1 - imuConfig.mahonyAccelWindow);
+    float hi = imuConfig.accel1G * (1 + imuConfig.mahonyAccelWindow);
+    accelMin2 = (uint32_t)(lo * lo);
+    accelMax2 = (uint32_t)(hi * hi);
+
+    q[0] = M::fromFloat(1);
+    for (uint8_t k = 0; k < 3; k++) {
+        q[k+1]        = 0;
+        correction[k] = 0;
+        integral[k]   = 0;
+    }
+}
+
+template <typename T>
+void Mahony<T>::update(const int16_t gyroRaw[3])
+{
+    T hx = M::scale(gyroRaw[0], gyroScale) + correction[0];
+    T hy = M::scale(gyroRaw[1], gyroScale) + correction[1];
+    T hz = M::scale(gyroRaw[2], gyroScale) + correction[2];
+
+    T w = q[0], x = q[1], y = q[2], z = q[3];
+
+    // q += q * (0, h)
+    q[0] = w - M::mul(x, hx) - M::mul(y, hy) - M::mul(z, hz);
+    q[1] = x + M::mul(w, hx) + M::mul(y, hz) - M::mul(z, hy);
+    q[2] = y + M::mul(w, hy) - M::mul(x, hz) + M::mul(z, hx);
+    q[3] = z + M::mul(w, hz) + M::mul(x, hy) - M::mul(y, hx);
+
+    // 1/sqrt(n) is (3 - n) / 2 to first order about n = 1
+    T n = M::mul(q[0], q[0]) + M::mul(q[1], q[1]) + M::mul(q[2], q[2]) + M::mul(q[3], q[3]);
+    T f = M::mul(three - n, half);
+
+    for (uint8_t k = 0; k < 4; k++) {
+        q[k] = M::mul(q[k], f);
+    }
+}
+
+template <typename T>
+void Mahony<T>::correct(const int16_t accelRaw[3])
+{
+    uint32_t norm2 = 0;
+    for (uint8_t k = 0; k < 3; k++) {
+        norm2 += (uint32_t)((int32_t)accelRaw[k] * accelRaw[k]);
+    }
+
+    // Accelerating, or no reading: nothing to correct toward
+    if (norm2 < accelMin2 || norm2 > accelMax2) {
+        for (uint8_t k = 0; k < 3; k++) {
+            correction[k] = M::mul(halfDt, integral[k]);
+        }
+        return;
+    }
+
+    T a[3];
+    M::unit(accelRaw, norm2, a);
+
+    // Gravity as the quaternion has it (Quaternion::gravity())
+    T w = q[0], x = q[1], y = q[2], z = q[3];
+    T two = M::fromFloat(2);
+    T v[3];
+    v[0] = M::mul(two, M::mul(x, z) - M::mul(w, y));
+    v[1] = M::mul(two, M::mul(y, z) + M::mul(w, x));
+    v[2] = M::mul(w, w) - M::mul(x, x) - M::mul(y, y) + M::mul(z, z);
+
+    // Error is the rotation from predicted to measured
+    T e[3];
+    e[0] = M::mul(a[1], v[2]) - M::mul(a[2], v[1]);
+    e[1] = M::mul(a[2], v[0]) - M::mul(a[0], v[2]);
+    e[2] = M::mul(a[0], v[1]) - M::mul(a[1], v[0]);
+
+    for (uint8_t k = 0; k < 3; k++) {
+        integral[k]  += M::mul(kiDt, e[k]);
+        correction[k] = M::mul(kpHalfDt, e[k]) + M::mul(halfDt, integral[k]);
+    }
+}
+
+template <typename T>
+void Mahony<T>::getQuaternion(float _q[4])
+{
+    for (uint8_t k = 0; k < 4; k++) {
+        _q[k] = M::toFloat(q[k]);
+    }
+}
+
+} // namespace hf
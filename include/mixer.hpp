@@ -22,19 +22,86 @@
 #include "debug.hpp"
 #include "stabilize.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <cstring>
+#include <cstdint>
 
 namespace hf {
 
+// Custom mixer data per motor
+typedef struct motorMixer_t {
+    float throttle;
+    float roll;
+    float pitch;
+    float yaw;
+} motorMixer_t;
+
+// Each frame type supplies its motor count and a constexpr mixing table, so that
+// the mixer loops have a compile-time trip count and the compiler can unroll them
+// and fold away the multiplications by +/-1.
+
+struct QuadX {
+    static const uint8_t MOTORS = 4;
+    static constexpr motorMixer_t table[MOTORS] = {
+        { +1.0f, -1.0f,  +1.0f, -1.0f },    // right rear
+        { +1.0f, -1.0f,  -1.0f, +1.0f },    // right front
+        { +1.0f, +1.0f,  +1.0f, +1.0f },    // left rear
+        { +1.0f, +1.0f,  -1.0f, -1.0f },    // left front
+    };
+};
+
+struct HexX {
+    static const uint8_t MOTORS = 6;
+    static constexpr motorMixer_t table[MOTORS] = {
+        { +1.0f, -0.5f,  +0.866025f, +1.0f },    // right rear
+        { +1.0f, -0.5f,  -0.866025f, +1.0f },    // right front
+        { +1.0f, +0.5f,  +0.866025f, -1.0f },    // left rear
+        { +1.0f, +0.5f,  -0.866025f, -1.0f },    // left front
+        { +1.0f, -1.0f,   0.0f,      -1.0f },    // right
+        { +1.0f, +1.0f,   0.0f,      +1.0f },    // left
+    };
+};
+
+struct OctoFlatX {
+    static const uint8_t MOTORS = 8;
+    static constexpr motorMixer_t table[MOTORS] = {
+        { +1.0f, +1.0f,  -0.5f, +1.0f },    // mid front left
+        { +1.0f, -0.5f,  -1.0f, +1.0f },    // front right
+        { +1.0f, -1.0f,  +0.5f, +1.0f },    // mid rear right
+        { +1.0f, +0.5f,  +1.0f, +1.0f },    // rear left
+        { +1.0f, +0.5f,  -1.0f, -1.0f },    // front left
+        { +1.0f, -1.0f,  -0.5f, -1.0f },    // mid front right
+        { +1.0f, -0.5f,  +1.0f, -1.0f },    // rear right
+        { +1.0f, +1.0f,  +0.5f, -1.0f },    // mid rear left
+    };
+};
+
+constexpr motorMixer_t QuadX::table[QuadX::MOTORS];
+constexpr motorMixer_t HexX::table[HexX::MOTORS];
+constexpr motorMixer_t OctoFlatX::table[OctoFlatX::MOTORS];
+
+template <class Frame>
 class Mixer {
 
 public:
 
+    static const uint8_t MOTORS = Frame::MOTORS;
+
     // This is set by MSP
-    int16_t  motorsDisarmed[4];
+    int16_t  motorsDisarmed[MOTORS];
+
+    // Values last sent to the board, for logging
+    uint16_t outputs[MOTORS];
+
+    void init(const PwmConfig& _pwmConfig, const ThrustConfig& _thrustConfig, RC * _rc, Stabilize * _stabilize);
 
-    void init(const PwmConfig& _pwmConfig, RC * _rc, Stabilize * _stabilize);
-    void update(bool armed, Board* board);
+    // From the battery task, with the pack's voltage (mV); zero for unknown
+    void updateBattery(uint16_t millivolts);
+
+    // Takes the concrete board class where there is one, so that writeMotors() can be inlined
+    template <class BoardType>
+    void update(bool armed, BoardType * board);
 
 private:
 
@@ -42,80 +109,175 @@ private:
     RC        * rc;
     Stabilize * stabilize;
 
-    // Custom mixer data per motor
-    typedef struct motorMixer_t {
-        float throttle;
-        float roll;
-        float pitch;
-        float yaw;
-    } motorMixer_t;
+    bool airmodeActive;
+
+    // Thrust compensation: the linearization table over [0, max-min], every 2^thrustShift usec, and the battery
+    // boost in Q12, both found outside the IMU task, so that update() pays only a lookup and a multiply
+    ThrustConfig thrustConfig;
+    bool     compensating;
+    int16_t  thrustTable[CONFIG_THRUST_TABLE_LENGTH];
+    uint8_t  thrustShift;
+    int32_t  batteryScale;
+    uint16_t batteryMillivolts;
 
-	motorMixer_t mixerQuadX[4];
+    void computeThrustTable(void);
 };
 
+// Define CONFIG_MIXER_FRAME (e.g. -DCONFIG_MIXER_FRAME=HexX) to build for another airframe
+#ifndef CONFIG_MIXER_FRAME
+#define CONFIG_MIXER_FRAME QuadX
+#endif
+
+typedef Mixer<CONFIG_MIXER_FRAME> VehicleMixer;
+
 
 /********************************************* CPP ********************************************************/
 
-void Mixer::init(const PwmConfig& _pwmConfig, RC * _rc, Stabilize * _stabilize)
+template <class Frame>
+void Mixer<Frame>::init(const PwmConfig& _pwmConfig, const ThrustConfig& _thrustConfig, RC * _rc, Stabilize * _stabilize)
 {
-    mixerQuadX[0] = { +1.0f, -1.0f,  +1.0f, -1.0f };    // right rear
-    mixerQuadX[1] = { +1.0f, -1.0f,  -1.0f, +1.0f };    // right front
-    mixerQuadX[2] = { +1.0f, +1.0f,  +1.0f, +1.0f };    // left rear
-    mixerQuadX[3] = { +1.0f, +1.0f,  -1.0f, -1.0f };    // left front
-
     memcpy(&pwmConfig, &_pwmConfig, sizeof(PwmConfig));
+    memcpy(&thrustConfig, &_thrustConfig, sizeof(ThrustConfig));
 
     stabilize = _stabilize;
     rc = _rc;
 
     // set disarmed motor values
-    for (uint8_t i = 0; i < 4; i++)
+    for (uint8_t i = 0; i < MOTORS; i++) {
         motorsDisarmed[i] = pwmConfig.min;
+        outputs[i] = pwmConfig.min;
+    }
+
+    airmodeActive = false;
+
+    compensating = thrustConfig.linearization > 0 || thrustConfig.referenceMillivolts > 0;
+    batteryScale = 1 << 12;
+    batteryMillivolts = 0;
+    computeThrustTable();
 }
 
-void Mixer::update(bool armed, Board* board)
+template <class Frame>
+void Mixer<Frame>::computeThrustTable(void)
 {
-    int16_t motors[4];
+    int32_t range = pwmConfig.max - pwmConfig.min;
 
-    for (uint8_t i = 0; i < 4; i++) {
-        motors[i] = (int16_t)
-        (rc->command[DEMAND_THROTTLE]   * mixerQuadX[i].throttle + 
-         stabilize->axisPID[AXIS_PITCH] * mixerQuadX[i].pitch + 
-         stabilize->axisPID[AXIS_ROLL]  * mixerQuadX[i].roll - 
-         stabilize->axisPID[AXIS_YAW]   * mixerQuadX[i].yaw);
+    thrustShift = 0;
+    while ((range >> thrustShift) + 2 > CONFIG_THRUST_TABLE_LENGTH) {
+        thrustShift++;
+    }
+
+    // Solves (1-L)y + Ly^2 = x for the command y that gives thrust x
+    float l = thrustConfig.linearization;
 
-        //debug(board, "%d:%d   %c", i+1, motors[i], i==3?'\n':' ');
+    for (uint16_t i = 0; i < CONFIG_THRUST_TABLE_LENGTH; i++) {
+        int32_t x = (std::min)((int32_t)i << thrustShift, range);
+        float y = (float)x / range;
+        if (l > 0) {
+            float b = (1 - l) / (2 * l);
+            y = sqrtf(y / l + b * b) - b;
+        }
+        thrustTable[i] = (int16_t)lrintf(y * range);
     }
+}
 
-    int16_t maxMotor = motors[0];
+template <class Frame>
+void Mixer<Frame>::updateBattery(uint16_t millivolts)
+{
+    if (!thrustConfig.referenceMillivolts || !millivolts) {
+        return;
+    }
+
+    // Smooth out the dips under load, which would otherwise come back as a wobble in the gains
+    batteryMillivolts = batteryMillivolts ? batteryMillivolts + ((int32_t)millivolts - batteryMillivolts) / 4 : millivolts;
+
+    int32_t scale = ((int32_t)thrustConfig.referenceMillivolts << 12) / batteryMillivolts;
+    int32_t maxScale = (int32_t)(thrustConfig.maxBoost * (1 << 12));
+
+    batteryScale = scale < (1 << 12) ? (1 << 12) : (scale > maxScale ? maxScale : scale);
+}
+
+template <class Frame>
+template <class BoardType>
+void Mixer<Frame>::update(bool armed, BoardType * board)
+{
+    int16_t motors[MOTORS];
+
+    // Mix and track the extremes in one pass
+    int16_t maxMotor = INT16_MIN;
+    int16_t minMotor = INT16_MAX;
+
+    for (uint8_t i = 0; i < MOTORS; i++) {
+        motors[i] = (int16_t)
+        (rc->command[DEMAND_THROTTLE]   * Frame::table[i].throttle + 
+         stabilize->axisPID[AXIS_PITCH] * Frame::table[i].pitch + 
+         stabilize->axisPID[AXIS_ROLL]  * Frame::table[i].roll - 
+         stabilize->axisPID[AXIS_YAW]   * Frame::table[i].yaw);
 
-    for (uint8_t i = 1; i < 4; i++)
         if (motors[i] > maxMotor)
             maxMotor = motors[i];
+        if (motors[i] < minMotor)
+            minMotor = motors[i];
+    }
 
-    for (uint8_t i = 0; i < 4; i++) {
+    int16_t low  = pwmConfig.min + pwmConfig.idle;
+    int16_t high = pwmConfig.max;
 
-        // This is a way to still have good gyro corrections if at least one motor reaches its max
-        if (maxMotor > pwmConfig.max) {
-            motors[i] -= maxMotor - pwmConfig.max;
-        }
+    bool throttleDown = rc->throttleIsDown();
+
+    // Airmode waits for the throttle to come up, so that arming with the sticks doesn't start the motors
+    if (!armed) {
+        airmodeActive = false;
+    }
+    else if (pwmConfig.airmode && !throttleDown) {
+        airmodeActive = true;
+    }
+
+    // This is a way to still have good gyro corrections if at least one motor reaches its max; in airmode,
+    // its min too, and a mix too wide for the range is squeezed into it
+    int32_t spread = maxMotor - minMotor;
+    bool    squeeze = airmodeActive && spread > high - low;
+    int16_t shift = maxMotor > high ? high - maxMotor : 0;
+    if (airmodeActive && minMotor < low) {
+        shift = low - minMotor;
+    }
+
+    // Everything else per motor happens in this one pass
+    for (uint8_t i = 0; i < MOTORS; i++) {
+
+        int32_t motor = squeeze ? low + (motors[i] - minMotor) * (high - low) / spread : motors[i] + shift;
 
-        motors[i] = constrain(motors[i], pwmConfig.min, pwmConfig.max);
+        motor = constrain(motor, low, high);
 
         // Avoid sudden motor jump from right yaw while arming
-        if (rc->throttleIsDown()) {
-            motors[i] = pwmConfig.min;
+        if (throttleDown && !airmodeActive) {
+            motor = low;
         } 
 
+        // From thrust to command, boosted for the battery's sag; both only raise the value, so idle still holds
+        if (compensating) {
+            int32_t x = motor - pwmConfig.min;
+            int32_t idx = x >> thrustShift;
+            int32_t f = x & ((1 << thrustShift) - 1);
+            int32_t y = thrustTable[idx] + (((thrustTable[idx+1] - thrustTable[idx]) * f) >> thrustShift);
+            y = (y * batteryScale) >> 12;
+            motor = pwmConfig.min + (y < high - pwmConfig.min ? y : high - pwmConfig.min);
+        }
+
+        if (pwmConfig.slewLimit && armed) {
+            int32_t change = motor - outputs[i];
+            change = constrain(change, -(int32_t)pwmConfig.slewLimit, (int32_t)pwmConfig.slewLimit);
+            motor = outputs[i] + change;
+        }
+
         // This is how we can spin the motors from the GCS
         if (!armed) {
-            motors[i] = motorsDisarmed[i];
+            motor = motorsDisarmed[i];
         }
-    }
 
-    for (uint8_t i = 0; i < 4; i++) {
-        board->writeMotor(i, motors[i]);
+        outputs[i] = (uint16_t)motor;
     }
+
+    board->writeMotors(outputs, MOTORS);
 }
 
 } // namespace
@@ -1,6 +1,18 @@
 /*
    msp.hpp : MSP (Multiwii Serial Protocol) support
 
+   Requests come in either framing: MSPv1 ($M, one-byte size and command, XOR checksum) or MSPv2 ($X, a
+   flag byte, two-byte command and size, CRC-8/DVB-S2).  Each reply goes out in its request's framing, so
+   a host that sends v2 and hears nothing back knows to fall back to v1.  Commands above 255, and replies
+   too big for a one-byte size, exist only in v2.
+
+   SET_RAW_RC and SET_MOTOR may carry a sequence number after their values.  Zero, or none at all, gets
+   the usual empty reply; any other number gets none, so that a host streaming commands doesn't have a
+   reply coming back for each one.  Such a host subscribes to ACK instead, which reports at the rate it
+   asks for the last number accepted and what has been lost on the way.  A command older than the last
+   one accepted is dropped, so that a late frame can't take the sticks back in time.  Hosts count from
+   one and skip zero when they wrap.
+
    This file is part of Hackflight.
 
    Hackflight is free software: you can redistribute it and/or modify
@@ -21,21 +33,31 @@
 #include "board.hpp"
 #include "rc.hpp"
 #include "mixer.hpp"
+#include "profiler.hpp"
+
+// Command IDs and the dispatch-slot table are generated from parser/messages.json ('make firmware' there)
+#include "mspcommands.hpp"
 
 // See http://www.multiwii.com/wiki/index.php?title=Multiwii_Serial_Protocol
 #define MSP_REBOOT               68     
-#define MSP_RC                   105    
-#define MSP_ATTITUDE             108    
-#define MSP_ALTITUDE             109    
 #define MSP_BARO_SONAR_RAW       126    
-#define MSP_SONARS               127    
-#define MSP_SET_RAW_RC           200    
-#define MSP_SET_HEAD             211
-#define MSP_SET_MOTOR            214    
 
 namespace hf {
 
-static const int INBUF_SIZE = 128;
+// Without the tuning commands, no request is much bigger than SET_RAW_RC's, and no reply more than a few
+// dozen bytes
+#ifdef CONFIG_NO_MSP_TUNING
+static const int INBUF_SIZE = 64;
+#else
+static const int INBUF_SIZE = 256;
+#endif
+
+// Power of two, so that ring indices can wrap with a mask
+#ifdef CONFIG_NO_MSP_TUNING
+static const int TXBUF_SIZE = 128;
+#else
+static const int TXBUF_SIZE = 512;
+#endif
 
 typedef enum serialState_t {
     IDLE,
@@ -43,41 +65,129 @@ typedef enum serialState_t {
     HEADER_M,
     HEADER_ARROW,
     HEADER_SIZE,
-    HEADER_CMD
+    HEADER_CMD,
+    HEADER_X,
+    HEADER_X_ARROW,
+    HEADER_FLAG,
+    HEADER_CMD_LOW,
+    HEADER_CMD_HIGH,
+    HEADER_SIZE_LOW
 } serialState_t;
 
 typedef  struct mspPortState_t {
     uint8_t checksum;
-    uint8_t indRX;
+    uint16_t indRX;
     uint8_t inBuf[INBUF_SIZE];
-    uint8_t cmdMSP;
-    uint8_t offset;
-    uint8_t dataSize;
+    uint16_t cmdMSP;
+    uint16_t offset;
+    uint16_t dataSize;
+    bool v2;                // framing of the request being parsed or answered
+    bool hostV2;            // framing of the last good request, for pushes
     serialState_t c_state;
+    uint8_t txBuf[TXBUF_SIZE];
+    uint16_t txHead;
+    uint16_t txTail;
+    bool txDropping;
+    uint16_t txDropped;
+    bool replied;           // the handler has started a reply
+    uint16_t rxErrors;      // frames with bad checksums
 } mspPortState_t;
 
+class MSP;
+
+// A handler reads its request with read8() etc., then starts at most one reply with headSerialReply() or 
+// headSerialError() and serializes the payload; MSP adds the checksum
+typedef void (*mspHandler_t)(MSP & msp, void * context);
+
 class MSP {
 public:
-    void init(Mixer * _mixer, RC * _rc, Board * _board);
-    void update(float eulerAngles[3], bool armed);
+    void init(VehicleMixer * _mixer, RC * _rc, Profiler * _profiler, Board * _board, uint8_t _maxBytes);
+    void update(float eulerAngles[3], bool armed) { update(board, eulerAngles, armed); }
 
-private:
-    Mixer  * mixer;
-    RC     * rc;
-    Board  * board;
+    // The same, talking to the port through the concrete board class, so its accessors can be inlined
+    template <class BoardType>
+    void update(BoardType * board, float eulerAngles[3], bool armed);
 
-    mspPortState_t portState;
+    // Returns false for a command that is not in messages.json
+    bool registerHandler(uint16_t command, mspHandler_t handler, void * context=NULL);
 
-    void serialize8(uint8_t a);
-    void serialize16(int16_t a);
+    // Sends the reply to command as if the host had asked for it, and starts it on its way; for data
+    // that is ready outside the MSP task
+    void push(uint16_t command);
+
+    // For use by handlers
+    uint16_t payloadSize(void);
     uint8_t read8(void);
     uint16_t read16(void);
     uint32_t read32(void);
+    float readFloat(void);
+    void serialize8(uint8_t a);
+    void serialize16(int16_t a);
     void serialize32(uint32_t a);
-    void headSerialResponse(uint8_t err, uint8_t s);
-    void headSerialReply(uint8_t s);
-    void headSerialError(uint8_t s);
+    void serializeSaturated16(uint32_t a);
+    void serializeFloat(float a);
+    void headSerialReply(uint16_t s);
+    void headSerialError(uint16_t s);
+
+    // For a command whose values take size bytes: reads the sequence number after them, if there is one,
+    // and replies if there isn't; false if the command is stale and should be dropped
+    bool sequence(uint16_t size);
+
+private:
+    VehicleMixer * mixer;
+    RC           * rc;
+    Profiler     * profiler;
+    Board        * board;
+
+    uint8_t        maxBytes;
+    float        * eulerAngles;
+
+    struct {
+        mspHandler_t handler;
+        void       * context;
+    } handlers[MSP_COMMAND_COUNT];
+
+    mspPortState_t portState;
+
+    // Telemetry the host has subscribed to; command zero marks a free entry
+    struct {
+        uint16_t command;
+        bool     v2;
+        uint32_t period;
+        uint32_t due;
+    } streams[CONFIG_MSP_STREAMS];
+
+    // Sequenced commands, as ACK reports them
+    struct {
+        bool     started;
+        uint16_t seq;
+        uint32_t accepted;
+        uint16_t gaps;
+        uint16_t stale;
+    } acks;
+
+    void headSerialResponse(uint8_t err, uint16_t s);
     void tailSerialReply(void);
+    void updateChecksum(uint8_t c);
+    void dispatch(void);
+    bool subscribe(uint16_t command, uint8_t rate);
+    void stream(uint16_t command, bool v2);
+    void updateStreams(uint32_t currentTime);
+    uint16_t txFree(void);
+
+    static void saturatedAdd(uint16_t & count, uint16_t n);
+
+    template <class BoardType>
+    void txDrain(BoardType * board);
+
+    static void handleSetRawRc(MSP & msp, void * context);
+    static void handleSetMotor(MSP & msp, void * context);
+    static void handleRc(MSP & msp, void * context);
+    static void handleRcLink(MSP & msp, void * context);
+    static void handleAttitude(MSP & msp, void * context);
+    static void handleLoopTiming(MSP & msp, void * context);
+    static void handleSetStream(MSP & msp, void * context);
+    static void handleAck(MSP & msp, void * context);
 
 }; // class MSP
 
@@ -87,8 +197,27 @@ private:
 
 void MSP::serialize8(uint8_t a)
 {
-    board->serialWriteByte(a);
-    portState.checksum ^= a;
+    // Replies are queued here and sent by txDrain(), so the flight loop never waits on the UART
+    if (!portState.txDropping) {
+        portState.txBuf[portState.txHead] = a;
+        portState.txHead = (portState.txHead + 1) & (TXBUF_SIZE-1);
+    }
+    updateChecksum(a);
+}
+
+void MSP::updateChecksum(uint8_t c)
+{
+    if (!portState.v2) {
+        portState.checksum ^= c;
+        return;
+    }
+
+    // CRC-8/DVB-S2, over the flag, command, size and payload
+    uint8_t crc = portState.checksum ^ c;
+    for (uint8_t k = 0; k < 8; k++) {
+        crc = (crc & 0x80) ? (crc << 1) ^ 0xD5 : crc << 1;
+    }
+    portState.checksum = crc;
 }
 
 void MSP::serialize16(int16_t a)
@@ -97,6 +226,11 @@ void MSP::serialize16(int16_t a)
     serialize8((a >> 8) & 0xFF);
 }
 
+uint16_t MSP::payloadSize(void)
+{
+    return portState.dataSize;
+}
+
 uint8_t MSP::read8(void)
 {
     return portState.inBuf[portState.indRX++] & 0xff;
@@ -116,6 +250,14 @@ uint32_t MSP::read32(void)
     return t;
 }
 
+float MSP::readFloat(void)
+{
+    uint32_t t = read32();
+    float f;
+    memcpy(&f, &t, sizeof(f));
+    return f;
+}
+
 void MSP::serialize32(uint32_t a)
 {
     serialize8(a & 0xFF);
@@ -124,23 +266,51 @@ void MSP::serialize32(uint32_t a)
     serialize8((a >> 24) & 0xFF);
 }
 
+void MSP::serializeFloat(float a)
+{
+    uint32_t t;
+    memcpy(&t, &a, sizeof(t));
+    serialize32(t);
+}
+
+void MSP::serializeSaturated16(uint32_t a)
+{
+    serialize16((int16_t)(a > 0xFFFF ? 0xFFFF : a));
+}
 
-void MSP::headSerialResponse(uint8_t err, uint8_t s)
+void MSP::headSerialResponse(uint8_t err, uint16_t s)
 {
+    // Drop the whole reply rather than send a truncated one: header (five bytes, or eight in v2), 
+    // payload, checksum; a v1 request can't have a reply its size byte can't hold
+    uint16_t header = portState.v2 ? 8 : 5;
+    portState.txDropping = txFree() < s + header + 1 || (!portState.v2 && s > 0xFF);
+    if (portState.txDropping && portState.txDropped < 0xFFFF)
+        portState.txDropped++;
+
+    portState.replied = true;
+
     serialize8('$');
-    serialize8('M');
+    serialize8(portState.v2 ? 'X' : 'M');
     serialize8(err ? '!' : '>');
     portState.checksum = 0;               // start calculating a new checksum
-    serialize8(s);
-    serialize8(portState.cmdMSP);
+
+    if (portState.v2) {
+        serialize8(0);                    // flag
+        serialize16(portState.cmdMSP);
+        serialize16(s);
+    }
+    else {
+        serialize8(s);
+        serialize8(portState.cmdMSP);
+    }
 }
 
-void MSP::headSerialReply(uint8_t s)
+void MSP::headSerialReply(uint16_t s)
 {
     headSerialResponse(0, s);
 }
 
-void MSP::headSerialError(uint8_t s)
+void MSP::headSerialError(uint16_t s)
 {
     headSerialResponse(1, s);
 }
@@ -148,20 +318,327 @@ void MSP::headSerialError(uint8_t s)
 void MSP::tailSerialReply(void)
 {
     serialize8(portState.checksum);
+    portState.txDropping = false;
+}
+
+uint16_t MSP::txFree(void)
+{
+    // One slot stays empty so that a full ring can be told apart from an empty one
+    return (portState.txTail - portState.txHead - 1) & (TXBUF_SIZE-1);
+}
+
+template <class BoardType>
+void MSP::txDrain(BoardType * board)
+{
+    // Send at most what the port can take right now, in at most two contiguous chunks
+    uint16_t space = board->serialAvailableForWrite();
+
+    while (space && portState.txTail != portState.txHead) {
+
+        uint16_t end = portState.txHead > portState.txTail ? portState.txHead : TXBUF_SIZE;
+        uint16_t count = end - portState.txTail;
+        if (count > space)
+            count = space;
+
+        board->serialWriteBytes(&portState.txBuf[portState.txTail], count);
+
+        portState.txTail = (portState.txTail + count) & (TXBUF_SIZE-1);
+        space -= count;
+    }
+
+    board->serialFlush();
 }
 
-void MSP::init(Mixer * _mixer, RC * _rc, Board * _board)
+void MSP::init(VehicleMixer * _mixer, RC * _rc, Profiler * _profiler, Board * _board, uint8_t _maxBytes)
 {
-    mixer = _mixer;
-    rc    = _rc;
-    board = _board;
+    mixer    = _mixer;
+    rc       = _rc;
+    profiler = _profiler;
+    board    = _board;
+    maxBytes = _maxBytes;
+    eulerAngles = NULL;
 
     memset(&portState, 0, sizeof(portState));
+    memset(handlers, 0, sizeof(handlers));
+    memset(streams, 0, sizeof(streams));
+    memset(&acks, 0, sizeof(acks));
+
+    registerHandler(MSP_SET_RAW_RC,  handleSetRawRc);
+    registerHandler(MSP_SET_MOTOR,   handleSetMotor);
+    registerHandler(MSP_RC,          handleRc);
+    registerHandler(MSP_RC_LINK,     handleRcLink);
+    registerHandler(MSP_ATTITUDE,    handleAttitude);
+    registerHandler(MSP_ACK,         handleAck);
+
+    // Handlers not registered are not linked in
+#ifndef CONFIG_NO_MSP_TUNING
+    registerHandler(MSP_LOOP_TIMING, handleLoopTiming);
+    registerHandler(MSP_SET_STREAM,  handleSetStream);
+#endif
+}
+
+bool MSP::registerHandler(uint16_t command, mspHandler_t handler, void * context)
+{
+    uint8_t slot = mspCommandSlot(command);
+
+    if (slot >= MSP_COMMAND_COUNT)
+        return false;
+
+    handlers[slot].handler = handler;
+    handlers[slot].context = context;
+
+    return true;
+}
+
+void MSP::dispatch(void)
+{
+    uint8_t slot = mspCommandSlot(portState.cmdMSP);
+
+    portState.replied = false;
+
+    if (slot < MSP_COMMAND_COUNT && handlers[slot].handler)
+        handlers[slot].handler(*this, handlers[slot].context);
+
+    // don't know how to handle the (valid) message, indicate error MSP $M!
+    else
+        headSerialError(0);
+
+    if (portState.replied)
+        tailSerialReply();
+}
+
+void MSP::saturatedAdd(uint16_t & count, uint16_t n)
+{
+    count = n > 0xFFFF - count ? 0xFFFF : count + n;
+}
+
+bool MSP::sequence(uint16_t size)
+{
+    uint16_t seq = payloadSize() >= size + 2 ? read16() : 0;
+
+    if (seq == 0) {
+        headSerialReply(0);
+        return true;
+    }
+
+    if (acks.started) {
+
+        int16_t delta = (int16_t)(seq - acks.seq);
+
+        if (delta <= 0 && delta >= -(int16_t)CONFIG_MSP_SEQ_WINDOW) {
+            saturatedAdd(acks.stale, 1);
+            return false;
+        }
+
+        // Anything further back is a host counting from one again, which has skipped nothing
+        if (delta > 0) {
+            // Hosts skip zero, so crossing it isn't a gap
+            saturatedAdd(acks.gaps, delta - 1 - (seq < acks.seq ? 1 : 0));
+        }
+    }
+
+    acks.started = true;
+    acks.seq = seq;
+    acks.accepted++;
+
+    return true;
+}
+
+bool MSP::subscribe(uint16_t command, uint8_t rate)
+{
+    // Only replies (low byte of the ID below 200) can be streamed
+    if ((command & 0xFF) >= 200 || mspCommandSlot(command) >= MSP_COMMAND_COUNT)
+        return false;
+
+    uint8_t k = 0;
+    for (; k < CONFIG_MSP_STREAMS && streams[k].command != command; k++)
+        ;
+
+    if (rate == 0) {
+        if (k < CONFIG_MSP_STREAMS)
+            streams[k].command = 0;
+        return true;
+    }
+
+    if (k == CONFIG_MSP_STREAMS) {
+        for (k = 0; k < CONFIG_MSP_STREAMS && streams[k].command; k++)
+            ;
+        if (k == CONFIG_MSP_STREAMS)
+            return false;
+    }
+
+    // Telemetry goes out in the framing the host subscribed in
+    streams[k].command = command;
+    streams[k].v2      = portState.v2;
+    streams[k].period  = 1000000 / rate;
+    streams[k].due     = board->getMicros();
+
+    return true;
+}
+
+void MSP::stream(uint16_t command, bool v2)
+{
+    // Replies are built as if the host had polled; a request may be half-parsed, so keep its state
+    uint8_t  checksum = portState.checksum;
+    uint16_t cmdMSP   = portState.cmdMSP;
+    uint16_t dataSize = portState.dataSize;
+    uint16_t indRX    = portState.indRX;
+    bool     wasV2    = portState.v2;
+
+    portState.cmdMSP   = command;
+    portState.dataSize = 0;
+    portState.indRX    = 0;
+    portState.v2       = v2;
+
+    dispatch();
+
+    portState.checksum = checksum;
+    portState.cmdMSP   = cmdMSP;
+    portState.dataSize = dataSize;
+    portState.indRX    = indRX;
+    portState.v2       = wasV2;
+}
+
+void MSP::push(uint16_t command)
+{
+    stream(command, portState.hostV2);
+    txDrain(board);
+}
+
+void MSP::updateStreams(uint32_t currentTime)
+{
+    for (uint8_t k = 0; k < CONFIG_MSP_STREAMS; k++) {
+
+        if (!streams[k].command || (int32_t)(currentTime - streams[k].due) < 0)
+            continue;
+
+        // Advance on a fixed grid, so that the MSP task period doesn't cut the rate, but don't 
+        // try to catch up after a long stall
+        streams[k].due += streams[k].period;
+        if ((int32_t)(currentTime - streams[k].due) >= 0)
+            streams[k].due = currentTime + streams[k].period;
+
+        stream(streams[k].command, streams[k].v2);
+    }
+}
+
+void MSP::handleSetRawRc(MSP & msp, void * context)
+{
+    (void)context;
+    uint16_t channels[8];
+    for (uint8_t i = 0; i < 8; i++)
+        channels[i] = msp.read16();
+    if (!msp.sequence(16))
+        return;
+    for (uint8_t i = 0; i < 8; i++)
+        msp.rc->data[i] = channels[i];
 }
 
-void MSP::update(float eulerAngles[3], bool armed)
+// Up to four motors, then the sequence number
+void MSP::handleSetMotor(MSP & msp, void * context)
 {
-    while (board->serialAvailableBytes()) {
+    (void)context;
+    uint16_t motors[4];
+    uint8_t count = 0;
+    for (; count < 4 && 2*count+1 < msp.payloadSize(); count++)
+        motors[count] = msp.read16();
+    if (!msp.sequence(8))
+        return;
+    for (uint8_t i = 0; i < VehicleMixer::MOTORS && i < count; i++)
+        msp.mixer->motorsDisarmed[i] = motors[i];
+}
+
+void MSP::handleRc(MSP & msp, void * context)
+{
+    (void)context;
+    msp.headSerialReply(16);
+    for (uint8_t i = 0; i < 8; i++)
+        msp.serialize16(msp.rc->data[i]);
+}
+
+void MSP::handleRcLink(MSP & msp, void * context)
+{
+    (void)context;
+
+    rcLinkStats_t stats;
+    if (!msp.board->rcGetLinkStats(stats)) {
+        msp.headSerialError(0);
+        return;
+    }
+
+    msp.headSerialReply(13);
+    msp.serialize32(stats.frames);
+    msp.serialize16(stats.errors);
+    msp.serialize16(stats.lost);
+    msp.serializeSaturated16(stats.frameMicro);
+    msp.serialize8(stats.quality);
+    msp.serialize8(stats.rssi);
+    msp.serialize8(stats.failsafe);
+}
+
+void MSP::handleAttitude(MSP & msp, void * context)
+{
+    (void)context;
+    msp.headSerialReply(6);
+    for (uint8_t i = 0; i < 3; i++)
+        msp.serialize16((int16_t)(msp.eulerAngles[i]));
+}
+
+// Optional one-byte payload selects the task; default is the IMU task
+void MSP::handleLoopTiming(MSP & msp, void * context)
+{
+    (void)context;
+    uint8_t task = msp.payloadSize() ? msp.read8() : (uint8_t)PROFILER_TASK_IMU;
+    if (task >= PROFILER_TASK_COUNT) {
+        msp.headSerialError(0);
+        return;
+    }
+    const Profiler::taskStats_t & stats = msp.profiler->getStats(task);
+    msp.headSerialReply(6 + 4*CONFIG_PROFILER_BUCKETS);
+    msp.serializeSaturated16(stats.lateMax);
+    msp.serializeSaturated16(stats.execMax);
+    msp.serializeSaturated16(stats.overruns);
+    for (uint8_t i = 0; i < CONFIG_PROFILER_BUCKETS; i++)
+        msp.serialize16(stats.lateHist[i]);
+    for (uint8_t i = 0; i < CONFIG_PROFILER_BUCKETS; i++)
+        msp.serialize16(stats.execHist[i]);
+}
+
+// Payload is one or more command/rate pairs
+void MSP::handleSetStream(MSP & msp, void * context)
+{
+    (void)context;
+    bool ok = msp.payloadSize() >= 2;
+    for (uint8_t i = 0; 2*i+1 < msp.payloadSize(); i++) {
+        uint8_t command = msp.read8();
+        uint8_t rate    = msp.read8();
+        ok = msp.subscribe(command, rate) && ok;
+    }
+    if (ok)
+        msp.headSerialReply(0);
+    else
+        msp.headSerialError(0);
+}
+
+void MSP::handleAck(MSP & msp, void * context)
+{
+    (void)context;
+    msp.headSerialReply(14);
+    msp.serialize16(msp.acks.seq);
+    msp.serialize32(msp.acks.accepted);
+    msp.serialize16(msp.acks.gaps);
+    msp.serialize16(msp.acks.stale);
+    msp.serialize16(msp.portState.rxErrors);
+    msp.serialize16(msp.portState.txDropped);
+}
+
+template <class BoardType>
+void MSP::update(BoardType * board, float _eulerAngles[3], bool armed)
+{
+    eulerAngles = _eulerAngles;
+
+    // Parse at most maxBytes per call; the state machine picks up where it left off next time
+    for (uint8_t n = 0; n < maxBytes && board->serialAvailableBytes(); n++) {
 
         uint8_t c = board->serialReadByte();
 
@@ -170,68 +647,71 @@ void MSP::update(float eulerAngles[3], bool armed)
             if (portState.c_state == IDLE && !armed) {
             }
         } else if (portState.c_state == HEADER_START) {
-            portState.c_state = (c == 'M') ? HEADER_M : IDLE;
+            portState.c_state = (c == 'M') ? HEADER_M : (c == 'X') ? HEADER_X : IDLE;
         } else if (portState.c_state == HEADER_M) {
             portState.c_state = (c == '<') ? HEADER_ARROW : IDLE;
+        } else if (portState.c_state == HEADER_X) {
+            portState.c_state = (c == '<') ? HEADER_X_ARROW : IDLE;
         } else if (portState.c_state == HEADER_ARROW) {
             if (c > INBUF_SIZE) {       // now we are expecting the payload size
                 portState.c_state = IDLE;
                 continue;
             }
+            portState.v2 = false;
             portState.dataSize = c;
             portState.offset = 0;
             portState.checksum = 0;
             portState.indRX = 0;
-            portState.checksum ^= c;
+            updateChecksum(c);
             portState.c_state = HEADER_SIZE;      // the command is to follow
         } else if (portState.c_state == HEADER_SIZE) {
             portState.cmdMSP = c;
-            portState.checksum ^= c;
+            updateChecksum(c);
             portState.c_state = HEADER_CMD;
+        } else if (portState.c_state == HEADER_X_ARROW) {
+            portState.v2 = true;                  // flag byte, unused so far
+            portState.offset = 0;
+            portState.checksum = 0;
+            portState.indRX = 0;
+            updateChecksum(c);
+            portState.c_state = HEADER_FLAG;
+        } else if (portState.c_state == HEADER_FLAG) {
+            portState.cmdMSP = c;
+            updateChecksum(c);
+            portState.c_state = HEADER_CMD_LOW;
+        } else if (portState.c_state == HEADER_CMD_LOW) {
+            portState.cmdMSP |= (uint16_t)c << 8;
+            updateChecksum(c);
+            portState.c_state = HEADER_CMD_HIGH;
+        } else if (portState.c_state == HEADER_CMD_HIGH) {
+            portState.dataSize = c;
+            updateChecksum(c);
+            portState.c_state = HEADER_SIZE_LOW;
+        } else if (portState.c_state == HEADER_SIZE_LOW) {
+            portState.dataSize |= (uint16_t)c << 8;
+            updateChecksum(c);
+            portState.c_state = portState.dataSize > INBUF_SIZE ? IDLE : HEADER_CMD;
         } else if (portState.c_state == HEADER_CMD && 
             portState.offset < portState.dataSize) {
-            portState.checksum ^= c;
+            updateChecksum(c);
             portState.inBuf[portState.offset++] = c;
         } else if (portState.c_state == HEADER_CMD && portState.offset >= portState.dataSize) {
 
             if (portState.checksum == c) {        // compare calculated and transferred checksum
-
-                switch (portState.cmdMSP) {
-
-                case MSP_SET_RAW_RC:
-                    for (uint8_t i = 0; i < 8; i++)
-                        rc->data[i] = read16();
-                    headSerialReply(0);
-                    break;
-
-                case MSP_SET_MOTOR:
-                    for (uint8_t i = 0; i < 4; i++)
-                        mixer->motorsDisarmed[i] = read16();
-                    headSerialReply(0);
-                    break;
-
-                case MSP_RC:
-                    headSerialReply(16);
-                    for (uint8_t i = 0; i < 8; i++)
-                        serialize16(rc->data[i]);
-                    break;
-
-                case MSP_ATTITUDE: 
-                    headSerialReply(6);
-                    for (uint8_t i = 0; i < 3; i++)
-                        serialize16((int16_t)(eulerAngles[i]));
-                    break;
-
-                    // don't know how to handle the (valid) message, indicate error MSP $M!
-                default:                   
-                    headSerialError(0);
-                    break;
-                }
-                tailSerialReply();
+                portState.hostV2 = portState.v2;
+                dispatch();
+            }
+            else {
+                saturatedAdd(portState.rxErrors, 1);
             }
             portState.c_state = IDLE;
         }
     }
+
+    // Due telemetry goes out in the same burst as any replies
+    updateStreams(board->getMicros());
+
+    txDrain(board);
 }
 
 } // namespace
@@ -0,0 +1,60 @@
+// AUTO-GENERATED CODE: DO NOT EDIT!!!
+
+#pragma once
+
+#include <cstdint>
+
+#define MSP_RC                   105
+#define MSP_ATTITUDE             108
+#define MSP_ALTITUDE             109
+#define MSP_RC_CONFIG            111
+#define MSP_PID_CONFIG           112
+#define MSP_RC_LINK              113
+#define MSP_STATE                114
+#define MSP_ACK                  115
+#define MSP_NAV_STATUS           121
+#define MSP_SONARS               127
+#define MSP_HIL_MOTORS           131
+#define MSP_LOOP_TIMING          150
+#define MSP_LOOP_RATE            151
+#define MSP_SET_RAW_RC           200
+#define MSP_SET_PID_CONFIG       202
+#define MSP_SET_RC_CONFIG        204
+#define MSP_SET_HEAD             205
+#define MSP_SET_WAYPOINT         209
+#define MSP_SET_MOTOR            214
+#define MSP_SET_STREAM           216
+#define MSP_HIL_STATE            231
+#define MSP_EEPROM_WRITE         250
+
+namespace hf {
+
+static const uint8_t MSP_COMMAND_COUNT = 22;
+
+// Dispatch-table slot for each command ID; MSP_COMMAND_COUNT means no such command
+static const uint8_t MSP_COMMAND_SLOTS[256] = {
+    22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+    22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+    22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+    22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+    22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+    22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+    22, 22, 22, 22, 22, 22, 22, 22, 22,  0, 22, 22,  1,  2, 22,  3,
+     4,  5,  6,  7, 22, 22, 22, 22, 22,  8, 22, 22, 22, 22, 22,  9,
+    22, 22, 22, 10, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+    22, 22, 22, 22, 22, 22, 11, 12, 22, 22, 22, 22, 22, 22, 22, 22,
+    22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+    22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+    22, 22, 22, 22, 22, 22, 22, 22, 13, 22, 14, 22, 15, 16, 22, 22,
+    22, 17, 22, 22, 22, 22, 18, 22, 19, 22, 22, 22, 22, 22, 22, 22,
+    22, 22, 22, 22, 22, 22, 22, 20, 22, 22, 22, 22, 22, 22, 22, 22,
+    22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 21, 22, 22, 22, 22, 22,
+};
+
+// Slot for any command ID, the MSPv2-only ones above 255 included
+static inline uint8_t mspCommandSlot(uint16_t command)
+{
+    return command < 256 ? MSP_COMMAND_SLOTS[command] : MSP_COMMAND_COUNT;
+}
+
+} // namespace
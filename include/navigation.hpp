@@ -0,0 +1,417 @@
+/*
+   navigation.hpp : guided flight along an uploaded mission of waypoints
+
+   Positions are meters north, east and up from wherever the board's position source has its origin
+   (see Board::navGetPosition()).  The mission is a fixed array of waypoints, uploaded one at a time
+   over MSP while not navigating.  With the nav aux switch position selected and armed, the vehicle
+   flies from where it is to each waypoint in turn, hovers there for the waypoint's hold time, and
+   holds position at the last one; with no mission it holds where the switch was thrown.
+
+   Each segment's direction and length are found once, when it starts; after that, every update()
+   is a dot product for the distance along it, a carrot point a little further on for the position
+   controller to aim at, and the velocity and climb controllers, so the cost does not depend on the
+   mission.  update() runs from the extras task at the nav rate and leaves its roll, pitch and
+   throttle demands; apply() copies them over the pilot's in the IMU task.  Yaw stays with the
+   pilot, and the demands follow the heading.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstring>
+
+#include "config.hpp"
+#include "fastmath.hpp"
+#include "msp.hpp"
+
+namespace hf {
+
+enum {
+    NAV_OFF = 0,
+    NAV_HOLD,       // at the last waypoint, or where guided mode started with no mission
+    NAV_TRACKING,   // flying a segment
+    NAV_WAITING     // at a waypoint, for its hold time
+};
+
+#ifdef CONFIG_NO_NAVIGATION
+
+// Left out of the build (config.hpp): guided mode never engages, and no mission is kept
+class Navigator {
+
+    public:
+
+        static const bool BUILT = false;
+
+        void init(const NavConfig & _config) { (void)_config; }
+        void setEngaged(bool engaged) { (void)engaged; }
+        bool active(void) { return false; }
+
+        void update(const float position[3], const float velocity[3], float headingDegrees, int16_t throttle,
+                uint32_t currentTime)
+        {
+            (void)position; (void)velocity; (void)headingDegrees; (void)throttle; (void)currentTime;
+        }
+
+        void apply(int16_t command[4]) { (void)command; }
+        void registerMspHandlers(MSP * msp) { (void)msp; }
+};
+
+#else
+
+class Navigator {
+
+    public:
+
+        static const bool BUILT = true;
+
+        void init(const NavConfig & _config);
+
+        // Guided mode on or off, from the RC task; off drops the demands at once
+        void setEngaged(bool engaged);
+
+        bool active(void) { return state != NAV_OFF && started; }
+
+        // At the nav rate while engaged: position (m) and velocity (m/s) north, east, up; heading (degrees);
+        // and the pilot's throttle command, which the climb controller starts from
+        void update(const float position[3], const float velocity[3], float headingDegrees, int16_t throttle,
+                uint32_t currentTime);
+
+        // Every IMU cycle while active(), after RC::computeExpo()
+        void apply(int16_t command[4]);
+
+        void registerMspHandlers(MSP * msp);
+
+    private:
+
+        // Payload sizes of SET_WAYPOINT and NAV_STATUS
+        static const uint8_t SET_WAYPOINT_SIZE = 1 + 3*4 + 2 + 2;
+        static const uint8_t NAV_STATUS_SIZE   = 3 + 4 + 2;
+
+        // Longest hold (tenths of a second) the microsecond clock can time, about 71 minutes
+        static const uint16_t HOLD_MAX_DECI = 0xFFFFFFFFUL / 100000;
+
+        static constexpr float GRAVITY = 9.80665f;
+
+        typedef struct waypoint_t {
+            float    position[3];
+            float    speed;         // m/s
+            uint32_t holdMicro;
+        } waypoint_t;
+
+        NavConfig  config;
+
+        waypoint_t mission[CONFIG_NAV_WAYPOINTS];
+        uint8_t    count;
+
+        uint8_t    state;
+        bool       started;         // the first update() after engaging has fixed the start
+        uint8_t    target;          // waypoint being flown to, or waited at
+        uint32_t   waitStart;
+
+        // Current segment, fixed when it starts
+        float      start[3];
+        float      direction[3];    // unit vector, start to end
+        float      length;
+        float      speed;
+        float      lookahead;       // m
+
+        // Where NAV_HOLD holds
+        float      hold[3];
+
+        // Controller state, earth frame
+        float      velocityI[2];
+        float      throttleI;
+        int16_t    hoverThrottle;
+        uint32_t   lastTime;
+
+        // Last offset to the target, and squared distance off the segment, for NAV_STATUS
+        float      toTarget[3];
+        float      crossTrack2;
+
+        // Demands in command units, for apply()
+        int16_t    demands[3];
+
+        void startSegment(const float from[3]);
+        void startHold(const float at[3]);
+        void control(const float aim[3], float maxSpeed, const float position[3], const float velocity[3],
+                float headingDegrees, float dt);
+
+        static float limit(float value, float max) { return value > max ? max : (value < -max ? -max : value); }
+
+        static void handleSetWaypoint(MSP & msp, void * context);
+        static void handleNavStatus(MSP & msp, void * context);
+};
+
+/********************************************* CPP ********************************************************/
+
+constexpr float Navigator::GRAVITY;
+
+void Navigator::init(const NavConfig & _config)
+{
+    memcpy(&config, &_config, sizeof(NavConfig));
+
+    count   = 0;
+    state   = NAV_OFF;
+    started = false;
+    target  = 0;
+
+    memset(toTarget, 0, sizeof(toTarget));
+    crossTrack2 = 0;
+}
+
+void Navigator::setEngaged(bool engaged)
+{
+    if (engaged == (state != NAV_OFF)) {
+        return;
+    }
+
+    // The start is fixed by the first update(), which has the position
+    state   = engaged ? NAV_HOLD : NAV_OFF;
+    started = false;
+}
+
+void Navigator::startSegment(const float from[3])
+{
+    const waypoint_t & wp = mission[target];
+
+    float squared = 0;
+    for (uint8_t k = 0; k < 3; k++) {
+        start[k]     = from[k];
+        direction[k] = wp.position[k] - from[k];
+        squared     += direction[k] * direction[k];
+    }
+
+    // The one square root per segment
+    length = sqrtf(squared);
+    for (uint8_t k = 0; k < 3; k++) {
+        direction[k] = length > 0 ? direction[k] / length : 0;
+    }
+
+    speed     = wp.speed > 0 ? wp.speed : config.defaultSpeed;
+    lookahead = speed * config.lookaheadSec;
+    state     = NAV_TRACKING;
+}
+
+void Navigator::startHold(const float at[3])
+{
+    memcpy(hold, at, sizeof(hold));
+    state = NAV_HOLD;
+}
+
+void Navigator::update(const float position[3], const float velocity[3], float headingDegrees, int16_t throttle,
+        uint32_t currentTime)
+{
+    if (state == NAV_OFF) {
+        return;
+    }
+
+    if (!started) {
+        started       = true;
+        target        = 0;
+        velocityI[0]  = 0;
+        velocityI[1]  = 0;
+        throttleI     = 0;
+        hoverThrottle = throttle;
+        lastTime      = currentTime;
+
+        if (count > 0) {
+            startSegment(position);
+        }
+        else {
+            startHold(position);
+        }
+    }
+
+    float dt = (currentTime - lastTime) * 1e-6f;
+    lastTime = currentTime;
+
+    if (state == NAV_TRACKING) {
+
+        float offset[3];
+        float along = 0;
+        for (uint8_t k = 0; k < 3; k++) {
+            offset[k] = position[k] - start[k];
+            along    += offset[k] * direction[k];
+            toTarget[k] = mission[target].position[k] - position[k];
+        }
+
+        // Squared distances, so no root on the way
+        float off2 = 0;
+        float arrive2 = 0;
+        for (uint8_t k = 0; k < 3; k++) {
+            float c = offset[k] - along * direction[k];
+            off2    += c * c;
+            arrive2 += toTarget[k] * toTarget[k];
+        }
+        crossTrack2 = off2;
+
+        if (arrive2 < config.acceptRadius * config.acceptRadius) {
+            waitStart = currentTime;
+            state = NAV_WAITING;
+        }
+        else {
+            // The carrot runs ahead of the vehicle's place on the segment, and stops at its end
+            float s = along + lookahead;
+            s = s < 0 ? 0 : (s > length ? length : s);
+
+            float aim[3];
+            for (uint8_t k = 0; k < 3; k++) {
+                aim[k] = start[k] + s * direction[k];
+            }
+
+            control(aim, speed, position, velocity, headingDegrees, dt);
+        }
+    }
+
+    if (state == NAV_WAITING) {
+
+        const waypoint_t & wp = mission[target];
+
+        if (currentTime - waitStart < wp.holdMicro) {
+            control(wp.position, speed, position, velocity, headingDegrees, dt);
+        }
+
+        // The next segment starts from this waypoint, not from wherever the vehicle drifted to
+        else if (target + 1 < count) {
+            target++;
+            startSegment(wp.position);
+        }
+        else {
+            startHold(wp.position);
+        }
+    }
+
+    if (state == NAV_HOLD) {
+        for (uint8_t k = 0; k < 3; k++) {
+            toTarget[k] = hold[k] - position[k];
+        }
+        crossTrack2 = 0;
+        control(hold, config.defaultSpeed, position, velocity, headingDegrees, dt);
+    }
+}
+
+void Navigator::control(const float aim[3], float maxSpeed, const float position[3], const float velocity[3],
+        float headingDegrees, float dt)
+{
+    // Position to velocity, capped at the segment's speed horizontally and the climb limit vertically
+    float want[2];
+    float speed2 = 0;
+    for (uint8_t k = 0; k < 2; k++) {
+        want[k] = config.positionP * (aim[k] - position[k]);
+        speed2 += want[k] * want[k];
+    }
+    if (speed2 > maxSpeed * maxSpeed) {
+        float scale = maxSpeed / sqrtf(speed2);
+        want[0] *= scale;
+        want[1] *= scale;
+    }
+
+    // Velocity to acceleration, and acceleration to tilt
+    float accel[2];
+    for (uint8_t k = 0; k < 2; k++) {
+        float error = want[k] - velocity[k];
+        velocityI[k] = limit(velocityI[k] + config.velocityI * error * dt, GRAVITY / 2);
+        accel[k] = config.velocityP * error + velocityI[k];
+    }
+
+    float heading = headingDegrees * (float)M_PI / 180;
+    float c = FastMath::cos(heading);
+    float s = FastMath::sin(heading);
+
+    float forward = accel[0] * c + accel[1] * s;
+    float right   = accel[1] * c - accel[0] * s;
+
+    // Small tilts: the horizontal acceleration is g times the tilt in radians
+    float toDegrees = 180 / (float)M_PI / GRAVITY;
+    float pitch = limit(forward * toDegrees, config.maxTiltDegrees);
+    float roll  = limit(right   * toDegrees, config.maxTiltDegrees);
+
+    // Stabilize's level mode takes a command of 5 per degree
+    demands[0] = (int16_t)(5 * roll);
+    demands[1] = (int16_t)(5 * pitch);
+
+    // Height to climb rate, and climb rate to throttle about where the pilot left it
+    float climb = limit(config.climbP * (aim[2] - position[2]), config.maxClimb);
+    float error = climb - velocity[2];
+    throttleI = limit(throttleI + config.throttleI * error * dt, config.throttleIMax);
+    demands[2] = (int16_t)(hoverThrottle + config.throttleP * error + throttleI);
+}
+
+void Navigator::apply(int16_t command[4])
+{
+    command[DEMAND_ROLL]     = demands[0];
+    command[DEMAND_PITCH]    = demands[1];
+    command[DEMAND_THROTTLE] = demands[2];
+}
+
+void Navigator::registerMspHandlers(MSP * msp)
+{
+    msp->registerHandler(MSP_SET_WAYPOINT, handleSetWaypoint, this);
+    msp->registerHandler(MSP_NAV_STATUS,   handleNavStatus,   this);
+}
+
+void Navigator::handleSetWaypoint(MSP & msp, void * context)
+{
+    Navigator * nav = (Navigator *)context;
+
+    if (msp.payloadSize() != SET_WAYPOINT_SIZE) {
+        msp.headSerialError(0);
+        return;
+    }
+
+    // Index zero starts a new mission; the others replace a waypoint or add the next one
+    uint8_t index = msp.read8();
+
+    if (nav->state != NAV_OFF || index > nav->count || index >= CONFIG_NAV_WAYPOINTS) {
+        msp.headSerialError(0);
+        return;
+    }
+
+    waypoint_t & wp = nav->mission[index];
+
+    for (uint8_t k = 0; k < 3; k++) {
+        wp.position[k] = (int32_t)msp.read32() / 100.f;
+    }
+    wp.speed     = msp.read16() / 100.f;
+    uint16_t hold = msp.read16();
+    wp.holdMicro = (hold > HOLD_MAX_DECI ? HOLD_MAX_DECI : hold) * 100000UL;
+
+    nav->count = index == 0 ? 1 : (index == nav->count ? nav->count + 1 : nav->count);
+
+    msp.headSerialReply(0);
+}
+
+void Navigator::handleNavStatus(MSP & msp, void * context)
+{
+    Navigator * nav = (Navigator *)context;
+
+    float distance2 = 0;
+    for (uint8_t k = 0; k < 3; k++) {
+        distance2 += nav->toTarget[k] * nav->toTarget[k];
+    }
+
+    msp.headSerialReply(NAV_STATUS_SIZE);
+    msp.serialize8(nav->state);
+    msp.serialize8(nav->target);
+    msp.serialize8(nav->count);
+    msp.serialize32((uint32_t)(int32_t)(100 * sqrtf(distance2)));
+    msp.serializeSaturated16((uint32_t)(100 * sqrtf(nav->crossTrack2)));
+}
+
+#endif // CONFIG_NO_NAVIGATION
+
+} // namespace hf
@@ -0,0 +1,216 @@
+/*
+   opticalflow.hpp : velocity and position from a downward optical-flow sensor and range finder
+
+   For boards with no position source of their own (see Board::navGetPosition()), this gives guided mode a
+   position relative to where the vehicle armed.  The flow task runs update() at a fixed step, one sensor
+   read each, so every step has the same length and no clock is read.  A flow sensor sees the vehicle's
+   turning as well as its motion, so the gyro is averaged over the same step (addGyro(), every IMU cycle)
+   and taken out; what is left, times the range to the surface, is the velocity over the ground.  That goes
+   through a fixed-gain filter, is turned from the body's heading to north and east, and is summed into a
+   position.  Up is the range times the tilt's cosine, so it is height above whatever is below.
+
+   A read the sensor can't vouch for (low surface quality), or with the surface too near or too far for the
+   range finder, is skipped, and the estimate coasts on the last velocity; too many skipped in a row, and
+   getEstimate() reports nothing until a good read comes back.  The position drifts with each error in the
+   velocity, so it suits holding and short hops, not long missions.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "config.hpp"
+#include "fastmath.hpp"
+
+namespace hf {
+
+#ifdef CONFIG_NO_NAVIGATION
+
+// Left out of the build along with guided mode (config.hpp), which is all that uses it
+class OpticalFlow {
+
+    public:
+
+        static const bool BUILT = false;
+
+        void init(const FlowConfig & _config, float gyroLsbPerDps) { (void)_config; (void)gyroLsbPerDps; }
+        void reset(void) { }
+        void addGyro(const int16_t gyroRaw[3]) { (void)gyroRaw; }
+
+        void update(const int16_t * counts, uint8_t quality, bool haveRange, float range,
+                const float eulerDegrees[3])
+        {
+            (void)counts; (void)quality; (void)haveRange; (void)range; (void)eulerDegrees;
+        }
+
+        bool getEstimate(float position[3], float velocity[3]) { (void)position; (void)velocity; return false; }
+};
+
+#else
+
+class OpticalFlow {
+
+    public:
+
+        static const bool BUILT = true;
+
+        void init(const FlowConfig & _config, float gyroLsbPerDps);
+
+        // Position back to zero, and nothing known; on arming
+        void reset(void);
+
+        // Every IMU cycle, with the gyro the PID sees
+        void addGyro(const int16_t gyroRaw[3]);
+
+        // Once per step: counts and quality from Board::flowRead(), or NULL if it failed; the range, if
+        // there is one; and the attitude (degrees)
+        void update(const int16_t * counts, uint8_t quality, bool haveRange, float range,
+                const float eulerDegrees[3]);
+
+        // Meters and m/s north, east and up, as Board::navGetPosition() gives them; false while stale
+        bool getEstimate(float position[3], float velocity[3]);
+
+    private:
+
+        FlowConfig config;
+
+        float    dt;
+        float    radiansPerSecond;  // per count, over one step
+        float    gyroScale;         // counts to rad/s
+
+        // Gyro summed since the last step
+        int32_t  gyroSum[2];
+        uint16_t gyroCount;
+
+        float    position[3];
+        float    velocity[3];
+        float    lastHeight;
+        bool     haveHeight;
+        uint8_t  staleSteps;
+};
+
+/********************************************* CPP ********************************************************/
+
+void OpticalFlow::init(const FlowConfig & _config, float gyroLsbPerDps)
+{
+    memcpy(&config, &_config, sizeof(FlowConfig));
+
+    dt = config.loopMilli * 1e-3f;
+    radiansPerSecond = config.radiansPerCount / dt;
+    gyroScale = (float)M_PI / 180 / gyroLsbPerDps;
+
+    reset();
+}
+
+void OpticalFlow::reset(void)
+{
+    memset(position, 0, sizeof(position));
+    memset(velocity, 0, sizeof(velocity));
+
+    gyroSum[0] = 0;
+    gyroSum[1] = 0;
+    gyroCount  = 0;
+
+    haveHeight = false;
+    staleSteps = config.maxStaleSteps + 1;
+}
+
+void OpticalFlow::addGyro(const int16_t gyroRaw[3])
+{
+    gyroSum[0] += gyroRaw[0];
+    gyroSum[1] += gyroRaw[1];
+    gyroCount++;
+}
+
+void OpticalFlow::update(const int16_t * counts, uint8_t quality, bool haveRange, float range,
+        const float eulerDegrees[3])
+{
+    // Roll (right positive) and pitch (nose-down positive) rates over the step, as the sensor saw them
+    float rollRate  = 0;
+    float pitchRate = 0;
+    if (gyroCount) {
+        rollRate  = gyroSum[0] * gyroScale / gyroCount;
+        pitchRate = gyroSum[1] * gyroScale / gyroCount;
+    }
+    gyroSum[0] = 0;
+    gyroSum[1] = 0;
+    gyroCount  = 0;
+
+    bool usable = counts && quality >= config.minQuality &&
+        haveRange && range >= config.minRange && range <= config.maxRange;
+
+    if (!usable) {
+        if (staleSteps <= config.maxStaleSteps) {
+            staleSteps++;
+        }
+        for (uint8_t k = 0; k < 3; k++) {
+            position[k] += velocity[k] * dt;
+        }
+        return;
+    }
+
+    float roll  = eulerDegrees[0] * (float)M_PI / 180;
+    float pitch = eulerDegrees[1] * (float)M_PI / 180;
+    float yaw   = eulerDegrees[2] * (float)M_PI / 180;
+
+    // Nose-up pitch reads as forward flow, and right roll as leftward; the rest is motion over the ground
+    float forward = range * (counts[0] * radiansPerSecond + pitchRate);
+    float right   = range * (counts[1] * radiansPerSecond + rollRate);
+
+    float c = FastMath::cos(yaw);
+    float s = FastMath::sin(yaw);
+
+    float measured[3];
+    measured[0] = forward * c - right * s;
+    measured[1] = forward * s + right * c;
+
+    // Height is the range projected onto the vertical; climb is its change over the step
+    float height = range * FastMath::cos(roll) * FastMath::cos(pitch);
+    measured[2] = haveHeight ? (height - lastHeight) / dt : 0;
+    lastHeight = height;
+    haveHeight = true;
+
+    // Coming back from stale, the measurement is all there is to go on
+    float gain = staleSteps > config.maxStaleSteps ? 1 : config.velocityGain;
+    staleSteps = 0;
+
+    for (uint8_t k = 0; k < 3; k++) {
+        velocity[k] += gain * (measured[k] - velocity[k]);
+    }
+
+    position[0] += velocity[0] * dt;
+    position[1] += velocity[1] * dt;
+    position[2]  = height;
+}
+
+bool OpticalFlow::getEstimate(float _position[3], float _velocity[3])
+{
+    if (staleSteps > config.maxStaleSteps) {
+        return false;
+    }
+
+    memcpy(_position, position, sizeof(position));
+    memcpy(_velocity, velocity, sizeof(velocity));
+
+    return true;
+}
+
+#endif // CONFIG_NO_NAVIGATION
+
+} // namespace hf
@@ -0,0 +1,149 @@
+/*
+   profiler.hpp : loop-timing instrumentation for Hackflight::update
+
+   Keeps fixed-bucket histograms of how late each timed task ran relative to
+   its deadline, and of how long each task took, along with worst-case values.
+   No dynamic memory is used.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "config.hpp"
+
+namespace hf {
+
+enum {
+    PROFILER_TASK_IMU = 0,
+    PROFILER_TASK_RC,
+    PROFILER_TASK_EXTRAS,
+    PROFILER_TASK_MSP,
+    PROFILER_TASK_COUNT
+};
+
+class Profiler {
+
+    public:
+
+        typedef struct taskStats_t {
+            uint16_t lateHist[CONFIG_PROFILER_BUCKETS];
+            uint16_t execHist[CONFIG_PROFILER_BUCKETS];
+            uint32_t lateMax;
+            uint32_t execMax;
+            uint32_t lateLast;
+            uint32_t execLast;
+            uint32_t overruns;
+            uint32_t period;
+            bool     primed;
+        } taskStats_t;
+
+        void init(void);
+        void setPeriod(uint8_t task, uint32_t period);
+        void record(uint8_t task, int32_t lateness, uint32_t execTime);
+        void reset(void);
+
+        const taskStats_t & getStats(uint8_t task);
+
+    private:
+
+        taskStats_t stats[PROFILER_TASK_COUNT];
+
+        static uint8_t bucket(uint32_t usec);
+        static void    increment(uint16_t & count);
+};
+
+/********************************************* CPP ********************************************************/
+
+void Profiler::init(void)
+{
+    memset(stats, 0, sizeof(stats));
+}
+
+void Profiler::setPeriod(uint8_t task, uint32_t period)
+{
+    stats[task].period = period;
+}
+
+void Profiler::reset(void)
+{
+    for (uint8_t k=0; k<PROFILER_TASK_COUNT; ++k) {
+        uint32_t period = stats[k].period;
+        memset(&stats[k], 0, sizeof(taskStats_t));
+        stats[k].period = period;
+    }
+}
+
+void Profiler::record(uint8_t task, int32_t lateness, uint32_t execTime)
+{
+    taskStats_t & s = stats[task];
+
+    // First run of a task is measured from time zero, so its lateness is meaningless
+    if (s.primed) {
+
+        uint32_t late = lateness > 0 ? (uint32_t)lateness : 0;
+
+        increment(s.lateHist[bucket(late)]);
+
+        if (late > s.lateMax)
+            s.lateMax = late;
+
+        s.lateLast = late;
+
+        // A task that ran a full period late has missed a deadline altogether
+        if (s.period && late >= s.period)
+            s.overruns++;
+    }
+
+    s.primed = true;
+
+    increment(s.execHist[bucket(execTime)]);
+
+    if (execTime > s.execMax)
+        s.execMax = execTime;
+
+    s.execLast = execTime;
+}
+
+const Profiler::taskStats_t & Profiler::getStats(uint8_t task)
+{
+    return stats[task];
+}
+
+uint8_t Profiler::bucket(uint32_t usec)
+{
+    usec >>= CONFIG_PROFILER_BUCKET0_LOG2;
+
+    uint8_t k = 0;
+
+    while (usec && k < CONFIG_PROFILER_BUCKETS-1) {
+        usec >>= 1;
+        k++;
+    }
+
+    return k;
+}
+
+void Profiler::increment(uint16_t & count)
+{
+    // Saturate rather than wrap, so that a long flight doesn't reset the histogram
+    if (count < 0xFFFF)
+        count++;
+}
+
+} // namespace
@@ -0,0 +1,228 @@
+/*
+   pulserx.hpp : PPM and PWM receivers, decoded from timer input-capture edges
+
+   The board's input-capture interrupt hands over the timer's count at each edge, so the times are the
+   hardware's, whatever else the processor was doing; all the interrupt does with one is a subtraction,
+   a multiply to microseconds, and a range check.  PPM carries every channel on one pin: each pulse's
+   start is a capture, the time from one to the next is a channel, and a gap longer than any channel
+   ends the frame.  A frame with a pulse out of range is dropped whole.  PWM has a pin per channel, and
+   each channel's high time is its value.  Good values go into the back one of two buffers, which then
+   becomes the front, a whole frame at a time for PPM and a channel at a time for PWM; getFrame() copies
+   the front one out.  A frame is some 20 msec apart from the next, far longer than the copy, so the
+   front buffer is never rewritten while it is being read.
+
+   The counter may be any width up to 32 bits, and wrap: only differences between captures are used,
+   in the counter's own width.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "config.hpp"
+
+namespace hf {
+
+enum {
+    PULSERX_PPM = 0,    // all channels on one pin, a pulse start per channel
+    PULSERX_PWM         // a pin per channel
+};
+
+class PulseRx {
+
+    public:
+
+        static const uint8_t CHANNELS = 8;
+
+        // Timer ticks per microsecond, and the counter's width in bits
+        void init(uint8_t _protocol, float ticksPerMicro, uint8_t counterBits = 16);
+
+        // From the input-capture interrupt: PPM, the capture at each pulse start; PWM, a channel's
+        // capture at either edge
+        void ppmEdge(uint32_t capture);
+        void pwmEdge(uint8_t chan, bool high, uint32_t capture);
+
+        // True from a new PPM frame until getFrame() takes it
+        bool frameReady(void) { return frontSeq != readSeq; }
+
+        // Latest values (usec) in the receiver's order; returns how many channels it filled, or zero if
+        // nothing has come in since the last call.  PWM channels with no pulse since then read zero.
+        uint8_t getFrame(uint16_t channels[CHANNELS]);
+
+        // Frames (PPM) or pulses (PWM) dropped for a value out of range
+        uint32_t getErrors(void) { return errors; }
+
+    private:
+
+        // Gaps longer than this end a PPM frame; every channel is shorter
+        static const uint16_t SYNC_MIN_MICRO = 2700;
+
+        // PPM frames need the sticks, at least
+        static const uint8_t  MIN_CHANNELS = 4;
+
+        uint8_t  protocol;
+        uint32_t usecPerTickQ16;
+        uint32_t counterMask;
+
+        // Written only from the interrupt
+        uint32_t lastCapture;
+        bool     haveCapture;
+        uint8_t  index;
+        bool     frameGood;
+        uint32_t rise[CHANNELS];
+
+        uint16_t values[2][CHANNELS];
+        volatile uint8_t  front;
+        volatile uint8_t  frontCount;
+        volatile uint32_t frontSeq;
+        volatile uint32_t errors;
+
+        // PWM: a buffer index per channel, and a count of its pulses, which getFrame() compares with the
+        // count it last saw rather than clearing a flag the interrupt also writes
+        uint16_t pwmValues[CHANNELS][2];
+        volatile uint8_t pwmFront[CHANNELS];
+        volatile uint8_t pwmSeq[CHANNELS];
+        uint8_t  pwmReadSeq[CHANNELS];
+
+        uint32_t readSeq;
+
+        uint32_t toMicros(uint32_t ticks) { return (uint32_t)(((uint64_t)(ticks & counterMask) * usecPerTickQ16) >> 16); }
+
+        static bool inRange(uint32_t usec) { return usec >= CONFIG_RC_PULSE_MIN && usec <= CONFIG_RC_PULSE_MAX; }
+};
+
+/********************************************* CPP ********************************************************/
+
+void PulseRx::init(uint8_t _protocol, float ticksPerMicro, uint8_t counterBits)
+{
+    protocol       = _protocol;
+    usecPerTickQ16 = (uint32_t)(65536 / ticksPerMicro + 0.5f);
+    counterMask    = counterBits >= 32 ? 0xFFFFFFFF : ((1UL << counterBits) - 1);
+
+    haveCapture = false;
+    index       = 0;
+    frameGood   = false;
+    front       = 0;
+    frontCount  = 0;
+    frontSeq    = 0;
+    readSeq     = 0;
+    errors      = 0;
+
+    memset(rise, 0, sizeof(rise));
+    memset(values, 0, sizeof(values));
+    memset(pwmValues, 0, sizeof(pwmValues));
+    memset((void *)pwmFront, 0, sizeof(pwmFront));
+    memset((void *)pwmSeq, 0, sizeof(pwmSeq));
+    memset(pwmReadSeq, 0, sizeof(pwmReadSeq));
+}
+
+void PulseRx::ppmEdge(uint32_t capture)
+{
+    uint32_t usec = toMicros(capture - lastCapture);
+    lastCapture = capture;
+
+    if (!haveCapture) {
+        haveCapture = true;
+        return;
+    }
+
+    // The sync gap: publish what came before it, if it was a whole frame, and start the next
+    if (usec >= SYNC_MIN_MICRO) {
+        if (frameGood && index >= MIN_CHANNELS) {
+            front      = 1 - front;
+            frontCount = index > CHANNELS ? CHANNELS : index;
+            frontSeq   = frontSeq + 1;
+        }
+        else if (index > 0) {
+            errors = errors + 1;
+        }
+        index     = 0;
+        frameGood = true;
+        return;
+    }
+
+    // Until the first sync, there is no telling which channel this is
+    if (!frameGood) {
+        return;
+    }
+
+    if (!inRange(usec)) {
+        frameGood = false;
+        errors = errors + 1;
+        index = 0;
+        return;
+    }
+
+    if (index < CHANNELS) {
+        values[1 - front][index] = (uint16_t)usec;
+    }
+    index++;
+}
+
+void PulseRx::pwmEdge(uint8_t chan, bool high, uint32_t capture)
+{
+    if (chan >= CHANNELS) {
+        return;
+    }
+
+    if (high) {
+        rise[chan] = capture;
+        return;
+    }
+
+    uint32_t usec = toMicros(capture - rise[chan]);
+
+    if (!inRange(usec)) {
+        errors = errors + 1;
+        return;
+    }
+
+    uint8_t back = 1 - pwmFront[chan];
+    pwmValues[chan][back] = (uint16_t)usec;
+    pwmFront[chan] = back;
+    pwmSeq[chan] = pwmSeq[chan] + 1;
+}
+
+uint8_t PulseRx::getFrame(uint16_t channels[CHANNELS])
+{
+    if (protocol == PULSERX_PPM) {
+
+        uint32_t seq = frontSeq;
+        if (seq == readSeq) {
+            return 0;
+        }
+        readSeq = seq;
+
+        uint8_t count = frontCount;
+        memcpy(channels, values[front], count * sizeof(uint16_t));
+        return count;
+    }
+
+    bool fresh = false;
+
+    for (uint8_t chan = 0; chan < CHANNELS; chan++) {
+        uint8_t seq = pwmSeq[chan];
+        channels[chan] = seq != pwmReadSeq[chan] ? pwmValues[chan][pwmFront[chan]] : 0;
+        fresh |= seq != pwmReadSeq[chan];
+        pwmReadSeq[chan] = seq;
+    }
+
+    return fresh ? CHANNELS : 0;
+}
+
+} // namespace hf
@@ -0,0 +1,117 @@
+/*
+   quaternion.hpp : attitude from an IMU's quaternion, without Euler angles on the hot path
+
+   Quaternions are (w, x, y, z), as from the EM7180 with w moved to the front.  Leveling and
+   altitude need only where gravity points in the vehicle's frame, which is all products and
+   sums; the atan2/asin of a full Euler conversion is left for the ground station.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cmath>
+
+#include "config.hpp"
+#include "fastmath.hpp"
+
+namespace hf {
+
+class Quaternion {
+
+    public:
+
+        // Roll, pitch (positive nose-down, as the firmware has it) and yaw in [-pi,+pi], in radians
+        static void  toEuler(const float q[4], float eulerAnglesRadians[3]);
+
+        // Unit vector along gravity, in the vehicle's frame: (0,0,1) when level
+        static void  gravity(const float q[4], float g[3]);
+
+        // The same, for boards that give Euler angles (radians, as toEuler() has them)
+        static void  gravityFromEuler(const float eulerAnglesRadians[3], float g[3]);
+
+        // Roll and pitch errors from level (radians, same signs as toEuler()), as the rotation that
+        // would level the vehicle: 2sin(angle/2) about each axis, so within 3% of the Euler angle
+        // out to 50 degrees of tilt, and costing one square root
+        static void  tilt(const float q[4], float tiltRadians[2]);
+
+        // The same, from a gravity() already computed for the tick
+        static void  tiltFromGravity(const float g[3], float tiltRadians[2]);
+
+        // Vertical (earth-frame) component of a vector in the vehicle's frame
+        static float earthZ(const float q[4], const float v[3]);
+};
+
+/********************************************* CPP ********************************************************/
+
+void Quaternion::toEuler(const float q[4], float eulerAnglesRadians[3])
+{
+    float w = q[0], x = q[1], y = q[2], z = q[3];
+
+    eulerAnglesRadians[0] = FastMath::atan2<CONFIG_FASTMATH_EULER>(2.0f * (w * x + y * z), w * w - x * x - y * y + z * z);
+    eulerAnglesRadians[1] = FastMath::asin<CONFIG_FASTMATH_EULER>(2.0f * (x * z - w * y));
+    eulerAnglesRadians[2] = FastMath::atan2<CONFIG_FASTMATH_EULER>(2.0f * (x * y + w * z), w * w + x * x - y * y - z * z);
+}
+
+void Quaternion::gravity(const float q[4], float g[3])
+{
+    float w = q[0], x = q[1], y = q[2], z = q[3];
+
+    g[0] = 2.0f * (x * z - w * y);
+    g[1] = 2.0f * (y * z + w * x);
+    g[2] = w * w - x * x - y * y + z * z;
+}
+
+void Quaternion::gravityFromEuler(const float eulerAnglesRadians[3], float g[3])
+{
+    float sinr = FastMath::sin<CONFIG_FASTMATH_ACCELZ>(eulerAnglesRadians[0]);
+    float cosr = FastMath::cos<CONFIG_FASTMATH_ACCELZ>(eulerAnglesRadians[0]);
+    float sinp = FastMath::sin<CONFIG_FASTMATH_ACCELZ>(eulerAnglesRadians[1]);
+    float cosp = FastMath::cos<CONFIG_FASTMATH_ACCELZ>(eulerAnglesRadians[1]);
+
+    g[0] = sinp;
+    g[1] = sinr * cosp;
+    g[2] = cosr * cosp;
+}
+
+void Quaternion::tilt(const float q[4], float tiltRadians[2])
+{
+    float g[3];
+    gravity(q, g);
+
+    tiltFromGravity(g, tiltRadians);
+}
+
+void Quaternion::tiltFromGravity(const float g[3], float tiltRadians[2])
+{
+    // cos(angle/2) of the tilt; upside down there is no one way back, so keep it from vanishing
+    float c = sqrtf((1 + g[2]) / 2);
+    if (c < 0.05f) {
+        c = 0.05f;
+    }
+
+    tiltRadians[0] = g[1] / c;
+    tiltRadians[1] = g[0] / c;
+}
+
+float Quaternion::earthZ(const float q[4], const float v[3])
+{
+    float g[3];
+    gravity(q, g);
+
+    return g[0] * v[0] + g[1] * v[1] + g[2] * v[2];
+}
+
+} // namespace hf
@@ -32,57 +32,175 @@ namespace hf {
 
 class RC {
 private:
-    int16_t dataAverage[CONFIG_RC_CHANS][4];
-    uint8_t commandDelay;                               // cycles since most recent movement
-    int32_t averageIndex;
-    int16_t lookupPitchRollRC[CONFIG_PITCH_LOOKUP_LENGTH];     // lookup table for expo & RC rate PITCH+ROLL
-    int16_t lookupThrottleRC[CONFIG_THROTTLE_LOOKUP_LENGTH];   // lookup table for expo & mid THROTTLE
+    int16_t dataAverage[CONFIG_RC_CHANS][1 << CONFIG_RC_AVERAGE_MAX_LOG2];
+    int32_t dataSum[CONFIG_RC_CHANS];                   // running sums of dataAverage
+    uint32_t sticksTime;                                // usec when the sticks last moved to a new position
+    bool    comboDone;                                  // the position has been reported by changed()
+    bool    combo;
+    uint8_t averageIndex;
+    uint8_t averageLog2;
+    int16_t expoPitchRoll[CONFIG_RC_PITCH_TABLE_LENGTH];      // expo & RC rate PITCH+ROLL, every 2^CONFIG_RC_EXPO_SHIFT usec
+    int16_t expoThrottle[CONFIG_RC_THROTTLE_TABLE_LENGTH];    // expo & mid THROTTLE, from MINCHECK up
+    int16_t expoData[4];                                      // stick values the current commands came from
     int16_t midrc;
+    uint16_t pwmMin;
+    uint16_t pwmMax;
+
+    void computePitchRollTable(void);
+    void computeThrottleTable(void);
+    void computeTargets(void);
+
+    // Commands ramp toward the targets from the latest reading, a step per IMU cycle, in 1/256ths, over
+    // as many cycles as the readings are coming apart
+    bool    interpolating;
+    uint32_t imuLoopMicro;
+    uint32_t readingTime;
+    bool    readingTimeValid;
+    uint8_t interpolationSteps;
+    uint8_t interpolationLeft;
+    int16_t commandTarget[4];
+    int16_t deflectionTarget[3];
+    int32_t commandRamp[4];
+    int32_t commandStep[4];
+    int32_t deflectionRamp[3];
+    int32_t deflectionStep[3];
 
     RcConfig config;
 
+    // When each channel last had a good reading, and the oldest of the sticks' (usec)
+    uint32_t channelTime[CONFIG_RC_CHANS];
+    uint32_t linkTime;
+
     Board * board;
 
 public:
-    void init(const RcConfig& rcConfig, const PwmConfig& pwmConfig, Board * _board);
-    void update(void);
+    void init(const RcConfig& rcConfig, const PwmConfig& pwmConfig, const LoopConfig& loopConfig, Board * _board);
+    void update(void) { update(board); }
+
+    // The same, reading the receiver through the concrete board class, so its accessors can be inlined
+    template <class BoardType>
+    void update(BoardType * board);
 
     int16_t data[CONFIG_RC_CHANS]; // raw PWM values for MSP
     int16_t command[4];            // stick PWM values for mixer, MSP
+    int16_t deflection[3];         // roll, pitch, yaw stick distance from center in [-500,+500], signed as command is
     uint8_t sticks;                // stick positions for command combos
     
+    // True at the reading where the sticks have been held in their position for CONFIG_RC_COMBO_MICRO
     bool changed(void);
 
+    // Looks up x in a table sampled every 2^CONFIG_RC_EXPO_SHIFT, interpolating with shifts
+    static int16_t interpolate(const int16_t table[], int32_t x);
+
+    // Once per IMU cycle
     void computeExpo(void);
 
+    // IMU cycles per RC reading
+    static uint8_t cyclesPerReading(const LoopConfig& loopConfig);
+
+    // For an IMU period chosen after init(); interpolation spreads each reading over the new number of cycles
+    void setLoopConfig(const LoopConfig& loopConfig);
+
+    // For tuning without a reboot: takes effect from the next computeExpo(), and rebuilds only the expo
+    // tables whose curves have changed
+    void setConfig(const RcConfig & rcConfig);
+    const RcConfig & getConfig(void) { return config; }
+
     uint8_t getAuxState(void);
 
+    // For failsafe: usec of the oldest stick channel's latest good reading
+    uint32_t getLinkTime(void) { return linkTime; }
+
+    // Centers roll, pitch and yaw and drops the aux switches, as if the pilot had; throttle is stick PWM
+    void centerSticks(int16_t throttle);
+
     bool throttleIsDown(void);
 };
 
 
 /********************************************* CPP ********************************************************/
 
-void RC::init(const RcConfig& rcConfig, const PwmConfig& pwmConfig, Board * _board)
+void RC::init(const RcConfig& rcConfig, const PwmConfig& pwmConfig, const LoopConfig& loopConfig, Board * _board)
 {
     board = _board;
 
+    interpolating = loopConfig.rcInterpolation;
+    imuLoopMicro = loopConfig.imuLoopMicro;
+    readingTimeValid = false;
+    interpolationSteps = interpolating ? cyclesPerReading(loopConfig) : 1;
+    interpolationLeft = 0;
+
     memcpy(&config, &rcConfig, sizeof(RcConfig));
 
-    midrc = (pwmConfig.max + pwmConfig.min) / 2;
+    pwmMin = pwmConfig.min;
+    pwmMax = pwmConfig.max;
+    midrc = (pwmMax + pwmMin) / 2;
 
-    memset (dataAverage, 0, 8*4*sizeof(int16_t));
+    memset(dataAverage, 0, sizeof(dataAverage));
+    memset(dataSum, 0, sizeof(dataSum));
 
-    commandDelay = 0;
+    averageLog2 = (std::min)(config.averageLog2, CONFIG_RC_AVERAGE_MAX_LOG2);
+
+    sticksTime = 0;
+    comboDone = false;
+    combo = false;
     sticks = 0;
     averageIndex = 0;
 
     for (uint8_t i = 0; i < CONFIG_RC_CHANS; i++)
         data[i] = midrc;
 
+    // No link until the first reading
+    memset(channelTime, 0, sizeof(channelTime));
+    linkTime = 0;
+
+    computePitchRollTable();
+    computeThrottleTable();
+
+    // No commands computed yet
+    for (uint8_t i = 0; i < 4; i++)
+        expoData[i] = -1;
+    for (uint8_t i = 0; i < 4; i++)
+        command[i] = 0;
+    for (uint8_t i = 0; i < 3; i++)
+        deflection[i] = 0;
+}
+
+void RC::setLoopConfig(const LoopConfig& loopConfig)
+{
+    imuLoopMicro = loopConfig.imuLoopMicro;
+    interpolationSteps = interpolating ? cyclesPerReading(loopConfig) : 1;
+    interpolationLeft = 0;
+}
+
+uint8_t RC::cyclesPerReading(const LoopConfig& loopConfig)
+{
+    uint32_t cycles = loopConfig.rcLoopMilli * 1000 / loopConfig.imuLoopMicro;
+
+    return cycles < 1 ? 1 : (cycles > 255 ? 255 : (uint8_t)cycles);
+}
+
+void RC::computePitchRollTable(void)
+{
+    // Coarse curve, as in MultiWii; the fine table below is sampled from it
+    int16_t lookupPitchRollRC[CONFIG_PITCH_LOOKUP_LENGTH];
+
     for (uint8_t i = 0; i < CONFIG_PITCH_LOOKUP_LENGTH; i++)
         lookupPitchRollRC[i] = (2500 + config.expo8 * (i * i - 25)) * i * (int32_t)config.rate8 / 2500;
 
+    // Fine table takes the divides out of computeExpo(); indexed by distance from center stick
+    for (uint16_t i = 0; i < CONFIG_RC_PITCH_TABLE_LENGTH; i++) {
+        int32_t tmp = (std::min)(i << CONFIG_RC_EXPO_SHIFT, 500);
+        int32_t tmp2 = tmp / 100;
+        expoPitchRoll[i] = 
+            lookupPitchRollRC[tmp2] + (tmp-tmp2*100) * (lookupPitchRollRC[tmp2 + 1] - lookupPitchRollRC[tmp2])/100;
+    }
+}
+
+void RC::computeThrottleTable(void)
+{
+    int16_t lookupThrottleRC[CONFIG_THROTTLE_LOOKUP_LENGTH];
+
     for (uint8_t i = 0; i < CONFIG_THROTTLE_LOOKUP_LENGTH; i++) {
         int16_t tmp = 10 * i - config.thrMid8;
         uint8_t y = 1;
@@ -92,36 +210,115 @@ void RC::init(const RcConfig& rcConfig, const PwmConfig& pwmConfig, Board * _boa
             y = config.thrMid8;
         lookupThrottleRC[i] = 10 * config.thrMid8 + tmp * (100 - config.thrExpo8 + 
             config.thrExpo8 * (tmp * tmp) / (y * y)) / 10;
-        lookupThrottleRC[i] = pwmConfig.min + (int32_t)(pwmConfig.max - pwmConfig.min) * 
+        lookupThrottleRC[i] = pwmMin + (int32_t)(pwmMax - pwmMin) * 
             lookupThrottleRC[i] / 1000; // [PWM_MIN;PWM_MAX]
     }
+
+    // Indexed by distance above MINCHECK
+    int32_t throttleRange = 2000 - config.mincheck;
+    for (uint16_t i = 0; i < CONFIG_RC_THROTTLE_TABLE_LENGTH; i++) {
+        int32_t tmp = (std::min)((int32_t)(i << CONFIG_RC_EXPO_SHIFT), throttleRange);
+        tmp = tmp * 1000 / throttleRange;       // [MINCHECK;2000] -> [0;1000]
+        int32_t tmp2 = tmp / 100;
+        expoThrottle[i] = lookupThrottleRC[tmp2] + (tmp - tmp2 * 100) * (lookupThrottleRC[tmp2 + 1] - 
+            lookupThrottleRC[tmp2]) / 100;    // [0;1000] -> expo -> [PWM_MIN;PWM_MAX]
+    }
+}
+
+void RC::setConfig(const RcConfig & rcConfig)
+{
+    bool pitchRollChanged = rcConfig.expo8 != config.expo8 || rcConfig.rate8 != config.rate8;
+
+    bool throttleChanged = rcConfig.thrMid8 != config.thrMid8 || rcConfig.thrExpo8 != config.thrExpo8 ||
+        rcConfig.mincheck != config.mincheck;
+
+    bool averageChanged = rcConfig.averageLog2 != config.averageLog2;
+
+    memcpy(&config, &rcConfig, sizeof(RcConfig));
+
+    // Only the tables whose curves have changed are rebuilt
+    if (pitchRollChanged)
+        computePitchRollTable();
+
+    if (throttleChanged)
+        computeThrottleTable();
+
+    // Restart the running averages from the latest values, so that they don't jump
+    if (averageChanged) {
+        averageLog2 = (std::min)(config.averageLog2, CONFIG_RC_AVERAGE_MAX_LOG2);
+        averageIndex = 0;
+        for (uint8_t chan = 0; chan < CONFIG_RC_CHANS; chan++) {
+            for (uint8_t k = 0; k < (1 << CONFIG_RC_AVERAGE_MAX_LOG2); k++)
+                dataAverage[chan][k] = data[chan];
+            dataSum[chan] = (int32_t)data[chan] << averageLog2;
+        }
+    }
+
+    // Commands are recomputed on the next computeExpo(), whether or not the sticks have moved
+    for (uint8_t i = 0; i < 4; i++)
+        expoData[i] = -1;
 }
 
-void RC::update()
+template <class BoardType>
+void RC::update(BoardType * board)
 {
+    uint32_t currentTime = (uint32_t)board->getMicros();
+    bool     reading = true;
+
     if (board->rcUseSerial()) {
-        for (uint8_t chan = 0; chan < 5; chan++) {
-            data[chan] = board->rcReadSerial(chan);
+        uint16_t frame[CONFIG_RC_CHANS];
+        uint8_t count = board->rcReadSerialFrame(frame);
+        reading = count > 0;
+        for (uint8_t chan = 0; chan < count; chan++) {
+            data[chan] = frame[chan];
+            channelTime[chan] = currentTime;
         }
     }
 
     else {
-        for (uint8_t chan = 0; chan < 8; chan++) {
+        uint16_t frame[CONFIG_RC_CHANS];
+        uint8_t count = board->rcReadPwmFrame(frame);
+        reading = count > 0;
+
+        for (uint8_t chan = 0; chan < count; chan++) {
+
+            // get RC PWM, replacing the oldest sample in the running sum; a missing pulse leaves the
+            // channel as it was, for failsafe to notice
+            int16_t sample = frame[chan];
+            if (sample < CONFIG_RC_PULSE_MIN || sample > CONFIG_RC_PULSE_MAX) {
+                continue;
+            }
+            channelTime[chan] = currentTime;
 
-            // get RC PWM
-            dataAverage[chan][averageIndex % 4] = board->rcReadPwm(chan);
+            dataSum[chan] += sample - dataAverage[chan][averageIndex];
+            dataAverage[chan][averageIndex] = sample;
 
-            data[chan] = 0;
+            data[chan] = (int16_t)(dataSum[chan] >> averageLog2);
+        }
 
-            for (uint8_t i = 0; i < 4; i++)
-                data[chan] += dataAverage[chan][i];
-            data[chan] /= 4;
+        if (reading) {
+            averageIndex = (averageIndex + 1) & ((1 << averageLog2) - 1);
         }
+    }
 
-        averageIndex++;
+    linkTime = channelTime[0];
+    for (uint8_t chan = 1; chan < 4; chan++) {
+        if ((int32_t)(channelTime[chan] - linkTime) < 0) {
+            linkTime = channelTime[chan];
+        }
     }
 
-    // check stick positions, updating command delay
+    // The ramp to the next reading spans the IMU cycles since this one, whatever the receiver's rate
+    if (interpolating && reading) {
+        if (readingTimeValid) {
+            uint32_t cycles = (currentTime - readingTime) / imuLoopMicro;
+            interpolationSteps = cycles < 1 ? 1 : (cycles > 255 ? 255 : (uint8_t)cycles);
+        }
+        readingTime = currentTime;
+        readingTimeValid = true;
+    }
+
+    // check stick positions, timing how long they have been held
     uint8_t stTmp = 0;
     for (uint8_t i = 0; i < 4; i++) {
         stTmp >>= 2;
@@ -130,47 +327,97 @@ void RC::update()
         if (data[i] < config.maxcheck)
             stTmp |= 0x40;  // check for MAX
     }
-    if (stTmp == sticks) {
-        if (commandDelay < 250)
-            commandDelay++;
-    } else
-        commandDelay = 0;
+    if (stTmp != sticks) {
+        sticksTime = currentTime;
+        comboDone = false;
+    }
     sticks = stTmp;
+
+    combo = !comboDone && currentTime - sticksTime >= CONFIG_RC_COMBO_MICRO;
+    if (combo) {
+        comboDone = true;
+    }
 }
 
 bool RC::changed(void)
 {
-    return commandDelay == 20;
+    return combo;
+}
+
+int16_t RC::interpolate(const int16_t table[], int32_t x)
+{
+    int32_t i = x >> CONFIG_RC_EXPO_SHIFT;
+    int32_t f = x & ((1 << CONFIG_RC_EXPO_SHIFT) - 1);
+
+    return table[i] + (((table[i+1] - table[i]) * f) >> CONFIG_RC_EXPO_SHIFT);
 }
 
 void RC::computeExpo(void)
 {
-    int32_t tmp, tmp2;
+    // Sticks moved (or were set over MSP) since last time: ramp from where the commands are now
+    if (memcmp(expoData, data, sizeof(expoData))) {
 
-    for (uint8_t channel = 0; channel < 3; channel++) {
+        memcpy(expoData, data, sizeof(expoData));
+
+        computeTargets();
 
-        tmp = (std::min)(abs(data[channel] - midrc), 500);
+        // Ramps are in 1/256ths; multiplied rather than shifted, as the sticks below center are negative
+        for (uint8_t i = 0; i < 4; i++) {
+            commandRamp[i] = (int32_t)command[i] * 256;
+            commandStep[i] = ((int32_t)commandTarget[i] * 256 - commandRamp[i]) / interpolationSteps;
+        }
 
-        if (channel != DEMAND_YAW) { // roll, pitch
-            tmp2 = tmp / 100;
-            command[channel] = 
-                lookupPitchRollRC[tmp2] + (tmp-tmp2*100) * (lookupPitchRollRC[tmp2 + 1] - lookupPitchRollRC[tmp2])/100;
-        } else {                    // yaw
-            command[channel] = tmp * -1;
+        for (uint8_t i = 0; i < 3; i++) {
+            deflectionRamp[i] = (int32_t)deflection[i] * 256;
+            deflectionStep[i] = ((int32_t)deflectionTarget[i] * 256 - deflectionRamp[i]) / interpolationSteps;
         }
 
-        if (data[channel] < midrc)
-            command[channel] = -command[channel];
+        interpolationLeft = interpolationSteps;
     }
 
-    tmp = constrain(data[DEMAND_THROTTLE], config.mincheck, 2000);
-    tmp = (uint32_t)(tmp - config.mincheck) * 1000 / (2000 - config.mincheck);       // [MINCHECK;2000] -> [0;1000]
-    tmp2 = tmp / 100;
-    command[DEMAND_THROTTLE] = lookupThrottleRC[tmp2] + (tmp - tmp2 * 100) * (lookupThrottleRC[tmp2 + 1] - 
-        lookupThrottleRC[tmp2]) / 100;    // [0;1000] -> expo -> [PWM_MIN;PWM_MAX]
+    // Otherwise the commands are still good, once they have reached the targets
+    if (!interpolationLeft)
+        return;
+
+    // The last step lands exactly on the targets
+    if (--interpolationLeft == 0) {
+        memcpy(command, commandTarget, sizeof(command));
+        memcpy(deflection, deflectionTarget, sizeof(deflection));
+        return;
+    }
+
+    for (uint8_t i = 0; i < 4; i++) {
+        commandRamp[i] += commandStep[i];
+        command[i] = (int16_t)(commandRamp[i] / 256);
+    }
+
+    for (uint8_t i = 0; i < 3; i++) {
+        deflectionRamp[i] += deflectionStep[i];
+        deflection[i] = (int16_t)(deflectionRamp[i] / 256);
+    }
 
 } // computeExpo
 
+void RC::computeTargets(void)
+{
+    // Same branch-free arithmetic for roll and pitch; yaw is linear
+    for (uint8_t channel = 0; channel < 3; channel++) {
+
+        int32_t tmp = (std::min)(abs(data[channel] - midrc), 500);
+
+        commandTarget[channel] = channel == DEMAND_YAW ? -tmp : interpolate(expoPitchRoll, tmp);
+        deflectionTarget[channel] = channel == DEMAND_YAW ? -tmp : tmp;
+
+        if (data[channel] < midrc) {
+            commandTarget[channel] = -commandTarget[channel];
+            deflectionTarget[channel] = -deflectionTarget[channel];
+        }
+    }
+
+    int32_t tmp = constrain(data[DEMAND_THROTTLE], config.mincheck, 2000);
+    commandTarget[DEMAND_THROTTLE] = interpolate(expoThrottle, tmp - config.mincheck);
+}
+
 uint8_t RC::getAuxState(void) 
 {
     int16_t aux = data[4];
@@ -178,6 +425,18 @@ uint8_t RC::getAuxState(void)
     return aux < 1500 ? 0 : (aux < 1700 ? 1 : 2);
 }
 
+void RC::centerSticks(int16_t throttle)
+{
+    data[DEMAND_ROLL]     = midrc;
+    data[DEMAND_PITCH]    = midrc;
+    data[DEMAND_YAW]      = midrc;
+    data[DEMAND_THROTTLE] = throttle;
+
+    for (uint8_t chan = DEMAND_AUX1; chan < CONFIG_RC_CHANS; chan++) {
+        data[chan] = pwmMin;
+    }
+}
+
 bool RC::throttleIsDown(void)
 {
     return data[DEMAND_THROTTLE] < config.mincheck;
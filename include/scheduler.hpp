@@ -0,0 +1,277 @@
+/*
+   scheduler.hpp : cooperative priority scheduler for Hackflight::update
+
+   Each call to run() starts at most one task: the ready task of highest priority, with ties
+   going to the one that has waited longest.  A task below SCHEDULER_PRIORITY_REALTIME is deferred
+   if its measured worst-case execution time would carry it past the next realtime deadline,
+   unless it has already been deferred too often.  Periodic tasks use a TimedTask; event-driven
+   tasks run only when triggered; background tasks (period zero) are always ready.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "board.hpp"
+#include "config.hpp"
+#include "profiler.hpp"
+#include "timedtask.hpp"
+
+namespace hf {
+
+enum {
+    SCHEDULER_PRIORITY_BACKGROUND = 0,
+    SCHEDULER_PRIORITY_LOW,
+    SCHEDULER_PRIORITY_MEDIUM,
+    SCHEDULER_PRIORITY_HIGH,
+    SCHEDULER_PRIORITY_REALTIME
+};
+
+static const uint8_t SCHEDULER_NO_PROFILE = 0xFF;
+
+// What add() returns when all CONFIG_SCHEDULER_TASKS slots are taken; the other methods ignore it
+static const uint8_t SCHEDULER_NO_TASK    = 0xFF;
+
+class Scheduler {
+
+    public:
+
+        typedef void (*task_t)(void * context);
+
+        void init(Board * _board, Profiler * _profiler);
+
+        // Returns the task's ID, or SCHEDULER_NO_TASK (with a message to Board::dump()) if there's no slot
+        // left for it.  Period zero makes a background task.
+        uint8_t add(task_t function, void * context, uint32_t period, uint8_t priority,
+                uint8_t profilerTask=SCHEDULER_NO_PROFILE);
+
+        // An event-driven task runs only after trigger(); its period is the expected interval between
+        // events, used to predict its next deadline
+        void setEventDriven(uint8_t id);
+        void trigger(uint8_t id) { trigger(board, id); }
+
+        // A disabled task is skipped until enabled again; tasks start enabled
+        void setEnabled(uint8_t id, bool enabled);
+
+        // A new period takes effect from now
+        void setPeriod(uint8_t id, uint32_t period);
+
+        // Runs at most one task; returns false if only background work (or nothing) was ready
+        bool run(void) { return run(board); }
+
+        // The same, with the clock read through the concrete board class, so it can be inlined
+        template <class BoardType>
+        void trigger(BoardType * board, uint8_t id);
+        template <class BoardType>
+        bool run(BoardType * board);
+
+        uint32_t getWorstCase(uint8_t id) { return id < count ? tasks[id].worstCase : 0; }
+
+    private:
+
+        typedef struct task_state_t {
+            task_t    function;
+            void    * context;
+            TimedTask timer;
+            uint32_t  period;
+            uint32_t  lastStart;
+            uint32_t  triggerTime;
+            uint32_t  worstCase;
+            uint8_t   priority;
+            uint8_t   profilerTask;
+            uint8_t   deferrals;
+            bool      eventDriven;
+            bool      triggered;
+            bool      disabled;
+        } task_state_t;
+
+        task_state_t tasks[CONFIG_SCHEDULER_TASKS];
+        uint8_t      count;
+
+        Board      * board;
+        Profiler   * profiler;
+
+        bool    ready(task_state_t & task, uint32_t now);
+        int32_t waiting(task_state_t & task, uint32_t now);
+        bool    fitsBeforeRealtime(task_state_t & task, uint32_t now);
+};
+
+/********************************************* CPP ********************************************************/
+
+void Scheduler::init(Board * _board, Profiler * _profiler)
+{
+    board    = _board;
+    profiler = _profiler;
+
+    memset(tasks, 0, sizeof(tasks));
+    count = 0;
+}
+
+uint8_t Scheduler::add(task_t function, void * context, uint32_t period, uint8_t priority, uint8_t profilerTask)
+{
+    if (count == CONFIG_SCHEDULER_TASKS) {
+        board->dump((char *)"Scheduler: no slot left for another task; raise CONFIG_SCHEDULER_TASKS\n");
+        return SCHEDULER_NO_TASK;
+    }
+
+    task_state_t & task = tasks[count];
+
+    task.function     = function;
+    task.context      = context;
+    task.period       = period;
+    task.priority     = priority;
+    task.profilerTask = profilerTask;
+    task.timer.init(period);
+
+    return count++;
+}
+
+void Scheduler::setEventDriven(uint8_t id)
+{
+    if (id < count)
+        tasks[id].eventDriven = true;
+}
+
+template <class BoardType>
+void Scheduler::trigger(BoardType * board, uint8_t id)
+{
+    if (id < count && !tasks[id].triggered) {
+        tasks[id].triggered = true;
+        tasks[id].triggerTime = (uint32_t)board->getMicros();
+    }
+}
+
+void Scheduler::setEnabled(uint8_t id, bool enabled)
+{
+    if (id < count)
+        tasks[id].disabled = !enabled;
+}
+
+void Scheduler::setPeriod(uint8_t id, uint32_t period)
+{
+    if (id >= count)
+        return;
+
+    tasks[id].period = period;
+    tasks[id].timer.init(period);
+}
+
+bool Scheduler::ready(task_state_t & task, uint32_t now)
+{
+    if (task.disabled)
+        return false;
+
+    if (task.eventDriven)
+        return task.triggered;
+
+    return task.period == 0 || task.timer.check(now);
+}
+
+// How long a ready task has been waiting: past its deadline, since its event, or since it last ran
+int32_t Scheduler::waiting(task_state_t & task, uint32_t now)
+{
+    if (task.eventDriven)
+        return (int32_t)(now - task.triggerTime);
+
+    if (task.period == 0)
+        return (int32_t)(now - task.lastStart);
+
+    return task.timer.lateness(now);
+}
+
+bool Scheduler::fitsBeforeRealtime(task_state_t & task, uint32_t now)
+{
+    if (task.priority >= SCHEDULER_PRIORITY_REALTIME || task.deferrals >= CONFIG_SCHEDULER_MAX_DEFERRALS)
+        return true;
+
+    for (uint8_t k=0; k<count; ++k) {
+
+        task_state_t & rt = tasks[k];
+
+        // A disabled one (the IMU task during startup) has no deadline to keep, however overdue its timer
+        if (rt.priority < SCHEDULER_PRIORITY_REALTIME || rt.disabled)
+            continue;
+
+        // Time until the realtime task is next due; an event-driven one is predicted from its last run
+        int32_t slack = rt.eventDriven ?
+            (int32_t)(rt.lastStart + rt.period - now) : -rt.timer.lateness(now);
+
+        if ((int32_t)task.worstCase > slack)
+            return false;
+    }
+
+    return true;
+}
+
+template <class BoardType>
+bool Scheduler::run(BoardType * board)
+{
+    uint32_t now = (uint32_t)board->getMicros();
+
+    task_state_t * best = NULL;
+    int32_t bestWaiting = 0;
+
+    for (uint8_t k=0; k<count; ++k) {
+
+        task_state_t & task = tasks[k];
+
+        if (!ready(task, now))
+            continue;
+
+        int32_t w = waiting(task, now);
+
+        if (best && (task.priority < best->priority || (task.priority == best->priority && w <= bestWaiting)))
+            continue;
+
+        if (!fitsBeforeRealtime(task, now)) {
+            if (task.deferrals < 0xFF)
+                task.deferrals++;
+            continue;
+        }
+
+        best = &task;
+        bestWaiting = w;
+    }
+
+    if (!best)
+        return false;
+
+    uint32_t start = (uint32_t)board->getMicros();
+
+    int32_t lateness = best->period == 0 ? 0 : waiting(*best, start);
+
+    best->lastStart = start;
+    best->triggered = false;
+    best->deferrals = 0;
+    if (!best->eventDriven)
+        best->timer.update(start);
+
+    best->function(best->context);
+
+    uint32_t execTime = (uint32_t)board->getMicros() - start;
+
+    // Worst case decays slowly, so that one long run doesn't defer a task forever
+    best->worstCase = execTime > best->worstCase ? execTime : best->worstCase - (best->worstCase >> 6);
+
+    if (best->profilerTask != SCHEDULER_NO_PROFILE)
+        profiler->record(best->profilerTask, lateness, execTime);
+
+    return best->priority > SCHEDULER_PRIORITY_BACKGROUND;
+}
+
+} // namespace
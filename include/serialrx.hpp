@@ -0,0 +1,293 @@
+/*
+   serialrx.hpp : SBUS and CRSF receivers, decoded a byte at a time
+
+   The board feeds parse() every byte from the receiver's UART, from its receive interrupt or a drain of
+   its DMA buffer.  Frames are found by their start (and, for SBUS, end) bytes rather than by the gap
+   between them, so bytes may arrive in bursts.  Each good frame's channels go into the back one of two
+   buffers, which then becomes the front; getFrame() copies the front one out and says whether it is new.
+   A frame takes the receiver milliseconds to send, far longer than the copy, so the front buffer is never
+   rewritten while it is being read.
+
+   Channels come out as PWM microseconds (172..1811 ticks is 988..2012 usec, as Betaflight has it), in the
+   receiver's order: usually roll, pitch, throttle, yaw (AETR), then the aux switches.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "board.hpp"
+
+namespace hf {
+
+enum {
+    SERIALRX_SBUS = 0,  // 100000 baud 8E2, inverted; 25 bytes every 7 or 14 msec
+    SERIALRX_CRSF       // 420000 baud 8N1; up to 64 bytes, channels every 4 msec or faster
+};
+
+class SerialRx {
+
+    public:
+
+        static const uint8_t CHANNELS = 16;
+
+        // Called from parse(), so from the UART interrupt if that is where parse() is called
+        typedef void (*frameCallback_t)(void * context);
+
+        void init(uint8_t _protocol, frameCallback_t _callback=NULL, void * _context=NULL);
+
+        // Every byte from the receiver, with the time it came in (usec)
+        void parse(uint8_t c, uint32_t usec);
+
+        // True from a new frame until getFrame() takes it
+        bool frameReady(void) { return fresh; }
+
+        // Latest frame's channels; false if there has been no new one since the last call
+        bool getFrame(uint16_t channels[CHANNELS]);
+
+        void getStats(rcLinkStats_t & stats);
+
+    private:
+
+        static const uint8_t SBUS_FRAME_SIZE   = 25;
+        static const uint8_t SBUS_START        = 0x0F;
+        static const uint8_t SBUS_FLAGS        = 23;
+        static const uint8_t SBUS_LOST_BIT     = 0x04;
+        static const uint8_t SBUS_FAILSAFE_BIT = 0x08;
+
+        // SBUS gives no link quality, so it is worked out from the lost-frame bit over this many frames
+        static const uint8_t SBUS_QUALITY_FRAMES = 100;
+
+        static const uint8_t CRSF_FRAME_MAX         = 64;
+        static const uint8_t CRSF_ADDRESS           = 0xC8;    // flight controller
+        static const uint8_t CRSF_TYPE_LINK_STATS   = 0x14;
+        static const uint8_t CRSF_TYPE_CHANNELS     = 0x16;
+        static const uint8_t CRSF_LINK_STATS_SIZE   = 10;
+        static const uint8_t CRSF_CHANNELS_SIZE     = 22;
+
+        uint8_t  protocol;
+
+        frameCallback_t callback;
+        void          * context;
+
+        // Frame coming in, and how long it will be once its length is known
+        uint8_t  buffer[CRSF_FRAME_MAX];
+        uint8_t  position;
+        uint8_t  frameSize;
+
+        uint16_t frames[2][CHANNELS];
+        volatile uint8_t front;
+        volatile bool    fresh;
+
+        rcLinkStats_t stats;
+        uint32_t lastFrameUsec;
+        uint8_t  qualityFrames;
+        uint8_t  qualityLost;
+
+        void parseSbus(uint8_t c, uint32_t usec);
+        void parseCrsf(uint8_t c, uint32_t usec);
+
+        // Unpacks 11-bit channels, least significant bit first, as both protocols have them
+        void publish(const uint8_t * packed, uint32_t usec);
+
+        static uint8_t crc8(const uint8_t * buf, uint8_t count);
+};
+
+/********************************************* CPP ********************************************************/
+
+void SerialRx::init(uint8_t _protocol, frameCallback_t _callback, void * _context)
+{
+    protocol = _protocol;
+    callback = _callback;
+    context  = _context;
+
+    position  = 0;
+    frameSize = 0;
+
+    memset(frames, 0, sizeof(frames));
+    front = 0;
+    fresh = false;
+
+    memset(&stats, 0, sizeof(rcLinkStats_t));
+    lastFrameUsec = 0;
+    qualityFrames = 0;
+    qualityLost   = 0;
+}
+
+void SerialRx::parse(uint8_t c, uint32_t usec)
+{
+    if (protocol == SERIALRX_SBUS) {
+        parseSbus(c, usec);
+    }
+    else {
+        parseCrsf(c, usec);
+    }
+}
+
+void SerialRx::parseSbus(uint8_t c, uint32_t usec)
+{
+    // Wait for a start byte
+    if (position == 0 && c != SBUS_START) {
+        return;
+    }
+
+    buffer[position++] = c;
+
+    if (position < SBUS_FRAME_SIZE) {
+        return;
+    }
+
+    position = 0;
+
+    // SBUS ends its frames with zero, SBUS2 with 0x04, 0x14, 0x24 or 0x34; anything else means we
+    // started on a data byte that happened to look like a start byte
+    if (c != 0x00 && (c & 0x0F) != 0x04) {
+        stats.errors++;
+        return;
+    }
+
+    uint8_t flags = buffer[SBUS_FLAGS];
+
+    stats.failsafe = (flags & SBUS_FAILSAFE_BIT) != 0;
+
+    if (flags & SBUS_LOST_BIT) {
+        stats.lost++;
+        qualityLost++;
+    }
+
+    if (++qualityFrames == SBUS_QUALITY_FRAMES) {
+        stats.quality = 100 - qualityLost;
+        qualityFrames = 0;
+        qualityLost   = 0;
+    }
+
+    // In failsafe the receiver repeats the last channels it had, or whatever it was set up to send
+    if (!stats.failsafe) {
+        publish(&buffer[1], usec);
+    }
+}
+
+void SerialRx::parseCrsf(uint8_t c, uint32_t usec)
+{
+    if (position == 0 && c != CRSF_ADDRESS) {
+        return;
+    }
+
+    // The length byte counts the type, payload and CRC
+    if (position == 1) {
+        if (c < 2 || c > CRSF_FRAME_MAX - 2) {
+            position = 0;
+            stats.errors++;
+            return;
+        }
+        frameSize = c + 2;
+    }
+
+    buffer[position++] = c;
+
+    if (position < 2 || position < frameSize) {
+        return;
+    }
+
+    position = 0;
+
+    uint8_t type = buffer[2];
+    uint8_t payloadSize = frameSize - 4;
+    const uint8_t * payload = &buffer[3];
+
+    if (crc8(&buffer[2], frameSize - 3) != buffer[frameSize - 1]) {
+        stats.errors++;
+        return;
+    }
+
+    if (type == CRSF_TYPE_CHANNELS && payloadSize == CRSF_CHANNELS_SIZE) {
+        publish(payload, usec);
+    }
+
+    // Uplink RSSI for each antenna (-dBm), uplink LQ (%), SNR, active antenna, and downlink figures
+    else if (type == CRSF_TYPE_LINK_STATS && payloadSize == CRSF_LINK_STATS_SIZE) {
+        stats.rssi     = -(int8_t)payload[payload[4] ? 1 : 0];
+        stats.quality  = payload[2];
+        stats.failsafe = payload[2] == 0;
+        if (stats.failsafe) {
+            stats.lost++;
+        }
+    }
+}
+
+void SerialRx::publish(const uint8_t * packed, uint32_t usec)
+{
+    uint16_t * channels = frames[front ^ 1];
+
+    for (uint8_t chan = 0; chan < CHANNELS; chan++) {
+        uint16_t bit  = chan * 11;
+        uint8_t  byte = bit >> 3;
+        uint8_t  shift = bit & 7;
+
+        uint32_t bits = packed[byte] | (packed[byte+1] << 8) | ((uint32_t)packed[byte+2] << 16);
+        uint16_t ticks = (bits >> shift) & 0x07FF;
+
+        channels[chan] = 5 * ticks / 8 + 880;
+    }
+
+    front ^= 1;
+    fresh = true;
+
+    stats.frames++;
+    stats.frameMicro = stats.frames > 1 ? usec - lastFrameUsec : 0;
+    lastFrameUsec = usec;
+
+    if (callback) {
+        callback(context);
+    }
+}
+
+bool SerialRx::getFrame(uint16_t channels[CHANNELS])
+{
+    if (!fresh) {
+        return false;
+    }
+
+    // Clear first, so that a frame landing during the copy is reported next time
+    fresh = false;
+    memcpy(channels, frames[front], sizeof(frames[0]));
+
+    return true;
+}
+
+void SerialRx::getStats(rcLinkStats_t & _stats)
+{
+    memcpy(&_stats, &stats, sizeof(rcLinkStats_t));
+}
+
+uint8_t SerialRx::crc8(const uint8_t * buf, uint8_t count)
+{
+    // CRC-8/DVB-S2 over the type and payload
+    uint8_t crc = 0;
+
+    for (uint8_t i = 0; i < count; i++) {
+        crc ^= buf[i];
+        for (uint8_t k = 0; k < 8; k++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0xD5 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+} // namespace hf
@@ -27,18 +27,39 @@
 #include "config.hpp"
 #include "common.hpp"
 
+// Define CONFIG_PID_FIXED_POINT before including this file (or with -D) to run the PID
+// with integer-only arithmetic, for FPU-less targets like the STM32F1 boards.
+
 namespace hf {
 
 class Stabilize {
 public:
     int16_t axisPID[3];
 
-    void init(const PidConfig& _pidConfig, const ImuConfig& _imuConfig, Board * _board);
+    void init(const PidConfig& _pidConfig, const ImuConfig& _imuConfig, const RateConfig& _rateConfig, 
+            const LoopConfig& _loopConfig, Board * _board);
 
+    // Self-leveling: roll and pitch blend toward level as the sticks center
     void update(int16_t rcCommand[4], int16_t gyroADC[3], float eulerAngles[3]);
 
+    // Rate (acro): every axis holds the rate the stick asks for, as RC::deflection has it, on the gyro
+    // alone, so no attitude is needed; roll and pitch P and D are attenuated at high throttle
+    void updateRate(int16_t rcDeflection[3], int16_t throttle, int16_t gyroADC[3]);
+
     void resetIntegral(void);
 
+    // For tuning without a reboot: the new gains are converted into the spare set, and used once
+    // swapGains() has been called
+    void setPidConfig(const PidConfig & _pidConfig);
+    const PidConfig & getPidConfig(void) { return pidConfig; }
+
+    // Call before update(), never during it, so that every axis is computed with the same gains
+    void swapGains(void);
+
+    // For an IMU period other than the one the gains were tuned at: I and D are rescaled so that they do
+    // per second what they did; takes effect with the next swapGains()
+    void setLoopConfig(const LoopConfig & loopConfig);
+
 private:
 
     int16_t lastGyro[2];
@@ -52,22 +73,91 @@ private:
     ImuConfig imuConfig;
     PidConfig pidConfig;
 
-    int32_t computeITermGyro(float rateP, float rateI, int16_t rcCommand[4], int16_t gyroADC[3], uint8_t axis);
-    int16_t computePid(float rateP, int32_t PTerm, int32_t ITerm, int32_t DTerm, int16_t gyroADC[3], uint8_t axis);
+#ifdef CONFIG_PID_FIXED_POINT
+    // Q16.16: PID gains can be larger than one, so Q15 would not hold them
+    typedef int32_t gain_t;
+    static const uint8_t GAIN_FRACTION_BITS = 16;
+#else
+    typedef float gain_t;
+#endif
+
+    // Gains are converted once in setPidConfig(), so update() never converts between int and float.
+    // update() reads the active set through a pointer; setPidConfig() fills the other one, and
+    // swapGains() moves the pointer, so a change costs the loop nothing and never tears.
+    typedef struct {
+        gain_t  levelP;
+        gain_t  ratePitchrollP;
+        gain_t  ratePitchrollI;
+        gain_t  ratePitchrollD;
+        gain_t  yawP;
+        gain_t  yawI;
+        int16_t softwareTrim[3];
+        gain_t  feedForward;
+    } gains_t;
+
+    gains_t   gainSets[2];
+    gains_t * gains;
+    bool      gainsPending;
+
+    // IMU period over the one the gains were tuned at
+    uint32_t  tunedLoopMicro;
+    float     loopScale;
+
+    int32_t   maxAngleInclination;
+
+    // Rate mode: setpoint (gyro counts) every 2^CONFIG_RC_EXPO_SHIFT of stick deflection, and TPA as
+    // 1/256ths of P and D lost per 1/256th of throttle above the breakpoint
+    int16_t   rateSetpoint[CONFIG_RC_PITCH_TABLE_LENGTH];
+    int32_t   tpaBreakpoint;
+    int32_t   tpaSlope;
+
+    void computeRateTable(const RateConfig & rateConfig, float gyroLsbPerDps);
+
+    // Feed-forward: each axis's setpoint (in P-term units) at the last update, which mode that was, and
+    // IMU cycles per RC reading, so that the gain means the same at any loop rate
+    int32_t   lastSetpoint[3];
+    bool      lastRateMode;
+    bool      setpointsValid;
+    int32_t   rcCycles;
+
+    int32_t computeFeedForward(int32_t setpoint, uint8_t axis);
+
+    static gain_t  toGain(float value);
+    static int32_t applyGain(int32_t value, gain_t gain);
+
+    int32_t computeITermGyro(gain_t rateP, gain_t rateI, int16_t rcCommand[4], int16_t gyroADC[3], uint8_t axis);
+    int16_t computePid(gain_t rateP, int32_t PTerm, int32_t ITerm, int32_t DTerm, int16_t gyroADC[3], uint8_t axis);
     int16_t computeLevelPid(int16_t rcCommand[4], int16_t gyroADC[3], float eulerAngles[3], uint8_t axis);
+    int16_t computeRatePid(int32_t setpoint, int32_t tpa, int16_t gyroADC[3], uint8_t axis);
+    int32_t computeDTerm(int16_t gyroADC[3], uint8_t axis);
+    int32_t rateSetpointFor(int16_t deflection);
 }; 
 
 
 /********************************************* CPP ********************************************************/
 
-void Stabilize::init(const PidConfig& _pidConfig, const ImuConfig& _imuConfig, Board * _board)
+void Stabilize::init(const PidConfig& _pidConfig, const ImuConfig& _imuConfig, const RateConfig& _rateConfig, 
+        const LoopConfig& _loopConfig, Board * _board)
 {
     // a hack for debugging
     board = _board;
 
     // We'll use PID, IMU config values in update() below
-    memcpy(&pidConfig, &_pidConfig, sizeof(PidConfig));
     memcpy(&imuConfig, &_imuConfig, sizeof(ImuConfig));
+    maxAngleInclination = (int32_t)imuConfig.maxAngleInclination;
+
+    computeRateTable(_rateConfig, imuConfig.gyroLsbPerDps);
+
+    rcCycles = RC::cyclesPerReading(_loopConfig);
+    tunedLoopMicro = _loopConfig.imuLoopMicro;
+    loopScale = 1;
+    lastRateMode = false;
+    setpointsValid = false;
+
+    // The first set fills the spare, which becomes the active one
+    gains = &gainSets[1];
+    setPidConfig(_pidConfig);
+    swapGains();
 
     // Zero-out previous values for D term
     for (uint8_t axis=0; axis<2; ++axis) {
@@ -79,9 +169,71 @@ void Stabilize::init(const PidConfig& _pidConfig, const ImuConfig& _imuConfig, B
     resetIntegral();
 }
 
-int32_t Stabilize::computeITermGyro(float rateP, float rateI, int16_t rcCommand[4], int16_t gyroADC[3], uint8_t axis)
+void Stabilize::setPidConfig(const PidConfig & _pidConfig)
 {
-    int32_t error = ((int32_t)rcCommand[axis] * rateP) - gyroADC[axis];
+    memcpy(&pidConfig, &_pidConfig, sizeof(PidConfig));
+
+    gains_t * spare = gains == &gainSets[0] ? &gainSets[1] : &gainSets[0];
+
+    spare->levelP         = toGain(pidConfig.levelP);
+    spare->ratePitchrollP = toGain(pidConfig.ratePitchrollP);
+    spare->ratePitchrollI = toGain(pidConfig.ratePitchrollI * loopScale);
+    spare->ratePitchrollD = toGain(pidConfig.ratePitchrollD / loopScale);
+    spare->yawP           = toGain(pidConfig.yawP);
+    spare->yawI           = toGain(pidConfig.yawI * loopScale);
+    memcpy(spare->softwareTrim, pidConfig.softwareTrim, sizeof(spare->softwareTrim));
+    spare->feedForward    = toGain(pidConfig.feedForward);
+
+    gainsPending = true;
+}
+
+void Stabilize::swapGains(void)
+{
+    if (gainsPending) {
+        gains = gains == &gainSets[0] ? &gainSets[1] : &gainSets[0];
+        gainsPending = false;
+    }
+}
+
+void Stabilize::setLoopConfig(const LoopConfig & loopConfig)
+{
+    // The integral adds up, and the derivative differences, once a cycle
+    rcCycles  = RC::cyclesPerReading(loopConfig);
+    loopScale = (float)loopConfig.imuLoopMicro / tunedLoopMicro;
+
+    setPidConfig(pidConfig);
+}
+
+#ifdef CONFIG_PID_FIXED_POINT
+
+Stabilize::gain_t Stabilize::toGain(float value)
+{
+    return (gain_t)lrintf(value * (1 << GAIN_FRACTION_BITS));
+}
+
+int32_t Stabilize::applyGain(int32_t value, gain_t gain)
+{
+    // 32x32->64 multiply is a single instruction (SMULL) on Cortex-M3 and up
+    return (int32_t)(((int64_t)value * gain) >> GAIN_FRACTION_BITS);
+}
+
+#else
+
+Stabilize::gain_t Stabilize::toGain(float value)
+{
+    return value;
+}
+
+int32_t Stabilize::applyGain(int32_t value, gain_t gain)
+{
+    return (int32_t)(value * gain);
+}
+
+#endif
+
+int32_t Stabilize::computeITermGyro(gain_t rateP, gain_t rateI, int16_t rcCommand[4], int16_t gyroADC[3], uint8_t axis)
+{
+    int32_t error = applyGain(rcCommand[axis], rateP) - gyroADC[axis];
 
     // Avoid integral windup
     errorGyroI[axis] = constrain(errorGyroI[axis] + error, -16000, +16000);
@@ -89,26 +241,29 @@ int32_t Stabilize::computeITermGyro(float rateP, float rateI, int16_t rcCommand[
     if ((std::abs(gyroADC[axis]) > 640) || ((axis == AXIS_YAW) && (std::abs(rcCommand[axis]) > 100)))
         errorGyroI[axis] = 0;
 
-    return ((int32_t)(errorGyroI[axis] * rateI)) >> 6;
+    return applyGain(errorGyroI[axis], rateI) >> 6;
 }
 
-int16_t Stabilize::computePid(float rateP, int32_t PTerm, int32_t ITerm, int32_t DTerm, int16_t gyroADC[3], uint8_t axis)
+int16_t Stabilize::computePid(gain_t rateP, int32_t PTerm, int32_t ITerm, int32_t DTerm, int16_t gyroADC[3], uint8_t axis)
 {
-    PTerm -= (int32_t)gyroADC[axis] * rateP;
-    return PTerm + ITerm - DTerm + pidConfig.softwareTrim[axis];
+    PTerm -= applyGain(gyroADC[axis], rateP);
+    return PTerm + ITerm - DTerm + gains->softwareTrim[axis];
 }
 
 int16_t Stabilize::computeLevelPid(int16_t rcCommand[4], int16_t gyroADC[3], float eulerAngles[3], uint8_t axis)
 {
-    int32_t ITermGyro = computeITermGyro(pidConfig.ratePitchrollP, pidConfig.ratePitchrollI, rcCommand, gyroADC, axis);
+    int32_t ITermGyro = computeITermGyro(gains->ratePitchrollP, gains->ratePitchrollI, rcCommand, gyroADC, axis);
+
+    // Euler angles arrive as float degrees; this is the only conversion per axis
+    int32_t angle = (int32_t)(10*eulerAngles[axis]);
 
     // max inclination
     int32_t errorAngle = constrain(2 * rcCommand[axis], 
-            - imuConfig.maxAngleInclination, 
-            + imuConfig.maxAngleInclination) 
-        - 10*eulerAngles[axis];
+            - maxAngleInclination, 
+            + maxAngleInclination) 
+        - angle;
 
-    int32_t PTermAccel = errorAngle * pidConfig.levelP; 
+    int32_t PTermAccel = applyGain(errorAngle, gains->levelP); 
 
     // Avoid integral windup
     errorAngleI[axis] = constrain(errorAngleI[axis] + errorAngle, -10000, +10000);
@@ -119,29 +274,122 @@ int16_t Stabilize::computeLevelPid(int16_t rcCommand[4], int16_t gyroADC[3], flo
     int32_t PTerm = (PTermAccel * (500 - prop) + rcCommand[axis] * prop) / 500;
     int32_t ITerm = (ITermGyro * prop) / 500;
 
+    // The stick's share of the P term gets the feed-forward too
+    PTerm += computeFeedForward(rcCommand[axis], axis) * prop / 500;
+
+    int32_t DTerm = computeDTerm(gyroADC, axis);
+
+    return computePid(gains->ratePitchrollP, PTerm, ITerm, DTerm, gyroADC, axis);
+}
+
+int32_t Stabilize::computeDTerm(int16_t gyroADC[3], uint8_t axis)
+{
+    // Both modes keep the same history, so switching between them causes no D kick
     int32_t delta = gyroADC[axis] - lastGyro[axis];
     lastGyro[axis] = gyroADC[axis];
     int32_t deltaSum = delta1[axis] + delta2[axis] + delta;
     delta2[axis] = delta1[axis];
     delta1[axis] = delta;
-    int32_t DTerm = deltaSum * pidConfig.ratePitchrollD;
 
-    return computePid(pidConfig.ratePitchrollP, PTerm, ITerm, DTerm, gyroADC, axis);
+    return applyGain(deltaSum, gains->ratePitchrollD);
+}
+
+void Stabilize::computeRateTable(const RateConfig & rateConfig, float gyroLsbPerDps)
+{
+    // Past 2, rcRate climbs faster, as in Betaflight
+    float rcRate = rateConfig.rcRate > 2 ? rateConfig.rcRate + 14.54f * (rateConfig.rcRate - 2) : rateConfig.rcRate;
+
+    for (uint16_t i = 0; i < CONFIG_RC_PITCH_TABLE_LENGTH; i++) {
+
+        float stick = (std::min)(i << CONFIG_RC_EXPO_SHIFT, 500) / 500.0f;
+
+        stick = stick * stick * stick * stick * rateConfig.expo + stick * (1 - rateConfig.expo);
+
+        float superFactor = constrain(1 - stick * rateConfig.superRate, 0.01f, 1.0f);
+
+        float angleRate = 200 * rcRate * stick / superFactor;
+
+        rateSetpoint[i] = (int16_t)lrintf((std::min)(angleRate, 1998.0f) * gyroLsbPerDps);
+    }
+
+    tpaBreakpoint = rateConfig.tpaBreakpoint;
+    tpaSlope      = tpaBreakpoint < 2000 ? (int32_t)lrintf(rateConfig.tpaRate * 65536 / (2000 - tpaBreakpoint)) : 0;
+}
+
+int32_t Stabilize::rateSetpointFor(int16_t deflection)
+{
+    int32_t setpoint = RC::interpolate(rateSetpoint, std::abs(deflection));
+
+    return deflection < 0 ? -setpoint : setpoint;
+}
+
+int16_t Stabilize::computeRatePid(int32_t setpoint, int32_t tpa, int16_t gyroADC[3], uint8_t axis)
+{
+    gain_t rateP = axis == AXIS_YAW ? gains->yawP : gains->ratePitchrollP;
+    gain_t rateI = axis == AXIS_YAW ? gains->yawI : gains->ratePitchrollI;
+
+    int32_t error = setpoint - gyroADC[axis];
+
+    // Avoid integral windup; fast rotation is the point here, so unlike leveling it doesn't reset the I term
+    errorGyroI[axis] = constrain(errorGyroI[axis] + error, -16000, +16000);
+
+    int32_t PTerm = applyGain(error, rateP);
+    int32_t ITerm = applyGain(errorGyroI[axis], rateI) >> 6;
+    int32_t DTerm = axis == AXIS_YAW ? 0 : computeDTerm(gyroADC, axis);
+    int32_t FTerm = computeFeedForward(applyGain(setpoint, rateP), axis);
+
+    return (((PTerm - DTerm) * tpa) >> 8) + ITerm + FTerm + gains->softwareTrim[axis];
+}
+
+int32_t Stabilize::computeFeedForward(int32_t setpoint, uint8_t axis)
+{
+    // Nothing to difference against on the first update in a mode
+    int32_t change = setpointsValid ? setpoint - lastSetpoint[axis] : 0;
+    lastSetpoint[axis] = setpoint;
+
+    // With RC interpolation the change is spread over the cycles between readings; without it, it all
+    // comes in one; either way, it's scaled to a change per RC period
+    return applyGain(change * rcCycles, gains->feedForward);
 }
 
 void Stabilize::update(int16_t rcCommand[4], int16_t gyroADC[3], float eulerAngles[3])
 {
+    // Setpoints from rate mode are in other units
+    setpointsValid = setpointsValid && !lastRateMode;
+    lastRateMode = false;
+
     // Pitch, roll use leveling based on Euler angles
     axisPID[AXIS_ROLL]  = computeLevelPid(rcCommand, gyroADC, eulerAngles, AXIS_ROLL);
     axisPID[AXIS_PITCH] = computeLevelPid(rcCommand, gyroADC, eulerAngles, AXIS_PITCH);
 
     // For yaw, P term comes directly from RC command, and D term is zero
-    int32_t ITermGyroYaw = computeITermGyro(pidConfig.yawP, pidConfig.yawI, rcCommand, gyroADC, AXIS_YAW);
-    axisPID[AXIS_YAW] = computePid(pidConfig.yawP, rcCommand[AXIS_YAW], ITermGyroYaw, 0, gyroADC, AXIS_YAW);
+    int32_t ITermGyroYaw = computeITermGyro(gains->yawP, gains->yawI, rcCommand, gyroADC, AXIS_YAW);
+    int32_t FTermYaw = computeFeedForward(rcCommand[AXIS_YAW], AXIS_YAW);
+    axisPID[AXIS_YAW] = computePid(gains->yawP, rcCommand[AXIS_YAW] + FTermYaw, ITermGyroYaw, 0, gyroADC, AXIS_YAW);
 
     // Prevent "yaw jump" during yaw correction
     axisPID[AXIS_YAW] = constrain(axisPID[AXIS_YAW], 
             -100 - std::abs(rcCommand[DEMAND_YAW]), +100 + std::abs(rcCommand[DEMAND_YAW]));
+
+    setpointsValid = true;
+}
+
+void Stabilize::updateRate(int16_t rcDeflection[3], int16_t throttle, int16_t gyroADC[3])
+{
+    setpointsValid = setpointsValid && lastRateMode;
+    lastRateMode = true;
+
+    // TPA, in 1/256ths
+    int32_t tpa = 256;
+    if (throttle > tpaBreakpoint) {
+        tpa -= ((std::min)((int32_t)throttle, (int32_t)2000) - tpaBreakpoint) * tpaSlope >> 8;
+    }
+
+    axisPID[AXIS_ROLL]  = computeRatePid(rateSetpointFor(rcDeflection[AXIS_ROLL]),  tpa, gyroADC, AXIS_ROLL);
+    axisPID[AXIS_PITCH] = computeRatePid(rateSetpointFor(rcDeflection[AXIS_PITCH]), tpa, gyroADC, AXIS_PITCH);
+    axisPID[AXIS_YAW]   = computeRatePid(rateSetpointFor(rcDeflection[AXIS_YAW]),   256, gyroADC, AXIS_YAW);
+
+    setpointsValid = true;
 }
 
 void Stabilize::resetIntegral(void)
@@ -54,6 +54,17 @@ class TimedTask {
 
             return (int32_t)(currentTime - usec) >= 0;
         }
+
+        // How far past its deadline the task is (negative if not yet due)
+        int32_t lateness(uint32_t currentTime) {
+
+            return (int32_t)(currentTime - usec);
+        }
+
+        uint32_t getPeriod(void) {
+
+            return period;
+        }
 };
 
 }
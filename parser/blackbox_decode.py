@@ -0,0 +1,139 @@
+#!/usr/bin/python3
+
+'''
+blackbox_decode.py Decodes a Hackflight blackbox log (see include/blackbox.hpp) into CSV
+
+Usage: blackbox_decode.py LOGFILE [CSVFILE]
+
+Copyright (C) Simon D. Levy 2017
+
+This program is part of Hackflight
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this code.  If not, see <http:#www.gnu.org/licenses/>.
+'''
+
+from sys import argv, exit, stdout
+
+MAGIC   = b'HFBB'
+VERSION = 1
+
+# Fields before the motors; angles are in tenths of a degree
+FIXED_FIELDS = ['time', 'gyroRoll', 'gyroPitch', 'gyroYaw', 'roll', 'pitch', 'yaw',
+                'rcRoll', 'rcPitch', 'rcYaw', 'rcThrottle', 'pidRoll', 'pidPitch', 'pidYaw']
+
+def error(errmsg):
+    print(errmsg)
+    exit(1)
+
+class Decoder(object):
+
+    def __init__(self, data):
+
+        self.data = data
+        self.pos = 0
+
+    def done(self):
+
+        return self.pos >= len(self.data)
+
+    def byte(self):
+
+        b = self.data[self.pos]
+        self.pos += 1
+        return b
+
+    def varint(self):
+
+        u = 0
+        shift = 0
+        while True:
+            b = self.byte()
+            u |= (b & 0x7F) << shift
+            shift += 7
+            if b < 0x80:
+                break
+
+        # Undo zigzag encoding
+        return (u >> 1) ^ -(u & 1)
+
+def to_int32(value):
+
+    value &= 0xFFFFFFFF
+    return value - (1 << 32) if value & 0x80000000 else value
+
+def decode(data, output):
+
+    decoder = Decoder(data)
+
+    session = 0
+    fields = None
+    previous = None
+
+    while not decoder.done():
+
+        marker = decoder.byte()
+
+        if marker == MAGIC[0]:
+
+            if bytes(decoder.data[decoder.pos:decoder.pos+3]) != MAGIC[1:]:
+                error('Bad header at byte %d' % (decoder.pos-1))
+            decoder.pos += 3
+
+            version = decoder.byte()
+            if version != VERSION:
+                error('Unsupported log version %d' % version)
+
+            count = decoder.byte()
+            motors = decoder.byte()
+            if count != len(FIXED_FIELDS) + motors:
+                error('Field count %d does not match %d motors' % (count, motors))
+
+            fields = FIXED_FIELDS + ['motor%d' % (k+1) for k in range(motors)]
+            previous = None
+            session += 1
+
+            output.write('session,' + ','.join(fields) + '\n')
+
+        elif marker in (ord('I'), ord('P')):
+
+            if fields is None:
+                error('Record before header at byte %d' % (decoder.pos-1))
+
+            values = [decoder.varint() for _ in fields]
+
+            if marker == ord('P'):
+                if previous is None:
+                    error('Predicted frame without an intra frame at byte %d' % (decoder.pos-1))
+                values = [to_int32(p + v) for (p,v) in zip(previous, values)]
+
+            previous = values
+
+            # Time wraps as an unsigned 32-bit counter
+            values[0] &= 0xFFFFFFFF
+
+            output.write('%d,' % session + ','.join([str(v) for v in values]) + '\n')
+
+        else:
+            error('Bad frame marker %d at byte %d' % (marker, decoder.pos-1))
+
+if __name__ == '__main__':
+
+    if len(argv) < 2:
+        error('Usage: %s LOGFILE [CSVFILE]' % argv[0])
+
+    data = open(argv[1], 'rb').read()
+
+    output = open(argv[2], 'w') if len(argv) > 2 else stdout
+
+    decode(data, output)
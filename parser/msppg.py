@@ -26,6 +26,7 @@ PYTHON_EXAMPLES = ['getimu', 'getrc', 'imudisplay', 'blueimudisplay', 'setrc']
 from sys import exit, argv
 import os
 import json
+import textwrap
 from pkg_resources import resource_string
 
 def clean(string):
@@ -40,6 +41,12 @@ def error(errmsg):
     print(errmsg)
     exit(1)
 
+def _isreply(msgid):
+
+    # As in MSPv1, IDs below 200 are replies from the FC and the rest are commands to it; the MSPv2-only
+    # IDs above 255 split the same way in each block of 256
+    return (msgid & 0xFF) < 200
+
 def _openw(fname):
 
     print('Creating file ' + fname)
@@ -67,7 +74,7 @@ class CodeEmitter(object):
         return cmt + ' AUTO-GENERATED CODE: DO NOT EDIT!!!\n\n'
 
     # Helper for writing parameter list with type declarations
-    def _write_params(self, outfile, argtypes, argnames, prefix = ''):
+    def _write_params(self, outfile, argtypes, argnames, prefix = '', suffix = ''):
 
         outfile.write('(')
         outfile.write(prefix)
@@ -75,8 +82,15 @@ class CodeEmitter(object):
             outfile.write(self.type2decl[argtype] + ' ' +  argname)
             if argname != argnames[-1]:
                 outfile.write(', ')
+        if suffix:
+            outfile.write((', ' if len(argnames) > 0 or prefix else '') + suffix)
         outfile.write(')')
 
+    # IDs above 255 won't fit in an MSPv1 frame, so their serializers always use MSPv2
+    def _v2arg(self, msgid, v2name, truename):
+
+        return truename if msgid > 255 else v2name
+
 
     def _paysize(self, argtypes):
 
@@ -135,7 +149,7 @@ class Python_Emitter(CodeEmitter):
         for msgtype in msgdict.keys():
             msgstuff = msgdict[msgtype]
             msgid = msgstuff[0]
-            if msgid < 200:
+            if _isreply(msgid):
                 self._write(4*self.indent + ('if self.message_id == %d:\n\n' % msgstuff[0]))
                 self._write(5*self.indent + ('if self.message_direction == 0:\n\n'))
                 self._write(6*self.indent + 'if hasattr(self, \'' +  msgtype + '_Request_Handler\'):\n\n')
@@ -155,7 +169,7 @@ class Python_Emitter(CodeEmitter):
             msgstuff = msgdict[msgtype]
             msgid = msgstuff[0]
 
-            if msgid < 200:
+            if _isreply(msgid):
 
                 self._write(self.indent + 'def set_%s_Handler(self, handler):\n\n' % msgtype) 
                 self._write(2*self.indent + "'''\n")
@@ -175,30 +189,37 @@ class Python_Emitter(CodeEmitter):
             msgstuff = msgdict[msgtype]
             msgid = msgstuff[0]
 
-            self._write('def serialize_' + msgtype + '(' + ', '.join(self._getargnames(msgstuff)) + '):\n\n')
+            self._write('def serialize_' + msgtype + '(' + ', '.join(self._getargnames(msgstuff) + ['v2=False']) + '):\n\n')
             self._write(self.indent + "'''\n")
-            self._write(self.indent + 'Serializes the contents of a message of type ' + msgtype + '.\n')
+            self._write(self.indent + 'Serializes the contents of a message of type ' + msgtype + ', as MSPv2 if v2 is set.\n')
             self._write(self.indent + "'''\n")
-            self._write(self.indent + 'message_buffer = struct.pack(\'')
+            # Standard sizes and no padding, as the parser unpacks them
+            self._write(self.indent + 'message_buffer = struct.pack(\'=')
             for argtype in self._getargtypes(msgstuff):
                 self._write(self.type2pack[argtype])
             self._write('\'')
             for argname in self._getargnames(msgstuff):
                 self._write(', ' + argname)
             self._write(')\n\n')
-            self._write(self.indent)
 
-            self._write('msg = chr(len(message_buffer)) + chr(%s) + str(message_buffer)\n\n' % msgid)
-            self._write(self.indent + 'return _bytes(\'$M%c\' + msg + chr(_CRC8(msg)))\n\n' %
-                    ('>' if msgid < 200 else '<'))
+            self._write(self.indent + 'return _frame(b\'%c\', %d, message_buffer, %s)\n\n' %
+                    ('>' if _isreply(msgid) else '<', msgid, self._v2arg(msgid, 'v2', 'True')))
 
-            if msgid < 200:
+            if _isreply(msgid):
 
-                self._write('def serialize_' + msgtype + '_Request():\n\n')
+                self._write('def serialize_' + msgtype + '_Request(v2=False):\n\n')
                 self._write(self.indent + "'''\n")
-                self._write(self.indent + 'Serializes a request for ' + msgtype + ' data.\n')
+                self._write(self.indent + 'Serializes a request for ' + msgtype + ' data, as MSPv2 if v2 is set.\n')
                 self._write(self.indent + "'''\n")
-                self._write(self.indent + 'return _bytes(\'$M<\' + chr(0) + chr(%s) + chr(%s))\n\n' % (msgid, msgid))
+                self._write(self.indent + 'return _frame(b\'<\', %d, b\'\', %s)\n\n' %
+                        (msgid, self._v2arg(msgid, 'v2', 'True')))
+
+        # Handler for each message the native parser hands back
+        self._write('_HANDLERS = {\n')
+        for msgtype in msgdict.keys():
+            if _isreply(msgdict[msgtype][0]):
+                self._write(self.indent + '%d : \'%s_Handler\',\n' % (msgdict[msgtype][0], msgtype))
+        self._write('}\n')
 
     def _write(self, s):
 
@@ -246,45 +267,53 @@ class CPP_Emitter(CodeEmitter):
             argtypes = self._getargtypes(msgstuff)
 
             self._hwrite(self.indent*2 + 'static MSP_Message serialize_%s' % msgtype)
-            self._write_params(self.houtput, argtypes, argnames)
-            self._write_params(self.ahoutput, argtypes, argnames)
+            self._write_params(self.houtput, argtypes, argnames, suffix='bool v2=false')
+            self._write_params(self.ahoutput, argtypes, argnames, suffix='bool v2=false')
+            self._hwrite(';\n\n')
+
+            # Writes the message into a caller's buffer; returns its length, or 0 if it won't fit
+            self._hwrite(self.indent*2 + 'static size_t serialize_%s_into' % msgtype)
+            self._write_params(self.houtput, argtypes, argnames, self._intoprefix(argnames), 'bool v2=false')
+            self._write_params(self.ahoutput, argtypes, argnames, self._intoprefix(argnames), 'bool v2=false')
             self._hwrite(';\n\n')
 
             # Write handler code for incoming messages
-            if msgid < 200:
+            if _isreply(msgid):
 
-                self._cwrite(5*self.indent + ('case %s: {\n\n' % msgdict[msgtype][0]))
+                self._cwrite(2*self.indent + ('case %s: {\n\n' % msgdict[msgtype][0]))
                 nargs = len(argnames)
                 offset = 0
                 for k in range(nargs):
                     argname = argnames[k]
                     argtype = argtypes[k]
                     decl = self.type2decl[argtype]
-                    self._cwrite(6*self.indent + decl  + ' ' + argname + ';\n')
-                    self._cwrite(6*self.indent + 
+                    self._cwrite(3*self.indent + decl  + ' ' + argname + ';\n')
+                    self._cwrite(3*self.indent + 
                             'memcpy(&%s,  &this->message_buffer[%d], sizeof(%s));\n\n' % 
                             (argname, offset, decl))
                     offset += self.type2size[argtype]
-                self._cwrite(6*self.indent + 'this->handlerFor%s->handle_%s(' % (msgtype, msgtype))
+                self._cwrite(3*self.indent + 'this->handlerFor%s->handle_%s(' % (msgtype, msgtype))
                 for k in range(nargs):
                     self._cwrite(argnames[k])
                     if k < nargs-1:
                         self._cwrite(', ')
                 self._cwrite(');\n')
-                self._cwrite(6*self.indent + '} break;\n\n')
+                self._cwrite(3*self.indent + '} break;\n\n')
                 
-                self._hwrite(self.indent*2 + 'static MSP_Message serialize_%s_Request();\n\n' % msgtype)
+                self._hwrite(self.indent*2 + 'static MSP_Message serialize_%s_Request(bool v2=false);\n\n' % msgtype)
                 self._hwrite(self.indent*2 + 
                         'void set_%s_Handler(class %s_Handler * handler);\n\n' % (msgtype, msgtype))
 
         self._hwrite(self.indent + 'private:\n\n')
 
+        self._hwrite(2*self.indent + 'void dispatch(void);\n\n')
+
         for msgtype in msgdict.keys():
 
             msgstuff = msgdict[msgtype]
             msgid = msgstuff[0]
             
-            if msgid < 200:
+            if _isreply(msgid):
                 self._hwrite(2*self.indent + 
                         'class %s_Handler * handlerFor%s;\n\n' % (msgtype, msgtype));
 
@@ -301,7 +330,7 @@ class CPP_Emitter(CodeEmitter):
             argtypes = self._getargtypes(msgstuff)
 
             # Incoming messages
-            if msgid < 200:
+            if _isreply(msgid):
 
                 # Declare handler class
                 self._hwrite('\n\n' + 'class %s_Handler {\n' % msgtype)
@@ -320,47 +349,56 @@ class CPP_Emitter(CodeEmitter):
                 self._cwrite('}\n\n')
 
                 # Write request method
-                self._cwrite('MSP_Message MSP_Parser::serialize_%s_Request() {\n\n' % msgtype)
+                self._cwrite('MSP_Message MSP_Parser::serialize_%s_Request(bool v2) {\n\n' % msgtype)
                 self._cwrite(self.indent + 'MSP_Message msg;\n\n')
-                self._cwrite(self.indent + 'msg.bytes[0] = 36;\n')
-                self._cwrite(self.indent + 'msg.bytes[1] = 77;\n')
-                self._cwrite(self.indent + 'msg.bytes[2] = %d;\n' % 60 if msgid < 200 else 62)
-                self._cwrite(self.indent + 'msg.bytes[3] = 0;\n')
-                self._cwrite(self.indent + 'msg.bytes[4] = %d;\n' % msgid)
-                self._cwrite(self.indent + 'msg.bytes[5] = %d;\n\n' % msgid)
-                self._cwrite(self.indent + 'msg.len = 6;\n\n')
+                self._cwrite(self.indent + 'msg.len = frame(msg.bytes, %s, 60, %d, 0);\n\n' % 
+                        (self._v2arg(msgid, 'v2', 'true'), msgid))
                 self._cwrite(self.indent + 'return msg;\n')
                 self._cwrite('}\n\n')
 
 
-            # Add parser method for serializing message
-            self._cwrite('MSP_Message MSP_Parser::serialize_%s' % msgtype)
-            self._write_params(self.coutput, argtypes, argnames)
-            self._write_params(self.acoutput, argtypes, argnames)
+            # Add parser method for serializing message into a buffer
+            self._cwrite('size_t MSP_Parser::serialize_%s_into' % msgtype)
+            self._write_params(self.coutput, argtypes, argnames, self._intoprefix(argnames), 'bool v2')
+            self._write_params(self.acoutput, argtypes, argnames, self._intoprefix(argnames), 'bool v2')
             self._cwrite(' {\n\n')
-            self._cwrite(self.indent + 'MSP_Message msg;\n\n')
             msgsize = self._msgsize(argtypes)
-            self._cwrite(self.indent + 'msg.bytes[0] = 36;\n')
-            self._cwrite(self.indent + 'msg.bytes[1] = 77;\n')
-            self._cwrite(self.indent + 'msg.bytes[2] = 62;\n')
-            self._cwrite(self.indent + 'msg.bytes[3] = %d;\n' % msgsize)
-            self._cwrite(self.indent + 'msg.bytes[4] = %d;\n\n' % msgid)
+            if msgid > 255:
+                self._cwrite(self.indent + 'v2 = true;\n\n')
+            self._cwrite(self.indent + 'size_t headerSize = v2 ? 8 : 5;\n\n')
+            self._cwrite(self.indent + 'if (cap < headerSize + %d) {\n' % (msgsize+1))
+            self._cwrite(2*self.indent + 'return 0;\n')
+            self._cwrite(self.indent + '}\n\n')
             nargs = len(argnames)
-            offset = 5
+            offset = 0
             for k in range(nargs):
                 argname = argnames[k]
                 argtype = argtypes[k]
                 decl = self.type2decl[argtype]
                 self._cwrite(self.indent + 
-                        'memcpy(&msg.bytes[%d], &%s, sizeof(%s));\n' %  (offset, argname, decl))
+                        'memcpy(&out[headerSize+%d], &%s, sizeof(%s));\n' %  (offset, argname, decl))
                 offset += self.type2size[argtype]
-            self._cwrite('\n')
-            self._cwrite(self.indent + 
-                    'msg.bytes[%d] = CRC8(&msg.bytes[3], %d);\n\n' % (msgsize+5, msgsize+2))
-            self._cwrite(self.indent + 'msg.len = %d;\n\n' % (msgsize+6))
+            if nargs > 0:
+                self._cwrite('\n')
+            self._cwrite(self.indent + 'return frame(out, v2, %d, %d, %d);\n' % 
+                    (62 if _isreply(msgid) else 60, msgid, msgsize))
+            self._cwrite('}\n\n')
+
+            # Add parser method for serializing message
+            self._cwrite('MSP_Message MSP_Parser::serialize_%s' % msgtype)
+            self._write_params(self.coutput, argtypes, argnames, suffix='bool v2')
+            self._write_params(self.acoutput, argtypes, argnames, suffix='bool v2')
+            self._cwrite(' {\n\n')
+            self._cwrite(self.indent + 'MSP_Message msg;\n\n')
+            self._cwrite(self.indent + 'msg.len = serialize_%s_into(%s);\n\n' % 
+                    (msgtype, ', '.join(['msg.bytes', 'MAXBUF'] + argnames + ['v2'])))
             self._cwrite(self.indent + 'return msg;\n')
             self._cwrite('}\n\n')
  
+    def _intoprefix(self, argnames):
+
+        return 'byte * out, size_t cap' + (', ' if len(argnames) > 0 else '')
+
     def _cwrite(self, s):
 
         self.coutput.write(s)
@@ -371,6 +409,181 @@ class CPP_Emitter(CodeEmitter):
         self.houtput.write(s)
         self.ahoutput.write(s)
 
+# Header-only C++ emitter ===========================================================================
+
+class CPP_Static_Emitter(CodeEmitter):
+
+    def __init__(self, msgdict):
+
+        # Goes out alongside MSPPG.h, which the Makefile already covers
+        self.indent = '    '
+
+        self.type2size = {'byte': 1, 'short' : 2, 'float' : 4, 'int' : 4}
+        self.type2decl = {'byte': 'uint8_t', 'short' : 'int16_t', 'float' : 'float', 'int' : 'int32_t'}
+
+        self._copyfile('example-static.cpp', 'cpp/example-static.cpp')
+
+        self.output = _openw('output/cpp/msppg/msppg.hpp')
+
+        self._write(self.warning('//'))
+
+        self._write(self._getsrc('top-static-hpp'))
+
+        # Order by ID, as the firmware's table is
+        msgtypes = sorted(msgdict.keys(), key=lambda msgtype: msgdict[msgtype][0])
+
+        for msgtype in msgtypes:
+
+            msgstuff = msgdict[msgtype]
+            msgid = msgstuff[0]
+
+            argnames = self._getargnames(msgstuff)
+            argtypes = self._getargtypes(msgstuff)
+            nargs = len(argnames)
+            msgsize = self._msgsize(argtypes)
+
+            for argname,argtype in zip(msgstuff[1], msgstuff[2]):
+                if argname.lower() == 'comment':
+                    for line in textwrap.wrap(argtype, 104):
+                        self._write('// %s\n' % line)
+
+            self._write('struct %s {\n\n' % msgtype)
+            self._write(self.indent + 'enum { ID = %d, SIZE = %d };\n\n' % (msgid, msgsize))
+
+            for argname,argtype in zip(argnames, argtypes):
+                self._write(self.indent + '%-7s %s;\n' % (self.type2decl[argtype], argname))
+            if nargs > 0:
+                self._write('\n')
+
+            # A payload from the wire, at least SIZE bytes of it
+            self._write(self.indent + 'static %s decode(const uint8_t * payload)\n' % msgtype)
+            self._write(self.indent + '{\n')
+            self._write(2*self.indent + '%s message;\n' % msgtype)
+            if nargs > 0:
+                self._write('#if MSPPG_BIG_ENDIAN\n')
+                offset = 0
+                for argname,argtype in zip(argnames, argtypes):
+                    self._write(2*self.indent + 'detail::get(&payload[%d], message.%s);\n' % (offset, argname))
+                    offset += self.type2size[argtype]
+                self._write('#else\n')
+                self._write(2*self.indent + 'memcpy(&message, payload, SIZE);\n')
+                self._write('#endif\n')
+            else:
+                self._write(2*self.indent + '(void)payload;\n')
+            self._write(2*self.indent + 'return message;\n')
+            self._write(self.indent + '}\n\n')
+
+            # The whole frame into out; returns its length, or 0 if it won't fit
+            self._write(self.indent + 'size_t serialize(uint8_t * out, size_t cap, bool v2=false) const\n')
+            self._write(self.indent + '{\n')
+            self._write(2*self.indent + 'return frame(out, cap, %s, %d);\n' %
+                    (self._v2arg(msgid, 'v2', 'true'), 62 if _isreply(msgid) else 60))
+            self._write(self.indent + '}\n\n')
+
+            if _isreply(msgid):
+                self._write(self.indent + '// Asks the FC for one\n')
+                self._write(self.indent + 'static size_t request(uint8_t * out, size_t cap, bool v2=false)\n')
+                self._write(self.indent + '{\n')
+                self._write(2*self.indent + 'return cap < 9 ? 0 : detail::frame(out, %s, 60, ID, 0);\n' %
+                        self._v2arg(msgid, 'v2', 'true'))
+                self._write(self.indent + '}\n\n')
+
+            self._write(self.indent + 'private:\n\n')
+            self._write(self.indent + 'size_t frame(uint8_t * out, size_t cap, bool v2, uint8_t direction) const\n')
+            self._write(self.indent + '{\n')
+            self._write(2*self.indent + 'size_t headerSize = v2 ? 8 : 5;\n\n')
+            self._write(2*self.indent + 'if (cap < headerSize + SIZE + 1) {\n')
+            self._write(3*self.indent + 'return 0;\n')
+            self._write(2*self.indent + '}\n\n')
+            if nargs > 0:
+                self._write('#if MSPPG_BIG_ENDIAN\n')
+                offset = 0
+                for argname,argtype in zip(argnames, argtypes):
+                    self._write(2*self.indent + 'detail::put(&out[headerSize+%d], %s);\n' % (offset, argname))
+                    offset += self.type2size[argtype]
+                self._write('#else\n')
+                self._write(2*self.indent + 'memcpy(&out[headerSize], this, SIZE);\n')
+                self._write('#endif\n\n')
+            self._write(2*self.indent + 'return detail::frame(out, v2, direction, ID, SIZE);\n')
+            self._write(self.indent + '}\n')
+
+            self._write('};\n\n')
+
+            # An empty struct is still a byte long
+            if nargs > 0:
+                self._write('static_assert(sizeof(%s) == %s::SIZE, "%s is not packed");\n\n' %
+                        (msgtype, msgtype, msgtype))
+
+        self._write(self._getsrc('middle-static-hpp'))
+
+        for msgtype in msgtypes:
+
+            msgid = msgdict[msgtype][0]
+
+            self._write(2*self.indent + 'case %s::ID:\n' % msgtype)
+            self._write(3*self.indent + '%s<%s>();\n' % ('reply' if _isreply(msgid) else 'command', msgtype))
+            self._write(3*self.indent + 'break;\n\n')
+
+        self._write(self._getsrc('bottom-static-hpp'))
+
+        self.output.close()
+
+    def _write(self, s):
+
+        self.output.write(s)
+
+# Python extension emitter =========================================================================
+
+class Python_Native_Emitter(CodeEmitter):
+
+    def __init__(self, msgdict):
+
+        # Builds on the header-only C++, which must have been emitted already
+        self.indent = '    '
+
+        self.type2build = {'byte': 'B', 'short' : 'h', 'float' : 'f', 'int' : 'i'}
+
+        self._copyfile_from('output/cpp/msppg/msppg.hpp', 'python/msppg/msppg.hpp')
+
+        self.output = _openw('output/python/msppg/_native.cpp')
+
+        self._write(self.warning('//'))
+
+        self._write(self._getsrc('top-native-cpp'))
+
+        msgtypes = sorted(msgdict.keys(), key=lambda msgtype: msgdict[msgtype][0])
+
+        for msgtype in msgtypes:
+
+            msgstuff = msgdict[msgtype]
+            msgid = msgstuff[0]
+
+            if _isreply(msgid):
+
+                argnames = self._getargnames(msgstuff)
+                argtypes = self._getargtypes(msgstuff)
+
+                self._write(self.indent + 'void operator()(const msppg::%s & m)\n' % msgtype)
+                self._write(self.indent + '{\n')
+                self._write(2*self.indent + 'add(msppg::%s::ID, Py_BuildValue("(%s)"%s));\n' % 
+                        (msgtype, ''.join([self.type2build[argtype] for argtype in argtypes]),
+                            ''.join([', m.' + argname for argname in argnames])))
+                self._write(self.indent + '}\n\n')
+
+        self._write(self._getsrc('bottom-native-cpp'))
+
+        self.output.close()
+
+    def _copyfile_from(self, src, dst):
+
+        outfile = _openw('output/' + dst)
+        outfile.write(open(src).read())
+        outfile.close()
+
+    def _write(self, s):
+
+        self.output.write(s)
+
 # C emitter ===============================================================================
 
 class C_Emitter(CodeEmitter):
@@ -395,7 +608,7 @@ class C_Emitter(CodeEmitter):
             msgstuff = msgdict[msgtype]
             msgid = msgstuff[0]
 
-            if msgid < 200:
+            if _isreply(msgid):
 
                 argnames = self._getargnames(msgstuff)
                 argtypes = self._getargtypes(msgstuff)
@@ -417,11 +630,11 @@ class C_Emitter(CodeEmitter):
             argtypes = self._getargtypes(msgstuff)
 
             self._hwrite('msp_message_t msp_serialize_%s' % msgtype)
-            self._write_params(self.houtput, argtypes, argnames)
+            self._write_params(self.houtput, argtypes, argnames, suffix='bool v2')
             self._hwrite(';\n\n')
 
             # Write handler code for incoming messages
-            if msgid < 200:
+            if _isreply(msgid):
 
                 self._cwrite(5*self.indent + ('case %s: {\n\n' % msgdict[msgtype][0]))
                 nargs = len(argnames)
@@ -443,12 +656,12 @@ class C_Emitter(CodeEmitter):
                 self._cwrite(');\n')
                 self._cwrite(6*self.indent + '} break;\n\n')
                 
-                self._hwrite('msp_message_t msp_serialize_%s_request();\n\n' % msgtype)
+                self._hwrite('msp_message_t msp_serialize_%s_request(bool v2);\n\n' % msgtype)
                 self._hwrite('void msp_set_%s_handler(msp_parser_t * parser, void (*handler)' % msgtype)
                 self._write_params(self.houtput, argtypes, argnames)
                 self._hwrite(');\n\n')
 
-        self._cwrite(self._getsrc('bottom-cpp'))
+        self._cwrite(self._getsrc('bottom-c'))
  
         for msgtype in msgdict.keys():
 
@@ -459,7 +672,7 @@ class C_Emitter(CodeEmitter):
             argtypes = self._getargtypes(msgstuff)
 
             # Incoming messages
-            if msgid < 200:
+            if _isreply(msgid):
 
                 # Write handler method
                 self._cwrite('void msp_set_%s_handler(msp_parser_t * parser, void (*handler)' % msgtype)
@@ -469,42 +682,36 @@ class C_Emitter(CodeEmitter):
                 self._cwrite('}\n\n')
 
                 # Write request method
-                self._cwrite('msp_message_t serialize_%s_Request() {\n\n' % msgtype)
+                self._cwrite('msp_message_t msp_serialize_%s_request(bool v2) {\n\n' % msgtype)
                 self._cwrite(self.indent + 'msp_message_t msg;\n\n')
-                self._cwrite(self.indent + 'msg.bytes[0] = 36;\n')
-                self._cwrite(self.indent + 'msg.bytes[1] = 77;\n')
-                self._cwrite(self.indent + 'msg.bytes[2] = %d;\n' % 60 if msgid < 200 else 62)
-                self._cwrite(self.indent + 'msg.bytes[3] = 0;\n')
-                self._cwrite(self.indent + 'msg.bytes[4] = %d;\n' % msgid)
-                self._cwrite(self.indent + 'msg.bytes[5] = %d;\n\n' % msgid)
-                self._cwrite(self.indent + 'msg.len = 6;\n\n')
+                self._cwrite(self.indent + 'msp_frame(&msg, %s, 60, %d, 0);\n\n' % 
+                        (self._v2arg(msgid, 'v2', '1'), msgid))
                 self._cwrite(self.indent + 'return msg;\n')
                 self._cwrite('}\n\n')
 
             # Add parser method for serializing message
             self._cwrite('msp_message_t msp_serialize_%s' % msgtype)
-            self._write_params(self.coutput, argtypes, argnames)
+            self._write_params(self.coutput, argtypes, argnames, suffix='bool v2')
             self._cwrite(' {\n\n')
             self._cwrite(self.indent + 'msp_message_t msg;\n\n')
             msgsize = self._msgsize(argtypes)
-            self._cwrite(self.indent + 'msg.bytes[0] = 36;\n')
-            self._cwrite(self.indent + 'msg.bytes[1] = 77;\n')
-            self._cwrite(self.indent + 'msg.bytes[2] = 62;\n')
-            self._cwrite(self.indent + 'msg.bytes[3] = %d;\n' % msgsize)
-            self._cwrite(self.indent + 'msg.bytes[4] = %d;\n\n' % msgid)
+            if msgid > 255:
+                self._cwrite(self.indent + 'v2 = 1;\n\n')
             nargs = len(argnames)
-            offset = 5
+            if nargs > 0:
+                self._cwrite(self.indent + 'int headerSize = v2 ? 8 : 5;\n\n')
+            offset = 0
             for k in range(nargs):
                 argname = argnames[k]
                 argtype = argtypes[k]
                 decl = self.type2decl[argtype]
                 self._cwrite(self.indent + 
-                        'memcpy(&msg.bytes[%d], &%s, sizeof(%s));\n' %  (offset, argname, decl))
+                        'memcpy(&msg.bytes[headerSize+%d], &%s, sizeof(%s));\n' %  (offset, argname, decl))
                 offset += self.type2size[argtype]
-            self._cwrite('\n')
-            self._cwrite(self.indent + 
-                    'msg.bytes[%d] = CRC8(&msg.bytes[3], %d);\n\n' % (msgsize+5, msgsize+2))
-            self._cwrite(self.indent + 'msg.len = %d;\n\n' % (msgsize+6))
+            if nargs > 0:
+                self._cwrite('\n')
+            self._cwrite(self.indent + 'msp_frame(&msg, v2, %d, %d, %d);\n\n' % 
+                    (62 if _isreply(msgid) else 60, msgid, msgsize))
             self._cwrite(self.indent + 'return msg;\n')
             self._cwrite('}\n\n')
  
@@ -546,9 +753,9 @@ class Java_Emitter(CodeEmitter):
             msgstuff = msgdict[msgtype]
             msgid = msgstuff[0]
 
-            if msgid < 200:
+            if _isreply(msgid):
 
-                self._write(6*self.indent + 'case (byte)%d:\n' % msgid)
+                self._write(6*self.indent + 'case %d:\n' % msgid)
                 self._write(7*self.indent + 'if (this.%s_handler != null) {\n' % msgtype)
                 self._write(8*self.indent + 'this.%s_handler.handle_%s(\n' % (msgtype, msgtype));
 
@@ -580,7 +787,7 @@ class Java_Emitter(CodeEmitter):
             argtypes = self._getargtypes(msgstuff)
 
             # For messages from FC
-            if msgid < 200:
+            if _isreply(msgid):
 
                 # Declare handler
                 self._write(self.indent + 'private %s_Handler %s_handler;\n\n' % (msgtype, msgtype))
@@ -589,43 +796,32 @@ class Java_Emitter(CodeEmitter):
                 self._write(2*self.indent + 'this.%s_handler = handler;\n' % msgtype)
                 self._write(self.indent + '}\n\n')
 
-                # Write serializer for requests
+                # Write serializers for requests, MSPv1 unless asked for MSPv2
                 self._write(self.indent + 'public byte [] serialize_%s_Request() {\n\n' % msgtype)
-                paysize = self._paysize(argtypes)
-                msgsize = self._msgsize(argtypes)
-                self._write('\n' + 2*self.indent + 'byte [] message = new byte[6];\n\n')
-                self._write(2*self.indent + 'message[0] = 36;\n')
-                self._write(2*self.indent + 'message[1] = 77;\n')
-                self._write(2*self.indent + 'message[2] = 60;\n')
-                self._write(2*self.indent + 'message[3] = 0;\n')
-                self._write(2*self.indent + 'message[4] = (byte)%d;\n' % msgid)
-                self._write(2*self.indent + 'message[5] = (byte)%d;\n\n' % msgid)
-                self._write(2*self.indent + 'return message;\n')
+                self._write(2*self.indent + 'return serialize_%s_Request(%s);\n' % 
+                        (msgtype, self._v2arg(msgid, 'false', 'true')))
+                self._write(self.indent + '}\n\n')
+                self._write(self.indent + 'public byte [] serialize_%s_Request(boolean v2) {\n\n' % msgtype)
+                self._write(2*self.indent + 'return frame(%s, 60, %d, new byte[0]);\n' % 
+                        (self._v2arg(msgid, 'v2', 'true'), msgid))
                 self._write(self.indent + '}\n\n')
 
-            # Write serializer method for messages from FC
+            # Write serializer methods for messages from FC
             self._write(self.indent + 'public byte [] serialize_%s' % msgtype)
             self._write_params(self.output, argtypes, argnames)
             self._write(' {\n\n')
+            self._write(2*self.indent + 'return serialize_%s(%s);\n' % 
+                    (msgtype, ', '.join(argnames + [self._v2arg(msgid, 'false', 'true')])))
+            self._write(self.indent + '}\n\n')
+            self._write(self.indent + 'public byte [] serialize_%s' % msgtype)
+            self._write_params(self.output, argtypes, argnames, suffix='boolean v2')
+            self._write(' {\n\n')
             paysize = self._paysize(argtypes)
-            msgsize = self._msgsize(argtypes)
             self._write(2*self.indent + 'ByteBuffer bb = newByteBuffer(%d);\n\n' % paysize)
             for (argname,argtype) in zip(argnames,argtypes):
                 self._write(2*self.indent + 'bb.put%s(%s);\n' % (self.type2bb[argtype], argname))
-            self._write('\n' + 2*self.indent + 'byte [] message = new byte[%d];\n' % (msgsize+6))
-            self._write(2*self.indent + 'message[0] = 36;\n')
-            self._write(2*self.indent + 'message[1] = 77;\n')
-            self._write(2*self.indent + 'message[2] = %d;\n' % (62 if msgid < 200 else 60))
-            self._write(2*self.indent + 'message[3] = %d;\n' % msgsize)
-            self._write(2*self.indent + 'message[4] = (byte)%d;\n' %msgdict[msgtype][0]) 
-            self._write(2*self.indent + 'byte [] data = bb.array();\n')
-            self._write(2*self.indent + 'int k;\n')
-            self._write(2*self.indent + 'for (k=0; k<data.length; ++k) {\n')
-            self._write(3*self.indent + 'message[k+5] = data[k];\n')
-            self._write(2*self.indent + '}\n\n')
-            self._write(2*self.indent + 'message[%d] = CRC8(message, 3, %d);\n\n' % 
-                    (msgsize+5, msgsize+4))
-            self._write(2*self.indent + 'return message;\n')
+            self._write('\n' + 2*self.indent + 'return frame(%s, %d, %d, bb.array());\n' % 
+                    (self._v2arg(msgid, 'v2', 'true'), 62 if _isreply(msgid) else 60, msgid))
             self._write(self.indent + '}\n\n')
 
         self._write('}')
@@ -638,7 +834,7 @@ class Java_Emitter(CodeEmitter):
             msgstuff = msgdict[msgtype]
             msgid = msgstuff[0]
 
-            if msgid < 200:
+            if _isreply(msgid):
 
                 argnames = self._getargnames(msgstuff)
                 argtypes = self._getargtypes(msgstuff)
@@ -656,6 +852,65 @@ class Java_Emitter(CodeEmitter):
 
         self.output.write(s)
 
+# Firmware emitter ========================================================================
+
+class Firmware_Emitter(CodeEmitter):
+
+    def __init__(self, msgdict):
+
+        # No Makefile: the header is copied into the firmware's include directory
+        mkdir_if_missing('output/firmware')
+
+        self.indent = '    '
+
+        self.output = _openw('output/firmware/mspcommands.hpp')
+
+        self._write(self.warning('//'))
+
+        self._write('#pragma once\n\n')
+        self._write('#include <cstdint>\n\n')
+
+        # Order by ID, so that the dispatch slots don't depend on the order of the JSON file
+        msgtypes = sorted(msgdict.keys(), key=lambda msgtype: msgdict[msgtype][0])
+
+        for msgtype in msgtypes:
+            self._write('#define MSP_%-20s %d\n' % (msgtype, msgdict[msgtype][0]))
+
+        # IDs above 255 (MSPv2 only) are few, so they get a switch rather than a bigger table
+        slots = [len(msgtypes)] * 256
+        extended = []
+        for slot,msgtype in enumerate(msgtypes):
+            msgid = msgdict[msgtype][0]
+            if msgid < 256:
+                slots[msgid] = slot
+            else:
+                extended.append((msgid, slot))
+
+        self._write('\nnamespace hf {\n\n')
+        self._write('static const uint8_t MSP_COMMAND_COUNT = %d;\n\n' % len(msgtypes))
+        self._write('// Dispatch-table slot for each command ID; MSP_COMMAND_COUNT means no such command\n')
+        self._write('static const uint8_t MSP_COMMAND_SLOTS[256] = {\n')
+        for k in range(0, 256, 16):
+            self._write(self.indent + ', '.join(['%2d' % slot for slot in slots[k:k+16]]) + ',\n')
+        self._write('};\n\n')
+        self._write('// Slot for any command ID, the MSPv2-only ones above 255 included\n')
+        self._write('static inline uint8_t mspCommandSlot(uint16_t command)\n')
+        self._write('{\n')
+        if extended:
+            self._write(self.indent + 'switch (command) {\n')
+            for msgid,slot in extended:
+                self._write(2*self.indent + 'case %d: return %d;\n' % (msgid, slot))
+            self._write(self.indent + '}\n\n')
+        self._write(self.indent + 'return command < 256 ? MSP_COMMAND_SLOTS[command] : MSP_COMMAND_COUNT;\n')
+        self._write('}\n\n')
+        self._write('} // namespace\n')
+
+        self.output.close()
+
+    def _write(self, s):
+
+        self.output.write(s)
+
 # main ===============================================================================================
 
 if __name__ == '__main__':
@@ -692,6 +947,8 @@ if __name__ == '__main__':
             argument_lists.append(argnames)
         if msgid is None:
             error('Missing ID for message ' + msgtype)
+        if msgid < 0 or msgid > 0xFFFF:
+            error('ID for message ' + msgtype + ' does not fit in 16 bits')
         argument_types.append(argtypes)
         msgdict[msgtype] = (msgid, argnames, argtypes)
 
@@ -703,9 +960,16 @@ if __name__ == '__main__':
 
     # Emit C++
     CPP_Emitter(msgdict)
+    CPP_Static_Emitter(msgdict)
+
+    # Emit the Python extension wrapping it
+    Python_Native_Emitter(msgdict)
 
     # Emit C
     C_Emitter(msgdict)
 
     # Emite Java
     Java_Emitter(msgdict)
+
+    # Emit firmware dispatch table
+    Firmware_Emitter(msgdict)
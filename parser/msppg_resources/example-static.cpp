@@ -0,0 +1,49 @@
+/*
+Example for testing the header-only C++ output of MSPPG
+
+Copyright (C) Simon D. Levy 2015
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as 
+published by the Free Software Foundation, either version 3 of the 
+License, or (at your option) any later version.
+This code is distributed in the hope that it will be useful,     
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License 
+along with this code.  If not, see <http:#www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+
+#include "msppg/msppg.hpp"
+
+int main(int argc, char ** argv) {
+
+    auto handler = msppg::handlers(
+
+        [](const msppg::ATTITUDE & attitude) {
+            printf("%+3d %+3d %+3d\n", attitude.roll, attitude.pitch, attitude.yaw);
+        },
+
+        [](const msppg::HIL_MOTORS & motors) {
+            printf("%d %d %d %d\n", motors.m1, motors.m2, motors.m3, motors.m4);
+        });
+
+    msppg::Parser<decltype(handler)> parser(handler);
+
+    msppg::ATTITUDE attitude = {59, 76, 1};
+
+    uint8_t buf[msppg::MAXBUF];
+
+    size_t len = attitude.serialize(buf, sizeof(buf));
+
+    for (size_t k=0; k<len; ++k) {
+
+        parser.parse(buf[k]);
+    }
+
+    return 0;
+}
@@ -30,7 +30,8 @@ int main(int argc, char ** argv) {
 
     msp_parser_init(&parser);
 
-    msp_message_t message = msp_serialize_ATTITUDE(59, 76, 1);
+    // Last argument zero for MSP v1 framing, nonzero for v2
+    msp_message_t message = msp_serialize_ATTITUDE(59, 76, 1, 0);
 
     msp_set_ATTITUDE_handler(&parser, handle_attitude);
 
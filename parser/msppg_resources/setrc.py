@@ -32,7 +32,11 @@ PWM_MAX         = 2000
 CHANNEL_NEUTRAL       = 1500
 CHANNEL_AUTOPILOT     = 1600
 
-from msppg import MSP_Parser as Parser, serialize_SET_RAW_RC, serialize_RC_Request
+# Commands are sequenced, so the firmware doesn't answer each one; it reports what got through at this rate
+ACK_RATE_HZ = 5
+ACK_ID      = 115   # should agree with messages.json
+
+from msppg import MSP_Parser as Parser, serialize_SET_RAW_RC, serialize_RC_Request, serialize_SET_STREAM
 import serial
 import time
 from sys import argv
@@ -58,6 +62,15 @@ class SetterThread(threading.Thread):
 
         self.getter = getter
 
+        self.seq = 0
+
+    # Counts from one, skips zero (an unsequenced command) when it wraps, and goes out as a signed short
+    def _next_seq(self):
+
+        self.seq = self.seq % 0xFFFF + 1
+
+        return self.seq if self.seq < 0x8000 else self.seq - 0x10000
+
     def setter(self):
 
         while(True):
@@ -68,7 +81,7 @@ class SetterThread(threading.Thread):
 
                 # Make the vehicle pitch forward on autopilot
                 message = serialize_SET_RAW_RC(getter.c1, CHANNEL_AUTOPILOT, getter.c3, getter.c4, 
-                            CHANNEL_NEUTRAL, 0, 0, 0)
+                            CHANNEL_NEUTRAL, 0, 0, 0, self._next_seq())
                 port.write(message)
 
             time.sleep(1./UPDATE_RATE_HZ)
@@ -85,6 +98,10 @@ class Getter:
 
         parser.set_RC_Handler(self.get)
 
+        parser.set_ACK_Handler(self.ack)
+        port.write(serialize_SET_STREAM(ACK_ID, ACK_RATE_HZ))
+        self.lost = 0
+
         self.autopilot = False
         self.offtime = 0
         self.timestart = time.time()
@@ -94,6 +111,16 @@ class Getter:
         print(msg)
         exit(1)
 
+    # Counters other than accepted saturate at 0xFFFF, but come in as signed shorts
+    def ack(self, seq, accepted, gaps, stale, rxErrors, txDropped):
+
+        lost = (gaps & 0xFFFF) + (stale & 0xFFFF) + (rxErrors & 0xFFFF)
+
+        if lost != self.lost:
+            print('%d commands accepted, %d missing, %d stale, %d bad frames, %d replies dropped' % 
+                    (accepted, gaps & 0xFFFF, stale & 0xFFFF, rxErrors & 0xFFFF, txDropped & 0xFFFF))
+            self.lost = lost
+
     def get(self, c1, c2, c3, c4, c5, c6, c7, c8):
 
         # Store stick values
@@ -16,7 +16,15 @@ You should have received a copy of the GNU Lesser General Public License
 along with this code.  If not, see <http:#www.gnu.org/licenses/>.
 '''
 
-from distutils.core import setup
+try:
+    from setuptools import setup, Extension
+except ImportError:
+    from distutils.core import setup, Extension
+
+# Optional: without a C++11 compiler and the Python headers, MSP_Parser parses in Python
+native = Extension('msppg._native', ['msppg/_native.cpp'], include_dirs=['msppg'], 
+        extra_compile_args=['-std=c++11'], optional=True)
 
 setup(name = 'msppg',
-      packages = ['msppg'])
+      packages = ['msppg'],
+      ext_modules = [native])
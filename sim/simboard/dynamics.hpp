@@ -0,0 +1,228 @@
+/*
+   dynamics.hpp : rigid-body multirotor model for the headless simulator
+
+   State is kept in the usual aerospace frames: the world is north-east-down, and the body is
+   forward-right-down, so roll is right wing down, pitch is nose up and yaw is clockwise from
+   above.  Motor forces and torques come from the firmware's own mixer table, so the model
+   flies whatever frame CONFIG_MIXER_FRAME selects with signs that match the mixer.  Each
+   motor's speed lags its command with a first-order time constant, and thrust goes as speed
+   squared.  Integration is semi-implicit Euler at a fixed step, so a run is repeatable.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstring>
+
+#include "mixer.hpp"
+
+namespace hf {
+
+struct DynamicsParams {
+
+    double mass          = 1.0;     // kg
+    double ixx           = 0.010;   // kg m^2
+    double iyy           = 0.010;
+    double izz           = 0.018;
+    double arm           = 0.10;    // m of lever per unit of mixer roll/pitch coefficient
+    double maxThrust     = 12.0;    // N per motor at full command
+    double torqueRatio   = 0.016;   // yaw reaction torque per unit thrust, m
+    double motorTau      = 0.020;   // s
+    double linearDrag    = 0.10;    // N per m/s
+    double angularDrag   = 0.002;   // N m per rad/s
+};
+
+class Dynamics {
+
+    public:
+
+        static const uint8_t MOTORS = VehicleMixer::MOTORS;
+
+        void init(const DynamicsParams & params);
+
+        // Motor commands in [0,1]
+        void setMotors(const double commands[MOTORS]);
+
+        // Extra body-frame torque (N m), e.g. a gust or an unbalanced prop
+        void setDisturbance(const double torque[3]);
+
+        void step(double dt);
+
+        // Roll, pitch, yaw in radians
+        void getEulerAngles(double euler[3]);
+
+        // Body rates p, q, r in rad/s
+        void getBodyRates(double rates[3]);
+
+        // Altitude in m (up is positive), and world-frame position (m) and velocity (m/s), NED
+        double getAltitude(void) { return -position[2]; }
+        void   getPosition(double p[3]) { memcpy(p, position, sizeof(position)); }
+        void   getVelocity(double v[3]) { memcpy(v, velocity, sizeof(velocity)); }
+
+        // Normalized motor speed in [0,1]
+        double getMotorSpeed(uint8_t index) { return speeds[index]; }
+
+        bool   isOnGround(void) { return onGround; }
+
+    private:
+
+        DynamicsParams params;
+
+        double position[3];
+        double velocity[3];
+        double quat[4];       // w, x, y, z: body to world
+        double rates[3];
+
+        double commands[MOTORS];
+        double speeds[MOTORS];  // normalized to [0,1]
+
+        double disturbance[3];
+
+        bool   onGround;
+
+        void rotateToWorld(const double body[3], double world[3]);
+};
+
+/********************************************* CPP ********************************************************/
+
+void Dynamics::init(const DynamicsParams & _params)
+{
+    params = _params;
+
+    memset(position, 0, sizeof(position));
+    memset(velocity, 0, sizeof(velocity));
+    memset(rates, 0, sizeof(rates));
+    memset(commands, 0, sizeof(commands));
+    memset(speeds, 0, sizeof(speeds));
+    memset(disturbance, 0, sizeof(disturbance));
+
+    quat[0] = 1;
+    quat[1] = quat[2] = quat[3] = 0;
+
+    onGround = true;
+}
+
+void Dynamics::setMotors(const double _commands[MOTORS])
+{
+    for (uint8_t i=0; i<MOTORS; ++i)
+        commands[i] = _commands[i] < 0 ? 0 : (_commands[i] > 1 ? 1 : _commands[i]);
+}
+
+void Dynamics::setDisturbance(const double torque[3])
+{
+    memcpy(disturbance, torque, sizeof(disturbance));
+}
+
+void Dynamics::rotateToWorld(const double b[3], double w[3])
+{
+    double qw = quat[0], qx = quat[1], qy = quat[2], qz = quat[3];
+
+    w[0] = (1 - 2*(qy*qy + qz*qz))*b[0] + 2*(qx*qy - qw*qz)*b[1] + 2*(qx*qz + qw*qy)*b[2];
+    w[1] = 2*(qx*qy + qw*qz)*b[0] + (1 - 2*(qx*qx + qz*qz))*b[1] + 2*(qy*qz - qw*qx)*b[2];
+    w[2] = 2*(qx*qz - qw*qy)*b[0] + 2*(qy*qz + qw*qx)*b[1] + (1 - 2*(qx*qx + qy*qy))*b[2];
+}
+
+void Dynamics::step(double dt)
+{
+    // Motor speeds follow their commands
+    double alpha = dt / (params.motorTau + dt);
+
+    double thrust = 0;
+    double torque[3] = {disturbance[0], disturbance[1], disturbance[2]};
+
+    for (uint8_t i=0; i<MOTORS; ++i) {
+
+        speeds[i] += alpha * (commands[i] - speeds[i]);
+
+        double t = params.maxThrust * speeds[i] * speeds[i];
+
+        const motorMixer_t & m = CONFIG_MIXER_FRAME::table[i];
+
+        // Mixer roll lifts the left side (positive roll); mixer pitch lifts the rear (nose down, negative
+        // pitch); mixer yaw is subtracted, so motors with negative yaw turn the vehicle clockwise
+        thrust    += t;
+        torque[0] += params.arm * m.roll * t;
+        torque[1] -= params.arm * m.pitch * t;
+        torque[2] -= params.torqueRatio * m.yaw * t;
+    }
+
+    // Translation, with thrust along body -z
+    double bodyForce[3] = {0, 0, -thrust};
+    double force[3];
+    rotateToWorld(bodyForce, force);
+
+    for (uint8_t k=0; k<3; ++k)
+        force[k] -= params.linearDrag * velocity[k];
+    force[2] += params.mass * 9.80665;
+
+    for (uint8_t k=0; k<3; ++k) {
+        velocity[k] += force[k] / params.mass * dt;
+        position[k] += velocity[k] * dt;
+    }
+
+    // Resting on the ground: nothing moves until thrust exceeds weight
+    onGround = position[2] >= 0 && velocity[2] >= 0;
+    if (onGround) {
+        position[2] = 0;
+        memset(velocity, 0, sizeof(velocity));
+        memset(rates, 0, sizeof(rates));
+        return;
+    }
+
+    // Rotation: Euler's equations in the body frame
+    double inertia[3] = {params.ixx, params.iyy, params.izz};
+    double gyroscopic[3] = {
+        (params.iyy - params.izz) * rates[1] * rates[2],
+        (params.izz - params.ixx) * rates[2] * rates[0],
+        (params.ixx - params.iyy) * rates[0] * rates[1]
+    };
+
+    for (uint8_t k=0; k<3; ++k)
+        rates[k] += (torque[k] + gyroscopic[k] - params.angularDrag * rates[k]) / inertia[k] * dt;
+
+    // Quaternion kinematics, q' = q (0, w) / 2
+    double qw = quat[0], qx = quat[1], qy = quat[2], qz = quat[3];
+    double p = rates[0], q = rates[1], r = rates[2];
+
+    quat[0] += 0.5 * dt * (-qx*p - qy*q - qz*r);
+    quat[1] += 0.5 * dt * ( qw*p + qy*r - qz*q);
+    quat[2] += 0.5 * dt * ( qw*q - qx*r + qz*p);
+    quat[3] += 0.5 * dt * ( qw*r + qx*q - qy*p);
+
+    double norm = sqrt(quat[0]*quat[0] + quat[1]*quat[1] + quat[2]*quat[2] + quat[3]*quat[3]);
+    for (uint8_t k=0; k<4; ++k)
+        quat[k] /= norm;
+}
+
+void Dynamics::getEulerAngles(double euler[3])
+{
+    double qw = quat[0], qx = quat[1], qy = quat[2], qz = quat[3];
+
+    euler[0] = atan2(2*(qw*qx + qy*qz), 1 - 2*(qx*qx + qy*qy));
+
+    double s = 2*(qw*qy - qz*qx);
+    euler[1] = s >= 1 ? M_PI/2 : (s <= -1 ? -M_PI/2 : asin(s));
+
+    euler[2] = atan2(2*(qw*qz + qx*qy), 1 - 2*(qy*qy + qz*qz));
+}
+
+void Dynamics::getBodyRates(double _rates[3])
+{
+    memcpy(_rates, rates, sizeof(rates));
+}
+
+} // namespace
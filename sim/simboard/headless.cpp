@@ -0,0 +1,135 @@
+/*
+   headless.cpp : runs Hackflight against the simulated board, with no GUI and faster than real time
+
+   Flies a scripted sequence (arm, climb, hover, roll and pitch steps, land) and writes the
+   trajectory as CSV to standard output; a summary goes to standard error.  With a LOG, also
+   records what the firmware read and wrote, for replay.
+
+   Usage: headless [SECONDS [LOG]]
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include "hackflight.hpp"
+#include "simboard.hpp"
+#include "replaylog.hpp"
+
+// Stick demands in [-1,+1] from a given time (seconds) on
+typedef struct step_t {
+    float time;
+    float roll;
+    float pitch;
+    float yaw;
+    float throttle;
+} step_t;
+
+static const step_t SCRIPT[] = {
+    { 0.0f,  0.0f,  0.0f,  0.0f, -1.0f },   // sit on the ground until it is level long enough to arm
+    { 1.0f,  0.0f,  0.0f, +1.0f, -1.0f },   // arm: throttle down, yaw right
+    { 1.5f,  0.0f,  0.0f,  0.0f, -1.0f },
+    { 2.0f,  0.0f,  0.0f,  0.0f,  0.2f },   // climb
+    { 2.6f,  0.0f,  0.0f,  0.0f,  0.0f },   // hover
+    { 4.0f,  0.3f,  0.0f,  0.0f,  0.0f },   // roll step
+    { 5.0f,  0.0f,  0.0f,  0.0f,  0.0f },
+    { 6.0f,  0.0f,  0.3f,  0.0f,  0.0f },   // pitch step
+    { 7.0f,  0.0f,  0.0f,  0.0f,  0.0f },
+    { 8.0f,  0.0f,  0.0f,  0.0f, -0.2f },   // descend
+};
+
+static const uint32_t LOG_MICRO = 10000;
+
+int main(int argc, char ** argv)
+{
+    float seconds = argc > 1 ? (float)atof(argv[1]) : 10;
+
+    hf::SimBoard board;
+    hf::Hackflight<> h;
+
+    hf::ReplayLogWriter log;
+    hf::RecordingBoard recorder(&board, &log);
+
+    if (argc > 2 && !log.open(argv[2])) {
+        fprintf(stderr, "%s: can't write %s\n", argv[0], argv[2]);
+        return 1;
+    }
+
+    clock_t start = clock();
+
+    if (log.isOpen())
+        h.init(&recorder);
+    else
+        h.init(&board);
+
+    printf("time,altitude,roll,pitch,yaw");
+    for (uint8_t k=0; k<hf::Dynamics::MOTORS; ++k)
+        printf(",motor%d", k+1);
+    printf("\n");
+
+    hf::Dynamics & dynamics = board.getDynamics();
+
+    uint64_t end = (uint64_t)(seconds * 1e6);
+    uint64_t nextLog = 0;
+    uint8_t  scriptIndex = 0;
+    uint32_t updates = 0;
+    double   maxAltitude = 0;
+
+    while (board.getMicros() < end) {
+
+        float t = board.getMicros() / 1e6f;
+
+        while (scriptIndex < sizeof(SCRIPT)/sizeof(step_t) && SCRIPT[scriptIndex].time <= t) {
+            const step_t & s = SCRIPT[scriptIndex++];
+            board.setDemand(hf::DEMAND_ROLL,     s.roll);
+            board.setDemand(hf::DEMAND_PITCH,    s.pitch);
+            board.setDemand(hf::DEMAND_YAW,      s.yaw);
+            board.setDemand(hf::DEMAND_THROTTLE, s.throttle);
+        }
+
+        h.update();
+        updates++;
+
+        board.advance(hf::SimBoard::STEP_MICRO);
+
+        if (board.getMicros() >= nextLog) {
+
+            double euler[3];
+            dynamics.getEulerAngles(euler);
+
+            printf("%.3f,%.3f,%.2f,%.2f,%.2f", t, dynamics.getAltitude(),
+                    euler[0]*180/M_PI, euler[1]*180/M_PI, euler[2]*180/M_PI);
+            for (uint8_t k=0; k<hf::Dynamics::MOTORS; ++k)
+                printf(",%.3f", dynamics.getMotorSpeed(k));
+            printf("\n");
+
+            nextLog += LOG_MICRO;
+        }
+
+        if (dynamics.getAltitude() > maxAltitude)
+            maxAltitude = dynamics.getAltitude();
+    }
+
+    double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    log.close();
+
+    fprintf(stderr, "%.1f sec simulated in %.3f sec (%.0fx real time), %u updates, max altitude %.2f m\n",
+            seconds, elapsed, seconds / elapsed, updates, maxAltitude);
+
+    return 0;
+}
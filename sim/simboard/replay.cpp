@@ -0,0 +1,117 @@
+/*
+   replay.cpp : runs Hackflight on a recorded log as fast as the host allows
+
+   Replays a log written by RecordingBoard (e.g. by headless -r), then compares the motor values
+   this build computed with the ones in the log, so that a change to the control code can be
+   checked against a flight recorded before it.  The motor values can also be written as CSV,
+   to compare two replays directly.  The replay itself is the timed part: it does no I/O, so it
+   doubles as a fixed workload for profiling.
+
+   Usage: replay LOG [CSV]
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include "hackflight.hpp"
+#include "replayboard.hpp"
+#include "simboard.hpp"
+
+int main(int argc, char ** argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s LOG [CSV]\n", argv[0]);
+        return 1;
+    }
+
+    hf::ReplayBoard board;
+
+    if (!board.open(argv[1])) {
+        fprintf(stderr, "%s: can't read replay log %s\n", argv[0], argv[1]);
+        return 1;
+    }
+
+    // Logs from the headless simulator were flown with its gains
+    hf::SimBoard sim;
+    board.setConfig(sim.getConfig());
+
+    hf::Hackflight<> h;
+
+    clock_t start = clock();
+
+    h.init(&board);
+
+    uint32_t updates = 0;
+    while (board.advance()) {
+        h.update();
+        updates++;
+    }
+
+    double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    const hf::ReplayBoard::motor_frame_t * frames = board.getMotorFrames();
+    uint32_t count = board.getMotorFrameCount();
+
+    // Compare with the log's own motor records, in order
+    const hf::replay_record_t * records = board.getRecords();
+    uint32_t compared = 0;
+    uint32_t differing = 0;
+    int      maxDiff = 0;
+    for (uint64_t k=0; k<board.getRecordCount() && compared<count; ++k) {
+        if (records[k].type == hf::REPLAY_MOTORS) {
+            bool differs = false;
+            for (uint8_t i=0; i<records[k].arg && i<hf::ReplayBoard::MOTORS; ++i) {
+                int diff = abs((int)frames[compared].values[i] - (int)records[k].motors[i]);
+                if (diff > maxDiff)
+                    maxDiff = diff;
+                if (diff)
+                    differs = true;
+            }
+            if (differs)
+                differing++;
+            compared++;
+        }
+    }
+
+    if (argc > 2) {
+        FILE * csv = fopen(argv[2], "w");
+        if (!csv) {
+            fprintf(stderr, "%s: can't write %s\n", argv[0], argv[2]);
+            return 1;
+        }
+        fprintf(csv, "time");
+        for (uint8_t i=0; i<hf::ReplayBoard::MOTORS; ++i)
+            fprintf(csv, ",motor%d", i+1);
+        fprintf(csv, "\n");
+        for (uint32_t k=0; k<count; ++k) {
+            fprintf(csv, "%.6f", frames[k].usec / 1e6);
+            for (uint8_t i=0; i<hf::ReplayBoard::MOTORS; ++i)
+                fprintf(csv, ",%u", frames[k].values[i]);
+            fprintf(csv, "\n");
+        }
+        fclose(csv);
+    }
+
+    double seconds = board.getMicros() / 1e6;
+
+    fprintf(stderr, "%.1f sec replayed in %.3f sec (%.0fx real time), %u updates, %u motor frames\n",
+            seconds, elapsed, seconds / elapsed, updates, count);
+    fprintf(stderr, "%u of %u frames differ from the log, by at most %d\n", differing, compared, maxDiff);
+
+    return differing ? 2 : 0;
+}
@@ -0,0 +1,428 @@
+/*
+   replayboard.hpp : Board implementation that replays a log written by RecordingBoard
+
+   The log is memory-mapped and walked in place.  Like SimBoard, time moves only when the caller
+   runs advance(), which jumps the clock to the next record (or at most MAX_STEP_MICRO on) and
+   applies every record that is due: IMU samples become the IMU's reading and raise data-ready,
+   so the IMU task runs once per logged sample; RC records set their channel; serial records
+   queue bytes for MSP.  Motor values the firmware writes go into a buffer allocated at open(),
+   one frame per logged IMU sample, so nothing is allocated or written out while replaying.
+
+   Usage:
+
+       ReplayBoard board;
+       board.open("flight.log");
+       h.init(&board);
+       while (board.advance())
+           h.update();
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "board.hpp"
+#include "config.hpp"
+#include "replaylog.hpp"
+
+namespace hf {
+
+class ReplayBoard : public Board {
+
+    public:
+
+        static const uint8_t MOTORS = 4;
+
+        // Longest the clock jumps between updates.  Timed tasks (RC, MSP) read the board when they
+        // are due, not when a record is, so this should be no coarser than the recording board's
+        // updates: matching SimBoard's step, a log from the headless simulator replays exactly.
+        static const uint32_t MAX_STEP_MICRO = 250;
+
+        typedef struct motor_frame_t {
+            uint64_t usec;
+            uint16_t values[MOTORS];
+        } motor_frame_t;
+
+        ReplayBoard(void);
+        ~ReplayBoard(void);
+
+        // Maps the log; false if it can't be read or isn't a replay log
+        bool     open(const char * path);
+        void     close(void);
+
+        // Gains and loop rates should be those of the board the log came from; call before Hackflight::init()
+        void     setConfig(const Config & _config) { config = _config; }
+
+        // Moves the clock on and applies the records now due; false once the log is used up
+        bool     advance(void);
+
+        // What the firmware wrote, one frame per writeMotors()
+        const motor_frame_t * getMotorFrames(void) { return frames; }
+        uint32_t getMotorFrameCount(void) { return frameCount; }
+
+        // Motor values in the log itself, for comparison with a replay
+        const replay_record_t * getRecords(void) { return records; }
+        uint64_t getRecordCount(void) { return recordCount; }
+
+        virtual void     init(void) override;
+        virtual const    Config& getConfig(void) override;
+        virtual void     delayMilliseconds(uint32_t msec) override;
+        virtual void     dump(char * msg) override;
+        virtual uint64_t getMicros(void) override;
+
+        virtual bool     imuHasDataReadyInterrupt(void) override;
+        virtual bool     imuDataReady(void) override;
+        virtual void     imuGetEulerAndGyro(float eulerAnglesRadians[3], int16_t gyroRaw[3]) override;
+        virtual bool     imuReadGyro(int16_t gyroRaw[3]) override;
+
+        virtual uint16_t rcReadSerial(uint8_t chan) override;
+        virtual bool     rcUseSerial(void) override;
+        virtual uint16_t rcReadPwm(uint8_t chan) override;
+
+        virtual uint8_t  serialAvailableBytes(void) override;
+        virtual uint8_t  serialReadByte(void) override;
+        virtual void     serialWriteByte(uint8_t c) override;
+
+        virtual void     writeMotor(uint8_t index, uint16_t value) override;
+        virtual void     writeMotors(const uint16_t * values, uint8_t count) override;
+
+    private:
+
+        // Power of two, for the ring index
+        static const uint16_t SERIAL_BUFFER_SIZE = 256;
+
+        void                  * map;
+        size_t                  mapSize;
+        const replay_record_t * records;
+        uint64_t                recordCount;
+        uint64_t                next;
+
+        uint64_t micros;
+        bool     advanced;
+
+        float    eulerAngles[3];
+        int16_t  gyro[3];
+        int16_t  gyroAlone[3];
+        bool     fresh;
+
+        uint16_t rc[CONFIG_RC_CHANS];
+        bool     rcSerial;
+
+        uint8_t  rx[SERIAL_BUFFER_SIZE];
+        uint16_t rxHead;
+        uint16_t rxTail;
+
+        motor_frame_t * frames;
+        uint32_t        frameCount;
+        uint32_t        frameMax;
+        uint16_t        motors[MOTORS];
+
+        void     apply(const replay_record_t & record);
+        void     applyUntil(uint64_t usec);
+};
+
+/********************************************* CPP ********************************************************/
+
+ReplayBoard::ReplayBoard(void)
+{
+    map         = NULL;
+    mapSize     = 0;
+    records     = NULL;
+    recordCount = 0;
+    next        = 0;
+    frames      = NULL;
+    frameCount  = 0;
+    frameMax    = 0;
+
+    micros   = 0;
+    advanced = false;
+
+    // No LEDs to watch, so don't wait on them
+    config.init.ledFlashCount = 1;
+    config.init.ledFlashMilli = 10;
+}
+
+ReplayBoard::~ReplayBoard(void)
+{
+    close();
+}
+
+bool ReplayBoard::open(const char * path)
+{
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(replay_header_t)) {
+        ::close(fd);
+        return false;
+    }
+
+    void * p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+
+    const replay_header_t * header = (const replay_header_t *)p;
+
+    uint64_t available = (st.st_size - sizeof(replay_header_t)) / sizeof(replay_record_t);
+
+    if (header->magic != REPLAY_MAGIC || header->version != REPLAY_VERSION ||
+            header->recordSize != sizeof(replay_record_t) || header->records > available) {
+        munmap(p, st.st_size);
+        return false;
+    }
+
+    map         = p;
+    mapSize     = st.st_size;
+    records     = (const replay_record_t *)((const uint8_t *)p + sizeof(replay_header_t));
+    recordCount = header->records;
+
+    // The whole walk is front to back
+    madvise(map, mapSize, MADV_SEQUENTIAL);
+
+    // Every IMU sample gives at most one set of motor values, plus one for startup
+    frameMax   = (uint32_t)header->imuRecords + 1;
+    frames     = new motor_frame_t[frameMax];
+    frameCount = 0;
+
+    next   = 0;
+    micros = 0;
+    advanced = false;
+    fresh  = false;
+    rcSerial = false;
+    rxHead = 0;
+    rxTail = 0;
+
+    memset(eulerAngles, 0, sizeof(eulerAngles));
+    memset(gyro, 0, sizeof(gyro));
+    memset(gyroAlone, 0, sizeof(gyroAlone));
+    memset(motors, 0, sizeof(motors));
+
+    // Sticks centered, throttle and aux switches down, until the log says otherwise
+    for (uint8_t k=0; k<CONFIG_RC_CHANS; ++k) {
+        rc[k] = k == DEMAND_THROTTLE || k >= DEMAND_AUX1 ? config.pwm.min : (config.pwm.min + config.pwm.max) / 2;
+    }
+
+    return true;
+}
+
+void ReplayBoard::close(void)
+{
+    if (map) {
+        munmap(map, mapSize);
+        map = NULL;
+    }
+
+    delete[] frames;
+    frames = NULL;
+
+    records     = NULL;
+    recordCount = 0;
+}
+
+bool ReplayBoard::advance(void)
+{
+    if (next >= recordCount) {
+        return false;
+    }
+
+    // The first update comes at the time Hackflight::init() left the clock
+    if (advanced) {
+        uint64_t due = records[next].usec;
+        micros = due > micros + MAX_STEP_MICRO ? micros + MAX_STEP_MICRO : (due > micros ? due : micros);
+    }
+
+    advanced = true;
+
+    applyUntil(micros);
+
+    return true;
+}
+
+void ReplayBoard::applyUntil(uint64_t usec)
+{
+    while (next < recordCount && records[next].usec <= usec) {
+
+        const replay_record_t & record = records[next];
+
+        // An IMU sample waits until the IMU task has had the one before it
+        if (record.type == REPLAY_IMU && fresh) {
+            break;
+        }
+
+        apply(record);
+        next++;
+    }
+}
+
+void ReplayBoard::apply(const replay_record_t & record)
+{
+    switch (record.type) {
+
+        case REPLAY_IMU:
+            for (uint8_t k=0; k<3; ++k) {
+                eulerAngles[k] = record.imu.eulerAnglesRadians[k];
+                gyro[k] = record.imu.gyroRaw[k];
+            }
+            fresh = true;
+            break;
+
+        case REPLAY_GYRO:
+            memcpy(gyroAlone, record.gyroRaw, sizeof(gyroAlone));
+            break;
+
+        case REPLAY_RC:
+            {
+                uint8_t chan = record.arg & ~REPLAY_RC_SERIAL;
+                if (chan < CONFIG_RC_CHANS) {
+                    rc[chan] = record.rc;
+                }
+                rcSerial = (record.arg & REPLAY_RC_SERIAL) != 0;
+            }
+            break;
+
+        case REPLAY_SERIAL:
+            for (uint8_t k=0; k<record.arg && k<sizeof(record.serial); ++k) {
+                // Bytes MSP hasn't read yet are dropped when the ring is full, as a UART's would be
+                if ((uint16_t)(rxHead - rxTail) < SERIAL_BUFFER_SIZE) {
+                    rx[rxHead++ & (SERIAL_BUFFER_SIZE-1)] = record.serial[k];
+                }
+            }
+            break;
+
+        default:
+            // Motor records are the recording's outputs, not inputs
+            break;
+    }
+}
+
+void ReplayBoard::init(void)
+{
+}
+
+const Config& ReplayBoard::getConfig(void)
+{
+    return config;
+}
+
+void ReplayBoard::delayMilliseconds(uint32_t msec)
+{
+    micros += msec * 1000;
+    applyUntil(micros);
+}
+
+void ReplayBoard::dump(char * msg)
+{
+    printf("%s", msg);
+}
+
+uint64_t ReplayBoard::getMicros(void)
+{
+    return micros;
+}
+
+bool ReplayBoard::imuHasDataReadyInterrupt(void)
+{
+    return true;
+}
+
+bool ReplayBoard::imuDataReady(void)
+{
+    bool ready = fresh;
+    fresh = false;
+    return ready;
+}
+
+void ReplayBoard::imuGetEulerAndGyro(float eulerAnglesRadians[3], int16_t gyroRaw[3])
+{
+    for (uint8_t k=0; k<3; ++k) {
+        eulerAnglesRadians[k] = eulerAngles[k];
+        gyroRaw[k] = gyro[k];
+    }
+}
+
+bool ReplayBoard::imuReadGyro(int16_t gyroRaw[3])
+{
+    memcpy(gyroRaw, gyroAlone, sizeof(gyroAlone));
+    return true;
+}
+
+uint16_t ReplayBoard::rcReadSerial(uint8_t chan)
+{
+    return chan < CONFIG_RC_CHANS ? rc[chan] : 0;
+}
+
+bool ReplayBoard::rcUseSerial(void)
+{
+    return rcSerial;
+}
+
+uint16_t ReplayBoard::rcReadPwm(uint8_t chan)
+{
+    return chan < CONFIG_RC_CHANS ? rc[chan] : 0;
+}
+
+uint8_t ReplayBoard::serialAvailableBytes(void)
+{
+    uint16_t count = rxHead - rxTail;
+    return count > 255 ? 255 : (uint8_t)count;
+}
+
+uint8_t ReplayBoard::serialReadByte(void)
+{
+    return rxHead == rxTail ? 0 : rx[rxTail++ & (SERIAL_BUFFER_SIZE-1)];
+}
+
+void ReplayBoard::serialWriteByte(uint8_t c)
+{
+    (void)c;
+}
+
+void ReplayBoard::writeMotor(uint8_t index, uint16_t value)
+{
+    if (index < MOTORS) {
+        motors[index] = value;
+    }
+}
+
+void ReplayBoard::writeMotors(const uint16_t * values, uint8_t count)
+{
+    for (uint8_t i=0; i<count && i<MOTORS; ++i) {
+        motors[i] = values[i];
+    }
+
+    if (frameCount < frameMax) {
+        motor_frame_t & frame = frames[frameCount++];
+        frame.usec = micros;
+        memcpy(frame.values, motors, sizeof(motors));
+    }
+}
+
+} // namespace
@@ -0,0 +1,512 @@
+/*
+   replaylog.hpp : binary log of a board's inputs and motor outputs, for replay by ReplayBoard
+
+   A log is a header followed by fixed-size records in time order, each holding one thing the
+   firmware read from the board (an IMU sample, a gyro sample, an RC channel that changed, serial
+   bytes) or one set of motor values it wrote.  Fixed-size records let ReplayBoard walk a
+   memory-mapped log without parsing.  Fields are in host byte order (little-endian on every
+   target we build the simulator for).
+
+   RecordingBoard wraps another board and writes everything the firmware reads from it, and
+   every writeMotors(), to a log.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include "board.hpp"
+#include "config.hpp"
+
+namespace hf {
+
+typedef struct replay_header_t {
+
+    uint32_t magic;         // 'HFRL'
+    uint16_t version;
+    uint16_t recordSize;
+    uint64_t records;
+    uint64_t imuRecords;    // bounds the motor frames a replay can produce
+
+} replay_header_t;
+
+enum {
+    REPLAY_IMU = 1,         // euler angles and gyro, from imuGetEulerAndGyro()
+    REPLAY_GYRO,            // gyro alone, from imuReadGyro()
+    REPLAY_RC,              // arg: channel, plus REPLAY_RC_SERIAL if read by rcReadSerial()
+    REPLAY_SERIAL,          // arg: byte count
+    REPLAY_MOTORS           // arg: motor count
+};
+
+static const uint8_t REPLAY_RC_SERIAL = 0x80;
+
+typedef struct replay_record_t {
+
+    uint64_t usec;
+    uint8_t  type;
+    uint8_t  arg;
+    uint8_t  reserved[2];
+
+    union {
+        struct {
+            float   eulerAnglesRadians[3];
+            int16_t gyroRaw[3];
+        } imu;
+        int16_t  gyroRaw[3];
+        uint16_t rc;
+        uint8_t  serial[20];
+        uint16_t motors[10];
+    };
+
+} replay_record_t;
+
+static_assert(sizeof(replay_record_t) == 32, "replay records must stay 32 bytes");
+
+static const uint32_t REPLAY_MAGIC   = 0x4C524648; // 'HFRL'
+static const uint16_t REPLAY_VERSION = 1;
+
+class ReplayLogWriter {
+
+    public:
+
+        ReplayLogWriter(void);
+
+        // Creates the log; false on failure
+        bool open(const char * path);
+
+        // Writes the counts into the header and closes the file
+        void close(void);
+
+        bool isOpen(void) { return file != NULL; }
+
+        void writeImu(uint64_t usec, const float eulerAnglesRadians[3], const int16_t gyroRaw[3]);
+        void writeGyro(uint64_t usec, const int16_t gyroRaw[3]);
+        void writeRc(uint64_t usec, uint8_t chan, bool serial, uint16_t value);
+        void writeMotors(uint64_t usec, const uint16_t * values, uint8_t count);
+
+        // Bytes read at the same time go into the same record
+        void writeSerialByte(uint64_t usec, uint8_t c);
+
+    private:
+
+        FILE *          file;
+        replay_header_t header;
+
+        // Serial bytes waiting for a full record or a change of time
+        replay_record_t pending;
+
+        void start(replay_record_t & record, uint64_t usec, uint8_t type, uint8_t arg);
+        void put(const replay_record_t & record);
+        void flushSerial(void);
+};
+
+class RecordingBoard : public Board {
+
+    public:
+
+        RecordingBoard(Board * _real, ReplayLogWriter * _log);
+
+    //------------------------------------ Core functionality ----------------------------------------------------
+        virtual void     init(void) override;
+        virtual const    Config& getConfig(void) override;
+        virtual void     delayMilliseconds(uint32_t msec) override;
+        virtual void     dump(char * msg) override;
+        virtual uint64_t getMicros(void) override;
+        virtual void     ledSet(uint8_t id, bool is_on, float max_brightness = 255) override;
+
+    //------------------------------------------- IMU -----------------------------------------------------------
+        virtual void     imuUpdate(void) override;
+        virtual bool     imuReady(void) override;
+        virtual bool     imuHasDataReadyInterrupt(void) override;
+        virtual bool     imuDataReady(void) override;
+        virtual void     idle(void) override;
+        virtual void     imuGetEulerAndGyro(float eulerAnglesRadians[3], int16_t gyroRaw[3]) override;
+        virtual bool     imuReadGyro(int16_t gyroRaw[3]) override;
+
+    //-------------------------------------------- RC -----------------------------------------------------
+        virtual uint16_t rcReadSerial(uint8_t chan) override;
+        virtual uint8_t  rcReadSerialFrame(uint16_t channels[CONFIG_RC_CHANS]) override;
+        virtual bool     rcHasFrameSignal(void) override;
+        virtual bool     rcFrameReady(void) override;
+        virtual bool     rcUseSerial(void) override;
+        virtual uint16_t rcReadPwm(uint8_t chan) override;
+
+    //------------------------------------------ Serial ---------------------------------------------------------
+        virtual uint8_t  serialAvailableBytes(void) override;
+        virtual uint8_t  serialReadByte(void) override;
+        virtual void     serialWriteByte(uint8_t c) override;
+        virtual uint16_t serialAvailableForWrite(void) override;
+        virtual void     serialWriteBytes(const uint8_t * buf, uint16_t count) override;
+        virtual void     serialFlush(void) override;
+
+    //------------------------------------------ Motors ---------------------------------------------------------
+        virtual void     writeMotor(uint8_t index, uint16_t value) override;
+        virtual void     writeMotors(const uint16_t * values, uint8_t count) override;
+
+    //----------------------------------------- Blackbox --------------------------------------------------------
+        virtual bool     blackboxInit(void) override;
+        virtual void     blackboxWrite(const uint8_t * buf, uint16_t count) override;
+
+    //------------------------------------------ Extras ---------------------------------------------------------
+        virtual void     extrasHandleAuxSwitch(uint8_t auxState) override;
+        virtual uint8_t  extrasGetTaskCount(void) override;
+        virtual void     extrasPerformTask(uint8_t taskIndex) override;
+        virtual void     extrasUpdateAccelZ(const float gravity[3], bool armed) override;
+        virtual void     extrasRegisterMspHandlers(MSP * msp) override;
+
+    private:
+
+        Board           * real;
+        ReplayLogWriter * log;
+
+        // Only channels that change are logged; 0 is never a valid pulse width, so the first read logs
+        uint16_t rcLast[CONFIG_RC_CHANS];
+};
+
+/********************************************* CPP ********************************************************/
+
+ReplayLogWriter::ReplayLogWriter(void)
+{
+    file = NULL;
+}
+
+bool ReplayLogWriter::open(const char * path)
+{
+    file = fopen(path, "wb");
+
+    if (!file) {
+        return false;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic      = REPLAY_MAGIC;
+    header.version    = REPLAY_VERSION;
+    header.recordSize = sizeof(replay_record_t);
+
+    // Rewritten with the counts on close
+    fwrite(&header, sizeof(header), 1, file);
+
+    pending.arg = 0;
+
+    return true;
+}
+
+void ReplayLogWriter::close(void)
+{
+    if (!file) {
+        return;
+    }
+
+    flushSerial();
+
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+
+    fclose(file);
+    file = NULL;
+}
+
+void ReplayLogWriter::start(replay_record_t & record, uint64_t usec, uint8_t type, uint8_t arg)
+{
+    memset(&record, 0, sizeof(record));
+    record.usec = usec;
+    record.type = type;
+    record.arg  = arg;
+}
+
+void ReplayLogWriter::put(const replay_record_t & record)
+{
+    // Serial bytes read before this record must come back before it
+    if (record.type != REPLAY_SERIAL) {
+        flushSerial();
+    }
+
+    fwrite(&record, sizeof(record), 1, file);
+
+    header.records++;
+    if (record.type == REPLAY_IMU) {
+        header.imuRecords++;
+    }
+}
+
+void ReplayLogWriter::flushSerial(void)
+{
+    if (pending.arg) {
+        put(pending);
+        pending.arg = 0;
+    }
+}
+
+void ReplayLogWriter::writeImu(uint64_t usec, const float eulerAnglesRadians[3], const int16_t gyroRaw[3])
+{
+    replay_record_t record;
+    start(record, usec, REPLAY_IMU, 0);
+    for (uint8_t k=0; k<3; ++k) {
+        record.imu.eulerAnglesRadians[k] = eulerAnglesRadians[k];
+        record.imu.gyroRaw[k] = gyroRaw[k];
+    }
+    put(record);
+}
+
+void ReplayLogWriter::writeGyro(uint64_t usec, const int16_t gyroRaw[3])
+{
+    replay_record_t record;
+    start(record, usec, REPLAY_GYRO, 0);
+    for (uint8_t k=0; k<3; ++k) {
+        record.gyroRaw[k] = gyroRaw[k];
+    }
+    put(record);
+}
+
+void ReplayLogWriter::writeRc(uint64_t usec, uint8_t chan, bool serial, uint16_t value)
+{
+    replay_record_t record;
+    start(record, usec, REPLAY_RC, chan | (serial ? REPLAY_RC_SERIAL : 0));
+    record.rc = value;
+    put(record);
+}
+
+void ReplayLogWriter::writeMotors(uint64_t usec, const uint16_t * values, uint8_t count)
+{
+    replay_record_t record;
+    start(record, usec, REPLAY_MOTORS, 0);
+    for (uint8_t k=0; k<count && k<sizeof(record.motors)/sizeof(uint16_t); ++k) {
+        record.motors[record.arg++] = values[k];
+    }
+    put(record);
+}
+
+void ReplayLogWriter::writeSerialByte(uint64_t usec, uint8_t c)
+{
+    if (pending.arg && (pending.usec != usec || pending.arg == sizeof(pending.serial))) {
+        flushSerial();
+    }
+
+    if (!pending.arg) {
+        start(pending, usec, REPLAY_SERIAL, 0);
+    }
+
+    pending.serial[pending.arg++] = c;
+}
+
+RecordingBoard::RecordingBoard(Board * _real, ReplayLogWriter * _log)
+{
+    real = _real;
+    log  = _log;
+
+    memset(rcLast, 0, sizeof(rcLast));
+}
+
+void RecordingBoard::init(void)
+{
+    real->init();
+}
+
+const Config& RecordingBoard::getConfig(void)
+{
+    return real->getConfig();
+}
+
+void RecordingBoard::delayMilliseconds(uint32_t msec)
+{
+    real->delayMilliseconds(msec);
+}
+
+void RecordingBoard::dump(char * msg)
+{
+    real->dump(msg);
+}
+
+uint64_t RecordingBoard::getMicros(void)
+{
+    return real->getMicros();
+}
+
+void RecordingBoard::ledSet(uint8_t id, bool is_on, float max_brightness)
+{
+    real->ledSet(id, is_on, max_brightness);
+}
+
+void RecordingBoard::imuUpdate(void)
+{
+    real->imuUpdate();
+}
+
+bool RecordingBoard::imuReady(void)
+{
+    return real->imuReady();
+}
+
+bool RecordingBoard::imuHasDataReadyInterrupt(void)
+{
+    return real->imuHasDataReadyInterrupt();
+}
+
+bool RecordingBoard::imuDataReady(void)
+{
+    return real->imuDataReady();
+}
+
+void RecordingBoard::idle(void)
+{
+    real->idle();
+}
+
+void RecordingBoard::imuGetEulerAndGyro(float eulerAnglesRadians[3], int16_t gyroRaw[3])
+{
+    real->imuGetEulerAndGyro(eulerAnglesRadians, gyroRaw);
+    log->writeImu(real->getMicros(), eulerAnglesRadians, gyroRaw);
+}
+
+bool RecordingBoard::imuReadGyro(int16_t gyroRaw[3])
+{
+    bool ok = real->imuReadGyro(gyroRaw);
+    if (ok) {
+        log->writeGyro(real->getMicros(), gyroRaw);
+    }
+    return ok;
+}
+
+uint16_t RecordingBoard::rcReadSerial(uint8_t chan)
+{
+    uint16_t value = real->rcReadSerial(chan);
+    if (chan < CONFIG_RC_CHANS && value != rcLast[chan]) {
+        log->writeRc(real->getMicros(), chan, true, value);
+        rcLast[chan] = value;
+    }
+    return value;
+}
+
+uint8_t RecordingBoard::rcReadSerialFrame(uint16_t channels[CONFIG_RC_CHANS])
+{
+    // Logged as the channels it changed, which ReplayBoard's rcReadSerial() then gives back
+    uint8_t count = real->rcReadSerialFrame(channels);
+    for (uint8_t chan = 0; chan < count; chan++) {
+        if (channels[chan] != rcLast[chan]) {
+            log->writeRc(real->getMicros(), chan, true, channels[chan]);
+            rcLast[chan] = channels[chan];
+        }
+    }
+    return count;
+}
+
+bool RecordingBoard::rcHasFrameSignal(void)
+{
+    return real->rcHasFrameSignal();
+}
+
+bool RecordingBoard::rcFrameReady(void)
+{
+    return real->rcFrameReady();
+}
+
+bool RecordingBoard::rcUseSerial(void)
+{
+    return real->rcUseSerial();
+}
+
+uint16_t RecordingBoard::rcReadPwm(uint8_t chan)
+{
+    uint16_t value = real->rcReadPwm(chan);
+    if (chan < CONFIG_RC_CHANS && value != rcLast[chan]) {
+        log->writeRc(real->getMicros(), chan, false, value);
+        rcLast[chan] = value;
+    }
+    return value;
+}
+
+uint8_t RecordingBoard::serialAvailableBytes(void)
+{
+    return real->serialAvailableBytes();
+}
+
+uint8_t RecordingBoard::serialReadByte(void)
+{
+    uint8_t c = real->serialReadByte();
+    log->writeSerialByte(real->getMicros(), c);
+    return c;
+}
+
+void RecordingBoard::serialWriteByte(uint8_t c)
+{
+    real->serialWriteByte(c);
+}
+
+uint16_t RecordingBoard::serialAvailableForWrite(void)
+{
+    return real->serialAvailableForWrite();
+}
+
+void RecordingBoard::serialWriteBytes(const uint8_t * buf, uint16_t count)
+{
+    real->serialWriteBytes(buf, count);
+}
+
+void RecordingBoard::serialFlush(void)
+{
+    real->serialFlush();
+}
+
+void RecordingBoard::writeMotor(uint8_t index, uint16_t value)
+{
+    real->writeMotor(index, value);
+}
+
+void RecordingBoard::writeMotors(const uint16_t * values, uint8_t count)
+{
+    real->writeMotors(values, count);
+    log->writeMotors(real->getMicros(), values, count);
+}
+
+bool RecordingBoard::blackboxInit(void)
+{
+    return real->blackboxInit();
+}
+
+void RecordingBoard::blackboxWrite(const uint8_t * buf, uint16_t count)
+{
+    real->blackboxWrite(buf, count);
+}
+
+void RecordingBoard::extrasHandleAuxSwitch(uint8_t auxState)
+{
+    real->extrasHandleAuxSwitch(auxState);
+}
+
+uint8_t RecordingBoard::extrasGetTaskCount(void)
+{
+    return real->extrasGetTaskCount();
+}
+
+void RecordingBoard::extrasPerformTask(uint8_t taskIndex)
+{
+    real->extrasPerformTask(taskIndex);
+}
+
+void RecordingBoard::extrasUpdateAccelZ(const float gravity[3], bool armed)
+{
+    real->extrasUpdateAccelZ(gravity, armed);
+}
+
+void RecordingBoard::extrasRegisterMspHandlers(MSP * msp)
+{
+    real->extrasRegisterMspHandlers(msp);
+}
+
+} // namespace
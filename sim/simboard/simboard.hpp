@@ -1,182 +1,385 @@
-// Board implementation ======================================================
-#include <cstdio>
-#include <cstdint>
-#include <chrono>
-#include <thread>
-#include "board.hpp"
-#include "config.hpp"
-#include "common.hpp"
-
-namespace hf {
-
-class SimBoard : public Board {
-public:
-    virtual void init() override
-    {
-        config.imu.imuLoopMicro = 10000;
-        config.imu.calibratingGyroMilli = 100; //long enough to see but not to annoy
-    }
-
-    virtual const Config& getConfig() override
-    {
-        return config;
-    }
-
-    virtual void imuRead(int16_t gyroAdc[3], int16_t accelAdc[3]) override
-    {
-        // Convert from radians to tenths of a degree
-
-        for (int k=0; k<3; ++k) {
-            accelAdc[k]  = (int16_t)(400000 * accel[k]);
-        }
-
-        gyroAdc[1] = -(int16_t)(1000 * gyro[0]);
-        gyroAdc[0] = -(int16_t)(1000 * gyro[1]);
-        gyroAdc[2] = -(int16_t)(1000 * gyro[2]);
-    }
-
-
-    virtual uint64_t getMicros() override
-    {
-        return static_cast<uint64_t>(getTimeSinceEpoch());
-    }
-
-    virtual bool rcUseSerial(void) override
-    {
-        return false;
-    }
-
-    virtual uint16_t readPWM(uint8_t chan) override
-    {
-        // Special handling for throttle
-        float demand = (chan == 3) ? throttleDemand : demands[chan];
-
-        // Special handling for pitch, roll on PS3, XBOX360
-        if (chan < 2) {
-           if (controller == PS3)
-            demand /= 2;
-           if (controller == XBOX360)
-            demand /= 1.5;
-        }
-
-        // Joystick demands are in [-1,+1]
-        int pwm =  (int)(CONFIG_PWM_MIN + (demand + 1) / 2 * (CONFIG_PWM_MAX - CONFIG_PWM_MIN));
-
-        return pwm;
-    }
-
-    virtual void dump(char * msg) override
-    {
-        printf("%s\n", msg);
-    }
-
-
-    virtual void writeMotor(uint8_t index, uint16_t value) override
-    {
-        thrusts[index] = (value - 1000) / 1000.0f;
-    }
-
-    virtual void showArmedStatus(bool armed) override
-    {
-        //TODO: provide implementtaion
-        //if (armed) 
-        //    startToast("                    ARMED", 1, 0, 0);
-    }
-
-    virtual void showAuxStatus(uint8_t status) override
-    {
-        if (status != auxStatus) {
-            char message[100];
-            switch (status) {
-                case 1:
-                    sprintf(message, "ENTERING ALT-HOLD");
-                    break;
-                case 2:
-                    sprintf(message, "ENTERING GUIDED MODE");
-                    break;
-                default:
-                    sprintf(message, "ENTERING NORMAL MODE");
-            }
-            //TODO: provide implementtaion
-            //startToast(message, 1,1,0);
-        }
-
-        auxStatus = status;
-    }
-    
-    virtual void delayMilliseconds(uint32_t msec) override
-    {
-        if (msec <= 0)
-            return;
-
-        //if duration is too small, use spin wait otherwise use spin wait
-        if (msec >= 10) {
-            static constexpr duration<double> MinSleepDuration(0);
-            clock::time_point start = clock::now();
-            double dt = msec * 1000;
-            //spin wait
-            while (duration<double>(clock::now() - start).count() < dt) {
-                std::this_thread::sleep_for(MinSleepDuration);
-            }
-        }
-        else {
-            std::this_thread::sleep_for(duration<double>(msec * 1000));
-        }
-    }
-
-
-private:
-    double getTimeSinceEpoch()
-    {
-        using Clock = std::chrono::high_resolution_clock;
-        return std::chrono::duration<double>(Clock::now().time_since_epoch()).count();
-    }
-
-private:
-    typedef std::chrono::high_resolution_clock clock;
-    template <typename T>
-    using duration = std::chrono::duration<T>;
-
-
-    // Launch support
-    bool ready;
-
-    // needed for spring-mounted throttle stick
-    float throttleDemand;
-    const float SPRINGY_THROTTLE_INC = .01f;
-
-    // IMU support
-    float accel[3];
-    float gyro[3];
-
-    // Barometer support
-    int baroPressure;
-
-    // Motor support
-    float thrusts[4];
-
-    // 100 Hz timestep, used for simulating microsend timer
-    float timestep;
-
-    int particleCount;
-
-    // Handles from scene
-    int motorList[4];
-    int motorJointList[4];
-    int quadcopterHandle;
-    int accelHandle;
-
-    // Support for reporting status of aux switch (alt-hold, etc.)
-    uint8_t auxStatus;
-    // Stick demands from controller
-    float demands[5];
-
-    // Controller type
-    // We currently support these controllers
-    enum controller_t { KEYBOARD, DSM, TARANIS, SPEKTRUM, EXTREME3D, PS3 , XBOX360 };
-    controller_t controller;
-
-    Config config;
-};
-
-} //namespace
+/*
+   simboard.hpp : Board implementation for the headless simulator
+
+   Time is simulated: getMicros() returns the model's clock, which moves only when the caller
+   runs advance() (or when the firmware calls delayMilliseconds()), so a flight runs as fast as
+   the host can step it and gives the same result every time.  Stick demands are set by the
+   caller in [-1,+1]; motor values drive a Dynamics model, whose attitude and body rates come
+   back as the IMU.  Serial ports are silent.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+
+#include "board.hpp"
+#include "config.hpp"
+#include "dynamics.hpp"
+
+namespace hf {
+
+class SimBoard : public Board {
+
+    public:
+
+        // Physics step (4 kHz); the firmware sees time in multiples of this, so its tasks start up
+        // to a step late
+        static const uint32_t STEP_MICRO = 250;
+
+        // Gyro counts per degree per second, the MultiWii scale that Stabilize is written for
+        static constexpr float GYRO_LSB_PER_DPS = 4.1f;
+
+        SimBoard(const DynamicsParams & params = DynamicsParams());
+
+        // Runs the model forward; Hackflight::update() should be called between steps
+        void     advance(uint32_t usec);
+
+        void     setDemand(uint8_t chan, float demand);
+
+        // Replaces the default gains; call before Hackflight::init()
+        void     setPidConfig(const PidConfig & pid);
+
+        // Adds zero-mean noise with the given standard deviation (deg/sec) to the gyro,
+        // from a generator seeded here so that runs are repeatable
+        void     setGyroNoise(float stdDps, uint32_t seed);
+
+        // With flowOnly, navGetPosition() reports nothing, so guided mode flies on the flow sensor alone
+        void     setFlowOnly(bool flowOnly) { this->flowOnly = flowOnly; }
+
+        // Last motor value from the firmware, normalized to [0,1]
+        double   getMotor(uint8_t index) { return motors[index]; }
+
+        Dynamics & getDynamics(void) { return dynamics; }
+
+        virtual void     init(void) override;
+        virtual const    Config& getConfig(void) override;
+        virtual void     delayMilliseconds(uint32_t msec) override;
+        virtual void     dump(char * msg) override;
+        virtual uint64_t getMicros(void) override;
+
+        virtual void     imuGetEulerAndGyro(float eulerAnglesRadians[3], int16_t gyroRaw[3]) override;
+        virtual bool     imuReadGyro(int16_t gyroRaw[3]) override;
+
+        virtual bool     navGetPosition(float position[3], float velocity[3]) override;
+
+        virtual bool     flowInit(void) override;
+        virtual bool     flowRead(int16_t counts[2], uint8_t & quality) override;
+        virtual bool     flowGetRange(float & meters) override;
+
+        virtual uint16_t rcReadSerial(uint8_t chan) override;
+        virtual bool     rcUseSerial(void) override;
+        virtual uint16_t rcReadPwm(uint8_t chan) override;
+
+        virtual uint8_t  serialAvailableBytes(void) override;
+        virtual uint8_t  serialReadByte(void) override;
+        virtual void     serialWriteByte(uint8_t c) override;
+
+        virtual void     writeMotor(uint8_t index, uint16_t value) override;
+        virtual void     writeMotors(const uint16_t * values, uint8_t count) override;
+
+    private:
+
+        Dynamics dynamics;
+        uint64_t micros;
+        uint32_t pending;
+
+        float    demands[CONFIG_RC_CHANS];
+        double   motors[Dynamics::MOTORS];
+
+        float    noiseCounts;
+        uint32_t noiseState;
+
+        // Flow sensor: the counts it has yet to report
+        bool     flowOnly;
+        float    flowResidual[2];
+
+        float    noise(void);
+        void     integrateFlow(double dt);
+};
+
+/********************************************* CPP ********************************************************/
+
+SimBoard::SimBoard(const DynamicsParams & params)
+{
+    dynamics.init(params);
+
+    micros  = 0;
+    pending = 0;
+
+    // Sticks centered, throttle and aux switches down
+    for (uint8_t k=0; k<CONFIG_RC_CHANS; ++k)
+        demands[k] = k == DEMAND_THROTTLE || k >= DEMAND_AUX1 ? -1 : 0;
+
+    for (uint8_t k=0; k<Dynamics::MOTORS; ++k)
+        motors[k] = 0;
+
+    noiseCounts = 0;
+    noiseState  = 1;
+
+    flowOnly        = false;
+    flowResidual[0] = 0;
+    flowResidual[1] = 0;
+
+    // PIDs, for the default model
+    config.pid.levelP         = 0.20f;
+
+    config.pid.ratePitchrollP = 0.225f;
+    config.pid.ratePitchrollI = 0.12f;
+    config.pid.ratePitchrollD = 0.375f;
+
+    config.pid.yawP           = 1.0625f;
+    config.pid.yawI           = 0.36f;
+
+    // No LEDs to watch, so don't wait on them
+    config.init.ledFlashCount = 1;
+    config.init.ledFlashMilli = 10;
+
+    // The vehicle sits still on the ground, so a short calibration will do
+    config.calibration.samples = 100;
+}
+
+void SimBoard::init(void)
+{
+}
+
+const Config& SimBoard::getConfig(void)
+{
+    return config;
+}
+
+void SimBoard::advance(uint32_t usec)
+{
+    // Carry any remainder, so that the clock and the model never drift apart
+    pending += usec;
+
+    while (pending >= STEP_MICRO) {
+        dynamics.setMotors(motors);
+        dynamics.step(STEP_MICRO * 1e-6);
+        integrateFlow(STEP_MICRO * 1e-6);
+        micros  += STEP_MICRO;
+        pending -= STEP_MICRO;
+    }
+}
+
+void SimBoard::setDemand(uint8_t chan, float demand)
+{
+    demands[chan] = demand < -1 ? -1 : (demand > +1 ? +1 : demand);
+}
+
+void SimBoard::setPidConfig(const PidConfig & pid)
+{
+    config.pid = pid;
+}
+
+void SimBoard::setGyroNoise(float stdDps, uint32_t seed)
+{
+    noiseCounts = stdDps * GYRO_LSB_PER_DPS;
+    noiseState  = seed ? seed : 1;
+}
+
+float SimBoard::noise(void)
+{
+    // Sum of four uniforms (xorshift32) is near enough to Gaussian, with unit variance after scaling
+    float sum = 0;
+
+    for (uint8_t k=0; k<4; ++k) {
+        noiseState ^= noiseState << 13;
+        noiseState ^= noiseState >> 17;
+        noiseState ^= noiseState << 5;
+        sum += noiseState / 4294967296.0f;
+    }
+
+    return (sum - 2) * 1.7320508f;
+}
+
+void SimBoard::delayMilliseconds(uint32_t msec)
+{
+    advance(msec * 1000);
+}
+
+void SimBoard::dump(char * msg)
+{
+    printf("%s", msg);
+}
+
+uint64_t SimBoard::getMicros(void)
+{
+    return micros;
+}
+
+void SimBoard::imuGetEulerAndGyro(float eulerAnglesRadians[3], int16_t gyroRaw[3])
+{
+    double euler[3];
+    dynamics.getEulerAngles(euler);
+
+    // Firmware pitch is positive nose-down; yaw is in [-pi,+pi] as from a real IMU
+    eulerAnglesRadians[0] = (float)euler[0];
+    eulerAnglesRadians[1] = (float)-euler[1];
+    eulerAnglesRadians[2] = (float)euler[2];
+
+    imuReadGyro(gyroRaw);
+}
+
+bool SimBoard::imuReadGyro(int16_t gyroRaw[3])
+{
+    double rates[3];
+    dynamics.getBodyRates(rates);
+
+    rates[1] = -rates[1];
+
+    for (uint8_t k=0; k<3; ++k) {
+        double counts = rates[k] * 180 / M_PI * GYRO_LSB_PER_DPS;
+        if (noiseCounts > 0)
+            counts += noiseCounts * noise();
+        gyroRaw[k] = (int16_t)(counts > INT16_MAX ? INT16_MAX : (counts < INT16_MIN ? INT16_MIN : counts));
+    }
+
+    return true;
+}
+
+bool SimBoard::navGetPosition(float position[3], float velocity[3])
+{
+    if (flowOnly) {
+        return false;
+    }
+
+    // NED to north, east, up
+    double p[3], v[3];
+    dynamics.getPosition(p);
+    dynamics.getVelocity(v);
+
+    for (uint8_t k=0; k<3; ++k) {
+        position[k] = (float)(k == 2 ? -p[k] : p[k]);
+        velocity[k] = (float)(k == 2 ? -v[k] : v[k]);
+    }
+
+    return true;
+}
+
+bool SimBoard::flowInit(void)
+{
+    return true;
+}
+
+bool SimBoard::flowRead(int16_t counts[2], uint8_t & quality)
+{
+    float range = 0;
+    if (!flowGetRange(range)) {
+        counts[0] = 0;
+        counts[1] = 0;
+        flowResidual[0] = 0;
+        flowResidual[1] = 0;
+        quality = 0;
+        return true;
+    }
+
+    for (uint8_t k=0; k<2; ++k) {
+        counts[k] = (int16_t)lrintf(flowResidual[k]);
+        flowResidual[k] -= counts[k];
+    }
+
+    quality = 150;
+    return true;
+}
+
+void SimBoard::integrateFlow(double dt)
+{
+    // Like the sensor, which sums the motion it sees between reads
+    float range = 0;
+    if (!flowGetRange(range)) {
+        return;
+    }
+
+    double v[3], rates[3], euler[3];
+    dynamics.getVelocity(v);
+    dynamics.getBodyRates(rates);
+    dynamics.getEulerAngles(euler);
+
+    // Level-frame velocity along and across the heading; pitch rate is positive nose-up here
+    double c = cos(euler[2]);
+    double s = sin(euler[2]);
+    double forward = v[0] * c + v[1] * s;
+    double right   = v[1] * c - v[0] * s;
+
+    double flow[2] = { forward / range + rates[1], right / range - rates[0] };
+
+    for (uint8_t k=0; k<2; ++k) {
+        flowResidual[k] += (float)(flow[k] * dt / config.flow.radiansPerCount);
+    }
+}
+
+bool SimBoard::flowGetRange(float & meters)
+{
+    // A sonar looking straight down the body's axis, out to its usual limit
+    double p[3], euler[3];
+    dynamics.getPosition(p);
+    dynamics.getEulerAngles(euler);
+
+    double range = -p[2] / (cos(euler[0]) * cos(euler[1]));
+    if (dynamics.isOnGround() || range > 5) {
+        return false;
+    }
+
+    meters = (float)range;
+    return true;
+}
+
+uint16_t SimBoard::rcReadSerial(uint8_t chan)
+{
+    (void)chan;
+    return 0;
+}
+
+bool SimBoard::rcUseSerial(void)
+{
+    return false;
+}
+
+uint16_t SimBoard::rcReadPwm(uint8_t chan)
+{
+    return (uint16_t)(config.pwm.min + (demands[chan] + 1) / 2 * (config.pwm.max - config.pwm.min));
+}
+
+uint8_t SimBoard::serialAvailableBytes(void)
+{
+    return 0;
+}
+
+uint8_t SimBoard::serialReadByte(void)
+{
+    return 0;
+}
+
+void SimBoard::serialWriteByte(uint8_t c)
+{
+    (void)c;
+}
+
+void SimBoard::writeMotor(uint8_t index, uint16_t value)
+{
+    motors[index] = (value - config.pwm.min) / (double)(config.pwm.max - config.pwm.min);
+}
+
+void SimBoard::writeMotors(const uint16_t * values, uint8_t count)
+{
+    for (uint8_t i=0; i<count && i<Dynamics::MOTORS; ++i)
+        writeMotor(i, values[i]);
+}
+
+} // namespace
@@ -0,0 +1,333 @@
+/*
+   tune.cpp : Monte-Carlo PID sweep over the headless simulator
+
+   Each run flies its own Hackflight and SimBoard with pitch/roll gains drawn around the
+   SimBoard defaults, seeded gyro noise, and a torque kick of random size and axis.  It scores
+   the roll step response (settling time, overshoot), recovery from the kick, and the fraction
+   of airborne IMU cycles with a motor at its limit.  Runs are spread over all cores by a small
+   work-stealing pool; every run is a function of its seed alone, so results do not depend on
+   the thread count or on scheduling.  One CSV line per run goes to standard output, and the
+   best runs to standard error.
+
+   Usage: tune [RUNS] [THREADS] [SEED]
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "hackflight.hpp"
+#include "simboard.hpp"
+
+// Flight script, in seconds
+static const float ARM_TIME      = 1.0f;
+static const float CLIMB_TIME    = 2.0f;
+static const float HOVER_TIME    = 2.6f;
+static const float STEP_TIME     = 4.0f;
+static const float STEP_END      = 6.0f;
+static const float KICK_TIME     = 7.0f;
+static const float KICK_DURATION = 0.05f;
+static const float END_TIME      = 9.0f;
+
+static const float STEP_DEMAND   = 0.3f;
+
+// Settled once within this fraction of the final value (or this many degrees, if larger)
+static const float SETTLE_FRACTION = 0.05f;
+static const float SETTLE_DEGREES  = 0.5f;
+
+typedef struct run_t {
+
+    // Inputs
+    uint64_t      seed;
+    hf::PidConfig pid;
+    double        kick[3];
+    float         noiseDps;
+
+    // Results
+    float         settling;     // sec after the step, or the whole step if never settled
+    float         overshoot;    // fraction of the final angle
+    float         recovery;     // sec after the kick to get back inside SETTLE_DEGREES of level
+    float         saturation;   // fraction of airborne cycles
+    float         score;
+    bool          crashed;
+} run_t;
+
+// SplitMix64 gives well-spread streams from consecutive seeds
+static uint64_t splitmix(uint64_t & state)
+{
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static double uniform(uint64_t & state, double lo, double hi)
+{
+    return lo + (hi - lo) * (splitmix(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Log-uniform over [nominal/2, nominal*2]
+static float around(uint64_t & state, float nominal)
+{
+    return (float)(nominal * exp2(uniform(state, -1, +1)));
+}
+
+static void setup(run_t & run, uint64_t seed)
+{
+    run.seed = seed;
+
+    uint64_t state = seed;
+
+    hf::SimBoard defaults;
+    run.pid = defaults.getConfig().pid;
+
+    run.pid.levelP         = around(state, run.pid.levelP);
+    run.pid.ratePitchrollP = around(state, run.pid.ratePitchrollP);
+    run.pid.ratePitchrollI = around(state, run.pid.ratePitchrollI);
+    run.pid.ratePitchrollD = around(state, run.pid.ratePitchrollD);
+
+    // Kick of 0.05 to 0.2 N m, mostly about roll or pitch
+    double magnitude = uniform(state, 0.05, 0.2);
+    double heading = uniform(state, 0, 2*M_PI);
+    run.kick[0] = magnitude * cos(heading);
+    run.kick[1] = magnitude * sin(heading);
+    run.kick[2] = magnitude * uniform(state, -0.2, +0.2);
+
+    run.noiseDps = (float)uniform(state, 0, 2);
+}
+
+static void fly(run_t & run)
+{
+    hf::SimBoard board;
+    hf::Hackflight<> h;
+
+    board.setPidConfig(run.pid);
+    board.setGyroNoise(run.noiseDps, (uint32_t)run.seed);
+
+    h.init(&board);
+
+    hf::Dynamics & dynamics = board.getDynamics();
+
+    const uint32_t step = hf::SimBoard::STEP_MICRO;
+
+    // Roll trace over the step, for settling and overshoot
+    std::vector<float> trace;
+    trace.reserve((size_t)((STEP_END - STEP_TIME) * 1e6f / step) + 1);
+
+    uint32_t airborne = 0;
+    uint32_t saturated = 0;
+    float    kickEnd = KICK_TIME + KICK_DURATION;
+    float    lastOutside = kickEnd;
+    double   zero[3] = {0, 0, 0};
+
+    run.crashed = false;
+
+    while (board.getMicros() < (uint64_t)(END_TIME * 1e6f)) {
+
+        float t = board.getMicros() / 1e6f;
+
+        board.setDemand(hf::DEMAND_YAW, t >= ARM_TIME && t < ARM_TIME+0.5f ? +1 : 0);
+        board.setDemand(hf::DEMAND_THROTTLE, t < CLIMB_TIME ? -1 : (t < HOVER_TIME ? 0.2f : 0.0f));
+        board.setDemand(hf::DEMAND_ROLL, t >= STEP_TIME && t < STEP_END ? STEP_DEMAND : 0);
+
+        dynamics.setDisturbance(t >= KICK_TIME && t < kickEnd ? run.kick : zero);
+
+        h.update();
+        board.advance(step);
+
+        double euler[3];
+        dynamics.getEulerAngles(euler);
+        float roll  = (float)(euler[0] * 180 / M_PI);
+        float pitch = (float)(euler[1] * 180 / M_PI);
+
+        if (t >= STEP_TIME && t < STEP_END)
+            trace.push_back(roll);
+
+        if (t >= kickEnd && (fabsf(roll) > SETTLE_DEGREES || fabsf(pitch) > SETTLE_DEGREES))
+            lastOutside = t;
+
+        if (t > HOVER_TIME) {
+
+            if (dynamics.isOnGround() || fabsf(roll) > 80 || fabsf(pitch) > 80) {
+                run.crashed = true;
+                break;
+            }
+
+            airborne++;
+            for (uint8_t k=0; k<hf::Dynamics::MOTORS; ++k) {
+                if (board.getMotor(k) <= 0 || board.getMotor(k) >= 1) {
+                    saturated++;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (run.crashed || trace.empty()) {
+        run.settling = run.recovery = END_TIME;
+        run.overshoot = run.saturation = 1;
+        run.score = 1e6f;
+        return;
+    }
+
+    // Final value is the mean over the last quarter of the step
+    size_t n = trace.size();
+    float final = 0;
+    for (size_t k=3*n/4; k<n; ++k)
+        final += trace[k];
+    final /= (n - 3*n/4);
+
+    float peak = *std::max_element(trace.begin(), trace.end());
+    run.overshoot = final > 0 ? std::max(0.0f, (peak - final) / final) : 1;
+
+    float band = std::max(SETTLE_FRACTION * fabsf(final), SETTLE_DEGREES);
+    size_t settled = n;
+    while (settled > 0 && fabsf(trace[settled-1] - final) <= band)
+        settled--;
+    run.settling = settled * step / 1e6f;
+
+    run.recovery = lastOutside - kickEnd;
+    run.saturation = airborne ? (float)saturated / airborne : 0;
+
+    run.score = run.settling + run.recovery + 2 * run.overshoot + 5 * run.saturation;
+}
+
+// Work-stealing pool: each worker takes runs from the back of its own queue, and when that is
+// empty steals from the front of another's
+class Pool {
+
+    public:
+
+        Pool(std::vector<run_t> & _runs, unsigned _threads) : runs(_runs), threads(_threads), queues(_threads)
+        {
+            for (size_t k=0; k<runs.size(); ++k)
+                queues[k % threads].tasks.push_back(k);
+        }
+
+        void run(void)
+        {
+            std::vector<std::thread> workers;
+
+            for (unsigned k=0; k<threads; ++k)
+                workers.push_back(std::thread(&Pool::work, this, k));
+
+            for (std::thread & w : workers)
+                w.join();
+        }
+
+        size_t getSteals(void) { return steals; }
+
+    private:
+
+        struct queue_t {
+            std::mutex         lock;
+            std::deque<size_t> tasks;
+        };
+
+        std::vector<run_t> & runs;
+        unsigned             threads;
+        std::vector<queue_t> queues;
+        std::atomic<size_t>  steals{0};
+
+        bool take(unsigned self, size_t & task)
+        {
+            {
+                std::lock_guard<std::mutex> guard(queues[self].lock);
+                if (!queues[self].tasks.empty()) {
+                    task = queues[self].tasks.back();
+                    queues[self].tasks.pop_back();
+                    return true;
+                }
+            }
+
+            for (unsigned k=1; k<threads; ++k) {
+                queue_t & victim = queues[(self + k) % threads];
+                std::lock_guard<std::mutex> guard(victim.lock);
+                if (!victim.tasks.empty()) {
+                    task = victim.tasks.front();
+                    victim.tasks.pop_front();
+                    steals++;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        void work(unsigned self)
+        {
+            size_t task;
+            while (take(self, task))
+                fly(runs[task]);
+        }
+};
+
+int main(int argc, char ** argv)
+{
+    unsigned count   = argc > 1 ? (unsigned)atoi(argv[1]) : 1000;
+    unsigned threads = argc > 2 ? (unsigned)atoi(argv[2]) : std::thread::hardware_concurrency();
+    uint64_t seed    = argc > 3 ? strtoull(argv[3], NULL, 0) : 1;
+
+    if (threads < 1)
+        threads = 1;
+
+    std::vector<run_t> runs(count);
+
+    uint64_t state = seed;
+    for (run_t & run : runs)
+        setup(run, splitmix(state));
+
+    auto start = std::chrono::steady_clock::now();
+
+    Pool pool(runs, threads);
+    pool.run();
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("seed,levelP,ratePitchrollP,ratePitchrollI,ratePitchrollD,noise,settling,overshoot,recovery,saturation,"
+            "crashed,score\n");
+
+    for (const run_t & r : runs) {
+        printf("%llu,%.4f,%.4f,%.4f,%.4f,%.2f,%.3f,%.3f,%.3f,%.3f,%d,%.3f\n", (unsigned long long)r.seed,
+                r.pid.levelP, r.pid.ratePitchrollP, r.pid.ratePitchrollI, r.pid.ratePitchrollD, r.noiseDps,
+                r.settling, r.overshoot, r.recovery, r.saturation, r.crashed, r.score);
+    }
+
+    std::vector<const run_t *> sorted;
+    for (const run_t & r : runs)
+        sorted.push_back(&r);
+    std::sort(sorted.begin(), sorted.end(), [](const run_t * a, const run_t * b) { return a->score < b->score; });
+
+    fprintf(stderr, "%u runs on %u threads in %.2f sec (%zu steals)\n", count, threads, elapsed, pool.getSteals());
+    fprintf(stderr, "best:   levelP  rateP   rateI   rateD   settle  over    recover score\n");
+    for (size_t k=0; k<sorted.size() && k<5; ++k) {
+        const run_t & r = *sorted[k];
+        fprintf(stderr, "        %.4f  %.4f  %.4f  %.4f  %.3f   %.3f   %.3f   %.3f\n", r.pid.levelP,
+                r.pid.ratePitchrollP, r.pid.ratePitchrollI, r.pid.ratePitchrollD,
+                r.settling, r.overshoot, r.recovery, r.score);
+    }
+
+    return 0;
+}
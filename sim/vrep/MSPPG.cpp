@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+// MSPv1 checksum: XOR of the size, ID and payload
 static byte CRC8(byte * data, int n) {
 
     byte crc = 0x00;
@@ -19,6 +20,53 @@ static byte CRC8(byte * data, int n) {
     return crc;
 }
 
+static byte CRC8_DVB_S2_step(byte crc, byte b) {
+
+    crc ^= b;
+
+    for (int k=0; k<8; ++k) {
+
+        crc = (crc & 0x80) ? (crc << 1) ^ 0xD5 : crc << 1;
+    }
+
+    return crc;
+}
+
+// MSPv2 checksum: CRC-8/DVB-S2 of the flag, ID, size and payload
+static byte CRC8_DVB_S2(byte * data, int n) {
+
+    byte crc = 0x00;
+
+    for (int k=0; k<n; ++k) {
+
+        crc = CRC8_DVB_S2_step(crc, data[k]);
+    }
+
+    return crc;
+}
+
+size_t MSP_Parser::frame(byte * out, bool v2, byte direction, unsigned short id, unsigned short size) {
+
+    out[0] = 36;
+    out[1] = v2 ? 88 : 77;
+    out[2] = direction;
+
+    if (v2) {
+        out[3] = 0;
+        out[4] = id & 0xFF;
+        out[5] = id >> 8;
+        out[6] = size & 0xFF;
+        out[7] = size >> 8;
+        out[8+size] = CRC8_DVB_S2(&out[3], size+5);
+        return size + 9;
+    }
+
+    out[3] = size;
+    out[4] = id;
+    out[5+size] = CRC8(&out[3], size+2);
+    return size + 6;
+}
+
 byte MSP_Message::start() {
 
     this->pos = 0;
@@ -39,6 +87,13 @@ byte MSP_Message::getNext() {
 MSP_Parser::MSP_Parser() {
 
     this->state = 0;
+    this->message_v2 = false;
+}
+
+void MSP_Parser::checksum(byte b) {
+
+    this->message_checksum = this->message_v2 ? CRC8_DVB_S2_step(this->message_checksum, b) :
+        this->message_checksum ^ b;
 }
 
 void MSP_Parser::parse(byte b) {
@@ -52,7 +107,8 @@ void MSP_Parser::parse(byte b) {
             break;        
 
         case 1:               // sync char 2
-            if (b == 77) { // M
+            if (b == 77 || b == 88) { // M or X
+                this->message_v2 = b == 88;
                 this->state++;
             }
             else {            // restart and try again
@@ -67,33 +123,27 @@ void MSP_Parser::parse(byte b) {
             else {            // <
                 this->message_direction = 0;
             }
-            this->state++;
+            this->message_checksum = 0;
+            this->message_length_received = 0;
+            this->state = this->message_v2 ? 7 : 3;
             break;
 
         case 3:
             this->message_length_expected = b;
-            this->message_checksum = b;
-            // setup arraybuffer
-            this->message_length_received = 0;
+            this->checksum(b);
             this->state++;
             break;
 
         case 4:
             this->message_id = b;
-            this->message_checksum ^= b;
-            if (this->message_length_expected > 0) {
-                // process payload
-                this->state++;
-            }
-            else {
-                // no payload
-                this->state += 2;
-            }
+            this->checksum(b);
+            // payload, or none
+            this->state = this->message_length_expected > 0 ? 5 : 6;
             break;
 
         case 5: // payload
             this->message_buffer[this->message_length_received] = b;
-            this->message_checksum ^= b;
+            this->checksum(b);
             this->message_length_received++;
             if (this->message_length_received >= this->message_length_expected) {
                 this->state++;
@@ -103,92 +153,456 @@ void MSP_Parser::parse(byte b) {
         case 6:
             this->state = 0;
             if (this->message_checksum == b) {
-                // message received, process
-                switch (this->message_id) {
-                
-                    case 105: {
+                this->dispatch();
+            }
+            break;
 
-                        short c1;
-                        memcpy(&c1,  &this->message_buffer[0], sizeof(short));
+        case 7: // MSPv2 flag, unused
+            this->checksum(b);
+            this->state++;
+            break;
 
-                        short c2;
-                        memcpy(&c2,  &this->message_buffer[2], sizeof(short));
+        case 8:
+            this->message_id = b;
+            this->checksum(b);
+            this->state++;
+            break;
+
+        case 9:
+            this->message_id |= b << 8;
+            this->checksum(b);
+            this->state++;
+            break;
+
+        case 10:
+            this->message_length_expected = b;
+            this->checksum(b);
+            this->state++;
+            break;
 
-                        short c3;
-                        memcpy(&c3,  &this->message_buffer[4], sizeof(short));
+        case 11:
+            this->message_length_expected |= b << 8;
+            this->checksum(b);
+            if (this->message_length_expected > MAXBUF) {
+                // too big for the buffer: resync
+                this->state = 0;
+            }
+            else {
+                // payload, or none
+                this->state = this->message_length_expected > 0 ? 5 : 6;
+            }
+            break;
 
-                        short c4;
-                        memcpy(&c4,  &this->message_buffer[6], sizeof(short));
+        default:
+            break;
+    }
+}
 
-                        short c5;
-                        memcpy(&c5,  &this->message_buffer[8], sizeof(short));
+void MSP_Parser::parse(const byte * buf, size_t len) {
 
-                        short c6;
-                        memcpy(&c6,  &this->message_buffer[10], sizeof(short));
+    size_t k = 0;
 
-                        short c7;
-                        memcpy(&c7,  &this->message_buffer[12], sizeof(short));
+    while (k < len) {
 
-                        short c8;
-                        memcpy(&c8,  &this->message_buffer[14], sizeof(short));
+        // Mid-message: continue a byte at a time until back in sync
+        if (this->state != 0) {
+            this->parse(buf[k++]);
+            continue;
+        }
 
-                        this->handlerForRC->handle_RC(c1, c2, c3, c4, c5, c6, c7, c8);
-                        } break;
+        // Skip straight to the next preamble
+        const byte * start = (const byte *)memchr(&buf[k], 36, len-k);
+        if (!start) {
+            return;
+        }
+        k = start - buf;
 
-                    case 127: {
+        // A whole MSPv1 message in the buffer can be checked and dispatched in one pass; anything
+        // else (a message split across calls, a stray $, or MSPv2) goes through the byte parser
+        size_t avail = len - k;
+        if (avail < 6 || buf[k+1] != 77 || avail < (size_t)(6 + buf[k+3])) {
+            this->parse(buf[k++]);
+            continue;
+        }
 
-                        short back;
-                        memcpy(&back,  &this->message_buffer[0], sizeof(short));
+        byte size = buf[k+3];
 
-                        short front;
-                        memcpy(&front,  &this->message_buffer[2], sizeof(short));
+        this->message_v2 = false;
+        this->message_direction = buf[k+2] == 62 ? 1 : 0;
+        this->message_length_expected = size;
+        this->message_length_received = size;
+        this->message_id = buf[k+4];
 
-                        short left;
-                        memcpy(&left,  &this->message_buffer[4], sizeof(short));
+        byte checksum = CRC8((byte *)&buf[k+3], size+2);
 
-                        short right;
-                        memcpy(&right,  &this->message_buffer[6], sizeof(short));
+        if (checksum == buf[k+5+size]) {
+            memcpy(this->message_buffer, &buf[k+5], size);
+            this->dispatch();
+        }
 
-                        this->handlerForSONARS->handle_SONARS(back, front, left, right);
-                        } break;
+        k += 6 + size;
+    }
+}
 
-                    case 108: {
+void MSP_Parser::dispatch(void) {
 
-                        short roll;
-                        memcpy(&roll,  &this->message_buffer[0], sizeof(short));
+    switch (this->message_id) {
 
-                        short pitch;
-                        memcpy(&pitch,  &this->message_buffer[2], sizeof(short));
+        case 105: {
 
-                        short yaw;
-                        memcpy(&yaw,  &this->message_buffer[4], sizeof(short));
+            short c1;
+            memcpy(&c1,  &this->message_buffer[0], sizeof(short));
 
-                        this->handlerForATTITUDE->handle_ATTITUDE(roll, pitch, yaw);
-                        } break;
+            short c2;
+            memcpy(&c2,  &this->message_buffer[2], sizeof(short));
 
-                    case 109: {
+            short c3;
+            memcpy(&c3,  &this->message_buffer[4], sizeof(short));
 
-                        int altitude;
-                        memcpy(&altitude,  &this->message_buffer[0], sizeof(int));
+            short c4;
+            memcpy(&c4,  &this->message_buffer[6], sizeof(short));
 
-                        short vario;
-                        memcpy(&vario,  &this->message_buffer[4], sizeof(short));
+            short c5;
+            memcpy(&c5,  &this->message_buffer[8], sizeof(short));
 
-                        this->handlerForALTITUDE->handle_ALTITUDE(altitude, vario);
-                        } break;
+            short c6;
+            memcpy(&c6,  &this->message_buffer[10], sizeof(short));
 
-                    case 128: {
+            short c7;
+            memcpy(&c7,  &this->message_buffer[12], sizeof(short));
 
-                        short distance;
-                        memcpy(&distance,  &this->message_buffer[0], sizeof(short));
+            short c8;
+            memcpy(&c8,  &this->message_buffer[14], sizeof(short));
 
-                        this->handlerForSONAR->handle_SONAR(distance);
-                        } break;
+            this->handlerForRC->handle_RC(c1, c2, c3, c4, c5, c6, c7, c8);
+            } break;
 
-                }
-            }
+        case 108: {
 
-            break;
+            short roll;
+            memcpy(&roll,  &this->message_buffer[0], sizeof(short));
+
+            short pitch;
+            memcpy(&pitch,  &this->message_buffer[2], sizeof(short));
+
+            short yaw;
+            memcpy(&yaw,  &this->message_buffer[4], sizeof(short));
+
+            this->handlerForATTITUDE->handle_ATTITUDE(roll, pitch, yaw);
+            } break;
+
+        case 109: {
+
+            int altitude;
+            memcpy(&altitude,  &this->message_buffer[0], sizeof(int));
+
+            short vario;
+            memcpy(&vario,  &this->message_buffer[4], sizeof(short));
+
+            this->handlerForALTITUDE->handle_ALTITUDE(altitude, vario);
+            } break;
+
+        case 111: {
+
+            short mincheck;
+            memcpy(&mincheck,  &this->message_buffer[0], sizeof(short));
+
+            short maxcheck;
+            memcpy(&maxcheck,  &this->message_buffer[2], sizeof(short));
+
+            short expo8;
+            memcpy(&expo8,  &this->message_buffer[4], sizeof(short));
+
+            short rate8;
+            memcpy(&rate8,  &this->message_buffer[6], sizeof(short));
+
+            byte thrMid8;
+            memcpy(&thrMid8,  &this->message_buffer[8], sizeof(byte));
+
+            byte thrExpo8;
+            memcpy(&thrExpo8,  &this->message_buffer[9], sizeof(byte));
+
+            byte averageLog2;
+            memcpy(&averageLog2,  &this->message_buffer[10], sizeof(byte));
+
+            this->handlerForRC_CONFIG->handle_RC_CONFIG(mincheck, maxcheck, expo8, rate8, thrMid8, thrExpo8, averageLog2);
+            } break;
+
+        case 112: {
+
+            float levelP;
+            memcpy(&levelP,  &this->message_buffer[0], sizeof(float));
+
+            float ratePitchrollP;
+            memcpy(&ratePitchrollP,  &this->message_buffer[4], sizeof(float));
+
+            float ratePitchrollI;
+            memcpy(&ratePitchrollI,  &this->message_buffer[8], sizeof(float));
+
+            float ratePitchrollD;
+            memcpy(&ratePitchrollD,  &this->message_buffer[12], sizeof(float));
+
+            float yawP;
+            memcpy(&yawP,  &this->message_buffer[16], sizeof(float));
+
+            float yawI;
+            memcpy(&yawI,  &this->message_buffer[20], sizeof(float));
+
+            short trimRoll;
+            memcpy(&trimRoll,  &this->message_buffer[24], sizeof(short));
+
+            short trimPitch;
+            memcpy(&trimPitch,  &this->message_buffer[26], sizeof(short));
+
+            short trimYaw;
+            memcpy(&trimYaw,  &this->message_buffer[28], sizeof(short));
+
+            float feedForward;
+            memcpy(&feedForward,  &this->message_buffer[30], sizeof(float));
+
+            this->handlerForPID_CONFIG->handle_PID_CONFIG(levelP, ratePitchrollP, ratePitchrollI, ratePitchrollD, yawP, yawI, trimRoll, trimPitch, trimYaw, feedForward);
+            } break;
+
+        case 113: {
+
+            int frames;
+            memcpy(&frames,  &this->message_buffer[0], sizeof(int));
+
+            short errors;
+            memcpy(&errors,  &this->message_buffer[4], sizeof(short));
+
+            short lost;
+            memcpy(&lost,  &this->message_buffer[6], sizeof(short));
+
+            short interval;
+            memcpy(&interval,  &this->message_buffer[8], sizeof(short));
+
+            byte quality;
+            memcpy(&quality,  &this->message_buffer[10], sizeof(byte));
+
+            byte rssi;
+            memcpy(&rssi,  &this->message_buffer[11], sizeof(byte));
+
+            byte failsafe;
+            memcpy(&failsafe,  &this->message_buffer[12], sizeof(byte));
+
+            this->handlerForRC_LINK->handle_RC_LINK(frames, errors, lost, interval, quality, rssi, failsafe);
+            } break;
+
+        case 114: {
+
+            int time;
+            memcpy(&time,  &this->message_buffer[0], sizeof(int));
+
+            short roll;
+            memcpy(&roll,  &this->message_buffer[4], sizeof(short));
+
+            short pitch;
+            memcpy(&pitch,  &this->message_buffer[6], sizeof(short));
+
+            short yaw;
+            memcpy(&yaw,  &this->message_buffer[8], sizeof(short));
+
+            short gyroX;
+            memcpy(&gyroX,  &this->message_buffer[10], sizeof(short));
+
+            short gyroY;
+            memcpy(&gyroY,  &this->message_buffer[12], sizeof(short));
+
+            short gyroZ;
+            memcpy(&gyroZ,  &this->message_buffer[14], sizeof(short));
+
+            short pidRoll;
+            memcpy(&pidRoll,  &this->message_buffer[16], sizeof(short));
+
+            short pidPitch;
+            memcpy(&pidPitch,  &this->message_buffer[18], sizeof(short));
+
+            short pidYaw;
+            memcpy(&pidYaw,  &this->message_buffer[20], sizeof(short));
+
+            byte m1;
+            memcpy(&m1,  &this->message_buffer[22], sizeof(byte));
+
+            byte m2;
+            memcpy(&m2,  &this->message_buffer[23], sizeof(byte));
+
+            byte m3;
+            memcpy(&m3,  &this->message_buffer[24], sizeof(byte));
+
+            byte m4;
+            memcpy(&m4,  &this->message_buffer[25], sizeof(byte));
+
+            short loopExec;
+            memcpy(&loopExec,  &this->message_buffer[26], sizeof(short));
+
+            short loopLate;
+            memcpy(&loopLate,  &this->message_buffer[28], sizeof(short));
+
+            this->handlerForSTATE->handle_STATE(time, roll, pitch, yaw, gyroX, gyroY, gyroZ, pidRoll, pidPitch, pidYaw, m1, m2, m3, m4, loopExec, loopLate);
+            } break;
+
+        case 115: {
+
+            short seq;
+            memcpy(&seq,  &this->message_buffer[0], sizeof(short));
+
+            int accepted;
+            memcpy(&accepted,  &this->message_buffer[2], sizeof(int));
+
+            short gaps;
+            memcpy(&gaps,  &this->message_buffer[6], sizeof(short));
+
+            short stale;
+            memcpy(&stale,  &this->message_buffer[8], sizeof(short));
+
+            short rxErrors;
+            memcpy(&rxErrors,  &this->message_buffer[10], sizeof(short));
+
+            short txDropped;
+            memcpy(&txDropped,  &this->message_buffer[12], sizeof(short));
+
+            this->handlerForACK->handle_ACK(seq, accepted, gaps, stale, rxErrors, txDropped);
+            } break;
+
+        case 121: {
+
+            byte state;
+            memcpy(&state,  &this->message_buffer[0], sizeof(byte));
+
+            byte waypoint;
+            memcpy(&waypoint,  &this->message_buffer[1], sizeof(byte));
+
+            byte count;
+            memcpy(&count,  &this->message_buffer[2], sizeof(byte));
+
+            int distance;
+            memcpy(&distance,  &this->message_buffer[3], sizeof(int));
+
+            short crossTrack;
+            memcpy(&crossTrack,  &this->message_buffer[7], sizeof(short));
+
+            this->handlerForNAV_STATUS->handle_NAV_STATUS(state, waypoint, count, distance, crossTrack);
+            } break;
+
+        case 127: {
+
+            short back;
+            memcpy(&back,  &this->message_buffer[0], sizeof(short));
+
+            short front;
+            memcpy(&front,  &this->message_buffer[2], sizeof(short));
+
+            short left;
+            memcpy(&left,  &this->message_buffer[4], sizeof(short));
+
+            short right;
+            memcpy(&right,  &this->message_buffer[6], sizeof(short));
+
+            this->handlerForSONARS->handle_SONARS(back, front, left, right);
+            } break;
+
+        case 150: {
+
+            short lateMax;
+            memcpy(&lateMax,  &this->message_buffer[0], sizeof(short));
+
+            short execMax;
+            memcpy(&execMax,  &this->message_buffer[2], sizeof(short));
+
+            short overruns;
+            memcpy(&overruns,  &this->message_buffer[4], sizeof(short));
+
+            short late0;
+            memcpy(&late0,  &this->message_buffer[6], sizeof(short));
+
+            short late1;
+            memcpy(&late1,  &this->message_buffer[8], sizeof(short));
+
+            short late2;
+            memcpy(&late2,  &this->message_buffer[10], sizeof(short));
+
+            short late3;
+            memcpy(&late3,  &this->message_buffer[12], sizeof(short));
+
+            short late4;
+            memcpy(&late4,  &this->message_buffer[14], sizeof(short));
+
+            short late5;
+            memcpy(&late5,  &this->message_buffer[16], sizeof(short));
+
+            short late6;
+            memcpy(&late6,  &this->message_buffer[18], sizeof(short));
+
+            short late7;
+            memcpy(&late7,  &this->message_buffer[20], sizeof(short));
+
+            short exec0;
+            memcpy(&exec0,  &this->message_buffer[22], sizeof(short));
+
+            short exec1;
+            memcpy(&exec1,  &this->message_buffer[24], sizeof(short));
+
+            short exec2;
+            memcpy(&exec2,  &this->message_buffer[26], sizeof(short));
+
+            short exec3;
+            memcpy(&exec3,  &this->message_buffer[28], sizeof(short));
+
+            short exec4;
+            memcpy(&exec4,  &this->message_buffer[30], sizeof(short));
+
+            short exec5;
+            memcpy(&exec5,  &this->message_buffer[32], sizeof(short));
+
+            short exec6;
+            memcpy(&exec6,  &this->message_buffer[34], sizeof(short));
+
+            short exec7;
+            memcpy(&exec7,  &this->message_buffer[36], sizeof(short));
+
+            this->handlerForLOOP_TIMING->handle_LOOP_TIMING(lateMax, execMax, overruns, late0, late1, late2, late3, late4, late5, late6, late7, exec0, exec1, exec2, exec3, exec4, exec5, exec6, exec7);
+            } break;
+
+        case 151: {
+
+            int period;
+            memcpy(&period,  &this->message_buffer[0], sizeof(int));
+
+            int tunedPeriod;
+            memcpy(&tunedPeriod,  &this->message_buffer[4], sizeof(int));
+
+            short worstCycle;
+            memcpy(&worstCycle,  &this->message_buffer[8], sizeof(short));
+
+            this->handlerForLOOP_RATE->handle_LOOP_RATE(period, tunedPeriod, worstCycle);
+            } break;
+
+        case 131: {
+
+            short seq;
+            memcpy(&seq,  &this->message_buffer[0], sizeof(short));
+
+            short m1;
+            memcpy(&m1,  &this->message_buffer[2], sizeof(short));
+
+            short m2;
+            memcpy(&m2,  &this->message_buffer[4], sizeof(short));
+
+            short m3;
+            memcpy(&m3,  &this->message_buffer[6], sizeof(short));
+
+            short m4;
+            memcpy(&m4,  &this->message_buffer[8], sizeof(short));
+
+            short latency;
+            memcpy(&latency,  &this->message_buffer[10], sizeof(short));
+
+            short missed;
+            memcpy(&missed,  &this->message_buffer[12], sizeof(short));
+
+            this->handlerForHIL_MOTORS->handle_HIL_MOTORS(seq, m1, m2, m3, m4, latency, missed);
+            } break;
 
         default:
             break;
@@ -200,277 +614,784 @@ void MSP_Parser::set_RC_Handler(class RC_Handler * handler) {
     this->handlerForRC = handler;
 }
 
-MSP_Message MSP_Parser::serialize_RC_Request() {
+MSP_Message MSP_Parser::serialize_RC_Request(bool v2) {
 
     MSP_Message msg;
 
-    msg.bytes[0] = 36;
-    msg.bytes[1] = 77;
-    msg.bytes[2] = 60;
-    msg.bytes[3] = 0;
-    msg.bytes[4] = 105;
-    msg.bytes[5] = 105;
+    msg.len = frame(msg.bytes, v2, 60, 105, 0);
+
+    return msg;
+}
+
+size_t MSP_Parser::serialize_RC_into(byte * out, size_t cap, short c1, short c2, short c3, short c4, short c5, short c6, short c7, short c8, bool v2) {
+
+    size_t headerSize = v2 ? 8 : 5;
+
+    if (cap < headerSize + 17) {
+        return 0;
+    }
+
+    memcpy(&out[headerSize+0], &c1, sizeof(short));
+    memcpy(&out[headerSize+2], &c2, sizeof(short));
+    memcpy(&out[headerSize+4], &c3, sizeof(short));
+    memcpy(&out[headerSize+6], &c4, sizeof(short));
+    memcpy(&out[headerSize+8], &c5, sizeof(short));
+    memcpy(&out[headerSize+10], &c6, sizeof(short));
+    memcpy(&out[headerSize+12], &c7, sizeof(short));
+    memcpy(&out[headerSize+14], &c8, sizeof(short));
+
+    return frame(out, v2, 62, 105, 16);
+}
+
+MSP_Message MSP_Parser::serialize_RC(short c1, short c2, short c3, short c4, short c5, short c6, short c7, short c8, bool v2) {
+
+    MSP_Message msg;
 
-    msg.len = 6;
+    msg.len = serialize_RC_into(msg.bytes, MAXBUF, c1, c2, c3, c4, c5, c6, c7, c8, v2);
 
     return msg;
 }
 
-MSP_Message MSP_Parser::serialize_RC(short c1, short c2, short c3, short c4, short c5, short c6, short c7, short c8) {
+void MSP_Parser::set_ATTITUDE_Handler(class ATTITUDE_Handler * handler) {
+
+    this->handlerForATTITUDE = handler;
+}
+
+MSP_Message MSP_Parser::serialize_ATTITUDE_Request(bool v2) {
 
     MSP_Message msg;
 
-    msg.bytes[0] = 36;
-    msg.bytes[1] = 77;
-    msg.bytes[2] = 62;
-    msg.bytes[3] = 16;
-    msg.bytes[4] = 105;
+    msg.len = frame(msg.bytes, v2, 60, 108, 0);
+
+    return msg;
+}
+
+size_t MSP_Parser::serialize_ATTITUDE_into(byte * out, size_t cap, short roll, short pitch, short yaw, bool v2) {
+
+    size_t headerSize = v2 ? 8 : 5;
+
+    if (cap < headerSize + 7) {
+        return 0;
+    }
+
+    memcpy(&out[headerSize+0], &roll, sizeof(short));
+    memcpy(&out[headerSize+2], &pitch, sizeof(short));
+    memcpy(&out[headerSize+4], &yaw, sizeof(short));
+
+    return frame(out, v2, 62, 108, 6);
+}
 
-    memcpy(&msg.bytes[5], &c1, sizeof(short));
-    memcpy(&msg.bytes[7], &c2, sizeof(short));
-    memcpy(&msg.bytes[9], &c3, sizeof(short));
-    memcpy(&msg.bytes[11], &c4, sizeof(short));
-    memcpy(&msg.bytes[13], &c5, sizeof(short));
-    memcpy(&msg.bytes[15], &c6, sizeof(short));
-    memcpy(&msg.bytes[17], &c7, sizeof(short));
-    memcpy(&msg.bytes[19], &c8, sizeof(short));
+MSP_Message MSP_Parser::serialize_ATTITUDE(short roll, short pitch, short yaw, bool v2) {
 
-    msg.bytes[21] = CRC8(&msg.bytes[3], 18);
+    MSP_Message msg;
 
-    msg.len = 22;
+    msg.len = serialize_ATTITUDE_into(msg.bytes, MAXBUF, roll, pitch, yaw, v2);
 
     return msg;
 }
 
-MSP_Message MSP_Parser::serialize_SET_HEAD(short head) {
+void MSP_Parser::set_ALTITUDE_Handler(class ALTITUDE_Handler * handler) {
+
+    this->handlerForALTITUDE = handler;
+}
+
+MSP_Message MSP_Parser::serialize_ALTITUDE_Request(bool v2) {
 
     MSP_Message msg;
 
-    msg.bytes[0] = 36;
-    msg.bytes[1] = 77;
-    msg.bytes[2] = 62;
-    msg.bytes[3] = 2;
-    msg.bytes[4] = 205;
+    msg.len = frame(msg.bytes, v2, 60, 109, 0);
+
+    return msg;
+}
+
+size_t MSP_Parser::serialize_ALTITUDE_into(byte * out, size_t cap, int altitude, short vario, bool v2) {
+
+    size_t headerSize = v2 ? 8 : 5;
 
-    memcpy(&msg.bytes[5], &head, sizeof(short));
+    if (cap < headerSize + 7) {
+        return 0;
+    }
+
+    memcpy(&out[headerSize+0], &altitude, sizeof(int));
+    memcpy(&out[headerSize+4], &vario, sizeof(short));
+
+    return frame(out, v2, 62, 109, 6);
+}
 
-    msg.bytes[7] = CRC8(&msg.bytes[3], 4);
+MSP_Message MSP_Parser::serialize_ALTITUDE(int altitude, short vario, bool v2) {
 
-    msg.len = 8;
+    MSP_Message msg;
+
+    msg.len = serialize_ALTITUDE_into(msg.bytes, MAXBUF, altitude, vario, v2);
 
     return msg;
 }
 
-void MSP_Parser::set_SONARS_Handler(class SONARS_Handler * handler) {
+void MSP_Parser::set_RC_CONFIG_Handler(class RC_CONFIG_Handler * handler) {
 
-    this->handlerForSONARS = handler;
+    this->handlerForRC_CONFIG = handler;
 }
 
-MSP_Message MSP_Parser::serialize_SONARS_Request() {
+MSP_Message MSP_Parser::serialize_RC_CONFIG_Request(bool v2) {
 
     MSP_Message msg;
 
-    msg.bytes[0] = 36;
-    msg.bytes[1] = 77;
-    msg.bytes[2] = 60;
-    msg.bytes[3] = 0;
-    msg.bytes[4] = 127;
-    msg.bytes[5] = 127;
+    msg.len = frame(msg.bytes, v2, 60, 111, 0);
+
+    return msg;
+}
+
+size_t MSP_Parser::serialize_RC_CONFIG_into(byte * out, size_t cap, short mincheck, short maxcheck, short expo8, short rate8, byte thrMid8, byte thrExpo8, byte averageLog2, bool v2) {
+
+    size_t headerSize = v2 ? 8 : 5;
+
+    if (cap < headerSize + 12) {
+        return 0;
+    }
+
+    memcpy(&out[headerSize+0], &mincheck, sizeof(short));
+    memcpy(&out[headerSize+2], &maxcheck, sizeof(short));
+    memcpy(&out[headerSize+4], &expo8, sizeof(short));
+    memcpy(&out[headerSize+6], &rate8, sizeof(short));
+    memcpy(&out[headerSize+8], &thrMid8, sizeof(byte));
+    memcpy(&out[headerSize+9], &thrExpo8, sizeof(byte));
+    memcpy(&out[headerSize+10], &averageLog2, sizeof(byte));
+
+    return frame(out, v2, 62, 111, 11);
+}
+
+MSP_Message MSP_Parser::serialize_RC_CONFIG(short mincheck, short maxcheck, short expo8, short rate8, byte thrMid8, byte thrExpo8, byte averageLog2, bool v2) {
 
-    msg.len = 6;
+    MSP_Message msg;
+
+    msg.len = serialize_RC_CONFIG_into(msg.bytes, MAXBUF, mincheck, maxcheck, expo8, rate8, thrMid8, thrExpo8, averageLog2, v2);
 
     return msg;
 }
 
-MSP_Message MSP_Parser::serialize_SONARS(short back, short front, short left, short right) {
+void MSP_Parser::set_PID_CONFIG_Handler(class PID_CONFIG_Handler * handler) {
+
+    this->handlerForPID_CONFIG = handler;
+}
+
+MSP_Message MSP_Parser::serialize_PID_CONFIG_Request(bool v2) {
 
     MSP_Message msg;
 
-    msg.bytes[0] = 36;
-    msg.bytes[1] = 77;
-    msg.bytes[2] = 62;
-    msg.bytes[3] = 8;
-    msg.bytes[4] = 127;
+    msg.len = frame(msg.bytes, v2, 60, 112, 0);
+
+    return msg;
+}
 
-    memcpy(&msg.bytes[5], &back, sizeof(short));
-    memcpy(&msg.bytes[7], &front, sizeof(short));
-    memcpy(&msg.bytes[9], &left, sizeof(short));
-    memcpy(&msg.bytes[11], &right, sizeof(short));
+size_t MSP_Parser::serialize_PID_CONFIG_into(byte * out, size_t cap, float levelP, float ratePitchrollP, float ratePitchrollI, float ratePitchrollD, float yawP, float yawI, short trimRoll, short trimPitch, short trimYaw, float feedForward, bool v2) {
 
-    msg.bytes[13] = CRC8(&msg.bytes[3], 10);
+    size_t headerSize = v2 ? 8 : 5;
 
-    msg.len = 14;
+    if (cap < headerSize + 35) {
+        return 0;
+    }
+
+    memcpy(&out[headerSize+0], &levelP, sizeof(float));
+    memcpy(&out[headerSize+4], &ratePitchrollP, sizeof(float));
+    memcpy(&out[headerSize+8], &ratePitchrollI, sizeof(float));
+    memcpy(&out[headerSize+12], &ratePitchrollD, sizeof(float));
+    memcpy(&out[headerSize+16], &yawP, sizeof(float));
+    memcpy(&out[headerSize+20], &yawI, sizeof(float));
+    memcpy(&out[headerSize+24], &trimRoll, sizeof(short));
+    memcpy(&out[headerSize+26], &trimPitch, sizeof(short));
+    memcpy(&out[headerSize+28], &trimYaw, sizeof(short));
+    memcpy(&out[headerSize+30], &feedForward, sizeof(float));
+
+    return frame(out, v2, 62, 112, 34);
+}
+
+MSP_Message MSP_Parser::serialize_PID_CONFIG(float levelP, float ratePitchrollP, float ratePitchrollI, float ratePitchrollD, float yawP, float yawI, short trimRoll, short trimPitch, short trimYaw, float feedForward, bool v2) {
+
+    MSP_Message msg;
+
+    msg.len = serialize_PID_CONFIG_into(msg.bytes, MAXBUF, levelP, ratePitchrollP, ratePitchrollI, ratePitchrollD, yawP, yawI, trimRoll, trimPitch, trimYaw, feedForward, v2);
 
     return msg;
 }
 
-void MSP_Parser::set_ATTITUDE_Handler(class ATTITUDE_Handler * handler) {
+void MSP_Parser::set_RC_LINK_Handler(class RC_LINK_Handler * handler) {
 
-    this->handlerForATTITUDE = handler;
+    this->handlerForRC_LINK = handler;
+}
+
+MSP_Message MSP_Parser::serialize_RC_LINK_Request(bool v2) {
+
+    MSP_Message msg;
+
+    msg.len = frame(msg.bytes, v2, 60, 113, 0);
+
+    return msg;
+}
+
+size_t MSP_Parser::serialize_RC_LINK_into(byte * out, size_t cap, int frames, short errors, short lost, short interval, byte quality, byte rssi, byte failsafe, bool v2) {
+
+    size_t headerSize = v2 ? 8 : 5;
+
+    if (cap < headerSize + 14) {
+        return 0;
+    }
+
+    memcpy(&out[headerSize+0], &frames, sizeof(int));
+    memcpy(&out[headerSize+4], &errors, sizeof(short));
+    memcpy(&out[headerSize+6], &lost, sizeof(short));
+    memcpy(&out[headerSize+8], &interval, sizeof(short));
+    memcpy(&out[headerSize+10], &quality, sizeof(byte));
+    memcpy(&out[headerSize+11], &rssi, sizeof(byte));
+    memcpy(&out[headerSize+12], &failsafe, sizeof(byte));
+
+    return frame(out, v2, 62, 113, 13);
+}
+
+MSP_Message MSP_Parser::serialize_RC_LINK(int frames, short errors, short lost, short interval, byte quality, byte rssi, byte failsafe, bool v2) {
+
+    MSP_Message msg;
+
+    msg.len = serialize_RC_LINK_into(msg.bytes, MAXBUF, frames, errors, lost, interval, quality, rssi, failsafe, v2);
+
+    return msg;
+}
+
+void MSP_Parser::set_STATE_Handler(class STATE_Handler * handler) {
+
+    this->handlerForSTATE = handler;
 }
 
-MSP_Message MSP_Parser::serialize_ATTITUDE_Request() {
+MSP_Message MSP_Parser::serialize_STATE_Request(bool v2) {
 
     MSP_Message msg;
 
-    msg.bytes[0] = 36;
-    msg.bytes[1] = 77;
-    msg.bytes[2] = 60;
-    msg.bytes[3] = 0;
-    msg.bytes[4] = 108;
-    msg.bytes[5] = 108;
+    msg.len = frame(msg.bytes, v2, 60, 114, 0);
+
+    return msg;
+}
+
+size_t MSP_Parser::serialize_STATE_into(byte * out, size_t cap, int time, short roll, short pitch, short yaw, short gyroX, short gyroY, short gyroZ, short pidRoll, short pidPitch, short pidYaw, byte m1, byte m2, byte m3, byte m4, short loopExec, short loopLate, bool v2) {
+
+    size_t headerSize = v2 ? 8 : 5;
+
+    if (cap < headerSize + 31) {
+        return 0;
+    }
+
+    memcpy(&out[headerSize+0], &time, sizeof(int));
+    memcpy(&out[headerSize+4], &roll, sizeof(short));
+    memcpy(&out[headerSize+6], &pitch, sizeof(short));
+    memcpy(&out[headerSize+8], &yaw, sizeof(short));
+    memcpy(&out[headerSize+10], &gyroX, sizeof(short));
+    memcpy(&out[headerSize+12], &gyroY, sizeof(short));
+    memcpy(&out[headerSize+14], &gyroZ, sizeof(short));
+    memcpy(&out[headerSize+16], &pidRoll, sizeof(short));
+    memcpy(&out[headerSize+18], &pidPitch, sizeof(short));
+    memcpy(&out[headerSize+20], &pidYaw, sizeof(short));
+    memcpy(&out[headerSize+22], &m1, sizeof(byte));
+    memcpy(&out[headerSize+23], &m2, sizeof(byte));
+    memcpy(&out[headerSize+24], &m3, sizeof(byte));
+    memcpy(&out[headerSize+25], &m4, sizeof(byte));
+    memcpy(&out[headerSize+26], &loopExec, sizeof(short));
+    memcpy(&out[headerSize+28], &loopLate, sizeof(short));
+
+    return frame(out, v2, 62, 114, 30);
+}
+
+MSP_Message MSP_Parser::serialize_STATE(int time, short roll, short pitch, short yaw, short gyroX, short gyroY, short gyroZ, short pidRoll, short pidPitch, short pidYaw, byte m1, byte m2, byte m3, byte m4, short loopExec, short loopLate, bool v2) {
+
+    MSP_Message msg;
+
+    msg.len = serialize_STATE_into(msg.bytes, MAXBUF, time, roll, pitch, yaw, gyroX, gyroY, gyroZ, pidRoll, pidPitch, pidYaw, m1, m2, m3, m4, loopExec, loopLate, v2);
+
+    return msg;
+}
+
+void MSP_Parser::set_ACK_Handler(class ACK_Handler * handler) {
+
+    this->handlerForACK = handler;
+}
+
+MSP_Message MSP_Parser::serialize_ACK_Request(bool v2) {
+
+    MSP_Message msg;
+
+    msg.len = frame(msg.bytes, v2, 60, 115, 0);
+
+    return msg;
+}
+
+size_t MSP_Parser::serialize_ACK_into(byte * out, size_t cap, short seq, int accepted, short gaps, short stale, short rxErrors, short txDropped, bool v2) {
+
+    size_t headerSize = v2 ? 8 : 5;
+
+    if (cap < headerSize + 15) {
+        return 0;
+    }
+
+    memcpy(&out[headerSize+0], &seq, sizeof(short));
+    memcpy(&out[headerSize+2], &accepted, sizeof(int));
+    memcpy(&out[headerSize+6], &gaps, sizeof(short));
+    memcpy(&out[headerSize+8], &stale, sizeof(short));
+    memcpy(&out[headerSize+10], &rxErrors, sizeof(short));
+    memcpy(&out[headerSize+12], &txDropped, sizeof(short));
+
+    return frame(out, v2, 62, 115, 14);
+}
+
+MSP_Message MSP_Parser::serialize_ACK(short seq, int accepted, short gaps, short stale, short rxErrors, short txDropped, bool v2) {
 
-    msg.len = 6;
+    MSP_Message msg;
+
+    msg.len = serialize_ACK_into(msg.bytes, MAXBUF, seq, accepted, gaps, stale, rxErrors, txDropped, v2);
 
     return msg;
 }
 
-MSP_Message MSP_Parser::serialize_ATTITUDE(short roll, short pitch, short yaw) {
+void MSP_Parser::set_NAV_STATUS_Handler(class NAV_STATUS_Handler * handler) {
+
+    this->handlerForNAV_STATUS = handler;
+}
+
+MSP_Message MSP_Parser::serialize_NAV_STATUS_Request(bool v2) {
 
     MSP_Message msg;
 
-    msg.bytes[0] = 36;
-    msg.bytes[1] = 77;
-    msg.bytes[2] = 62;
-    msg.bytes[3] = 6;
-    msg.bytes[4] = 108;
+    msg.len = frame(msg.bytes, v2, 60, 121, 0);
+
+    return msg;
+}
+
+size_t MSP_Parser::serialize_NAV_STATUS_into(byte * out, size_t cap, byte state, byte waypoint, byte count, int distance, short crossTrack, bool v2) {
+
+    size_t headerSize = v2 ? 8 : 5;
+
+    if (cap < headerSize + 10) {
+        return 0;
+    }
+
+    memcpy(&out[headerSize+0], &state, sizeof(byte));
+    memcpy(&out[headerSize+1], &waypoint, sizeof(byte));
+    memcpy(&out[headerSize+2], &count, sizeof(byte));
+    memcpy(&out[headerSize+3], &distance, sizeof(int));
+    memcpy(&out[headerSize+7], &crossTrack, sizeof(short));
+
+    return frame(out, v2, 62, 121, 9);
+}
 
-    memcpy(&msg.bytes[5], &roll, sizeof(short));
-    memcpy(&msg.bytes[7], &pitch, sizeof(short));
-    memcpy(&msg.bytes[9], &yaw, sizeof(short));
+MSP_Message MSP_Parser::serialize_NAV_STATUS(byte state, byte waypoint, byte count, int distance, short crossTrack, bool v2) {
 
-    msg.bytes[11] = CRC8(&msg.bytes[3], 8);
+    MSP_Message msg;
 
-    msg.len = 12;
+    msg.len = serialize_NAV_STATUS_into(msg.bytes, MAXBUF, state, waypoint, count, distance, crossTrack, v2);
 
     return msg;
 }
 
-MSP_Message MSP_Parser::serialize_SET_RAW_RC(short c1, short c2, short c3, short c4, short c5, short c6, short c7, short c8) {
+void MSP_Parser::set_SONARS_Handler(class SONARS_Handler * handler) {
+
+    this->handlerForSONARS = handler;
+}
+
+MSP_Message MSP_Parser::serialize_SONARS_Request(bool v2) {
 
     MSP_Message msg;
 
-    msg.bytes[0] = 36;
-    msg.bytes[1] = 77;
-    msg.bytes[2] = 62;
-    msg.bytes[3] = 16;
-    msg.bytes[4] = 200;
+    msg.len = frame(msg.bytes, v2, 60, 127, 0);
+
+    return msg;
+}
+
+size_t MSP_Parser::serialize_SONARS_into(byte * out, size_t cap, short back, short front, short left, short right, bool v2) {
+
+    size_t headerSize = v2 ? 8 : 5;
 
-    memcpy(&msg.bytes[5], &c1, sizeof(short));
-    memcpy(&msg.bytes[7], &c2, sizeof(short));
-    memcpy(&msg.bytes[9], &c3, sizeof(short));
-    memcpy(&msg.bytes[11], &c4, sizeof(short));
-    memcpy(&msg.bytes[13], &c5, sizeof(short));
-    memcpy(&msg.bytes[15], &c6, sizeof(short));
-    memcpy(&msg.bytes[17], &c7, sizeof(short));
-    memcpy(&msg.bytes[19], &c8, sizeof(short));
+    if (cap < headerSize + 9) {
+        return 0;
+    }
+
+    memcpy(&out[headerSize+0], &back, sizeof(short));
+    memcpy(&out[headerSize+2], &front, sizeof(short));
+    memcpy(&out[headerSize+4], &left, sizeof(short));
+    memcpy(&out[headerSize+6], &right, sizeof(short));
+
+    return frame(out, v2, 62, 127, 8);
+}
 
-    msg.bytes[21] = CRC8(&msg.bytes[3], 18);
+MSP_Message MSP_Parser::serialize_SONARS(short back, short front, short left, short right, bool v2) {
 
-    msg.len = 22;
+    MSP_Message msg;
+
+    msg.len = serialize_SONARS_into(msg.bytes, MAXBUF, back, front, left, right, v2);
 
     return msg;
 }
 
-MSP_Message MSP_Parser::serialize_SET_MOTOR(byte m1, byte m2, byte m3, byte m4) {
+void MSP_Parser::set_LOOP_TIMING_Handler(class LOOP_TIMING_Handler * handler) {
+
+    this->handlerForLOOP_TIMING = handler;
+}
+
+MSP_Message MSP_Parser::serialize_LOOP_TIMING_Request(bool v2) {
 
     MSP_Message msg;
 
-    msg.bytes[0] = 36;
-    msg.bytes[1] = 77;
-    msg.bytes[2] = 62;
-    msg.bytes[3] = 4;
-    msg.bytes[4] = 214;
+    msg.len = frame(msg.bytes, v2, 60, 150, 0);
+
+    return msg;
+}
+
+size_t MSP_Parser::serialize_LOOP_TIMING_into(byte * out, size_t cap, short lateMax, short execMax, short overruns, short late0, short late1, short late2, short late3, short late4, short late5, short late6, short late7, short exec0, short exec1, short exec2, short exec3, short exec4, short exec5, short exec6, short exec7, bool v2) {
+
+    size_t headerSize = v2 ? 8 : 5;
+
+    if (cap < headerSize + 39) {
+        return 0;
+    }
+
+    memcpy(&out[headerSize+0], &lateMax, sizeof(short));
+    memcpy(&out[headerSize+2], &execMax, sizeof(short));
+    memcpy(&out[headerSize+4], &overruns, sizeof(short));
+    memcpy(&out[headerSize+6], &late0, sizeof(short));
+    memcpy(&out[headerSize+8], &late1, sizeof(short));
+    memcpy(&out[headerSize+10], &late2, sizeof(short));
+    memcpy(&out[headerSize+12], &late3, sizeof(short));
+    memcpy(&out[headerSize+14], &late4, sizeof(short));
+    memcpy(&out[headerSize+16], &late5, sizeof(short));
+    memcpy(&out[headerSize+18], &late6, sizeof(short));
+    memcpy(&out[headerSize+20], &late7, sizeof(short));
+    memcpy(&out[headerSize+22], &exec0, sizeof(short));
+    memcpy(&out[headerSize+24], &exec1, sizeof(short));
+    memcpy(&out[headerSize+26], &exec2, sizeof(short));
+    memcpy(&out[headerSize+28], &exec3, sizeof(short));
+    memcpy(&out[headerSize+30], &exec4, sizeof(short));
+    memcpy(&out[headerSize+32], &exec5, sizeof(short));
+    memcpy(&out[headerSize+34], &exec6, sizeof(short));
+    memcpy(&out[headerSize+36], &exec7, sizeof(short));
+
+    return frame(out, v2, 62, 150, 38);
+}
 
-    memcpy(&msg.bytes[5], &m1, sizeof(byte));
-    memcpy(&msg.bytes[6], &m2, sizeof(byte));
-    memcpy(&msg.bytes[7], &m3, sizeof(byte));
-    memcpy(&msg.bytes[8], &m4, sizeof(byte));
+MSP_Message MSP_Parser::serialize_LOOP_TIMING(short lateMax, short execMax, short overruns, short late0, short late1, short late2, short late3, short late4, short late5, short late6, short late7, short exec0, short exec1, short exec2, short exec3, short exec4, short exec5, short exec6, short exec7, bool v2) {
 
-    msg.bytes[9] = CRC8(&msg.bytes[3], 6);
+    MSP_Message msg;
 
-    msg.len = 10;
+    msg.len = serialize_LOOP_TIMING_into(msg.bytes, MAXBUF, lateMax, execMax, overruns, late0, late1, late2, late3, late4, late5, late6, late7, exec0, exec1, exec2, exec3, exec4, exec5, exec6, exec7, v2);
 
     return msg;
 }
 
-void MSP_Parser::set_ALTITUDE_Handler(class ALTITUDE_Handler * handler) {
+void MSP_Parser::set_LOOP_RATE_Handler(class LOOP_RATE_Handler * handler) {
 
-    this->handlerForALTITUDE = handler;
+    this->handlerForLOOP_RATE = handler;
+}
+
+MSP_Message MSP_Parser::serialize_LOOP_RATE_Request(bool v2) {
+
+    MSP_Message msg;
+
+    msg.len = frame(msg.bytes, v2, 60, 151, 0);
+
+    return msg;
+}
+
+size_t MSP_Parser::serialize_LOOP_RATE_into(byte * out, size_t cap, int period, int tunedPeriod, short worstCycle, bool v2) {
+
+    size_t headerSize = v2 ? 8 : 5;
+
+    if (cap < headerSize + 11) {
+        return 0;
+    }
+
+    memcpy(&out[headerSize+0], &period, sizeof(int));
+    memcpy(&out[headerSize+4], &tunedPeriod, sizeof(int));
+    memcpy(&out[headerSize+8], &worstCycle, sizeof(short));
+
+    return frame(out, v2, 62, 151, 10);
+}
+
+MSP_Message MSP_Parser::serialize_LOOP_RATE(int period, int tunedPeriod, short worstCycle, bool v2) {
+
+    MSP_Message msg;
+
+    msg.len = serialize_LOOP_RATE_into(msg.bytes, MAXBUF, period, tunedPeriod, worstCycle, v2);
+
+    return msg;
+}
+
+void MSP_Parser::set_HIL_MOTORS_Handler(class HIL_MOTORS_Handler * handler) {
+
+    this->handlerForHIL_MOTORS = handler;
+}
+
+MSP_Message MSP_Parser::serialize_HIL_MOTORS_Request(bool v2) {
+
+    MSP_Message msg;
+
+    msg.len = frame(msg.bytes, v2, 60, 131, 0);
+
+    return msg;
+}
+
+size_t MSP_Parser::serialize_HIL_MOTORS_into(byte * out, size_t cap, short seq, short m1, short m2, short m3, short m4, short latency, short missed, bool v2) {
+
+    size_t headerSize = v2 ? 8 : 5;
+
+    if (cap < headerSize + 15) {
+        return 0;
+    }
+
+    memcpy(&out[headerSize+0], &seq, sizeof(short));
+    memcpy(&out[headerSize+2], &m1, sizeof(short));
+    memcpy(&out[headerSize+4], &m2, sizeof(short));
+    memcpy(&out[headerSize+6], &m3, sizeof(short));
+    memcpy(&out[headerSize+8], &m4, sizeof(short));
+    memcpy(&out[headerSize+10], &latency, sizeof(short));
+    memcpy(&out[headerSize+12], &missed, sizeof(short));
+
+    return frame(out, v2, 62, 131, 14);
+}
+
+MSP_Message MSP_Parser::serialize_HIL_MOTORS(short seq, short m1, short m2, short m3, short m4, short latency, short missed, bool v2) {
+
+    MSP_Message msg;
+
+    msg.len = serialize_HIL_MOTORS_into(msg.bytes, MAXBUF, seq, m1, m2, m3, m4, latency, missed, v2);
+
+    return msg;
+}
+
+size_t MSP_Parser::serialize_SET_RAW_RC_into(byte * out, size_t cap, short c1, short c2, short c3, short c4, short c5, short c6, short c7, short c8, short seq, bool v2) {
+
+    size_t headerSize = v2 ? 8 : 5;
+
+    if (cap < headerSize + 19) {
+        return 0;
+    }
+
+    memcpy(&out[headerSize+0], &c1, sizeof(short));
+    memcpy(&out[headerSize+2], &c2, sizeof(short));
+    memcpy(&out[headerSize+4], &c3, sizeof(short));
+    memcpy(&out[headerSize+6], &c4, sizeof(short));
+    memcpy(&out[headerSize+8], &c5, sizeof(short));
+    memcpy(&out[headerSize+10], &c6, sizeof(short));
+    memcpy(&out[headerSize+12], &c7, sizeof(short));
+    memcpy(&out[headerSize+14], &c8, sizeof(short));
+    memcpy(&out[headerSize+16], &seq, sizeof(short));
+
+    return frame(out, v2, 60, 200, 18);
+}
+
+MSP_Message MSP_Parser::serialize_SET_RAW_RC(short c1, short c2, short c3, short c4, short c5, short c6, short c7, short c8, short seq, bool v2) {
+
+    MSP_Message msg;
+
+    msg.len = serialize_SET_RAW_RC_into(msg.bytes, MAXBUF, c1, c2, c3, c4, c5, c6, c7, c8, seq, v2);
+
+    return msg;
 }
 
-MSP_Message MSP_Parser::serialize_ALTITUDE_Request() {
+size_t MSP_Parser::serialize_SET_PID_CONFIG_into(byte * out, size_t cap, float levelP, float ratePitchrollP, float ratePitchrollI, float ratePitchrollD, float yawP, float yawI, short trimRoll, short trimPitch, short trimYaw, float feedForward, bool v2) {
+
+    size_t headerSize = v2 ? 8 : 5;
+
+    if (cap < headerSize + 35) {
+        return 0;
+    }
+
+    memcpy(&out[headerSize+0], &levelP, sizeof(float));
+    memcpy(&out[headerSize+4], &ratePitchrollP, sizeof(float));
+    memcpy(&out[headerSize+8], &ratePitchrollI, sizeof(float));
+    memcpy(&out[headerSize+12], &ratePitchrollD, sizeof(float));
+    memcpy(&out[headerSize+16], &yawP, sizeof(float));
+    memcpy(&out[headerSize+20], &yawI, sizeof(float));
+    memcpy(&out[headerSize+24], &trimRoll, sizeof(short));
+    memcpy(&out[headerSize+26], &trimPitch, sizeof(short));
+    memcpy(&out[headerSize+28], &trimYaw, sizeof(short));
+    memcpy(&out[headerSize+30], &feedForward, sizeof(float));
+
+    return frame(out, v2, 60, 202, 34);
+}
+
+MSP_Message MSP_Parser::serialize_SET_PID_CONFIG(float levelP, float ratePitchrollP, float ratePitchrollI, float ratePitchrollD, float yawP, float yawI, short trimRoll, short trimPitch, short trimYaw, float feedForward, bool v2) {
 
     MSP_Message msg;
 
-    msg.bytes[0] = 36;
-    msg.bytes[1] = 77;
-    msg.bytes[2] = 60;
-    msg.bytes[3] = 0;
-    msg.bytes[4] = 109;
-    msg.bytes[5] = 109;
+    msg.len = serialize_SET_PID_CONFIG_into(msg.bytes, MAXBUF, levelP, ratePitchrollP, ratePitchrollI, ratePitchrollD, yawP, yawI, trimRoll, trimPitch, trimYaw, feedForward, v2);
+
+    return msg;
+}
+
+size_t MSP_Parser::serialize_SET_RC_CONFIG_into(byte * out, size_t cap, short mincheck, short maxcheck, short expo8, short rate8, byte thrMid8, byte thrExpo8, byte averageLog2, bool v2) {
+
+    size_t headerSize = v2 ? 8 : 5;
 
-    msg.len = 6;
+    if (cap < headerSize + 12) {
+        return 0;
+    }
+
+    memcpy(&out[headerSize+0], &mincheck, sizeof(short));
+    memcpy(&out[headerSize+2], &maxcheck, sizeof(short));
+    memcpy(&out[headerSize+4], &expo8, sizeof(short));
+    memcpy(&out[headerSize+6], &rate8, sizeof(short));
+    memcpy(&out[headerSize+8], &thrMid8, sizeof(byte));
+    memcpy(&out[headerSize+9], &thrExpo8, sizeof(byte));
+    memcpy(&out[headerSize+10], &averageLog2, sizeof(byte));
+
+    return frame(out, v2, 60, 204, 11);
+}
+
+MSP_Message MSP_Parser::serialize_SET_RC_CONFIG(short mincheck, short maxcheck, short expo8, short rate8, byte thrMid8, byte thrExpo8, byte averageLog2, bool v2) {
+
+    MSP_Message msg;
+
+    msg.len = serialize_SET_RC_CONFIG_into(msg.bytes, MAXBUF, mincheck, maxcheck, expo8, rate8, thrMid8, thrExpo8, averageLog2, v2);
 
     return msg;
 }
 
-MSP_Message MSP_Parser::serialize_ALTITUDE(int altitude, short vario) {
+size_t MSP_Parser::serialize_SET_HEAD_into(byte * out, size_t cap, short head, bool v2) {
+
+    size_t headerSize = v2 ? 8 : 5;
+
+    if (cap < headerSize + 3) {
+        return 0;
+    }
+
+    memcpy(&out[headerSize+0], &head, sizeof(short));
+
+    return frame(out, v2, 60, 205, 2);
+}
+
+MSP_Message MSP_Parser::serialize_SET_HEAD(short head, bool v2) {
 
     MSP_Message msg;
 
-    msg.bytes[0] = 36;
-    msg.bytes[1] = 77;
-    msg.bytes[2] = 62;
-    msg.bytes[3] = 6;
-    msg.bytes[4] = 109;
+    msg.len = serialize_SET_HEAD_into(msg.bytes, MAXBUF, head, v2);
 
-    memcpy(&msg.bytes[5], &altitude, sizeof(int));
-    memcpy(&msg.bytes[9], &vario, sizeof(short));
+    return msg;
+}
+
+size_t MSP_Parser::serialize_SET_WAYPOINT_into(byte * out, size_t cap, byte index, int north, int east, int up, short speed, short hold, bool v2) {
+
+    size_t headerSize = v2 ? 8 : 5;
 
-    msg.bytes[11] = CRC8(&msg.bytes[3], 8);
+    if (cap < headerSize + 18) {
+        return 0;
+    }
+
+    memcpy(&out[headerSize+0], &index, sizeof(byte));
+    memcpy(&out[headerSize+1], &north, sizeof(int));
+    memcpy(&out[headerSize+5], &east, sizeof(int));
+    memcpy(&out[headerSize+9], &up, sizeof(int));
+    memcpy(&out[headerSize+13], &speed, sizeof(short));
+    memcpy(&out[headerSize+15], &hold, sizeof(short));
+
+    return frame(out, v2, 60, 209, 17);
+}
 
-    msg.len = 12;
+MSP_Message MSP_Parser::serialize_SET_WAYPOINT(byte index, int north, int east, int up, short speed, short hold, bool v2) {
+
+    MSP_Message msg;
+
+    msg.len = serialize_SET_WAYPOINT_into(msg.bytes, MAXBUF, index, north, east, up, speed, hold, v2);
 
     return msg;
 }
 
-void MSP_Parser::set_SONAR_Handler(class SONAR_Handler * handler) {
+size_t MSP_Parser::serialize_SET_STREAM_into(byte * out, size_t cap, byte command, byte rate, bool v2) {
+
+    size_t headerSize = v2 ? 8 : 5;
+
+    if (cap < headerSize + 3) {
+        return 0;
+    }
+
+    memcpy(&out[headerSize+0], &command, sizeof(byte));
+    memcpy(&out[headerSize+1], &rate, sizeof(byte));
 
-    this->handlerForSONAR = handler;
+    return frame(out, v2, 60, 216, 2);
 }
 
-MSP_Message MSP_Parser::serialize_SONAR_Request() {
+MSP_Message MSP_Parser::serialize_SET_STREAM(byte command, byte rate, bool v2) {
 
     MSP_Message msg;
 
-    msg.bytes[0] = 36;
-    msg.bytes[1] = 77;
-    msg.bytes[2] = 60;
-    msg.bytes[3] = 0;
-    msg.bytes[4] = 128;
-    msg.bytes[5] = 128;
+    msg.len = serialize_SET_STREAM_into(msg.bytes, MAXBUF, command, rate, v2);
 
-    msg.len = 6;
+    return msg;
+}
+
+size_t MSP_Parser::serialize_SET_MOTOR_into(byte * out, size_t cap, short m1, short m2, short m3, short m4, short seq, bool v2) {
+
+    size_t headerSize = v2 ? 8 : 5;
+
+    if (cap < headerSize + 11) {
+        return 0;
+    }
+
+    memcpy(&out[headerSize+0], &m1, sizeof(short));
+    memcpy(&out[headerSize+2], &m2, sizeof(short));
+    memcpy(&out[headerSize+4], &m3, sizeof(short));
+    memcpy(&out[headerSize+6], &m4, sizeof(short));
+    memcpy(&out[headerSize+8], &seq, sizeof(short));
+
+    return frame(out, v2, 60, 214, 10);
+}
+
+MSP_Message MSP_Parser::serialize_SET_MOTOR(short m1, short m2, short m3, short m4, short seq, bool v2) {
+
+    MSP_Message msg;
+
+    msg.len = serialize_SET_MOTOR_into(msg.bytes, MAXBUF, m1, m2, m3, m4, seq, v2);
 
     return msg;
 }
 
-MSP_Message MSP_Parser::serialize_SONAR(short distance) {
+size_t MSP_Parser::serialize_HIL_STATE_into(byte * out, size_t cap, short seq, short roll, short pitch, short yaw, short gyroX, short gyroY, short gyroZ, bool v2) {
+
+    size_t headerSize = v2 ? 8 : 5;
+
+    if (cap < headerSize + 15) {
+        return 0;
+    }
+
+    memcpy(&out[headerSize+0], &seq, sizeof(short));
+    memcpy(&out[headerSize+2], &roll, sizeof(short));
+    memcpy(&out[headerSize+4], &pitch, sizeof(short));
+    memcpy(&out[headerSize+6], &yaw, sizeof(short));
+    memcpy(&out[headerSize+8], &gyroX, sizeof(short));
+    memcpy(&out[headerSize+10], &gyroY, sizeof(short));
+    memcpy(&out[headerSize+12], &gyroZ, sizeof(short));
+
+    return frame(out, v2, 60, 231, 14);
+}
+
+MSP_Message MSP_Parser::serialize_HIL_STATE(short seq, short roll, short pitch, short yaw, short gyroX, short gyroY, short gyroZ, bool v2) {
 
     MSP_Message msg;
 
-    msg.bytes[0] = 36;
-    msg.bytes[1] = 77;
-    msg.bytes[2] = 62;
-    msg.bytes[3] = 2;
-    msg.bytes[4] = 128;
+    msg.len = serialize_HIL_STATE_into(msg.bytes, MAXBUF, seq, roll, pitch, yaw, gyroX, gyroY, gyroZ, v2);
+
+    return msg;
+}
 
-    memcpy(&msg.bytes[5], &distance, sizeof(short));
+size_t MSP_Parser::serialize_EEPROM_WRITE_into(byte * out, size_t cap, bool v2) {
 
-    msg.bytes[7] = CRC8(&msg.bytes[3], 4);
+    size_t headerSize = v2 ? 8 : 5;
+
+    if (cap < headerSize + 1) {
+        return 0;
+    }
+
+    return frame(out, v2, 60, 250, 0);
+}
+
+MSP_Message MSP_Parser::serialize_EEPROM_WRITE(bool v2) {
+
+    MSP_Message msg;
 
-    msg.len = 8;
+    msg.len = serialize_EEPROM_WRITE_into(msg.bytes, MAXBUF, v2);
 
     return msg;
 }
@@ -1,5 +1,7 @@
 // AUTO-GENERATED CODE: DO NOT EDIT!!!\n\n'
 
+#include <stddef.h>
+
 static const int MAXBUF = 256;
 
 typedef unsigned char byte;
@@ -29,66 +31,201 @@ class MSP_Parser {
 
         int state;
         byte message_direction;
-        byte message_id;
-        byte message_length_expected;
-        byte message_length_received;
+        bool message_v2;
+        unsigned short message_id;
+        unsigned short message_length_expected;
+        unsigned short message_length_received;
         byte message_buffer[MAXBUF];
         byte message_checksum;
 
+        void checksum(byte b);
+
+        // Puts the header and checksum around a payload already in place after the header; returns the
+        // frame's length
+        static size_t frame(byte * out, bool v2, byte direction, unsigned short id, unsigned short size);
+
     public:
 
         MSP_Parser();
 
         void parse(byte b);
 
+        // Parses a block of bytes, e.g. everything one read() returned
+        void parse(const byte * buf, size_t len);
+
+        // True if the last message parsed was MSPv2, so that a host can answer in kind
+        bool receivedV2(void) { return this->message_v2; }
+
 
-        static MSP_Message serialize_RC(short c1, short c2, short c3, short c4, short c5, short c6, short c7, short c8);
+        static MSP_Message serialize_RC(short c1, short c2, short c3, short c4, short c5, short c6, short c7, short c8, bool v2=false);
 
-        static MSP_Message serialize_RC_Request();
+        static size_t serialize_RC_into(byte * out, size_t cap, short c1, short c2, short c3, short c4, short c5, short c6, short c7, short c8, bool v2=false);
+
+        static MSP_Message serialize_RC_Request(bool v2=false);
 
         void set_RC_Handler(class RC_Handler * handler);
 
-        static MSP_Message serialize_SET_HEAD(short head);
+        static MSP_Message serialize_ATTITUDE(short roll, short pitch, short yaw, bool v2=false);
+
+        static size_t serialize_ATTITUDE_into(byte * out, size_t cap, short roll, short pitch, short yaw, bool v2=false);
+
+        static MSP_Message serialize_ATTITUDE_Request(bool v2=false);
+
+        void set_ATTITUDE_Handler(class ATTITUDE_Handler * handler);
+
+        static MSP_Message serialize_ALTITUDE(int altitude, short vario, bool v2=false);
+
+        static size_t serialize_ALTITUDE_into(byte * out, size_t cap, int altitude, short vario, bool v2=false);
+
+        static MSP_Message serialize_ALTITUDE_Request(bool v2=false);
+
+        void set_ALTITUDE_Handler(class ALTITUDE_Handler * handler);
+
+        static MSP_Message serialize_RC_CONFIG(short mincheck, short maxcheck, short expo8, short rate8, byte thrMid8, byte thrExpo8, byte averageLog2, bool v2=false);
+
+        static size_t serialize_RC_CONFIG_into(byte * out, size_t cap, short mincheck, short maxcheck, short expo8, short rate8, byte thrMid8, byte thrExpo8, byte averageLog2, bool v2=false);
+
+        static MSP_Message serialize_RC_CONFIG_Request(bool v2=false);
+
+        void set_RC_CONFIG_Handler(class RC_CONFIG_Handler * handler);
+
+        static MSP_Message serialize_PID_CONFIG(float levelP, float ratePitchrollP, float ratePitchrollI, float ratePitchrollD, float yawP, float yawI, short trimRoll, short trimPitch, short trimYaw, float feedForward, bool v2=false);
+
+        static size_t serialize_PID_CONFIG_into(byte * out, size_t cap, float levelP, float ratePitchrollP, float ratePitchrollI, float ratePitchrollD, float yawP, float yawI, short trimRoll, short trimPitch, short trimYaw, float feedForward, bool v2=false);
+
+        static MSP_Message serialize_PID_CONFIG_Request(bool v2=false);
+
+        void set_PID_CONFIG_Handler(class PID_CONFIG_Handler * handler);
+
+        static MSP_Message serialize_RC_LINK(int frames, short errors, short lost, short interval, byte quality, byte rssi, byte failsafe, bool v2=false);
+
+        static size_t serialize_RC_LINK_into(byte * out, size_t cap, int frames, short errors, short lost, short interval, byte quality, byte rssi, byte failsafe, bool v2=false);
+
+        static MSP_Message serialize_RC_LINK_Request(bool v2=false);
+
+        void set_RC_LINK_Handler(class RC_LINK_Handler * handler);
+
+        static MSP_Message serialize_STATE(int time, short roll, short pitch, short yaw, short gyroX, short gyroY, short gyroZ, short pidRoll, short pidPitch, short pidYaw, byte m1, byte m2, byte m3, byte m4, short loopExec, short loopLate, bool v2=false);
+
+        static size_t serialize_STATE_into(byte * out, size_t cap, int time, short roll, short pitch, short yaw, short gyroX, short gyroY, short gyroZ, short pidRoll, short pidPitch, short pidYaw, byte m1, byte m2, byte m3, byte m4, short loopExec, short loopLate, bool v2=false);
+
+        static MSP_Message serialize_STATE_Request(bool v2=false);
+
+        void set_STATE_Handler(class STATE_Handler * handler);
+
+        static MSP_Message serialize_ACK(short seq, int accepted, short gaps, short stale, short rxErrors, short txDropped, bool v2=false);
+
+        static size_t serialize_ACK_into(byte * out, size_t cap, short seq, int accepted, short gaps, short stale, short rxErrors, short txDropped, bool v2=false);
+
+        static MSP_Message serialize_ACK_Request(bool v2=false);
+
+        void set_ACK_Handler(class ACK_Handler * handler);
+
+        static MSP_Message serialize_NAV_STATUS(byte state, byte waypoint, byte count, int distance, short crossTrack, bool v2=false);
+
+        static size_t serialize_NAV_STATUS_into(byte * out, size_t cap, byte state, byte waypoint, byte count, int distance, short crossTrack, bool v2=false);
+
+        static MSP_Message serialize_NAV_STATUS_Request(bool v2=false);
+
+        void set_NAV_STATUS_Handler(class NAV_STATUS_Handler * handler);
+
+        static MSP_Message serialize_SONARS(short back, short front, short left, short right, bool v2=false);
 
-        static MSP_Message serialize_SONARS(short back, short front, short left, short right);
+        static size_t serialize_SONARS_into(byte * out, size_t cap, short back, short front, short left, short right, bool v2=false);
 
-        static MSP_Message serialize_SONARS_Request();
+        static MSP_Message serialize_SONARS_Request(bool v2=false);
 
         void set_SONARS_Handler(class SONARS_Handler * handler);
 
-        static MSP_Message serialize_ATTITUDE(short roll, short pitch, short yaw);
+        static MSP_Message serialize_LOOP_TIMING(short lateMax, short execMax, short overruns, short late0, short late1, short late2, short late3, short late4, short late5, short late6, short late7, short exec0, short exec1, short exec2, short exec3, short exec4, short exec5, short exec6, short exec7, bool v2=false);
 
-        static MSP_Message serialize_ATTITUDE_Request();
+        static size_t serialize_LOOP_TIMING_into(byte * out, size_t cap, short lateMax, short execMax, short overruns, short late0, short late1, short late2, short late3, short late4, short late5, short late6, short late7, short exec0, short exec1, short exec2, short exec3, short exec4, short exec5, short exec6, short exec7, bool v2=false);
 
-        void set_ATTITUDE_Handler(class ATTITUDE_Handler * handler);
+        static MSP_Message serialize_LOOP_TIMING_Request(bool v2=false);
 
-        static MSP_Message serialize_SET_RAW_RC(short c1, short c2, short c3, short c4, short c5, short c6, short c7, short c8);
+        void set_LOOP_TIMING_Handler(class LOOP_TIMING_Handler * handler);
 
-        static MSP_Message serialize_SET_MOTOR(byte m1, byte m2, byte m3, byte m4);
+        static MSP_Message serialize_LOOP_RATE(int period, int tunedPeriod, short worstCycle, bool v2=false);
 
-        static MSP_Message serialize_ALTITUDE(int altitude, short vario);
+        static size_t serialize_LOOP_RATE_into(byte * out, size_t cap, int period, int tunedPeriod, short worstCycle, bool v2=false);
 
-        static MSP_Message serialize_ALTITUDE_Request();
+        static MSP_Message serialize_LOOP_RATE_Request(bool v2=false);
 
-        void set_ALTITUDE_Handler(class ALTITUDE_Handler * handler);
+        void set_LOOP_RATE_Handler(class LOOP_RATE_Handler * handler);
+
+        static MSP_Message serialize_HIL_MOTORS(short seq, short m1, short m2, short m3, short m4, short latency, short missed, bool v2=false);
+
+        static size_t serialize_HIL_MOTORS_into(byte * out, size_t cap, short seq, short m1, short m2, short m3, short m4, short latency, short missed, bool v2=false);
+
+        static MSP_Message serialize_HIL_MOTORS_Request(bool v2=false);
+
+        void set_HIL_MOTORS_Handler(class HIL_MOTORS_Handler * handler);
+
+        static MSP_Message serialize_SET_RAW_RC(short c1, short c2, short c3, short c4, short c5, short c6, short c7, short c8, short seq, bool v2=false);
+
+        static size_t serialize_SET_RAW_RC_into(byte * out, size_t cap, short c1, short c2, short c3, short c4, short c5, short c6, short c7, short c8, short seq, bool v2=false);
+
+        static MSP_Message serialize_SET_PID_CONFIG(float levelP, float ratePitchrollP, float ratePitchrollI, float ratePitchrollD, float yawP, float yawI, short trimRoll, short trimPitch, short trimYaw, float feedForward, bool v2=false);
+
+        static size_t serialize_SET_PID_CONFIG_into(byte * out, size_t cap, float levelP, float ratePitchrollP, float ratePitchrollI, float ratePitchrollD, float yawP, float yawI, short trimRoll, short trimPitch, short trimYaw, float feedForward, bool v2=false);
+
+        static MSP_Message serialize_SET_RC_CONFIG(short mincheck, short maxcheck, short expo8, short rate8, byte thrMid8, byte thrExpo8, byte averageLog2, bool v2=false);
+
+        static size_t serialize_SET_RC_CONFIG_into(byte * out, size_t cap, short mincheck, short maxcheck, short expo8, short rate8, byte thrMid8, byte thrExpo8, byte averageLog2, bool v2=false);
+
+        static MSP_Message serialize_SET_HEAD(short head, bool v2=false);
+
+        static size_t serialize_SET_HEAD_into(byte * out, size_t cap, short head, bool v2=false);
+
+        static MSP_Message serialize_SET_WAYPOINT(byte index, int north, int east, int up, short speed, short hold, bool v2=false);
+
+        static size_t serialize_SET_WAYPOINT_into(byte * out, size_t cap, byte index, int north, int east, int up, short speed, short hold, bool v2=false);
+
+        static MSP_Message serialize_SET_STREAM(byte command, byte rate, bool v2=false);
+
+        static size_t serialize_SET_STREAM_into(byte * out, size_t cap, byte command, byte rate, bool v2=false);
+
+        static MSP_Message serialize_SET_MOTOR(short m1, short m2, short m3, short m4, short seq, bool v2=false);
+
+        static size_t serialize_SET_MOTOR_into(byte * out, size_t cap, short m1, short m2, short m3, short m4, short seq, bool v2=false);
 
-        static MSP_Message serialize_SONAR(short distance);
+        static MSP_Message serialize_HIL_STATE(short seq, short roll, short pitch, short yaw, short gyroX, short gyroY, short gyroZ, bool v2=false);
 
-        static MSP_Message serialize_SONAR_Request();
+        static size_t serialize_HIL_STATE_into(byte * out, size_t cap, short seq, short roll, short pitch, short yaw, short gyroX, short gyroY, short gyroZ, bool v2=false);
 
-        void set_SONAR_Handler(class SONAR_Handler * handler);
+        static MSP_Message serialize_EEPROM_WRITE(bool v2=false);
+
+        static size_t serialize_EEPROM_WRITE_into(byte * out, size_t cap, bool v2=false);
 
     private:
 
-        class RC_Handler * handlerForRC;
+        void dispatch(void);
 
-        class SONARS_Handler * handlerForSONARS;
+        class RC_Handler * handlerForRC;
 
         class ATTITUDE_Handler * handlerForATTITUDE;
 
         class ALTITUDE_Handler * handlerForALTITUDE;
 
-        class SONAR_Handler * handlerForSONAR;
+        class RC_CONFIG_Handler * handlerForRC_CONFIG;
+
+        class PID_CONFIG_Handler * handlerForPID_CONFIG;
+
+        class RC_LINK_Handler * handlerForRC_LINK;
+
+        class STATE_Handler * handlerForSTATE;
+
+        class ACK_Handler * handlerForACK;
+
+        class NAV_STATUS_Handler * handlerForNAV_STATUS;
+
+        class SONARS_Handler * handlerForSONARS;
+
+        class LOOP_TIMING_Handler * handlerForLOOP_TIMING;
+
+        class LOOP_RATE_Handler * handlerForLOOP_RATE;
+
+        class HIL_MOTORS_Handler * handlerForHIL_MOTORS;
 
 };
 
@@ -105,6 +242,102 @@ class RC_Handler {
 
 
 
+class ATTITUDE_Handler {
+
+    public:
+
+        ATTITUDE_Handler() {}
+
+        virtual void handle_ATTITUDE(short roll, short pitch, short yaw){ }
+
+};
+
+
+
+class ALTITUDE_Handler {
+
+    public:
+
+        ALTITUDE_Handler() {}
+
+        virtual void handle_ALTITUDE(int altitude, short vario){ }
+
+};
+
+
+
+class RC_CONFIG_Handler {
+
+    public:
+
+        RC_CONFIG_Handler() {}
+
+        virtual void handle_RC_CONFIG(short mincheck, short maxcheck, short expo8, short rate8, byte thrMid8, byte thrExpo8, byte averageLog2){ }
+
+};
+
+
+
+class PID_CONFIG_Handler {
+
+    public:
+
+        PID_CONFIG_Handler() {}
+
+        virtual void handle_PID_CONFIG(float levelP, float ratePitchrollP, float ratePitchrollI, float ratePitchrollD, float yawP, float yawI, short trimRoll, short trimPitch, short trimYaw, float feedForward){ }
+
+};
+
+
+
+class RC_LINK_Handler {
+
+    public:
+
+        RC_LINK_Handler() {}
+
+        virtual void handle_RC_LINK(int frames, short errors, short lost, short interval, byte quality, byte rssi, byte failsafe){ }
+
+};
+
+
+
+class STATE_Handler {
+
+    public:
+
+        STATE_Handler() {}
+
+        virtual void handle_STATE(int time, short roll, short pitch, short yaw, short gyroX, short gyroY, short gyroZ, short pidRoll, short pidPitch, short pidYaw, byte m1, byte m2, byte m3, byte m4, short loopExec, short loopLate){ }
+
+};
+
+
+
+class ACK_Handler {
+
+    public:
+
+        ACK_Handler() {}
+
+        virtual void handle_ACK(short seq, int accepted, short gaps, short stale, short rxErrors, short txDropped){ }
+
+};
+
+
+
+class NAV_STATUS_Handler {
+
+    public:
+
+        NAV_STATUS_Handler() {}
+
+        virtual void handle_NAV_STATUS(byte state, byte waypoint, byte count, int distance, short crossTrack){ }
+
+};
+
+
+
 class SONARS_Handler {
 
     public:
@@ -117,37 +350,37 @@ class SONARS_Handler {
 
 
 
-class ATTITUDE_Handler {
+class LOOP_TIMING_Handler {
 
     public:
 
-        ATTITUDE_Handler() {}
+        LOOP_TIMING_Handler() {}
 
-        virtual void handle_ATTITUDE(short roll, short pitch, short yaw){ }
+        virtual void handle_LOOP_TIMING(short lateMax, short execMax, short overruns, short late0, short late1, short late2, short late3, short late4, short late5, short late6, short late7, short exec0, short exec1, short exec2, short exec3, short exec4, short exec5, short exec6, short exec7){ }
 
 };
 
 
 
-class ALTITUDE_Handler {
+class LOOP_RATE_Handler {
 
     public:
 
-        ALTITUDE_Handler() {}
+        LOOP_RATE_Handler() {}
 
-        virtual void handle_ALTITUDE(int altitude, short vario){ }
+        virtual void handle_LOOP_RATE(int period, int tunedPeriod, short worstCycle){ }
 
 };
 
 
 
-class SONAR_Handler {
+class HIL_MOTORS_Handler {
 
     public:
 
-        SONAR_Handler() {}
+        HIL_MOTORS_Handler() {}
 
-        virtual void handle_SONAR(short distance){ }
+        virtual void handle_HIL_MOTORS(short seq, short m1, short m2, short m3, short m4, short latency, short missed){ }
 
 };
 
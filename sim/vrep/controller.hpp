@@ -19,11 +19,22 @@
    along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#pragma once
+
 // We currently support these controllers
 enum controller_t { KEYBOARD, DSM, TARANIS, SPEKTRUM, EXTREME3D, PS3 , XBOX360};
 
+// Demands as the last controllerRead() left them, with when the newest input behind them came in (usec,
+// monotonic; zero before any) and how many input events that read took in
+typedef struct controller_snapshot_t {
+    float              demands[5];
+    unsigned long long usec;
+    int                events;
+} controller_snapshot_t;
+
 controller_t controllerInit(void);
 void         controllerRead(controller_t controller, float * demands);
+void         controllerGetSnapshot(controller_snapshot_t & snapshot);
 void         controllerClose(void);
 
 // in v_repExtHackflight.cpp
@@ -48,21 +48,25 @@ controller_t controllerInit(void)
 
 void controllerRead(controller_t controller, float * demands)
 {
+    int events = 0;
+
     if (joystick) {
 
-        // Poll until we get an event
+        // Take every event SDL has queued since the last step; only the latest position of each axis matters
         SDL_Event event;
-        while (SDL_PollEvent(&event))
-            ;
+        while (SDL_PollEvent(&event)) {
 
-        if (event.type == SDL_JOYAXISMOTION) {
-            SDL_JoyAxisEvent js = event.jaxis;
-            posixControllerGrabAxis(controller, demands, js.axis, js.value);
-        }
+            if (event.type == SDL_JOYAXISMOTION) {
+                SDL_JoyAxisEvent js = event.jaxis;
+                posixControllerQueueAxis(controller, demands, js.axis, js.value);
+            }
 
-        if (event.type == SDL_JOYBUTTONDOWN) {
-            SDL_JoyButtonEvent jb = event.jbutton;
-            posixControllerGrabButton(demands, jb.button);
+            if (event.type == SDL_JOYBUTTONDOWN) {
+                SDL_JoyButtonEvent jb = event.jbutton;
+                posixControllerGrabButton(demands, jb.button);
+            }
+
+            events++;
         }
      }
 
@@ -71,6 +75,8 @@ void controllerRead(controller_t controller, float * demands)
         char keys[8] = {52, 54, 50, 56, 48, 10, 51, 57};
         posixKbGrab(keys);
     }
+
+    posixControllerFlush(controller, demands, events);
 }
 
 void controllerClose(void)
@@ -23,20 +23,66 @@ static const char * DSM_DEV = "/dev/ttyACM0";
 #include "controller.hpp"
 #include "controller_Posix.hpp"
 #include "MSPPG.h"
+#include "serial.hpp"
 
 #include <fcntl.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <pthread.h>
 
+#include <atomic>
+
 #include <linux/joystick.h>
 
 static int joyfd;
 
 // Support for Spektrum DSM dongle
-static int dsmfd;
-static int dsmvals[5];
-static bool dsmrunning;
+static SerialConnection dsmport(DSM_DEV, 115200);
+static bool dsmopen;
+static std::atomic<bool> dsmrunning;
+static pthread_t dsmthreadid;
+
+// How long the reader thread waits for input before checking dsmrunning again
+static const int DSM_POLL_USEC = 100000;
+
+// Channel values are handed from the reader thread to the V-REP thread under a seqlock: the
+// writer makes the sequence odd while it updates the channels, and a reader retries until it
+// sees the same even sequence before and after its copy.  Neither side ever blocks.
+static const int DSM_CHANNELS = 5;
+static std::atomic<unsigned> dsmseq;
+static std::atomic<int> dsmvals[DSM_CHANNELS];
+
+static void dsmWrite(const int vals[DSM_CHANNELS])
+{
+    unsigned seq = dsmseq.load(std::memory_order_relaxed);
+
+    dsmseq.store(seq+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (int k=0; k<DSM_CHANNELS; ++k)
+        dsmvals[k].store(vals[k], std::memory_order_relaxed);
+
+    dsmseq.store(seq+2, std::memory_order_release);
+}
+
+// Returns the sequence number the channels came with, so the caller can tell a new frame
+static unsigned dsmRead(int vals[DSM_CHANNELS])
+{
+    unsigned before, after;
+
+    do {
+        before = dsmseq.load(std::memory_order_acquire);
+
+        for (int k=0; k<DSM_CHANNELS; ++k)
+            vals[k] = dsmvals[k].load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = dsmseq.load(std::memory_order_relaxed);
+
+    } while ((before & 1) || before != after);
+
+    return before;
+}
 
 // A class for handling RC messages from the Spektrum DSM dongle
 class My_RC_Handler : public RC_Handler {
@@ -45,11 +91,8 @@ class My_RC_Handler : public RC_Handler {
 
         void handle_RC(short c1, short c2, short c3, short c4, short c5, short c6, short c7, short c8)
         {
-            dsmvals[0] = c1;
-            dsmvals[1] = c2;
-            dsmvals[2] = c3;
-            dsmvals[3] = c4;
-            dsmvals[4] = c5;
+            int vals[DSM_CHANNELS] = {c1, c2, c3, c4, c5};
+            dsmWrite(vals);
         }
 };
 
@@ -64,13 +107,16 @@ static void * dsmthread(void * v)
     parser.set_RC_Handler(&handler);
 
     while (dsmrunning) {
-        int avail;
-        ioctl(dsmfd, FIONREAD, &avail);
-        if (avail > 0) {
-            char c;
-            read(dsmfd, &c, 1);
-            parser.parse(c);
-        }
+
+        // Sleep until the dongle has data, waking now and then to notice controllerClose()
+        byte buf[256];
+        int count = dsmport.readSome((char *)buf, sizeof(buf), DSM_POLL_USEC);
+
+        if (count < 0)
+            break;
+
+        if (count > 0)
+            parser.parse(buf, count);
     }
 
     pthread_exit(NULL);
@@ -96,12 +142,14 @@ controller_t controllerInit(void)
     }
 
     // Next try to open wireless DSM dongle
-    else if ((dsmfd=open(DSM_DEV, O_RDONLY)) > 0) {
+    else if (access(DSM_DEV, R_OK) == 0 && dsmport.openConnection()) {
+
+        dsmopen = true;
+        dsmport.setLowLatency();
 
         dsmrunning = true;
 
-        pthread_t thread;
-        pthread_create(&thread, NULL, dsmthread, NULL);
+        pthread_create(&dsmthreadid, NULL, dsmthread, NULL);
         controller = DSM;
     }
 
@@ -116,28 +164,39 @@ controller_t controllerInit(void)
 
 void controllerRead(controller_t controller, float * demands)
 {
-    // Have a joystick; grab its axes
+    int events = 0;
+
+    // Have a joystick; take every event queued since the last step, since a gamepad can send them
+    // faster than we step, and only the latest position of each axis matters
     if (joyfd > 0) {
 
         struct js_event js;
 
-        read(joyfd, &js, sizeof(struct js_event));
+        while (read(joyfd, &js, sizeof(struct js_event)) == sizeof(struct js_event)) {
+
+            int jstype = js.type & ~JS_EVENT_INIT;
 
-        int jstype = js.type & ~JS_EVENT_INIT;
+            // Grab demands from axes
+            if (jstype == JS_EVENT_AXIS) 
+                posixControllerQueueAxis(controller, demands, js.number, js.value);
 
-        // Grab demands from axes
-        if (jstype == JS_EVENT_AXIS) 
-            posixControllerGrabAxis(controller, demands, js.number, js.value);
+            // Grab aux demand from buttons when detected
+            if ((jstype == JS_EVENT_BUTTON) && (js.value==1)) 
+                posixControllerGrabButton(demands, js.number);
 
-        // Grab aux demand from buttons when detected
-        if ((jstype == JS_EVENT_BUTTON) && (js.value==1)) 
-            posixControllerGrabButton(demands, js.number);
+            events++;
+        }
     }
 
     // No joystick; try DSM dongle
-    else if (dsmfd > 0) {
-        for (int k=0; k<5; ++k)
-            demands[k] = (dsmvals[k] - 1500) / 500.;
+    else if (dsmopen) {
+        static unsigned lastseq;
+        int vals[DSM_CHANNELS];
+        unsigned seq = dsmRead(vals);
+        for (int k=0; k<DSM_CHANNELS; ++k)
+            demands[k] = (vals[k] - 1500) / 500.;
+        events = seq != lastseq;
+        lastseq = seq;
     }
 
     // No joystick or DSM; use keyboard
@@ -145,6 +204,8 @@ void controllerRead(controller_t controller, float * demands)
         char keys[8] = {68, 67, 66, 65, 50, 10, 54, 53};
         posixKbGrab(keys);
     }
+
+    posixControllerFlush(controller, demands, events);
 }
 
 void controllerClose(void)
@@ -154,8 +215,12 @@ void controllerClose(void)
     if (joyfd > 0)
         close(joyfd);
 
-    else if (dsmfd > 0)
-        close(dsmfd);
+    else if (dsmopen) {
+        // Thread notices within one read timeout; don't close the port under it
+        pthread_join(dsmthreadid, NULL);
+        dsmport.closeConnection();
+        dsmopen = false;
+    }
 
     else // reset keyboard if no joystick or DSM dongle
         posixKbClose();
@@ -25,6 +25,7 @@
 #include <string.h>
 
 #include <sys/time.h>
+#include <time.h>
 
 #include "controller.hpp"
 #include "controller_Posix.hpp"
@@ -32,6 +33,14 @@
 static int axisdir[5];
 static int axismap[5];
 
+// Axes queued since the last flush (bit k for axis k), and their latest values; controllers with
+// more axes than this have the rest applied as they come
+static const int QUEUE_AXES = 32;
+static unsigned  queuedaxes;
+static int       queuedvals[QUEUE_AXES];
+
+static controller_snapshot_t snapshot;
+
 static struct termios oldSettings;
 
 void posixKbInit(void)
@@ -147,6 +156,40 @@ void posixControllerGrabAxis(controller_t controller, float * demands, int numbe
         }
 }
 
+void posixControllerQueueAxis(controller_t controller, float * demands, int number, int value)
+{
+    if (number < 0 || number >= QUEUE_AXES) {
+        posixControllerGrabAxis(controller, demands, number, value);
+        return;
+    }
+
+    queuedaxes |= 1u << number;
+    queuedvals[number] = value;
+}
+
+void posixControllerFlush(controller_t controller, float * demands, int events)
+{
+    for (int k=0; queuedaxes; ++k)
+        if (queuedaxes & (1u << k)) {
+            posixControllerGrabAxis(controller, demands, k, queuedvals[k]);
+            queuedaxes &= ~(1u << k);
+        }
+
+    if (events > 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        snapshot.usec = (unsigned long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+    }
+
+    snapshot.events = events;
+    memcpy(snapshot.demands, demands, sizeof(snapshot.demands));
+}
+
+void controllerGetSnapshot(controller_snapshot_t & _snapshot)
+{
+    _snapshot = snapshot;
+}
+
 void posixControllerGrabButton(float * demands, int number)
 {
     switch (number) {
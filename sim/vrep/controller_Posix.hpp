@@ -28,3 +28,9 @@ controller_t posixControllerInit(char * name, const char * ps3name);
 void posixControllerGrabAxis(controller_t controller, float * demands, int number, int value);
 
 void posixControllerGrabButton(float * demands, int number);
+
+// Each read drains every queued event: posixControllerQueueAxis() keeps the latest value per axis, and
+// posixControllerFlush() applies them once each and stamps the snapshot if any events came in
+void posixControllerQueueAxis(controller_t controller, float * demands, int number, int value);
+
+void posixControllerFlush(controller_t controller, float * demands, int events);
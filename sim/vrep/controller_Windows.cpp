@@ -26,6 +26,8 @@
 
 // Adapted from http://olek.matthewm.com.pl//courses/ee-ces/examples/02_JOYSTICK_WIN32.C.HTML
 
+static controller_snapshot_t snapshot;
+
 controller_t controllerInit(void)
 { 
     controller_t controller = KEYBOARD;
@@ -144,6 +146,18 @@ void controllerRead(controller_t controller, float * demands)
                 kbRespond(c, keys);
             }
     }
+
+    // joyGetPosEx() gives the current state rather than a queue, so every joystick read is fresh
+    snapshot.events = controller == KEYBOARD ? 0 : 1;
+    if (snapshot.events)
+        snapshot.usec = GetTickCount64() * 1000;
+    for (int k=0; k<5; ++k)
+        snapshot.demands[k] = demands[k];
+}
+
+void controllerGetSnapshot(controller_snapshot_t & _snapshot)
+{
+    _snapshot = snapshot;
 }
 
 void controllerClose(void)
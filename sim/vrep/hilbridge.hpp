@@ -0,0 +1,263 @@
+/*
+   hilbridge.hpp : simulator side of hardware-in-the-loop flight
+
+   Each step, exchange() sends a simulated IMU sample to a board running HilBoard (include/hil.hpp)
+   and waits for the motor values its firmware computed from it.  Round-trip times are kept here,
+   and the board's own timing comes back with each reply; close() asks the board for its IMU task's
+   loop timing and prints it all, so that the headroom left at the simulated step is plain.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+
+#include "serial.hpp"
+#include "MSPPG.h"
+
+class HilBridge : public HIL_MOTORS_Handler, public LOOP_TIMING_Handler {
+
+    public:
+
+        // Must match HilBoard::ANGLE_SCALE
+        static constexpr float ANGLE_SCALE = 10000;
+
+        // How long a step waits for the board's motors before flying on with the last ones
+        static const int REPLY_TIMEOUT_USEC = 20000;
+
+        HilBridge(void)
+        {
+            this->port = NULL;
+        }
+
+        // stepUsec is the simulator's timestep, against which the board's headroom is reported
+        bool open(const char * portname, int baudrate, uint32_t stepUsec)
+        {
+            this->port = new SerialConnection(portname, baudrate);
+
+            if (!this->port->openConnection()) {
+                delete this->port;
+                this->port = NULL;
+                return false;
+            }
+
+            this->port->setLowLatency();
+
+            this->parser.set_HIL_MOTORS_Handler(this);
+            this->parser.set_LOOP_TIMING_Handler(this);
+
+            this->stepUsec    = stepUsec;
+            this->seq         = 0;
+            this->motors      = NULL;
+            this->answered    = true;
+            this->samples     = 0;
+            this->timeouts    = 0;
+            this->rttTotal    = 0;
+            this->rttMax      = 0;
+            this->boardTotal  = 0;
+            this->boardMax    = 0;
+            this->boardMissed = 0;
+            this->gotTiming   = false;
+
+            return true;
+        }
+
+        bool isOpen(void)
+        {
+            return this->port != NULL;
+        }
+
+        // Euler angles in radians and raw gyro, as from Board::imuGetEulerAndGyro(); motors come back as
+        // PWM values, untouched on timeout (false)
+        bool exchange(const float eulerAnglesRadians[3], const int16_t gyroRaw[3], uint16_t motors[4])
+        {
+            byte msg[32];
+
+            size_t len = MSP_Parser::serialize_HIL_STATE_into(msg, sizeof(msg), ++this->seq,
+                    angle(eulerAnglesRadians[0]), angle(eulerAnglesRadians[1]), angle(eulerAnglesRadians[2]),
+                    gyroRaw[0], gyroRaw[1], gyroRaw[2]);
+
+            auto start = std::chrono::steady_clock::now();
+
+            this->port->writeBytes((char *)msg, (int)len);
+
+            this->motors = motors;
+            this->answered = false;
+
+            while (!this->answered) {
+
+                int waited = (int)usecSince(start);
+
+                if (waited >= REPLY_TIMEOUT_USEC || !wait(REPLY_TIMEOUT_USEC - waited)) {
+                    this->timeouts++;
+                    return false;
+                }
+            }
+
+            uint32_t rtt = usecSince(start);
+
+            this->samples++;
+            this->rttTotal += rtt;
+            if (rtt > this->rttMax)
+                this->rttMax = rtt;
+
+            return true;
+        }
+
+        // Also prints the timing for the flight
+        void close(void)
+        {
+            if (!this->port)
+                return;
+
+            MSP_Message request = MSP_Parser::serialize_LOOP_TIMING_Request();
+            byte buf[MAXBUF];
+            int len = 0;
+            for (byte b=request.start(); request.hasNext(); b=request.getNext())
+                buf[len++] = b;
+            this->port->writeBytes((char *)buf, len);
+
+            // Replies to samples still in flight may be ahead of it
+            auto start = std::chrono::steady_clock::now();
+            while (!this->gotTiming && usecSince(start) < 10*REPLY_TIMEOUT_USEC && wait(REPLY_TIMEOUT_USEC))
+                ;
+
+            report();
+
+            this->port->closeConnection();
+            delete this->port;
+            this->port = NULL;
+        }
+
+        virtual void handle_HIL_MOTORS(short seq, short m1, short m2, short m3, short m4, short latency, short missed)
+        {
+            // A late reply to a sample we've given up on is no use now
+            if (seq != this->seq || this->answered || !this->motors)
+                return;
+
+            this->motors[0] = (uint16_t)m1;
+            this->motors[1] = (uint16_t)m2;
+            this->motors[2] = (uint16_t)m3;
+            this->motors[3] = (uint16_t)m4;
+
+            this->boardTotal += (uint16_t)latency;
+            if ((uint16_t)latency > this->boardMax)
+                this->boardMax = (uint16_t)latency;
+
+            this->boardMissed = (uint16_t)missed;
+
+            this->answered = true;
+        }
+
+        virtual void handle_LOOP_TIMING(short lateMax, short execMax, short overruns,
+                short late0, short late1, short late2, short late3, short late4, short late5, short late6, short late7,
+                short exec0, short exec1, short exec2, short exec3, short exec4, short exec5, short exec6, short exec7)
+        {
+            (void)late0; (void)late1; (void)late2; (void)late3; (void)late4; (void)late5; (void)late6; (void)late7;
+
+            short hist[8] = {exec0, exec1, exec2, exec3, exec4, exec5, exec6, exec7};
+
+            this->imuLateMax  = (uint16_t)lateMax;
+            this->imuExecMax  = (uint16_t)execMax;
+            this->imuOverruns = (uint16_t)overruns;
+            for (int k=0; k<8; ++k)
+                this->imuExecHist[k] = (uint16_t)hist[k];
+
+            this->gotTiming = true;
+        }
+
+    private:
+
+        SerialConnection * port;
+        MSP_Parser         parser;
+
+        uint32_t           stepUsec;
+        int16_t            seq;
+        uint16_t         * motors;
+        bool               answered;
+
+        // Host side: every exchange, send to reply
+        uint32_t           samples;
+        uint32_t           timeouts;
+        uint64_t           rttTotal;
+        uint32_t           rttMax;
+
+        // Board side: sample parsed to motors written, from each reply
+        uint64_t           boardTotal;
+        uint32_t           boardMax;
+        uint16_t           boardMissed;
+
+        // The board's IMU task, from MSP_LOOP_TIMING
+        bool               gotTiming;
+        uint16_t           imuLateMax;
+        uint16_t           imuExecMax;
+        uint16_t           imuOverruns;
+        uint16_t           imuExecHist[8];
+
+        static short angle(float radians)
+        {
+            float a = radians * ANGLE_SCALE;
+            return (short)(a > 32767 ? 32767 : (a < -32767 ? -32767 : a));
+        }
+
+        static uint32_t usecSince(std::chrono::steady_clock::time_point start)
+        {
+            return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+        }
+
+        // Parses whatever arrives within the timeout; false if nothing did
+        bool wait(int timeoutUsec)
+        {
+            byte buf[256];
+
+            int count = this->port->readSome((char *)buf, sizeof(buf), timeoutUsec);
+
+            if (count <= 0)
+                return false;
+
+            this->parser.parse(buf, count);
+
+            return true;
+        }
+
+        void report(void)
+        {
+            printf("HIL: %u samples answered, %u timed out, %u missed by the board\n",
+                    this->samples, this->timeouts, this->boardMissed);
+
+            if (this->samples) {
+                printf("HIL: round trip %u usec mean, %u max; on board %u usec mean, %u max\n",
+                        (unsigned)(this->rttTotal / this->samples), this->rttMax,
+                        (unsigned)(this->boardTotal / this->samples), this->boardMax);
+            }
+
+            if (this->gotTiming) {
+                printf("HIL: IMU task %u usec max (%.1f%% headroom at the %u usec step), %u usec late max, "
+                        "%u overruns\n", this->imuExecMax, 100 * (1 - this->imuExecMax / (float)this->stepUsec),
+                        this->stepUsec, this->imuLateMax, this->imuOverruns);
+                printf("HIL: IMU task exec histogram (usec):");
+                for (int k=0; k<7; ++k)
+                    printf(" <%u:%u", 32 << k, this->imuExecHist[k]);
+                printf(" >=%u:%u\n", 32 << 6, this->imuExecHist[7]);
+            }
+            else {
+                printf("HIL: no loop timing from the board\n");
+            }
+        }
+};
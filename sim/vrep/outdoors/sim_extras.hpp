@@ -41,19 +41,66 @@ void simExtrasStop(void)
 
 namespace hf {
 
+// MSP goes over UDP when MSP_UDP_PORT is set (see README), and nowhere otherwise
+
 uint8_t VrepSimBoard::serialAvailableBytes(void)
 {
+#ifndef _WIN32
+    if (mspLinked && !mspPort.available()) {
+        mspPort.received(mspLink.recvSome((char *)mspPort.receiveBuffer(), CONFIG_DATAGRAM_SIZE));
+    }
+    return mspPort.available();
+#else
     return 0;
+#endif
 }
 
 uint8_t VrepSimBoard::serialReadByte(void) 
 {
+#ifndef _WIN32
+    return mspPort.read();
+#else
     return 0;
+#endif
 }
 
 void VrepSimBoard::serialWriteByte(uint8_t c)
 {
+#ifndef _WIN32
+    mspPort.write(c);
+#else
     (void)c;
+#endif
+}
+
+uint16_t VrepSimBoard::serialAvailableForWrite(void)
+{
+#ifndef _WIN32
+    return mspLinked ? mspPort.availableForWrite() : 0xFFFF;
+#else
+    return 0xFFFF;
+#endif
+}
+
+void VrepSimBoard::serialWriteBytes(const uint8_t * buf, uint16_t count)
+{
+#ifndef _WIN32
+    mspPort.write(buf, count);
+#else
+    (void)buf;
+    (void)count;
+#endif
+}
+
+void VrepSimBoard::serialFlush(void)
+{
+#ifndef _WIN32
+    // With no ground station heard from yet, the burst goes nowhere, as on a port with nothing plugged in
+    if (mspPort.pending() && mspLinked) {
+        mspLink.send((const char *)mspPort.sendBuffer(), mspPort.pending());
+    }
+    mspPort.sent();
+#endif
 }
 
 } // namespace hf
@@ -0,0 +1,97 @@
+/*
+   propmodel.hpp : analytic motor and prop model, in place of V-REP's particle simulation
+
+   Each motor's speed follows its command with a first-order lag, and its thrust and drag torque
+   come from a table over speed, so a step costs a few multiplies instead of the hundreds of
+   particles a prop's script would otherwise launch, and two runs from the same inputs fly the
+   same.  The spinning props also push back on the frame: speeding one up turns the frame the
+   other way, and turning the frame tips the props' spin axes, which takes a gyroscopic torque.
+   The default table is the particle model's own (thrust in proportion to command), so gains
+   tuned with one carry over to the other; a thrust-stand run can replace it.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+class PropModel {
+
+    public:
+
+        // Table entries: thrust and torque, as fractions of full, at each tenth of full speed
+        static const int TABLE_SIZE = 11;
+
+        typedef struct params_t {
+            float maxThrust;        // N, at full speed
+            float maxTorque;        // N m of drag, at full speed
+            float maxSpeed;         // rad/s
+            float inertia;          // kg m^2, the prop and the motor's bell
+            float tau;              // sec, for the speed to get 63% of the way to a new command
+            float thrustTable[TABLE_SIZE];
+            float torqueTable[TABLE_SIZE];
+        } params_t;
+
+        void init(const params_t & _params, float timestep)
+        {
+            params = _params;
+
+            dt    = timestep;
+            alpha = timestep / (params.tau + timestep);
+            speed = 0;
+            accel = 0;
+        }
+
+        // One step toward a command in [0,1]; thrust along the axis (N) and drag torque (N m), the
+        // latter against the spin
+        void update(float command, float & thrust, float & torque)
+        {
+            float previous = speed;
+            speed += alpha * (command - speed);
+            accel  = (speed - previous) * params.maxSpeed / dt;
+
+            thrust = params.maxThrust * lookup(params.thrustTable, speed);
+            torque = params.maxTorque * lookup(params.torqueTable, speed);
+        }
+
+        // Fraction of full speed, for spinning the prop's joint
+        float getSpeed(void) { return speed; }
+
+        // Angular momentum about the spin axis (N m s), and the torque on the frame from the latest
+        // change of speed (N m), both in the spin's direction
+        float getMomentum(void) { return params.inertia * speed * params.maxSpeed; }
+        float getSpinupReaction(void) { return -params.inertia * accel; }
+
+    private:
+
+        params_t params;
+
+        float dt;
+        float alpha;
+        float speed;
+        float accel;    // rad/s/s, over the latest step
+
+        static float lookup(const float table[TABLE_SIZE], float x)
+        {
+            float f = x * (TABLE_SIZE - 1);
+
+            if (f <= 0)
+                return table[0];
+            if (f >= TABLE_SIZE - 1)
+                return table[TABLE_SIZE - 1];
+
+            int k = (int)f;
+            float t = f - k;
+            return table[k] + t * (table[k+1] - table[k]);
+        }
+};
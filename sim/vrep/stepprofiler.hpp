@@ -0,0 +1,207 @@
+/*
+   stepprofiler.hpp : where the wall-clock time of each simulation step goes
+
+   The plugin wraps each phase of its update callback, and the firmware updates and extras it runs
+   from v_repMessage(), in a StepProfiler::Phase.  That scoped timer adds its time to the current
+   second's totals.  Once a second has passed, its record goes into a ring of the last SECONDS of
+   them, and is optionally written as a line of CSV.  Whatever time in a second the plugin didn't
+   use went to V-REP itself: physics, rendering and the scene's scripts.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+class StepProfiler {
+
+    public:
+
+        enum {
+            CONTROLLER,     // reading the sticks
+            SENSORS,        // the vehicles' object queries and sensor models
+            HIL,            // the round trip to a hardware-in-the-loop board
+            EXTRAS,         // the companion-board extras, update and messages
+            MOTORS,         // the vehicles' motor and prop forces
+            FLUSH,          // sending forces and signals to the scene
+            FIRMWARE,       // the vehicles' Hackflight updates, from v_repMessage()
+            PHASES
+        };
+
+        // Seconds kept for stats()
+        static const int SECONDS = 60;
+
+        class Phase {
+
+            public:
+
+                Phase(StepProfiler & profiler, int phase)
+                    : _profiler(profiler), _phase(phase), _start(steady_t::now()) { }
+
+                ~Phase(void)
+                {
+                    _profiler.add(_phase, micros(steady_t::now() - _start));
+                }
+
+            private:
+
+                StepProfiler & _profiler;
+                int _phase;
+                std::chrono::steady_clock::time_point _start;
+        };
+
+        // NULL for no CSV
+        void start(const char * csvPath)
+        {
+            _count = 0;
+            _next  = 0;
+            clear();
+            _secondStart = steady_t::now();
+
+            _csv = csvPath ? fopen(csvPath, "w") : NULL;
+            if (csvPath && !_csv)
+                printf("Can't open %s for the step stats\n", csvPath);
+            if (_csv) {
+                fprintf(_csv, "steps,wall_us");
+                for (int k=0; k<PHASES; ++k)
+                    fprintf(_csv, ",%s_us", name(k));
+                for (int k=0; k<PHASES; ++k)
+                    fprintf(_csv, ",%s_max_us", name(k));
+                fprintf(_csv, "\n");
+            }
+        }
+
+        // Once per update callback, before its phases
+        void step(void)
+        {
+            uint32_t elapsed = micros(steady_t::now() - _secondStart);
+
+            if (elapsed >= 1000000) {
+                _current.wallMicros = elapsed;
+                _ring[_next] = _current;
+                _next = (_next + 1) % SECONDS;
+                if (_count < SECONDS)
+                    ++_count;
+                write(_current);
+                clear();
+                _secondStart += std::chrono::microseconds(elapsed);
+            }
+
+            ++_current.steps;
+        }
+
+        void stop(void)
+        {
+            if (_csv)
+                fclose(_csv);
+            _csv = NULL;
+        }
+
+        // Over the last seconds complete seconds (all those kept, if fewer): steps per second, then
+        // each phase's mean time per step in microseconds, V-REP's own, and each phase's longest pass
+        void stats(int seconds, std::vector<float> & out)
+        {
+            out.assign(2 + 2*PHASES, 0);
+
+            if (seconds < 1 || seconds > _count)
+                seconds = _count;
+
+            uint32_t steps  = 0;
+            uint64_t wall   = 0;
+            uint64_t plugin = 0;
+            uint64_t phase[PHASES] = {0};
+
+            for (int j=0; j<seconds; ++j) {
+                const second_t & s = _ring[(_next + SECONDS - 1 - j) % SECONDS];
+                steps += s.steps;
+                wall  += s.wallMicros;
+                for (int k=0; k<PHASES; ++k) {
+                    phase[k]  += s.phaseMicros[k];
+                    plugin    += s.phaseMicros[k];
+                    if (s.phaseMaxMicros[k] > out[2+PHASES+k])
+                        out[2+PHASES+k] = (float)s.phaseMaxMicros[k];
+                }
+            }
+
+            if (steps == 0)
+                return;
+
+            out[0] = 1e6f * steps / wall;
+            for (int k=0; k<PHASES; ++k)
+                out[1+k] = (float)phase[k] / steps;
+            out[1+PHASES] = (float)(wall > plugin ? wall - plugin : 0) / steps;
+        }
+
+    private:
+
+        typedef std::chrono::steady_clock steady_t;
+
+        typedef struct {
+            uint32_t steps;
+            uint32_t wallMicros;
+            uint32_t phaseMicros[PHASES];
+            uint32_t phaseMaxMicros[PHASES];    // longest single pass
+        } second_t;
+
+        static const char * name(int phase)
+        {
+            static const char * names[PHASES] =
+                {"controller", "sensors", "hil", "extras", "motors", "flush", "firmware"};
+            return names[phase];
+        }
+
+        second_t _ring[SECONDS];
+        int      _next;
+        int      _count;
+
+        second_t _current;
+        steady_t::time_point _secondStart;
+
+        FILE * _csv = NULL;
+
+        static uint32_t micros(steady_t::duration d)
+        {
+            return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+        }
+
+        void add(int phase, uint32_t usec)
+        {
+            _current.phaseMicros[phase] += usec;
+            if (usec > _current.phaseMaxMicros[phase])
+                _current.phaseMaxMicros[phase] = usec;
+        }
+
+        void clear(void)
+        {
+            memset(&_current, 0, sizeof(_current));
+        }
+
+        void write(const second_t & s)
+        {
+            if (!_csv)
+                return;
+            fprintf(_csv, "%u,%u", s.steps, s.wallMicros);
+            for (int k=0; k<PHASES; ++k)
+                fprintf(_csv, ",%u", s.phaseMicros[k]);
+            for (int k=0; k<PHASES; ++k)
+                fprintf(_csv, ",%u", s.phaseMaxMicros[k]);
+            fprintf(_csv, "\n");
+            fflush(_csv);
+        }
+};
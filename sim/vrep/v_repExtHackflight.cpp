@@ -25,6 +25,21 @@ static const float PARTICLE_SIZE           = .005f;
 
 static const int BARO_NOISE_PASCALS        = 3;
 
+// Send all the props' forces and torques as one packed signal per vehicle (see README),
+// rather than as 24 float signals for scenes whose prop scripts haven't been updated
+static const bool PACKED_PROP_SIGNAL       = true;
+
+// Work out the props' forces with PropModel (propmodel.hpp) and apply them here, rather than have
+// the props' scripts apply them alongside V-REP's particles; much faster, and the same every run
+// (see README).  Full thrust and drag torque are the particle model's, so the gains carry over.
+static const bool  ANALYTIC_PROP_MODEL     = false;
+static const float MOTOR_TAU               = 0.02f;     // sec
+static const float PROP_MAX_SPEED          = 2500;      // rad/s
+static const float PROP_INERTIA            = 2e-6f;     // kg m^2
+
+// Also write each second's step timing (stepprofiler.hpp) to this CSV file (e.g. "stepstats.csv"); NULL for none
+static const char * STATS_CSV              = NULL;
+
 #include "v_repExt.h"
 #include "scriptFunctionData.h"
 #include "v_repLib.h"
@@ -40,7 +55,10 @@ static const int BARO_NOISE_PASCALS        = 3;
 using namespace std;
 
 #include "controller.hpp"
+#include "propmodel.hpp"
 #include "sim_extras.hpp"
+#include "stepprofiler.hpp"
+#include "vehiclepool.hpp"
 
 #ifdef _WIN32
 #include "Shlwapi.h"
@@ -49,12 +67,24 @@ using namespace std;
 #include <unistd.h>
 #include <fcntl.h>
 #include "controller_Posix.hpp"
+#include "hilbridge.hpp"
 #endif 
 
 // Header-only Hackflight firmware
 #include <board.hpp>
 #include <hackflight.hpp>
 
+// Hardware-in-the-loop (not on Windows): fly the first vehicle with the firmware on a real board, at
+// this serial port (e.g. "/dev/ttyACM0"; see README), rather than here.  NULL flies them all here.
+static const char * HIL_PORT               = NULL;
+static const int    HIL_BAUD               = 115200;
+
+// MSP over UDP (not on Windows): each vehicle's firmware talks to ground stations on this port plus the
+// vehicle's index, and sends its telemetry to this multicast group too (see README).  Zero for no UDP.
+static const int    MSP_UDP_PORT           = 0;
+static const char * MSP_UDP_GROUP          = NULL;  // e.g. "239.255.72.70"
+static const int    MSP_UDP_GROUP_PORT     = 5200;
+
 // Controller type
 static controller_t controller;
 
@@ -103,89 +133,373 @@ void kbRespond(char key, char keys[8])
 
 LIBRARY vrepLib;
 
-// Hackflight interface
-extern void setup(void);
-extern void loop(void);
-static uint64_t micros;
-
 // Launch support
 static bool ready;
 
-// needed for spring-mounted throttle stick
-static float throttleDemand;
 static const float SPRINGY_THROTTLE_INC = .01f;
 
-// IMU support
-static float accel[3];
-static float gyro[3];
-static float eulerAngles[3];
-
-// Barometer support
-static int baroPressure;
-
-// Motor support
-static float thrusts[4];
-
 // 100 Hz timestep, used for simulating microsend timer
 static float timestep;
 
 static int particleCount;
 
-// Handles from scene
-static int motorList[4];
-static int motorJointList[4];
-static int quadcopterHandle;
-static int accelHandle;
-static int greenLedHandle;
-static int redLedHandle;
+// Scene time, for the toast dialog; each vehicle keeps its own clock
+static uint64_t sceneMicros;
 
-// Support for reporting status of aux switch (alt-hold, etc.)
-static uint8_t auxStatus;
+// Wall-clock time of each phase of the step, for simExtHackflight_stats
+static StepProfiler profiler;
 
-// LED support
+// forward declaration
+static void startToast(const char * message, int colorR, int colorG, int colorB);
 
-class LED {
+// Board implementation ======================================================
 
-    private:
+#include "vrepsimboard.hpp"
+
+static int get_indexed_object_handle(const char * name, int index, const char * vehicle)
+{
+    char tmp[100];
+    sprintf(tmp, "%s%d%s", name, index+1, vehicle);
+    return simGetObjectHandle(tmp);
+}
+
+static int get_indexed_suffixed_object_handle(const char * name, int index, const char * suffix, const char * vehicle)
+{
+    char tmp[100];
+    sprintf(tmp, "%s%d_%s%s", name, index+1, suffix, vehicle);
+    return simGetObjectHandle(tmp);
+}
+
+static int get_vehicle_object_handle(const char * name, const char * vehicle)
+{
+    char tmp[100];
+    sprintf(tmp, "%s%s", name, vehicle);
+    return simGetObjectHandle(tmp);
+}
+
+static void make_indexed_signal_name(char * out, const char * name, int i, int k, const char * vehicle)
+{
+    sprintf(out, "%s%d%d%s", name, i+1, k+1, vehicle);
+}
+
+// Rotates a body-frame vector into the world frame, using a 3x4 object matrix from V-REP
+static void bodyToWorld(const float m[12], const float b[3], float w[3])
+{
+    for (int r=0; r<3; ++r) {
+        w[r] = m[4*r]*b[0] + m[4*r+1]*b[1] + m[4*r+2]*b[2];
+    }
+}
+
+static void scalarTo3D(float s, const float axis[3], float out[3])
+{
+    out[0] = s*axis[0];
+    out[1] = s*axis[1];
+    out[2] = s*axis[2];
+}
+
+static void cross(const float a[3], const float b[3], float out[3])
+{
+    out[0] = a[1]*b[2] - a[2]*b[1];
+    out[1] = a[2]*b[0] - a[0]*b[2];
+    out[2] = a[0]*b[1] - a[1]*b[0];
+}
+
+// Full thrust and torque as the particle model gives them at full command, in proportion below that
+static void makePropParams(PropModel::params_t & params)
+{
+    params.maxThrust = PARTICLE_COUNT_PER_SECOND * PARTICLE_DENSITY * (float)M_PI * (float)pow(PARTICLE_SIZE,3);
+    params.maxTorque = 1;
+    params.maxSpeed  = PROP_MAX_SPEED;
+    params.inertia   = PROP_INERTIA;
+    params.tau       = MOTOR_TAU;
+
+    for (int k=0; k<PropModel::TABLE_SIZE; ++k) {
+        params.thrustTable[k] = k / (float)(PropModel::TABLE_SIZE - 1);
+        params.torqueTable[k] = k / (float)(PropModel::TABLE_SIZE - 1);
+    }
+}
 
-        int handle;
-        float color[3];
-        bool on;
+namespace hf {
 
-    public:
+void VrepSimBoard::nameSuffix(int index, char suffix[8])
+{
+    if (index == 0)
+        suffix[0] = 0;
+    else
+        sprintf(suffix, "#%d", index-1);
+}
 
-        LED(void) { }
+void VrepSimBoard::simStart(int index)
+{
+    nameSuffix(index, suffix);
 
-        void init(int _handle, float r, float g, float b)
-        {
-            this->handle = _handle;
-            this->color[0] = r;
-            this->color[1] = g;
-            this->color[2] = b;
-            this->on = false;
+    // Get the object handles for the motors, joints, respondables
+    for (int i=0; i<4; ++i) {
+        motorList[i]         = get_indexed_object_handle("Motor", i, suffix);
+        motorJointList[i]    = get_indexed_suffixed_object_handle("Motor", i, "joint", suffix);
+        for (int k=0; k<3; ++k) {
+            make_indexed_signal_name(forceSignals[i][k],  "force",  i, k, suffix);
+            make_indexed_signal_name(torqueSignals[i][k], "torque", i, k, suffix);
         }
+    }
+
+    sprintf(propSignalName, "props%s", suffix);
 
-        void set(bool status)
-        {
-            this->on = status;
-            float black[3] = {0,0,0};
-            simSetShapeColor(this->handle, NULL, 0, this->on ? this->color : black);
+    // Get handle for objects we'll access
+    quadcopterHandle   = get_vehicle_object_handle("Quadcopter", suffix);
+    accelHandle        = get_vehicle_object_handle("Accelerometer_forceSensor", suffix);
+
+    // The motors are fixed to the frame, so their thrust axes need only be found once, in the
+    // vehicle's frame; likewise their joints move only when we move them
+    for (int i=0; i<4; ++i) {
+        float motorMatrix[12];
+        simGetObjectMatrix(motorList[i], quadcopterHandle, motorMatrix);
+        motorAxes[i][0] = motorMatrix[2];
+        motorAxes[i][1] = motorMatrix[6];
+        motorAxes[i][2] = motorMatrix[10];
+        simGetJointPosition(motorJointList[i], &jointAngles[i]);
+    }
+
+    if (ANALYTIC_PROP_MODEL) {
+        PropModel::params_t params;
+        makePropParams(params);
+        for (int i=0; i<4; ++i) {
+            props[i].init(params, timestep);
         }
-};
+        for (int k=0; k<3; ++k) {
+            angularVelocity[k] = 0;
+        }
+    }
 
-static LED leds[2];
+    leds[0].init(get_vehicle_object_handle("Green_LED_visible", suffix), 0, 1, 0);
+    leds[1].init(get_vehicle_object_handle("Red_LED_visible", suffix), 1, 0, 0);
 
-// forward declaration
-static void startToast(const char * message, int colorR, int colorG, int colorB);
+    micros = 0;
 
-// Board implementation ======================================================
+#ifndef _WIN32
+    mspPort.init();
+    mspLinked = false;
+    if (MSP_UDP_PORT) {
+        mspLink = UdpLink(MSP_UDP_PORT + index);
+        mspLinked = mspLink.openLink();
+        if (mspLinked && MSP_UDP_GROUP)
+            mspLink.multicastTo(MSP_UDP_GROUP, MSP_UDP_GROUP_PORT + index);
+    }
+#endif
 
-#include "vrepsimboard.hpp"
+    for (int k=0; k<3; ++k) {
+        anglesPrev[k] = 0;
+    }
 
-static uint16_t pwmMin;
-static uint16_t pwmMax;
+    for (int k=0; k<4; ++k) {
+        thrusts[k] = 0;
+    }
 
-namespace hf {
+    // Need this for throttle on keyboard and PS3
+    throttleDemand = -1;
+
+    // For safety, all controllers start at minimum throttle, aux switch off
+    for (int k=0; k<5; ++k) {
+        demands[k] = k < 3 ? 0 : -1;
+    }
+
+    auxStatus = 0;
+    auxChanged = false;
+}
+
+void VrepSimBoard::simUpdateSensors(float timestep, controller_t _controller, const float _demands[5])
+{
+    float eulerFromSim[3];
+
+    // Get Euler angles for gyroscope simulation
+    simGetObjectOrientation(quadcopterHandle, -1, eulerFromSim);
+
+    // Convert Euler angles to pitch and roll via rotation formula
+    eulerAngles[0] =  sin(eulerFromSim[2])*eulerFromSim[0] - cos(eulerFromSim[2])*eulerFromSim[1];
+    eulerAngles[1] = -cos(eulerFromSim[2])*eulerFromSim[0] - sin(eulerFromSim[2])*eulerFromSim[1]; 
+    eulerAngles[2] = -eulerFromSim[2]; // yaw direct from Euler
+
+    // Compute pitch, roll, yaw first derivative to simulate gyro
+    for (int k=0; k<3; ++k) {
+        gyro[k] = (eulerAngles[k] - anglesPrev[k]) / timestep;
+        anglesPrev[k] = eulerAngles[k];
+    }
+
+    // Convert vehicle's Z coordinate in meters to barometric pressure in Pascals (millibars)
+    // At low altitudes above the sea level, the pressure decreases by about 1200 Pa for every 100 meters
+    // (See https://en.wikipedia.org/wiki/Atmospheric_pressure#Altitude_variation)
+    // The vehicle's matrix gives us its position as well as its motors' thrust axes
+    simGetObjectMatrix(quadcopterHandle, -1, vehicleMatrix);
+    baroPressure = (int)(1000 * (101.325 - 1.2 * vehicleMatrix[11] / 100));
+    
+    // Add some simulated measurement noise to the baro    
+    baroPressure += rand() % (2*BARO_NOISE_PASCALS + 1) - BARO_NOISE_PASCALS;
+
+    // Read accelerometer
+    simReadForceSensor(accelHandle, accel, NULL);
+
+    // The props' gyroscopic torque goes with the frame's rate of turn
+    if (ANALYTIC_PROP_MODEL) {
+        simGetObjectVelocity(quadcopterHandle, NULL, angularVelocity);
+    }
+
+    // Keep our own copy of the demands
+    controller = _controller;
+    for (int k=0; k<5; ++k) {
+        demands[k] = _demands[k];
+    }
+
+    // PS3 spring-mounted throttle requires special handling
+    switch (controller) {
+    case PS3:
+    case XBOX360:
+        throttleDemand += demands[3] * SPRINGY_THROTTLE_INC;     
+        if (throttleDemand < -1)
+            throttleDemand = -1;
+        if (throttleDemand > 1)
+            throttleDemand = 1;
+        break;
+    default:
+        throttleDemand = demands[3];
+    }
+
+    // Increment microsecond count
+    micros += (uint64_t)(1e6 * timestep);
+}
+
+void VrepSimBoard::simUpdateMotors(float timestep, int particleCount)
+{
+    const float tsigns[4] = {+1, -1, -1, +1};
+    const int propDirections[4] = {-1,+1,+1,-1};
+
+    if (ANALYTIC_PROP_MODEL) {
+        simUpdateProps(tsigns, propDirections);
+        return;
+    }
+
+    // Loop over motors
+    for (int i=0; i<4; ++i) {
+
+        // Get motor thrust in interval [0,1] from plugin
+        float thrust = thrusts[i];
+
+        // Simulate prop spin as a function of thrust
+        jointAngles[i] += propDirections[i] * thrust * 1.25f;
+
+        // Convert thrust to force and torque
+        float force = particleCount * PARTICLE_DENSITY * thrust * (float)M_PI * pow(PARTICLE_SIZE,3) / timestep;
+        float torque = tsigns[i] * thrust;
+
+        // Get motor's thrust axis in the world
+        float axis[3];
+        bodyToWorld(vehicleMatrix, motorAxes[i], axis);
+
+        // Convert force to 3D forces
+        scalarTo3D(force, axis, forces[i]);
+
+        // Convert force to 3D torques
+        scalarTo3D(torque, axis, torques[i]);
+
+    } // loop over motors
+}
+
+void VrepSimBoard::simUpdateProps(const float tsigns[4], const int propDirections[4])
+{
+    for (int i=0; i<4; ++i) {
+
+        float thrust, drag;
+        props[i].update(thrusts[i], thrust, drag);
+
+        // Spin the prop at its modeled speed, rather than at its command
+        jointAngles[i] += propDirections[i] * props[i].getSpeed() * 1.25f;
+
+        float axis[3];
+        bodyToWorld(vehicleMatrix, motorAxes[i], axis);
+
+        scalarTo3D(thrust, axis, forces[i]);
+
+        // Drag against the spin, the reaction to the spin's change, and the gyroscopic torque of the
+        // frame turning the spin axis: d/dt of the prop's momentum H comes from the frame as -w x H
+        float momentum[3];
+        float gyroscopic[3];
+        scalarTo3D(propDirections[i] * props[i].getMomentum(), axis, momentum);
+        cross(momentum, angularVelocity, gyroscopic);
+
+        float torque = tsigns[i] * drag + propDirections[i] * props[i].getSpinupReaction();
+        for (int k=0; k<3; ++k) {
+            torques[i][k] = torque * axis[k] + gyroscopic[k];
+        }
+    }
+}
+
+void VrepSimBoard::simFlush(void)
+{
+    // Send prop spin
+    for (int i=0; i<4; ++i) {
+        simSetJointPosition(motorJointList[i], jointAngles[i]);
+    }
+
+    // With the analytic model, the forces go straight to the props; the scripts get nothing to apply
+    if (ANALYTIC_PROP_MODEL) {
+        for (int i=0; i<4; ++i) {
+            simAddForceAndTorque(motorList[i], forces[i], torques[i]);
+        }
+    }
+
+    // Send forces and torques to props: force x,y,z then torque x,y,z for each motor in turn
+    else if (PACKED_PROP_SIGNAL) {
+        float packed[24];
+        for (int i=0; i<4; ++i) {
+            for (int k=0; k<3; ++k) {
+                packed[6*i+k]   = forces[i][k];
+                packed[6*i+3+k] = torques[i][k];
+            }
+        }
+        simSetStringSignal(propSignalName, (const char *)packed, sizeof(packed));
+    }
+    else {
+        for (int i=0; i<4; ++i) {
+            for (int k=0; k<3; ++k) {
+                simSetFloatSignal(forceSignals[i][k],  forces[i][k]);
+                simSetFloatSignal(torqueSignals[i][k], torques[i][k]);
+            }
+        }
+    }
+
+    leds[0].show();
+    leds[1].show();
+
+    if (auxChanged) {
+        char message[100];
+        switch (auxStatus) {
+            case 1:
+                sprintf(message, "ENTERING ALT-HOLD");
+                break;
+            case 2:
+                sprintf(message, "ENTERING GUIDED MODE");
+                break;
+            default:
+                sprintf(message, "ENTERING NORMAL MODE");
+        }
+        startToast(message, 1,1,0);
+        auxChanged = false;
+    }
+}
+
+void VrepSimBoard::simStop(void)
+{
+    // Turn off LEDs
+    leds[0].set(false);
+    leds[1].set(false);
+    leds[0].show();
+    leds[1].show();
+
+#ifndef _WIN32
+    if (mspLinked)
+        mspLink.closeLink();
+    mspLinked = false;
+#endif
+}
 
 void VrepSimBoard::init(void)
 {
@@ -201,11 +515,6 @@ void VrepSimBoard::init(void)
     // Convert gyro scale from degrees to radians
     // Config is available because VrepSimBoard is a subclass of Board
     gyroScale = (float)(4.0f / config.imu.gyroScale) * ((float)M_PI / 180.0f);
-    leds[0].init(greenLedHandle, 0, 1, 0);
-    leds[1].init(redLedHandle, 1, 0, 0);
-
-    pwmMin = config.pwm.min;
-    pwmMax = config.pwm.max;
 }
 
 const Config& VrepSimBoard::getConfig()
@@ -268,7 +577,7 @@ uint16_t VrepSimBoard::rcReadPwm(uint8_t chan)
     }
 
     // Joystick demands are in [-1,+1]
-    int pwm =  (int)(pwmMin + (demand + 1) / 2 * (pwmMax - pwmMin));
+    int pwm =  (int)(config.pwm.min + (demand + 1) / 2 * (config.pwm.max - config.pwm.min));
 
     return pwm;
 }
@@ -284,22 +593,19 @@ void VrepSimBoard::writeMotor(uint8_t index, uint16_t value)
     thrusts[index] = (value - 1000.f) / 1000.f;
 }
 
+void VrepSimBoard::writeMotors(const uint16_t * values, uint8_t count)
+{
+    for (uint8_t i = 0; i < count && i < 4; i++) {
+        thrusts[i] = (values[i] - 1000.f) / 1000.f;
+    }
+}
 
+
+// The toast is shown by simFlush()
 void VrepSimBoard::extrasHandleAuxSwitch(uint8_t status)
 {
     if (status != auxStatus) {
-        char message[100];
-        switch (status) {
-            case 1:
-                sprintf(message, "ENTERING ALT-HOLD");
-                break;
-            case 2:
-                sprintf(message, "ENTERING GUIDED MODE");
-                break;
-            default:
-                sprintf(message, "ENTERING NORMAL MODE");
-        }
-        startToast(message, 1,1,0);
+        auxChanged = true;
     }
 
     auxStatus = status;
@@ -333,8 +639,53 @@ void VrepSimBoard::normalizeV(float src[3], float dest[3])
 
 // --------------------------------------------------------------------------------------------------
 
-// Hackflight object
-static hf::Hackflight h;
+// A simulated vehicle: its board holds all of its state, and its Hackflight all of the firmware's
+typedef struct vehicle_t {
+    hf::VrepSimBoard board;
+    hf::Hackflight<> h;
+} vehicle_t;
+
+// Swarm support: every vehicle found in the scene flies its own Hackflight, all from the same pilot
+static const int MAX_VEHICLES = 16;
+
+static vehicle_t   vehicles[MAX_VEHICLES];
+static int         vehicleCount;
+static VehiclePool pool;
+
+// Set when the first vehicle's firmware is on a real board instead
+static bool        hilActive;
+#ifndef _WIN32
+static HilBridge   hil;
+#endif
+
+static void updateVehicle(int index)
+{
+    if (index == 0 && hilActive)
+        return;
+
+    vehicles[index].h.update();
+}
+
+static int countVehicles(void)
+{
+    // Quietly, since the first missing vehicle is how we know we've found them all
+    int errorModeSaved;
+    simGetIntegerParameter(sim_intparam_error_report_mode,&errorModeSaved);
+    simSetIntegerParameter(sim_intparam_error_report_mode,sim_api_errormessage_ignore);
+
+    int count = 0;
+    while (count < MAX_VEHICLES) {
+        char suffix[8];
+        hf::VrepSimBoard::nameSuffix(count, suffix);
+        if (get_vehicle_object_handle("Quadcopter", suffix) == -1)
+            break;
+        count++;
+    }
+
+    simSetIntegerParameter(sim_intparam_error_report_mode,errorModeSaved);
+
+    return count;
+}
 
 // Dialog support
 static int displayDialog(const char * title, char * message, float r, float g, float b, int style)
@@ -364,7 +715,7 @@ static void startToast(const char * message, int colorR, int colorG, int colorB)
 {
     hideToastDialog();
     toastDialogHandle = displayDialog("", (char *)message, (float)colorR, (float)colorG, (float)colorB, sim_dlgstyle_message);
-    toastDialogStartMicros = micros; 
+    toastDialogStartMicros = sceneMicros; 
 }
 
 // --------------------------------------------------------------------------------------
@@ -372,57 +723,51 @@ static void startToast(const char * message, int colorR, int colorG, int colorB)
 // --------------------------------------------------------------------------------------
 #define LUA_START_COMMAND  "simExtHackflight_start"
 
-static int get_indexed_object_handle(const char * name, int index)
-{
-    char tmp[100];
-    sprintf(tmp, "%s%d", name, index+1);
-    return simGetObjectHandle(tmp);
-}
-
-static int get_indexed_suffixed_object_handle(const char * name, int index, const char * suffix)
-{
-    char tmp[100];
-    sprintf(tmp, "%s%d_%s", name, index+1, suffix);
-    return simGetObjectHandle(tmp);
-}
-
 void LUA_START_CALLBACK(SScriptCallBack* cb)
 {
-    // Get the object handles for the motors, joints, respondables
-    for (int i=0; i<4; ++i) {
-        motorList[i]         = get_indexed_object_handle("Motor", i);
-		motorJointList[i]    = get_indexed_suffixed_object_handle("Motor", i, "joint");
-    }
-
-    // Get handle for objects we'll access
-    quadcopterHandle   = simGetObjectHandle("Quadcopter");
-    accelHandle        = simGetObjectHandle("Accelerometer_forceSensor");
-    greenLedHandle     = simGetObjectHandle("Green_LED_visible");
-    redLedHandle       = simGetObjectHandle("Red_LED_visible");
-
     // Timestep is used in various places
     timestep = simGetSimulationTimeStep();
 
     particleCount = (int)(PARTICLE_COUNT_PER_SECOND * timestep);
 
-    CScriptFunctionData D;
+    sceneMicros = 0;
 
-    // Init Hackflight object
-    h.init(new hf::VrepSimBoard());
-
-    // Need this for throttle on keyboard and PS3
-    throttleDemand = -1;
+    CScriptFunctionData D;
 
     // For safety, all controllers start at minimum throttle, aux switch off
     demands[3] = -1;
 	demands[4] = -1;
 
+    // Get each vehicle's scene handles, then init its Hackflight object
+    vehicleCount = countVehicles();
+
+    hilActive = false;
+#ifndef _WIN32
+    if (HIL_PORT) {
+        hilActive = hil.open(HIL_PORT, HIL_BAUD, (uint32_t)(1e6 * timestep));
+        if (!hilActive)
+            printf("Can't open %s for hardware-in-the-loop; flying here instead\n", HIL_PORT);
+    }
+#endif
+
+    for (int k=0; k<vehicleCount; ++k) {
+        vehicles[k].board.simStart(k);
+        if (k > 0 || !hilActive)
+            vehicles[k].h.init(&vehicles[k].board);
+    }
+
+    // No more threads than vehicles (or cores)
+    unsigned threads = std::thread::hardware_concurrency();
+    pool.start(threads < 1 ? 1 : (threads < (unsigned)vehicleCount ? threads : (unsigned)vehicleCount));
+
     // Each input device has its own axis and button mappings
     controller = controllerInit();
 
     // Do any extra initialization needed
     simExtrasStart();
 
+    profiler.start(STATS_CSV);
+
     // Now we're ready
     ready = true;
 
@@ -440,119 +785,65 @@ void LUA_START_CALLBACK(SScriptCallBack* cb)
 
 #define LUA_UPDATE_COMMAND "simExtHackflight_update"
 
-static void set_indexed_float_signal(const char * name, int i, int k, float value)
-{
-    char tmp[100];
-    sprintf(tmp, "%s%d%d", name, i+1, k+1);
-    simSetFloatSignal(tmp, value);
-}
-
-static void scalarTo3D(float s, float a[12], float out[3])
-{
-    out[0] = s*a[2];
-    out[1] = s*a[6];
-    out[2] = s*a[10];
-}
-
 void LUA_UPDATE_CALLBACK(SScriptCallBack* cb)
 {
     CScriptFunctionData D;
-    float eulerFromSim[3];
-
-    // For simulating gyro
-    static float anglesPrev[3];
-
-    // Get Euler angles for gyroscope simulation
-    simGetObjectOrientation(quadcopterHandle, -1, eulerFromSim);
 
-    // Convert Euler angles to pitch and roll via rotation formula
-    eulerAngles[0] =  sin(eulerFromSim[2])*eulerFromSim[0] - cos(eulerFromSim[2])*eulerFromSim[1];
-    eulerAngles[1] = -cos(eulerFromSim[2])*eulerFromSim[0] - sin(eulerFromSim[2])*eulerFromSim[1]; 
-    eulerAngles[2] = -eulerFromSim[2]; // yaw direct from Euler
+    profiler.step();
 
-    // Compute pitch, roll, yaw first derivative to simulate gyro
-    for (int k=0; k<3; ++k) {
-        gyro[k] = (eulerAngles[k] - anglesPrev[k]) / timestep;
-        anglesPrev[k] = eulerAngles[k];
+    // Get demands from controller
+    {
+        StepProfiler::Phase timed(profiler, StepProfiler::CONTROLLER);
+        controllerRead(controller, demands);
     }
 
-    // Convert vehicle's Z coordinate in meters to barometric pressure in Pascals (millibars)
-    // At low altitudes above the sea level, the pressure decreases by about 1200 Pa for every 100 meters
-    // (See https://en.wikipedia.org/wiki/Atmospheric_pressure#Altitude_variation)
-    float position[3];
-    simGetObjectPosition(quadcopterHandle, -1, position);
-    baroPressure = (int)(1000 * (101.325 - 1.2 * position[2] / 100));
-    
-    // Add some simulated measurement noise to the baro    
-    baroPressure += rand() % (2*BARO_NOISE_PASCALS + 1) - BARO_NOISE_PASCALS;
-
-    // Read accelerometer
-    simReadForceSensor(accelHandle, accel, NULL);
-
-    // Get demands from controller
-    controllerRead(controller, demands);
+    // Read the vehicles' sensors and advance their clocks
+    {
+        StepProfiler::Phase timed(profiler, StepProfiler::SENSORS);
+        for (int k=0; k<vehicleCount; ++k) {
+            vehicles[k].board.simUpdateSensors(timestep, controller, demands);
+        }
+    }
 
-    // PS3 spring-mounted throttle requires special handling
-	switch (controller) {
-	case PS3:
-	case XBOX360:
-        throttleDemand += demands[3] * SPRINGY_THROTTLE_INC;     
-        if (throttleDemand < -1)
-            throttleDemand = -1;
-        if (throttleDemand > 1)
-            throttleDemand = 1;
-		break;
-	default:
-        throttleDemand = demands[3];
-	}
+#ifndef _WIN32
+    // The real board answers this step's IMU sample with this step's motors; on timeout the
+    // vehicle flies on with the last ones
+    if (hilActive) {
+        StepProfiler::Phase timed(profiler, StepProfiler::HIL);
+        float    eulerAngles[3];
+        int16_t  gyroRaw[3];
+        uint16_t motors[4];
+        vehicles[0].board.imuGetEulerAndGyro(eulerAngles, gyroRaw);
+        if (hil.exchange(eulerAngles, gyroRaw, motors))
+            vehicles[0].board.writeMotors(motors, 4);
+    }
+#endif
 
     // Increment microsecond count
-    micros += (uint64_t)(1e6 * timestep);
+    sceneMicros += (uint64_t)(1e6 * timestep);
 
     // Do any extra update needed
-    simExtrasUpdate();
-
-    const float tsigns[4] = {+1, -1, -1, +1};
-	const int propDirections[4] = {-1,+1,+1,-1};
-
-    // Loop over motors
-    for (int i=0; i<4; ++i) {
-
-        // Get motor thrust in interval [0,1] from plugin
-        float thrust = thrusts[i];
-
-        // Simulate prop spin as a function of thrust
-        float jointAngleOld;
-        simGetJointPosition(motorJointList[i], &jointAngleOld);
-        float jointAngleNew = jointAngleOld + propDirections[i] * thrust * 1.25f;
-        simSetJointPosition(motorJointList[i], jointAngleNew);
-
-        // Convert thrust to force and torque
-        float force = particleCount * PARTICLE_DENSITY * thrust * (float)M_PI * pow(PARTICLE_SIZE,3) / timestep;
-        float torque = tsigns[i] * thrust;
-
-        // Get motor matrix
-        float motorMatrix[12];
-        simGetObjectMatrix(motorList[i],-1, motorMatrix);
-
-        // Convert force to 3D forces
-        float forces[3];
-        scalarTo3D(force, motorMatrix, forces);
-
-        // Convert force to 3D torques
-        float torques[3];
-        scalarTo3D(torque, motorMatrix,torques);
+    {
+        StepProfiler::Phase timed(profiler, StepProfiler::EXTRAS);
+        simExtrasUpdate();
+    }
 
-        // Send forces and torques to props
-        for (int k=0; k<3; ++k) {
-            set_indexed_float_signal("force",  i, k, forces[k]);
-            set_indexed_float_signal("torque", i, k, torques[k]);
+    // Compute the vehicles' motor forces, then send them all to the scene together
+    {
+        StepProfiler::Phase timed(profiler, StepProfiler::MOTORS);
+        for (int k=0; k<vehicleCount; ++k) {
+            vehicles[k].board.simUpdateMotors(timestep, particleCount);
         }
-
-    } // loop over motors
+    }
+    {
+        StepProfiler::Phase timed(profiler, StepProfiler::FLUSH);
+        for (int k=0; k<vehicleCount; ++k) {
+            vehicles[k].board.simFlush();
+        }
+    }
 
     // Hide toast dialog if needed
-    if (toastDialogHandle > -1 && (micros - toastDialogStartMicros) > TOAST_DIALOG_DURATION_SEC*1e6) {
+    if (toastDialogHandle > -1 && (sceneMicros - toastDialogStartMicros) > TOAST_DIALOG_DURATION_SEC*1e6) {
         simEndDialog(toastDialogHandle);
         toastDialogHandle = -1;
     }
@@ -575,9 +866,19 @@ void LUA_STOP_CALLBACK(SScriptCallBack* cb)
     // Disconnect from handheld controller
     controllerClose();
 
+    // Stop the vehicles' threads
+    pool.stop();
+
+#ifndef _WIN32
+    // Prints the round-trip and on-board timing for the flight
+    if (hilActive)
+        hil.close();
+#endif
+
     // Turn off LEDs
-    leds[0].set(false);
-    leds[1].set(false);
+    for (int k=0; k<vehicleCount; ++k) {
+        vehicles[k].board.simStop();
+    }
 
     // Hide any toast dialogs that may still be visible
     hideToastDialog();
@@ -585,11 +886,40 @@ void LUA_STOP_CALLBACK(SScriptCallBack* cb)
     // Do any extra shutdown needed
     simExtrasStop();
 
+    profiler.stop();
+
     // Return success to V-REP
     CScriptFunctionData D;
     D.pushOutData(CScriptFunctionDataItem(true));
     D.writeDataToStack(cb->stackID);
 }
+
+// --------------------------------------------------------------------------------------
+// simExtHackflight_stats
+// --------------------------------------------------------------------------------------
+#define LUA_STATS_COMMAND "simExtHackflight_stats"
+
+static const int inArgs_STATS[] = {1, sim_script_arg_int32, 0};
+
+void LUA_STATS_CALLBACK(SScriptCallBack* cb)
+{
+    CScriptFunctionData D;
+
+    // Optional number of seconds to average over; all those kept by default
+    int seconds = 0;
+    if (D.readDataFromStack(cb->stackID, inArgs_STATS, 0, LUA_STATS_COMMAND)) {
+        std::vector<CScriptFunctionDataItem> * inData = D.getInDataPtr();
+        if (inData->size() > 0)
+            seconds = inData->at(0).int32Data[0];
+    }
+
+    // Steps per second, each phase's mean microseconds per step, V-REP's own, each phase's longest
+    std::vector<float> stats;
+    profiler.stats(seconds, stats);
+
+    D.pushOutData(CScriptFunctionDataItem(stats));
+    D.writeDataToStack(cb->stackID);
+}
 // --------------------------------------------------------------------------------------
 
 
@@ -649,6 +979,8 @@ VREP_DLLEXPORT unsigned char v_repStart(void* reservedPointer,int reservedInt)
     simRegisterScriptCallbackFunction(strConCat(LUA_UPDATE_COMMAND,"@",PLUGIN_NAME), NULL, LUA_UPDATE_CALLBACK);
     simRegisterScriptCallbackFunction(strConCat(LUA_STOP_COMMAND,"@",PLUGIN_NAME),
             strConCat("boolean result=",LUA_STOP_COMMAND,"(number HackflightHandle)"),LUA_STOP_CALLBACK);
+    simRegisterScriptCallbackFunction(strConCat(LUA_STATS_COMMAND,"@",PLUGIN_NAME),
+            strConCat("table stats=",LUA_STATS_COMMAND,"(number seconds=0)"),LUA_STATS_CALLBACK);
 
     // Enable camera callbacks
     simEnableEventCallback(sim_message_eventcallback_openglcameraview, "Hackflight", -1);
@@ -691,15 +1023,21 @@ VREP_DLLEXPORT void* v_repMessage(int message, int * auxiliaryData, void * custo
         return NULL;
 
     // Handle messages mission-specifically
-    simExtrasMessage(message, auxiliaryData, customData);
+    {
+        StepProfiler::Phase timed(profiler, StepProfiler::EXTRAS);
+        simExtrasMessage(message, auxiliaryData, customData);
+    }
 
     int errorModeSaved;
     simGetIntegerParameter(sim_intparam_error_report_mode,&errorModeSaved);
     simSetIntegerParameter(sim_intparam_error_report_mode,sim_api_errormessage_ignore);
     simSetIntegerParameter(sim_intparam_error_report_mode,errorModeSaved); // restore previous settings
 
-    // Call Hackflight::update() from here for most realistic simulation
-    h.update();
+    // Call Hackflight::update() from here for most realistic simulation, every vehicle in parallel
+    {
+        StepProfiler::Phase timed(profiler, StepProfiler::FIRMWARE);
+        pool.run(updateVehicle, vehicleCount);
+    }
 
     return NULL;
 }
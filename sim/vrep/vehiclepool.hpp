@@ -0,0 +1,120 @@
+/*
+   vehiclepool.hpp : runs a job once for each simulated vehicle, spread over a few threads
+
+   The workers stay up for the whole simulation and sleep between jobs.  The calling thread
+   takes vehicles too, and run() returns only when every vehicle is done, so that the caller
+   can go on to talk to V-REP (which must only be called from its own thread).
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class VehiclePool {
+
+    public:
+
+        typedef void (*job_t)(int index);
+
+        // Total threads, including the caller's; one means run everything inline
+        void start(unsigned threads)
+        {
+            stopping   = false;
+            generation = 0;
+            busy       = 0;
+
+            for (unsigned k=1; k<threads; ++k)
+                workers.push_back(std::thread(&VehiclePool::work, this));
+        }
+
+        void run(job_t _job, int _count)
+        {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                job   = _job;
+                count = _count;
+                next  = 0;
+                busy  = (unsigned)workers.size();
+                generation++;
+            }
+            wake.notify_all();
+
+            drain();
+
+            std::unique_lock<std::mutex> guard(lock);
+            done.wait(guard, [this] { return busy == 0; });
+        }
+
+        void stop(void)
+        {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+            }
+            wake.notify_all();
+
+            for (std::thread & w : workers)
+                w.join();
+
+            workers.clear();
+        }
+
+    private:
+
+        std::vector<std::thread> workers;
+        std::mutex               lock;
+        std::condition_variable  wake;
+        std::condition_variable  done;
+
+        job_t                    job;
+        int                      count;
+        std::atomic<int>         next;
+        unsigned                 busy;
+        unsigned                 generation;
+        bool                     stopping;
+
+        void drain(void)
+        {
+            for (int index = next++; index < count; index = next++)
+                job(index);
+        }
+
+        void work(void)
+        {
+            unsigned seen = 0;
+
+            while (true) {
+
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    wake.wait(guard, [this, seen] { return stopping || generation != seen; });
+                    if (stopping)
+                        return;
+                    seen = generation;
+                }
+
+                drain();
+
+                std::lock_guard<std::mutex> guard(lock);
+                if (--busy == 0)
+                    done.notify_one();
+            }
+        }
+};
@@ -0,0 +1,179 @@
+/*
+   framering.hpp : shared-memory ring of raw camera frames, from the simulator to the companion board
+
+   The simulator writes each frame into the next slot and then publishes its sequence number; the
+   companion reads the newest frame and, if the sequence number still allows it (the simulator
+   hasn't lapped it), processes it and writes the result to the reply slot, publishing that frame's
+   sequence number in turn.  Frames are stored exactly as V-REP gives them (rows bottom-up, RGB),
+   so the simulator does no conversion; the companion flips them as it reads and writes them.
+   The reply is only displayed, so one overwritten while the simulator copies it costs no more
+   than a torn frame.
+
+   Layout, all fields 32-bit little-endian, and mirrored by FrameRing in framering.py:
+
+     0  magic       'HFFR'
+     4  width
+     8  height
+    12  channels
+    16  slots
+    20  frameBytes  width*height*channels
+    24  writeSeq    last frame published by the simulator, starting at 1
+    28  replySeq    frame whose processed copy is in the reply slot; 0 for none
+    32  (reserved, to HEADER_BYTES)
+
+   followed by the slots, then the reply slot.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+class FrameRing {
+
+    public:
+
+        static const uint32_t MAGIC         = 0x52464648; // 'HFFR'
+        static const size_t   HEADER_BYTES  = 64;
+        static const int      DEFAULT_SLOTS = 3;
+
+        FrameRing(void)
+        {
+            this->base = NULL;
+        }
+
+        // Creates (or re-creates) the named segment, e.g. "/hackflight_frames"; false on failure
+        bool open(const char * _name, int width, int height, int channels, int slots=DEFAULT_SLOTS)
+        {
+            this->close();
+
+            strncpy(this->name, _name, sizeof(this->name)-1);
+            this->name[sizeof(this->name)-1] = 0;
+
+            this->frameBytes = (size_t)width * height * channels;
+            this->slots      = slots;
+            this->size       = HEADER_BYTES + (slots + 1) * this->frameBytes;
+
+            int fd = shm_open(this->name, O_CREAT | O_RDWR, 0600);
+            if (fd < 0)
+                return false;
+
+            if (ftruncate(fd, this->size) < 0) {
+                ::close(fd);
+                return false;
+            }
+
+            void * p = mmap(NULL, this->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (p == MAP_FAILED)
+                return false;
+
+            this->base = (uint8_t *)p;
+
+            header()[1] = width;
+            header()[2] = height;
+            header()[3] = channels;
+            header()[4] = slots;
+            header()[5] = (uint32_t)this->frameBytes;
+            header()[6] = 0;
+            header()[7] = 0;
+
+            // Magic goes last, so a reader that sees it sees the rest
+            std::atomic_thread_fence(std::memory_order_release);
+            header()[0] = MAGIC;
+
+            this->writeSeq = 0;
+            this->lastReply = 0;
+
+            return true;
+        }
+
+        bool isOpen(void)
+        {
+            return this->base != NULL;
+        }
+
+        // Copies a frame in and publishes it; returns its sequence number
+        uint32_t write(const char * bytes)
+        {
+            uint32_t seq = this->writeSeq + 1;
+
+            memcpy(slot(seq % this->slots), bytes, this->frameBytes);
+
+            std::atomic_thread_fence(std::memory_order_release);
+            header()[6] = seq;
+            this->writeSeq = seq;
+
+            return seq;
+        }
+
+        // Sequence number of the frame whose processed copy is in the reply slot; 0 for none yet
+        uint32_t peekReply(void)
+        {
+            return header()[7];
+        }
+
+        // Copies out the companion's newest processed frame, if there is one we haven't had yet
+        bool readReply(char * bytes)
+        {
+            uint32_t seq = header()[7];
+
+            if (seq == this->lastReply)
+                return false;
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            memcpy(bytes, slot(this->slots), this->frameBytes);
+            this->lastReply = seq;
+
+            return true;
+        }
+
+        void close(void)
+        {
+            if (this->base) {
+                munmap(this->base, this->size);
+                shm_unlink(this->name);
+                this->base = NULL;
+            }
+        }
+
+    private:
+
+        char      name[64];
+        uint8_t * base;
+        size_t    size;
+        size_t    frameBytes;
+        int       slots;
+        uint32_t  writeSeq;
+        uint32_t  lastReply;
+
+        volatile uint32_t * header(void)
+        {
+            return (volatile uint32_t *)this->base;
+        }
+
+        // Slot index == slots is the reply slot
+        uint8_t * slot(int index)
+        {
+            return this->base + HEADER_BYTES + index * this->frameBytes;
+        }
+};
@@ -0,0 +1,90 @@
+'''
+   framering.py : companion side of the shared-memory camera frame ring in framering.hpp
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+'''
+
+import mmap
+import os
+import struct
+
+import numpy as np
+
+MAGIC        = 0x52464648 # 'HFFR'
+HEADER_BYTES = 64
+
+WRITESEQ_OFFSET = 24
+REPLYSEQ_OFFSET = 28
+
+class FrameRing(object):
+    '''
+    Maps the ring that the simulator created under /dev/shm.  Frames come out as OpenCV images
+    (rows top-down, BGR) and go back the same way; flipping to and from V-REP's layout happens
+    here, as part of the one copy each way.
+    '''
+
+    def __init__(self, name):
+
+        fd = os.open('/dev/shm' + name, os.O_RDWR)
+        self.mem = mmap.mmap(fd, 0)
+        os.close(fd)
+
+        magic, self.width, self.height, self.channels, self.slots, self.frameBytes = \
+            struct.unpack_from('<6I', self.mem, 0)
+
+        if magic != MAGIC:
+            raise ValueError('%s is not a frame ring' % name)
+
+        shape = (self.height, self.width, self.channels)
+
+        self.frames = [np.ndarray(shape, np.uint8, self.mem, HEADER_BYTES + k*self.frameBytes)
+                       for k in range(self.slots)]
+        self.replyImage = np.ndarray(shape, np.uint8, self.mem, HEADER_BYTES + self.slots*self.frameBytes)
+
+        self.lastSeq = 0
+
+    def _seq(self, offset):
+
+        return struct.unpack_from('<I', self.mem, offset)[0]
+
+    def read(self):
+        '''
+        Returns (seq, image) for the newest frame not yet read, or (0, None) if there is none or the
+        simulator overwrote it while we were copying it.
+        '''
+
+        seq = self._seq(WRITESEQ_OFFSET)
+
+        if seq == self.lastSeq:
+            return 0, None
+
+        # Bottom-up RGB to top-down BGR, in the copy
+        image = np.ascontiguousarray(self.frames[seq % self.slots][::-1, :, ::-1])
+
+        # The simulator may be one frame ahead of the one we copied, but no more
+        if (self._seq(WRITESEQ_OFFSET) - seq) % 2**32 > self.slots - 2:
+            return 0, None
+
+        self.lastSeq = seq
+
+        return seq, image
+
+    def reply(self, seq, image):
+        '''
+        Hands a processed image back to the simulator for display.
+        '''
+
+        self.replyImage[:] = image[::-1, :, ::-1]
+
+        struct.pack_into('<I', self.mem, REPLYSEQ_OFFSET, seq)
@@ -120,17 +120,20 @@ if __name__ == '__main__':
     altitude_request = serialize_ALTITUDE_Request()
 
     # More than two command-line arguments means simulation mode.  First arg is camera-client port, 
-    # second is MSP port, third is input image file name, fourth is outpt image file name.
+    # second and third are MSP ports, fourth is the name of the shared-memory frame ring.
     if len(sys.argv) > 2:
 
         from socket_server import serve_socket
+        from framering import FrameRing
 
         # Serve a socket for camera synching, and a socket for comms
         camera_client = serve_socket(int(sys.argv[1]))
         comms_to_client  = serve_socket(int(sys.argv[2]))
         comms_from_client  = serve_socket(int(sys.argv[3]))
-        image_from_sim_name  = sys.argv[4]
-        image_to_sim_name  = sys.argv[5]
+        frame_ring_name  = sys.argv[4]
+
+        # The simulator creates the ring with its first frame
+        frames = None
 
         # Run serial comms telemetry reading on its own thread
         thread = threading.Thread(target=commsReader, args = (comms_from_client,parser))
@@ -141,15 +144,20 @@ if __name__ == '__main__':
 
             # Receive the camera sync byte from the client
             camera_client.recv(1)
+
+            if frames is None:
+                frames = FrameRing(frame_ring_name)
          
-            # Load the image from the temp file
-            image = cv2.imread(image_from_sim_name, cv2.IMREAD_COLOR)
+            # Get the newest frame from shared memory; skip this one if we've fallen behind
+            seq, image = frames.read()
+            if image is None:
+                continue
 
             # Process it
             processImage(image, parser, comms_to_client)
 
-            # Write the processed image to a file for the simulator to display
-            cv2.imwrite(image_to_sim_name, image)
+            # Hand the processed image back for the simulator to display
+            frames.reply(seq, image)
 
             # Send an telemetry request messages to the client
             comms_to_client.send(attitude_request)
@@ -19,6 +19,7 @@
 
 #include "sim_extras.hpp"
 #include "sockets.hpp"
+#include "framering.hpp"
 
 #include "scriptFunctionData.h"
 #include "v_repLib.h"
@@ -31,22 +32,26 @@ static char mspFromServer[200];
 static int  mspFromServerLen;
 static int  mspFromServerIndex;
 
-// We use OpenCV to compress JPEG for use by Python script
-#include <opencv2/core/core.hpp>
-#include <opencv2/highgui/highgui.hpp>
-#include <opencv2/imgproc/imgproc.hpp>
-using namespace cv;
-
 #include <signal.h>
 #include <unistd.h>
-#include <sys/stat.h>
+
+#include <vector>
 
 static const int CAMERA_PORT          = 5000;
 static const int COMMS_IN_PORT        = 5001;
 static const int COMMS_OUT_PORT       = 5002;
-static const char * IMAGE_TO_PYTHON   = "image.jpg";
-static const char * IMAGE_FROM_PYTHON = "image2.jpg";
-static const int MAXMSG               = 1000;
+static const int GCS_PORT             = 5003;
+static const char * FRAME_RING_NAME   = "/hackflight_frames";
+static const int MAXMSG               = 200;
+
+// Results from the companion for frame N (its processed image, and any MSP requests that arrive then)
+// are applied at frame N+k, so that the simulation never waits on the vision script and sees the
+// same latency whether the script is fast or slow.  Zero applies them as soon as they arrive.
+static const int PIPELINE_LATENCY_FRAMES = 2;
+
+// MSP requests waiting for their frame, and MSP replies waiting for the socket
+static const int PIPELINE_MSP_CHUNKS     = 8;
+static const int PIPELINE_OUTBOX_BYTES   = 1000;
 
 class CompanionBoard {
     
@@ -58,13 +63,287 @@ class CompanionBoard {
         SocketClient commsInSocket;
         SocketClient commsOutSocket;
 
-        int imgsize;
+        // Ground stations can watch (and query) the vehicle too: each gets a copy of everything the
+        // firmware sends, and its requests join the companion's
+        SocketServer gcsServer;
+        int          gcsFds[SocketServer::MAX_CLIENTS];
+        int          gcsCount;
+        char         gcsPending[PIPELINE_OUTBOX_BYTES];
+        int          gcsPendingLen;
+
+        // One poll() per frame for all of the above
+        SocketReactor reactor;
+
+        // Raw frames go to the Python script, and processed ones come back, through shared memory
+        FrameRing frames;
+        int frameWidth;
+        int frameHeight;
+
+        // Replies waiting for their frame, by sequence number mod PIPELINE_LATENCY_FRAMES+1, and the one
+        // on display
+        std::vector<char> replies[PIPELINE_LATENCY_FRAMES+1];
+        uint32_t          replySeqs[PIPELINE_LATENCY_FRAMES+1];
+        std::vector<char> shown;
+        uint32_t          shownSeq;
+        uint32_t          frameSeq;
+
+        typedef struct msp_chunk_t {
+            uint32_t frame;
+            int      len;
+            char     bytes[MAXMSG];
+        } msp_chunk_t;
+
+        msp_chunk_t requests[PIPELINE_MSP_CHUNKS];
+        int         requestCount;
+
+        // Ring, so that a partial send needs no copying
+        char        outbox[PIPELINE_OUTBOX_BYTES];
+        int         outboxHead;
+        int         outboxLen;
+
+        // Frames that never got a reply, either because the script skipped them or because a later
+        // reply replaced them before their turn; and MSP bytes we had no room for
+        uint32_t    droppedFrames;
+        uint32_t    droppedBytes;
+        uint32_t    lastReplySeq;
+
+        void resetPipeline(void)
+        {
+            for (int k=0; k<=PIPELINE_LATENCY_FRAMES; ++k) {
+                this->replySeqs[k] = 0;
+            }
+            this->shownSeq = 0;
+            this->frameSeq = 0;
+            this->requestCount = 0;
+            this->outboxHead = 0;
+            this->outboxLen = 0;
+            this->gcsPendingLen = 0;
+            this->droppedFrames = 0;
+            this->droppedBytes = 0;
+            this->lastReplySeq = 0;
+        }
+
+        void collectReply(void)
+        {
+            uint32_t seq = this->frames.peekReply();
+
+            if (seq == this->lastReplySeq) {
+                return;
+            }
+
+            if (seq > this->lastReplySeq + 1) {
+                this->droppedFrames += seq - this->lastReplySeq - 1;
+            }
+            this->lastReplySeq = seq;
+
+            int slot = seq % (PIPELINE_LATENCY_FRAMES+1);
+            if (this->replySeqs[slot] > this->shownSeq) {
+                this->droppedFrames++; // replaced before its turn
+            }
+            this->frames.readReply(&this->replies[slot][0]);
+            this->replySeqs[slot] = seq;
+        }
+
+        void showReply(char * imageBytes)
+        {
+            // Newest reply whose turn has come
+            int best = -1;
+            for (int k=0; k<=PIPELINE_LATENCY_FRAMES; ++k) {
+                uint32_t seq = this->replySeqs[k];
+                if (seq > this->shownSeq && seq + PIPELINE_LATENCY_FRAMES <= this->frameSeq &&
+                        (best < 0 || seq > this->replySeqs[best])) {
+                    best = k;
+                }
+            }
+
+            if (best >= 0) {
+                for (int k=0; k<=PIPELINE_LATENCY_FRAMES; ++k) {
+                    if (this->replySeqs[k] > this->shownSeq && this->replySeqs[k] < this->replySeqs[best]) {
+                        this->droppedFrames++; // overtaken by a newer reply
+                    }
+                }
+                this->shown.swap(this->replies[best]);
+                this->replies[best].resize(this->shown.size());
+                this->shownSeq = this->replySeqs[best];
+            }
+
+            // Keep showing the last reply until the next one is due
+            if (this->shownSeq) {
+                memcpy(imageBytes, &this->shown[0], this->shown.size());
+            }
+        }
+
+        // Where the next MSP request should go, or NULL if we have no room; len is the room left
+        msp_chunk_t * requestChunk(void)
+        {
+            if (this->requestCount == PIPELINE_MSP_CHUNKS) {
+                return NULL;
+            }
+
+            msp_chunk_t & chunk = this->requests[this->requestCount];
+            chunk.frame = this->frameSeq;
+            chunk.len = 0;
+            return &chunk;
+        }
+
+        void requestRead(int len)
+        {
+            if (len > 0) {
+                this->requestCount++;
+            }
+        }
+
+        static void handleCompanionRequest(void * context, int fd, short revents)
+        {
+            (void)fd;
+            (void)revents;
+
+            CompanionBoard * board = (CompanionBoard *)context;
+
+            msp_chunk_t * chunk = board->requestChunk();
+
+            if (chunk) {
+                chunk->len = board->commsInSocket.recvSome(chunk->bytes, MAXMSG);
+                board->requestRead(chunk->len);
+            }
+            else {
+                char msg[MAXMSG];
+                board->droppedBytes += board->commsInSocket.recvSome(msg, MAXMSG);
+            }
+        }
+
+        static void handleCompanionWritable(void * context, int fd, short revents)
+        {
+            (void)fd;
+            (void)revents;
+
+            ((CompanionBoard *)context)->flushOutbox();
+        }
+
+        static void handleGcsConnect(void * context, int fd, short revents)
+        {
+            (void)fd;
+            (void)revents;
+
+            CompanionBoard * board = (CompanionBoard *)context;
+
+            while (board->gcsServer.acceptPending())
+                ;
+
+            board->syncGcsClients();
+        }
+
+        static void handleGcsRequest(void * context, int fd, short revents)
+        {
+            (void)revents;
+
+            CompanionBoard * board = (CompanionBoard *)context;
+
+            for (int k=0; k<board->gcsServer.getClientCount(); ++k) {
+
+                if (board->gcsServer.getClientFd(k) != fd) {
+                    continue;
+                }
+
+                msp_chunk_t * chunk = board->requestChunk();
+
+                if (chunk) {
+                    chunk->len = board->gcsServer.recvFrom(k, chunk->bytes, MAXMSG);
+                    board->requestRead(chunk->len);
+                }
+                else {
+                    char msg[MAXMSG];
+                    board->droppedBytes += board->gcsServer.recvFrom(k, msg, MAXMSG);
+                }
+
+                break;
+            }
+
+            board->syncGcsClients();
+        }
+
+        // The server accepts and drops clients on its own; keep the reactor watching the same ones
+        void syncGcsClients(void)
+        {
+            for (int j=this->gcsCount-1; j>=0; --j) {
+                bool present = false;
+                for (int k=0; k<this->gcsServer.getClientCount(); ++k) {
+                    present = present || this->gcsServer.getClientFd(k) == this->gcsFds[j];
+                }
+                if (!present) {
+                    this->reactor.remove(this->gcsFds[j]);
+                    this->gcsFds[j] = this->gcsFds[--this->gcsCount];
+                }
+            }
+
+            for (int k=0; k<this->gcsServer.getClientCount(); ++k) {
+                int fd = this->gcsServer.getClientFd(k);
+                bool known = false;
+                for (int j=0; j<this->gcsCount; ++j) {
+                    known = known || this->gcsFds[j] == fd;
+                }
+                if (!known && this->reactor.add(fd, POLLIN, handleGcsRequest, this)) {
+                    this->gcsFds[this->gcsCount++] = fd;
+                }
+            }
+        }
+
+        void releaseRequest(char * requestStr, int & requestLen)
+        {
+            if (this->requestCount == 0 || this->requests[0].frame + PIPELINE_LATENCY_FRAMES > this->frameSeq) {
+                return;
+            }
+
+            memcpy(requestStr, this->requests[0].bytes, this->requests[0].len);
+            requestLen = this->requests[0].len;
+
+            this->requestCount--;
+            memmove(&this->requests[0], &this->requests[1], this->requestCount * sizeof(msp_chunk_t));
+        }
+
+        void flushOutbox(void)
+        {
+            if (this->outboxLen > 0) {
+
+                // The ring's contents, in at most two pieces
+                struct iovec iov[2];
+                int first = PIPELINE_OUTBOX_BYTES - this->outboxHead;
+                if (first > this->outboxLen) {
+                    first = this->outboxLen;
+                }
+                iov[0].iov_base = this->outbox + this->outboxHead;
+                iov[0].iov_len  = first;
+                iov[1].iov_base = this->outbox;
+                iov[1].iov_len  = this->outboxLen - first;
+
+                int sent = this->commsOutSocket.sendSome(iov, iov[1].iov_len ? 2 : 1);
+                this->outboxHead = (this->outboxHead + sent) % PIPELINE_OUTBOX_BYTES;
+                this->outboxLen -= sent;
+            }
+
+            // Wait for room only while we have something to send
+            this->reactor.setEvents(this->commsOutSocket.getFd(), this->outboxLen ? POLLOUT : 0);
+        }
+
+        void flushGcs(void)
+        {
+            if (this->gcsPendingLen > 0) {
+                struct iovec iov = {this->gcsPending, (size_t)this->gcsPendingLen};
+                this->gcsServer.broadcast(&iov, 1);
+                this->gcsPendingLen = 0;
+                this->syncGcsClients();
+            }
+        }
 
     public:
 
         CompanionBoard(void)
         {
             this->procid = 0;
+            this->frameWidth = 0;
+            this->frameHeight = 0;
+            this->gcsCount = 0;
+            this->resetPipeline();
         }
 
         void start(void)
@@ -78,13 +357,12 @@ class CompanionBoard {
             sprintf(comms_in_port, "%d", COMMS_IN_PORT);
             char comms_out_port[10];
             sprintf(comms_out_port, "%d", COMMS_OUT_PORT);
-            char *argv[7] = { 
+            char *argv[6] = { 
                 (char *)script, 
                 camera_port, 
                 comms_in_port, 
                 comms_out_port, 
-                (char *)IMAGE_TO_PYTHON, 
-                (char *)IMAGE_FROM_PYTHON, 
+                (char *)FRAME_RING_NAME, 
                 NULL};
 
             // Fork the Python server script
@@ -101,56 +379,95 @@ class CompanionBoard {
             this->commsInSocket.connectToServer();
             this->commsOutSocket = SocketClient("localhost", COMMS_OUT_PORT);
             this->commsOutSocket.connectToServer();
+
+            this->reactor.add(this->commsInSocket.getFd(), POLLIN, handleCompanionRequest, this);
+            this->reactor.add(this->commsOutSocket.getFd(), 0, handleCompanionWritable, this);
+
+            // Ground stations
+            this->gcsServer = SocketServer("localhost", GCS_PORT);
+            this->gcsServer.listenForClients();
+            this->reactor.add(this->gcsServer.getListenFd(), POLLIN, handleGcsConnect, this);
         }
 
         void update(char * imageBytes, int imageWidth, int imageHeight,
                 char * requestStr, int & requestLen)
         {
-            // Use OpenCV to save image as JPEG
-            Mat image = Mat(imageHeight, imageWidth, CV_8UC3, imageBytes);
-            flip(image, image, 0);                 // rectify image
-            cvtColor(image, image, COLOR_BGR2RGB); // convert image BGR->RGB
-            imwrite(IMAGE_TO_PYTHON, image);
+            // Frame size is known only once the camera sends its first image
+            if (imageWidth != this->frameWidth || imageHeight != this->frameHeight) {
+                if (!this->frames.open(FRAME_RING_NAME, imageWidth, imageHeight, 3)) {
+                    return;
+                }
+                this->frameWidth = imageWidth;
+                this->frameHeight = imageHeight;
+
+                size_t frameBytes = (size_t)imageWidth * imageHeight * 3;
+                for (int k=0; k<=PIPELINE_LATENCY_FRAMES; ++k) {
+                    this->replies[k].resize(frameBytes);
+                }
+                this->shown.resize(frameBytes);
+                this->resetPipeline();
+            }
 
-            // Send sync byte to Python server, which will open the image, process it, and
-            // write the processed image to another file
+            // Publish the raw frame, then ring the Python server, which will process the newest frame and
+            // write the result to the reply slot.  If the server is so far behind that the doorbell socket
+            // is full, it has wakeups enough already.
+            this->frameSeq = this->frames.write(imageBytes);
             char sync = 0;
-            this->cameraSyncSocket.send(&sync, 1);
+            this->cameraSyncSocket.sendSome(&sync, 1);
 
-            // If server has created a file for the processed image, open it copy its bytes back to V-REP's camera image
-            struct stat fileStat; 
-            if (!stat(IMAGE_FROM_PYTHON, &fileStat)) {
-                Mat image2 = imread(IMAGE_FROM_PYTHON, CV_LOAD_IMAGE_COLOR);
-                flip(image2, image2, 0);                 // rectify image
-                cvtColor(image2, image2, COLOR_RGB2BGR); // convert image BGR->RGB
-                memcpy(imageBytes, image2.data, imageWidth*imageHeight*3);
-            }
+            // Take whatever the server has finished, and apply what's due
+            this->collectReply();
+            this->showReply(imageBytes);
 
-            // Check whether bytes are available from server
-            int avail = this->commsInSocket.available();
+            // Service every socket that's ready, without waiting
+            this->flushOutbox();
+            this->flushGcs();
+            this->reactor.run(0);
 
-            // Ignore OOB values for available bytes
-            if (avail > 0 && avail < MAXMSG) {
-                char msg[MAXMSG];
-                this->commsInSocket.recv(msg, avail);
-                memcpy(requestStr, msg, avail);
-                requestLen = avail;
-            }
+            this->releaseRequest(requestStr, requestLen);
         }
 
+        // Queued, so that a slow reader never holds up the firmware
         void sendByte(uint8_t b)
         {
-            this->commsOutSocket.send((char *)&b, 1);
+            if (this->outboxLen == PIPELINE_OUTBOX_BYTES) {
+                this->flushOutbox();
+            }
+
+            if (this->outboxLen < PIPELINE_OUTBOX_BYTES) {
+                this->outbox[(this->outboxHead + this->outboxLen++) % PIPELINE_OUTBOX_BYTES] = (char)b;
+            }
+            else {
+                this->droppedBytes++;
+            }
+
+            if (this->gcsPendingLen == PIPELINE_OUTBOX_BYTES) {
+                this->flushGcs();
+            }
+            this->gcsPending[this->gcsPendingLen++] = (char)b;
         }
 
         void halt(void)
         {
+            if (this->frameSeq) {
+                printf("Companion: %u frames, %u without a reply, %u MSP bytes dropped\n",
+                        (unsigned)this->frameSeq, (unsigned)this->droppedFrames, (unsigned)this->droppedBytes);
+            }
+
             if (this->procid) {
                 this->cameraSyncSocket.halt();
                 this->commsInSocket.halt();
                 this->commsOutSocket.halt();
+                this->gcsServer.halt();
                 kill(this->procid, SIGKILL);
             }
+
+            this->frames.close();
+            this->frameWidth = 0;
+            this->frameHeight = 0;
+
+            this->reactor = SocketReactor();
+            this->gcsCount = 0;
         }
 
 }; // CompanionBoard
@@ -172,7 +489,7 @@ void extrasMessage(int message, int * auxiliaryData, void * customData)
     if (message ==  sim_message_eventcallback_openglcameraview && auxiliaryData[2] == 1) {
 
         // Send in image bytes, get back serial message request
-        char request[200];
+        char request[MAXMSG];
         int requestLen = 0;
         companionBoard.update((char *)customData, auxiliaryData[0], auxiliaryData[1], request, requestLen);
 
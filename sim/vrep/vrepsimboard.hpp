@@ -24,12 +24,76 @@
 #include <board.hpp>
 #include <config.hpp>
 
+#include "controller.hpp"
+
+#ifndef _WIN32
+#include <datagramport.hpp>
+#include "udp.hpp"
+#endif
+
 namespace hf {
 
+    // Set from the firmware, possibly on a worker thread; shown from V-REP's thread
+    class LED {
+
+        private:
+
+            int handle;
+            float color[3];
+            bool on;
+            bool changed;
+
+        public:
+
+            LED(void) { }
+
+            void init(int _handle, float r, float g, float b)
+            {
+                this->handle = _handle;
+                this->color[0] = r;
+                this->color[1] = g;
+                this->color[2] = b;
+                this->on = false;
+                this->changed = true;
+            }
+
+            void set(bool status)
+            {
+                if (status != this->on) {
+                    this->on = status;
+                    this->changed = true;
+                }
+            }
+
+            void show(void)
+            {
+                if (this->changed) {
+                    float black[3] = {0,0,0};
+                    simSetShapeColor(this->handle, NULL, 0, this->on ? this->color : black);
+                    this->changed = false;
+                }
+            }
+    };
+
+    // One simulated vehicle: everything that differs between vehicles lives here, so that
+    // each has its own sensors, motors and clock.  The firmware's calls touch only these members,
+    // so vehicles can be updated in parallel; the sim*() methods talk to V-REP and must be called
+    // from its thread.
     class VrepSimBoard : public Board {
 
         public:
 
+            // Scene objects for vehicle 0 have the plain names (Quadcopter, Motor1, ...); copies
+            // pasted into the scene get V-REP's suffixes #0, #1, ...
+            static void nameSuffix(int index, char suffix[8]);
+
+            // Called from the plugin's start, update and stop callbacks
+            void simStart(int index);
+            void simUpdateSensors(float timestep, controller_t controller, const float demands[5]);
+            void simUpdateMotors(float timestep, int particleCount);
+            void simFlush(void);
+            void simStop(void);
+
             virtual void     imuGetEulerAndGyro(float eulerAnglesRadians[3], int16_t gyroADC[3]) override;
             virtual void     init(void) override;
             virtual const    Config& getConfig() override;
@@ -40,8 +104,12 @@ namespace hf {
             virtual uint8_t  serialAvailableBytes(void) override;
             virtual uint8_t  serialReadByte(void) override;
             virtual void     serialWriteByte(uint8_t c) override;
+            virtual uint16_t serialAvailableForWrite(void) override;
+            virtual void     serialWriteBytes(const uint8_t * buf, uint16_t count) override;
+            virtual void     serialFlush(void) override;
             virtual void     dump(char * msg) override;
             virtual void     writeMotor(uint8_t index, uint16_t value) override;
+            virtual void     writeMotors(const uint16_t * values, uint8_t count) override;
             virtual void     extrasHandleAuxSwitch(uint8_t status) override;
             virtual uint16_t rcReadSerial(uint8_t chan) override;
             virtual void     delayMilliseconds(uint32_t msec) override;
@@ -57,6 +125,8 @@ namespace hf {
 
         static void normalizeV(float src[3], float dest[3]);
 
+        void simUpdateProps(const float tsigns[4], const int propDirections[4]);
+
     private: // fields
 
         float       EstG[3];
@@ -64,6 +134,69 @@ namespace hf {
         float       gyroCmpfFactor;
         float       gyroScale;
 
+        // Simulated time, advanced by the scene's timestep
+        uint64_t     micros;
+
+        // Stick demands, copied from the controller every step
+        controller_t controller;
+        float        demands[5];
+
+        // Needed for spring-mounted throttle stick
+        float        throttleDemand;
+
+        // IMU support
+        float        accel[3];
+        float        gyro[3];
+        float        eulerAngles[3];
+        float        anglesPrev[3];
+
+        // Barometer support
+        int          baroPressure;
+
+        // Motor support
+        float        thrusts[4];
+
+        // Analytic prop model (ANALYTIC_PROP_MODEL), and the frame's rate of turn (rad/s, world frame) for
+        // its gyroscopic torque
+        PropModel    props[4];
+        float        angularVelocity[3];
+
+        // Motor outputs, computed by simUpdateMotors() and sent to the scene by simFlush()
+        float        jointAngles[4];
+        float        forces[4][3];
+        float        torques[4][3];
+
+        // Signal names for the props' scripts, with this vehicle's suffix
+        char         propSignalName[24];
+        char         forceSignals[4][3][24];
+        char         torqueSignals[4][3][24];
+
+        // Read once per step: vehicle's 3x4 matrix in the world
+        float        vehicleMatrix[12];
+
+        // Read once at start: motors' thrust axes in the vehicle's frame
+        float        motorAxes[4][3];
+
+        // Handles from scene
+        char         suffix[8];
+        int          motorList[4];
+        int          motorJointList[4];
+        int          quadcopterHandle;
+        int          accelHandle;
+
+        LED          leds[2];
+
+        // Support for reporting status of aux switch (alt-hold, etc.)
+        uint8_t      auxStatus;
+        bool         auxChanged;
+
+#ifndef _WIN32
+        // MSP over UDP (MSP_UDP_PORT), for ground stations
+        DatagramPort mspPort;
+        UdpLink      mspLink;
+        bool         mspLinked;
+#endif
+
     };  // class VrepSimBoard
 
 }  // namespace hf